@@ -204,6 +204,16 @@ namespace eflib
 				sz = 0;
 			}
 
+			size_t size() const
+			{
+				return sz;
+			}
+
+			T* data() const
+			{
+				return data_mem;
+			}
+
 			vls_vector_iterator<T> begin() const
 			{
 				return vls_vector_iterator<T>(data_mem, stride);
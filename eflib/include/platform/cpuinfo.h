@@ -16,6 +16,8 @@ namespace eflib{
 		cpu_sse42,
 		cpu_sse4a,
 		cpu_avx,
+		cpu_avx2,
+		cpu_avx512f,
 		
 		cpu_arm,
 		cpu_neon,
@@ -23,12 +23,25 @@ namespace eflib{
 
 			int cpu_infos[4];
 			int cpu_infos_ex[4];
+			int cpu_infos_7[4] = {0, 0, 0, 0};
+			int max_leaf = 0;
 #if defined(EFLIB_MSVC) || defined(EFLIB_MINGW64)
+			__cpuid(cpu_infos, 0);
+			max_leaf = cpu_infos[0];
 			__cpuid(cpu_infos, 1);
 			__cpuid(cpu_infos_ex, 0x80000001);
+			if(max_leaf >= 7)
+			{
+				__cpuidex(cpu_infos_7, 7, 0);
+			}
 #elif defined(EFLIB_MINGW32) || defined(EFLIB_GCC)
+			max_leaf = __get_cpuid_max(0, nullptr);
 			__cpuid(1, cpu_infos[0], cpu_infos[1], cpu_infos[2], cpu_infos[3]);
 			__cpuid(0x80000001, cpu_infos_ex[0], cpu_infos_ex[1], cpu_infos_ex[2], cpu_infos_ex[3]);
+			if(max_leaf >= 7)
+			{
+				__cpuid_count(7, 0, cpu_infos_7[0], cpu_infos_7[1], cpu_infos_7[2], cpu_infos_7[3]);
+			}
 #endif
 			feats[cpu_sse2]		= ( cpu_infos[3] & (1 << 26) ) || false;
 			feats[cpu_sse3]		= ( cpu_infos[2] & 0x1 ) || false;
@@ -38,9 +51,27 @@ namespace eflib{
 			feats[cpu_sse4a]	= ( cpu_infos_ex[2] & 0x40) || false;
 			feats[cpu_avx]		= (( cpu_infos[2] & (1 << 27) ) && ( cpu_infos[2] & (1 << 28) )) || false;
 
+			// AVX2 and AVX-512 need OS to save YMM and ZMM states too.
+			uint64_t xcr0 = feats[cpu_avx] ? xgetbv0() : 0;
+			bool os_ymm = (xcr0 & 0x06) == 0x06;
+			bool os_zmm = (xcr0 & 0xE6) == 0xE6;
+			feats[cpu_avx2]		= ( os_ymm && ( cpu_infos_7[1] & (1 << 5) ) ) || false;
+			feats[cpu_avx512f]	= ( os_zmm && ( cpu_infos_7[1] & (1 << 16) ) ) || false;
+
 			// others are unchecked.
 		};
 	private:
+		static uint64_t xgetbv0()
+		{
+#if defined(EFLIB_MSVC)
+			return _xgetbv(0);
+#else
+			uint32_t eax, edx;
+			__asm__ __volatile__("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+			return (static_cast<uint64_t>(edx) << 32) | eax;
+#endif
+		}
+
 		bool feats[cpu_unknown];
 	public:
 		bool support( cpu_features feat ) const{
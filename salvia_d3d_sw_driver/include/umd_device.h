@@ -2,6 +2,8 @@
 
 #include <salviar/include/renderer.h>
 
+#include <vector>
+
 class umd_resource;
 
 class umd_device
@@ -24,6 +26,11 @@ public:
 	{
 		return resolved_surf_;
 	}
+	// Linear copy of resolved surface which DC is created from.
+	std::vector<uint8_t>& present_buffer()
+	{
+		return present_buffer_;
+	}
 
 private:
 	static HRESULT APIENTRY retrieve_sub_object(D3D10DDI_HDEVICE device, UINT32 sub_device_id,
@@ -360,4 +367,5 @@ private:
 
 	salviar::renderer_ptr sa_renderer_;
 	salviar::surface_ptr resolved_surf_;
+	std::vector<uint8_t> present_buffer_;
 };
@@ -19,6 +19,13 @@ public:
 	{
 		return tex2d_;
 	}
+	// Swap chain buffer of sRGB format, which is stored as 8-bit UNORM texture of sRGB encoded colors.
+	bool srgb() const
+	{
+		return (creation_param_.BindFlags & D3D10_DDI_BIND_PRESENT)
+			&& ((creation_param_.Format == DXGI_FORMAT_B8G8R8A8_UNORM_SRGB)
+				|| (creation_param_.Format == DXGI_FORMAT_R8G8B8A8_UNORM_SRGB));
+	}
 
 private:
 	D3D11DDIARG_CREATERESOURCE creation_param_;
@@ -8,6 +8,7 @@
 #include <salvia_d3d_sw_driver/include/umd_device.h>
 
 #include <salviar/include/texture.h>
+#include <salviar/include/internal_mapped_resource.h>
 
 using namespace salviar;
 
@@ -179,7 +180,18 @@ NTSTATUS APIENTRY D3DKMTPresent(const D3DKMT_PRESENT* pData)
 					GetClientRect(wnd, &dst_rc);
 				}
 
-				void* fb = surf->texel_address(0, 0, 0);
+				// Storage of tiled surface is not a linear bitmap, so it is presented from the mapped copy.
+				// Buffer is reallocated only if size changed, so DC is not recreated on every present.
+				std::vector<uint8_t>& present_buf = um_dev->present_buffer();
+				internal_mapped_resource mapped([&present_buf](size_t size) -> void*
+				{
+					present_buf.resize(size);
+					return present_buf.data();
+				});
+				surf->map(mapped, map_read);
+				surf->unmap(mapped, map_read);
+
+				void* fb = mapped.data;
 				D3DKMT_CREATEDCFROMMEMORY& dc_from_mem = um_dev->dc_from_mem();
 				if ((static_cast<int>(dc_from_mem.Width) != surf->width())
 						|| (static_cast<int>(dc_from_mem.Height) != surf->height())
@@ -197,7 +209,7 @@ NTSTATUS APIENTRY D3DKMTPresent(const D3DKMT_PRESENT* pData)
 					dc_from_mem.Format = D3DDDIFMT_A8R8G8B8;
 					dc_from_mem.Width = surf->width();
 					dc_from_mem.Height = surf->height();
-					dc_from_mem.Pitch = static_cast<UINT>(surf->pitch());
+					dc_from_mem.Pitch = mapped.row_pitch;
 					dc_from_mem.hDeviceDc = CreateDCW(L"DISPLAY", NULL, NULL, NULL);
 					dc_from_mem.pColorTable = NULL;
 					D3DKMTCreateDCFromMemory(&dc_from_mem);
@@ -1645,7 +1645,8 @@ HRESULT umd_device::present_dxgi(DXGI_DDI_ARG_PRESENT* present_data)
 	umd_device* dev = reinterpret_cast<umd_device*>(present_data->hDevice);
 	dev->sa_renderer_->flush();
 
-	texture_ptr src_tex = reinterpret_cast<umd_resource*>(present_data->hSurfaceToPresent)->texture_2d();
+	umd_resource* src_res = reinterpret_cast<umd_resource*>(present_data->hSurfaceToPresent);
+	texture_ptr src_tex = src_res->texture_2d();
 	surface_ptr src_surf = src_tex->subresource(0);
 	if (!dev->resolved_surf_
 		|| (dev->resolved_surf_->width() != src_surf->width())
@@ -1654,7 +1655,7 @@ HRESULT umd_device::present_dxgi(DXGI_DDI_ARG_PRESENT* present_data)
 		dev->resolved_surf_ = dev->sa_renderer_->create_tex2d(src_surf->width(), src_surf->height(),
 			1, pixel_format_color_bgra8)->subresource(0);
 	}
-	src_surf->resolve(*dev->resolved_surf_);
+	src_surf->resolve(*dev->resolved_surf_, src_res->srgb());
 
 	DXGIDDICB_PRESENT args;
 	ZeroMemory( &args, sizeof( args ) );
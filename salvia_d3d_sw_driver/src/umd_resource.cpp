@@ -55,6 +55,16 @@ umd_resource::umd_resource(umd_device* dev, const D3D11DDIARG_CREATERESOURCE* cr
 		case DXGI_FORMAT_R8G8B8A8_UNORM:
 			fmt = pixel_format_color_rgba8;
 			break;
+		// sRGB is not decoded by samplers, so sRGB formats are only supported by swap chain buffers.
+		// They are stored as UNORM and resolved in linear space on present.
+		case DXGI_FORMAT_B8G8R8A8_UNORM_SRGB:
+			assert(create_resource->BindFlags & D3D10_DDI_BIND_PRESENT);
+			fmt = pixel_format_color_bgra8;
+			break;
+		case DXGI_FORMAT_R8G8B8A8_UNORM_SRGB:
+			assert(create_resource->BindFlags & D3D10_DDI_BIND_PRESENT);
+			fmt = pixel_format_color_rgba8;
+			break;
 		case DXGI_FORMAT_R32_FLOAT:
 			fmt = pixel_format_color_r32f;
 			break;
@@ -64,6 +74,15 @@ umd_resource::umd_resource(umd_device* dev, const D3D11DDIARG_CREATERESOURCE* cr
 		case DXGI_FORMAT_R32_SINT:
 			fmt = pixel_format_color_r32i;
 			break;
+		case DXGI_FORMAT_D16_UNORM:
+			fmt = pixel_format_color_d16;
+			break;
+		case DXGI_FORMAT_D24_UNORM_S8_UINT:
+			fmt = pixel_format_color_d24s8;
+			break;
+		case DXGI_FORMAT_D32_FLOAT:
+			fmt = pixel_format_color_d32f;
+			break;
 
 		default:
 			assert(false);
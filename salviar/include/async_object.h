@@ -178,12 +178,24 @@ protected:
 enum class internal_statistics_id: uint32_t
 {
     backend_input_pixels = 0,
+    hiz_tile_tests,
+    hiz_tile_rejections,
+    hiz_subtile_tests,
+    hiz_subtile_rejections,
+    guard_band_accepted_prims,
+    clipped_prims,
     count
 };
 
 struct internal_statistics
 {
     uint64_t backend_input_pixels;
+    uint64_t hiz_tile_tests;
+    uint64_t hiz_tile_rejections;
+    uint64_t hiz_subtile_tests;
+    uint64_t hiz_subtile_rejections;
+    uint64_t guard_band_accepted_prims;	// Triangles crossing viewport sides are rasterized without clipping.
+    uint64_t clipped_prims;				// Triangles which are clipped by near, far or guard band planes.
 };
 
 class async_internal_statistics: public async_object
@@ -210,7 +222,13 @@ protected:
     void get_value(void* v)
     {
         auto ret = reinterpret_cast<internal_statistics*>(v);
-        ret->backend_input_pixels = counters_[static_cast<uint32_t>(internal_statistics_id::backend_input_pixels)];
+        ret->backend_input_pixels   = counters_[static_cast<uint32_t>(internal_statistics_id::backend_input_pixels)];
+        ret->hiz_tile_tests         = counters_[static_cast<uint32_t>(internal_statistics_id::hiz_tile_tests)];
+        ret->hiz_tile_rejections    = counters_[static_cast<uint32_t>(internal_statistics_id::hiz_tile_rejections)];
+        ret->hiz_subtile_tests      = counters_[static_cast<uint32_t>(internal_statistics_id::hiz_subtile_tests)];
+        ret->hiz_subtile_rejections = counters_[static_cast<uint32_t>(internal_statistics_id::hiz_subtile_rejections)];
+        ret->guard_band_accepted_prims = counters_[static_cast<uint32_t>(internal_statistics_id::guard_band_accepted_prims)];
+        ret->clipped_prims          = counters_[static_cast<uint32_t>(internal_statistics_id::clipped_prims)];
     }
 
     virtual void init_async_data()
@@ -230,7 +248,11 @@ struct pipeline_profiles
 	uint64_t compact_clip;
 	uint64_t vp_trans;
 	uint64_t tri_dispatch;
+	uint64_t tile_schedule;		// Merging bins of threads and ordering tiles before rasterization.
 	uint64_t ras;
+	uint64_t ras_idle;			// Sum of time which threads wait for the slowest thread in rasterization.
+	uint64_t ras_tile_cost;		// Sum of estimated cost of all tiles.
+	uint64_t ras_max_tile_cost;	// Sum of estimated cost of the heaviest tile of each draw.
 };
 
 enum class pipeline_profile_id: uint32_t
@@ -241,7 +263,11 @@ enum class pipeline_profile_id: uint32_t
 	compact_clip,
 	vp_trans,
 	tri_dispatch,
+	tile_schedule,
 	ras,
+	ras_idle,
+	ras_tile_cost,
+	ras_max_tile_cost,
 	count
 };
 
@@ -280,8 +306,12 @@ protected:
 		ret->compact_clip	 = counters_[static_cast<uint32_t>(pipeline_profile_id::compact_clip)];
 		ret->vp_trans		 = counters_[static_cast<uint32_t>(pipeline_profile_id::vp_trans)];
 		ret->tri_dispatch	 = counters_[static_cast<uint32_t>(pipeline_profile_id::tri_dispatch)];
+		ret->tile_schedule	 = counters_[static_cast<uint32_t>(pipeline_profile_id::tile_schedule)];
 		ret->ras				 = counters_[static_cast<uint32_t>(pipeline_profile_id::ras)];
 		ret->vtx_proc		 = counters_[static_cast<uint32_t>(pipeline_profile_id::vtx_proc)];
+		ret->ras_idle		 = counters_[static_cast<uint32_t>(pipeline_profile_id::ras_idle)];
+		ret->ras_tile_cost	 = counters_[static_cast<uint32_t>(pipeline_profile_id::ras_tile_cost)];
+		ret->ras_max_tile_cost = counters_[static_cast<uint32_t>(pipeline_profile_id::ras_max_tile_cost)];
     }
 
     virtual void init_async_data()
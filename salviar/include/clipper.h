@@ -19,7 +19,13 @@ BEGIN_NS_SALVIAR();
 class vs_output;
 struct vs_output_op;
 
-const size_t plane_num = 2;
+// Near, far and 4 guard band planes.
+const size_t plane_num = 6;
+
+// Polygon gets one more vertex at most from each plane.
+const size_t MAX_CLIPPED_POLY_VERTS	= 3 + plane_num;
+// Vertexes of triangles which are triangulated from clipped polygon.
+const size_t MAX_CLIPPED_VERTS		= (MAX_CLIPPED_POLY_VERTS - 2) * 3;
 
 struct clip_context
 {
@@ -32,6 +38,7 @@ struct clip_context
 	prim_type			prim;
 	vs_output_op const*	vso_ops;
 	cull_fn				cull;
+	float				guard_band;		// Extent of guard band in NDC. 0 disables guard band clipping.
 };
 
 struct clip_results
@@ -40,6 +47,7 @@ struct clip_results
 	uint32_t	num_clipped_verts;
 	bool		is_front;
 	bool		is_clipped;
+	bool		is_accepted;	// Triangle crosses viewport sides inside of guard band and it is not clipped.
 };
 
 class clipper
@@ -50,6 +58,7 @@ private:
 	typedef eflib::pool::reserved_pool<vs_output> vs_output_pool;
 	
 	boost::array<eflib::vec4, plane_num>	planes_;
+	size_t									num_planes_;
 	
 	clip_context ctxt_;
 	clip_impl_fn clip_impl_;
@@ -337,6 +337,141 @@ private:
 	}
 };
 
+/** Depth formats. Depth is in R of color_rgba32f, and stencil of color_d24s8 is in G.
+*/
+struct color_d16
+{
+	typedef uint16_t comp_t;
+	comp_t d;
+
+	color_d16(){}
+	explicit color_d16(const comp_t* color):d(*color){}
+
+	template<class T>
+	color_d16(const T& rhs){
+		*this = rhs;
+	}
+
+	color_d16& operator = (const color_d16& rhs){
+		d = rhs.d;
+		return *this;
+	}
+
+	color_d16& operator = (const color_rgba32f& rhs){
+		return assign(rhs);
+	}
+
+	template<class T>
+	color_d16& operator = (const T& rhs){
+		return assign(rhs.to_rgba32f());
+	}
+
+	float depth() const{
+		return d * (1.0f / 65535);
+	}
+
+	color_rgba32f to_rgba32f() const{
+		return color_rgba32f(depth(), 0.0f, 0.0f, 0.0f);
+	}
+
+private:
+	color_d16& assign(const color_rgba32f& rhs){
+		d = round<comp_t>( eflib::clamp(rhs.r, 0.0f, 1.0f) * 65535.0f );
+		return *this;
+	}
+};
+
+// Depth is in low 24 bits and stencil is in high 8 bits.
+struct color_d24s8
+{
+	typedef uint32_t comp_t;
+	comp_t ds;
+
+	color_d24s8(){}
+	explicit color_d24s8(const comp_t* color):ds(*color){}
+
+	template<class T>
+	color_d24s8(const T& rhs){
+		*this = rhs;
+	}
+
+	color_d24s8& operator = (const color_d24s8& rhs){
+		ds = rhs.ds;
+		return *this;
+	}
+
+	color_d24s8& operator = (const color_rgba32f& rhs){
+		return assign(rhs);
+	}
+
+	template<class T>
+	color_d24s8& operator = (const T& rhs){
+		return assign(rhs.to_rgba32f());
+	}
+
+	float depth() const{
+		return (ds & 0xFFFFFF) * (1.0f / 16777215);
+	}
+
+	uint32_t stencil() const{
+		return ds >> 24;
+	}
+
+	color_rgba32f to_rgba32f() const{
+		return color_rgba32f( depth(), float( stencil() ), 0.0f, 0.0f );
+	}
+
+private:
+	color_d24s8& assign(const color_rgba32f& rhs){
+		comp_t d = round<comp_t>( eflib::clamp(rhs.r, 0.0f, 1.0f) * 16777215.0f );
+		comp_t s = comp_t( eflib::clamp(rhs.g, 0.0f, 255.0f) + 0.5f );
+		ds = d | (s << 24);
+		return *this;
+	}
+};
+
+struct color_d32f
+{
+	typedef float comp_t;
+	comp_t d;
+
+	color_d32f(){}
+	explicit color_d32f(const comp_t* color):d(*color){}
+
+	template<class T>
+	color_d32f(const T& rhs){
+		*this = rhs;
+	}
+
+	color_d32f& operator = (const color_d32f& rhs){
+		d = rhs.d;
+		return *this;
+	}
+
+	color_d32f& operator = (const color_rgba32f& rhs){
+		return assign(rhs);
+	}
+
+	template<class T>
+	color_d32f& operator = (const T& rhs){
+		return assign(rhs.to_rgba32f());
+	}
+
+	float depth() const{
+		return d;
+	}
+
+	color_rgba32f to_rgba32f() const{
+		return color_rgba32f(d, 0.0f, 0.0f, 0.0f);
+	}
+
+private:
+	color_d32f& assign(const color_rgba32f& rhs){
+		d = rhs.r;
+		return *this;
+	}
+};
+
 inline color_rgba32f lerp(const color_rgba32f& c0, const color_rgba32f& c1, float t)
 {
 #ifndef EFLIB_NO_SIMD
@@ -374,6 +509,18 @@ inline color_rgba32f lerp(const color_rg32f& c0, const color_rg32f& c1, float t)
 {
 	return color_rg32f(c0.r + (c1.r - c0.r) * t, c0.r + (c1.g - c0.g) * t).to_rgba32f();
 }
+inline color_rgba32f lerp(const color_d16& c0, const color_d16& c1, float t)
+{
+	return color_rgba32f(c0.depth() + (c1.depth() - c0.depth()) * t, 0.0f, 0.0f, 0.0f);
+}
+inline color_rgba32f lerp(const color_d24s8& c0, const color_d24s8& c1, float t)
+{
+	return color_rgba32f(c0.depth() + (c1.depth() - c0.depth()) * t, 0.0f, 0.0f, 0.0f);
+}
+inline color_rgba32f lerp(const color_d32f& c0, const color_d32f& c1, float t)
+{
+	return color_rgba32f(c0.d + (c1.d - c0.d) * t, 0.0f, 0.0f, 0.0f);
+}
 inline color_rgba32f lerp(const color_r32i& c0, const color_r32i& c1, float t)
 {
 	return color_r32i(static_cast<color_r32i::comp_t>(c0.r + (c1.r - c0.r) * t)).to_rgba32f();
@@ -488,6 +635,25 @@ inline color_rgba32f lerp(const color_r32i& c0, const color_r32i& c1, const colo
 	color_r32f c23(c2.r + (c3.r - c2.r) * tx);
 	return color_r32f(c01.r + (c23.r - c01.r) * ty).to_rgba32f();
 }
+template <class DepthColorT>
+inline color_rgba32f lerp_depth(const DepthColorT& c0, const DepthColorT& c1, const DepthColorT& c2, const DepthColorT& c3, float tx, float ty)
+{
+	float d01 = c0.depth() + (c1.depth() - c0.depth()) * tx;
+	float d23 = c2.depth() + (c3.depth() - c2.depth()) * tx;
+	return color_rgba32f(d01 + (d23 - d01) * ty, 0.0f, 0.0f, 0.0f);
+}
+inline color_rgba32f lerp(const color_d16& c0, const color_d16& c1, const color_d16& c2, const color_d16& c3, float tx, float ty)
+{
+	return lerp_depth(c0, c1, c2, c3, tx, ty);
+}
+inline color_rgba32f lerp(const color_d24s8& c0, const color_d24s8& c1, const color_d24s8& c2, const color_d24s8& c3, float tx, float ty)
+{
+	return lerp_depth(c0, c1, c2, c3, tx, ty);
+}
+inline color_rgba32f lerp(const color_d32f& c0, const color_d32f& c1, const color_d32f& c2, const color_d32f& c3, float tx, float ty)
+{
+	return lerp_depth(c0, c1, c2, c3, tx, ty);
+}
 
 END_NS_SALVIAR()
 
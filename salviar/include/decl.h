@@ -33,5 +33,6 @@ EFLIB_DECLARE_CLASS_SHARED_PTR(clipper);
 
 EFLIB_DECLARE_CLASS_SHARED_PTR(raster_state);
 EFLIB_DECLARE_CLASS_SHARED_PTR(depth_stencil_state);
+EFLIB_DECLARE_CLASS_SHARED_PTR(blend_state);
 
 END_NS_SALVIAR();
\ No newline at end of file
@@ -196,6 +196,39 @@ enum stencil_op
     stencil_op_decr_wrap = 8,
 };
 
+enum blend_factor
+{
+	blend_zero = 1,
+	blend_one = 2,
+	blend_src_color = 3,
+	blend_inv_src_color = 4,
+	blend_src_alpha = 5,
+	blend_inv_src_alpha = 6,
+	blend_dest_alpha = 7,
+	blend_inv_dest_alpha = 8,
+	blend_dest_color = 9,
+	blend_inv_dest_color = 10,
+	blend_src_alpha_sat = 11
+};
+
+enum blend_op
+{
+	blend_op_add = 1,
+	blend_op_subtract = 2,
+	blend_op_rev_subtract = 3,
+	blend_op_min = 4,
+	blend_op_max = 5
+};
+
+enum color_write_enable
+{
+	color_write_enable_red = 1,
+	color_write_enable_green = 2,
+	color_write_enable_blue = 4,
+	color_write_enable_alpha = 8,
+	color_write_enable_all = 15
+};
+
 enum clear_flag
 {
 	clear_depth = 0x1,
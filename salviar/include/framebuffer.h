@@ -8,11 +8,16 @@
 #include <salviar/include/renderer_capacity.h>
 
 #include <eflib/include/math/collision_detection.h>
+#include <eflib/include/math/vector.h>
 
+#include <algorithm>
 #include <vector>
 
 BEGIN_NS_SALVIAR();
 
+class  blend_shader_unit;
+struct blend_quad_context;
+struct early_z_quad_context;
 struct pixel_accessor;
 struct render_stages;
 struct render_state;
@@ -76,9 +81,60 @@ public:
 	bool        depth_test(float ps_depth, float cur_depth) const;
 	bool        stencil_test(bool front_face, uint32_t ref, uint32_t cur_stencil) const;
 	uint32_t    stencil_operation(bool front_face, bool depth_pass, bool stencil_pass, uint32_t ref, uint32_t cur_stencil) const;
+	// Returns false if stencil operation of test results is keep.
+	bool        stencil_writable(bool front_face, bool depth_pass, bool stencil_pass) const;
     uint32_t    mask_stencil(uint32_t stencil, uint32_t stencil_mask) const;
 };
 
+struct render_target_blend_desc
+{
+	bool			blend_enable;
+	blend_factor	src_blend;
+	blend_factor	dest_blend;
+	blend_op		blend_op_color;
+	blend_factor	src_blend_alpha;
+	blend_factor	dest_blend_alpha;
+	blend_op		blend_op_alpha;
+	uint32_t		write_mask;
+
+	render_target_blend_desc()
+		: blend_enable(false)
+		, src_blend(blend_one), dest_blend(blend_zero), blend_op_color(blend_op_add)
+		, src_blend_alpha(blend_one), dest_blend_alpha(blend_zero), blend_op_alpha(blend_op_add)
+		, write_mask(color_write_enable_all)
+	{
+	}
+};
+
+struct blend_desc
+{
+	bool						independent_blend_enable;
+	render_target_blend_desc	render_target[MAX_RENDER_TARGETS];
+
+	blend_desc(): independent_blend_enable(false)
+	{
+	}
+};
+
+// Fixed-function blending, used if no cpp_blend_shader is bound.
+class blend_state
+{
+	blend_desc desc_;
+
+public:
+	blend_state(blend_desc const& desc);
+	blend_desc const& get_desc() const;
+
+	// Returns desc of render target, which is the first one if blending is not independent.
+	render_target_blend_desc const& target_desc(size_t target_index) const;
+};
+
+// Hierarchical Z is kept as conservative depth bounds at two levels:
+// tiles of HIZ_TILE_SIZE and sub-tiles of HIZ_SUBTILE_SIZE.
+// HIZ_TILE_SIZE is the smallest rasterizer tile size, so a Hi-Z tile is never shared by two rasterizer tiles.
+static uint32_t const HIZ_TILE_SIZE		= 32;
+static uint32_t const HIZ_SUBTILE_SIZE	= 16;
+
 class framebuffer
 {
 private:
@@ -94,8 +150,65 @@ private:
 
 	void (*read_depth_stencil_)(float& depth, uint32_t& stencil, uint32_t stencil_mask, void const* ds_data);
 	void (*write_depth_stencil_)(void* ds_data, float depth, uint32_t stencil, uint32_t stencil_mask);
+	void (*write_depth_)(void* ds_data, float depth, uint32_t stencil, uint32_t stencil_mask);
+	void (*write_stencil_)(void* ds_data, float depth, uint32_t stencil, uint32_t stencil_mask);
+	float (*quantize_depth_)(float depth);	// Rounds incoming depth to precision of depth stencil format.
+
+	// SIMD quad depth stencil test, specialized on depth function, sample count and stencil enable.
+	// It is null if depth stencil format or sample count is not supported.
+	uint64_t (*early_z_quad_)(early_z_quad_context& ctx);
+	bool					early_z_write_depth_;
+
+	// Fixed-function blend kernels per render target, specialized on target format and blend mode.
+	blend_state*			blend_state_;
+	void (*blend_quads_[MAX_RENDER_TARGETS])(blend_quad_context const& ctx);
     
-    void update_ds_rw_functions(bool ds_format_changed, bool ds_state_changed, bool output_depth_enabled);
+	// Hierarchical Z. Bounds are stored as vec2(min z, max z) per tile and sub-tile.
+	surface_ptr				hiz_target_;
+	bool					hiz_enabled_;		// Hi-Z rejection is valid for current states.
+	bool					hiz_write_;			// Depth writes have to widen Hi-Z bounds.
+	compare_function		hiz_depth_func_;
+	size_t					hiz_tile_x_count_;
+	size_t					hiz_subtile_x_count_;
+	std::vector<eflib::vec2>
+							hiz_tiles_;
+	std::vector<eflib::vec2>
+							hiz_subtiles_;
+	std::vector<uint8_t>	hiz_subtiles_dirty_;
+	float (*hiz_read_depth_)(void const* ds_data);
+	float (*hiz_quantize_depth_)(float depth);	// Stored bounds are quantized, so primitive ranges have to be too.
+
+    void update_ds_rw_functions(bool ds_format_changed, bool ds_state_changed);
+	void update_early_z_quad();
+	void update_blend_quads();
+	void blend_quad(size_t x, size_t y, uint64_t quad_mask, ps_output const* const* pixels);
+	void blend_quad_shader(blend_shader_unit* bs_unit, size_t x, size_t y, uint64_t quad_mask, ps_output const* const* pixels);
+	bool early_z_test_sample(pixel_accessor& target_pixel, size_t x, size_t y, size_t i_sample, float depth, bool front_face);
+	void update_hiz(surface_ptr const& ds_target, bool output_depth_enabled);
+
+	void reset_hiz();
+	void compute_hiz_subtile(size_t subtile_x, size_t subtile_y);
+	void refresh_hiz_tile(size_t tile_x, size_t tile_y);
+	void widen_hiz(size_t x, size_t y, float depth)
+	{
+		size_t subtile_x = x / HIZ_SUBTILE_SIZE;
+		size_t subtile_y = y / HIZ_SUBTILE_SIZE;
+		size_t tile_index = (y / HIZ_TILE_SIZE) * hiz_tile_x_count_ + (x / HIZ_TILE_SIZE);
+		size_t subtile_index = subtile_y * hiz_subtile_x_count_ + subtile_x;
+
+		eflib::vec2& subtile_range = hiz_subtiles_[subtile_index];
+		subtile_range.x() = std::min(subtile_range.x(), depth);
+		subtile_range.y() = std::max(subtile_range.y(), depth);
+		hiz_subtiles_dirty_[subtile_index] = 1;
+
+		eflib::vec2& tile_range = hiz_tiles_[tile_index];
+		tile_range.x() = std::min(tile_range.x(), depth);
+		tile_range.y() = std::max(tile_range.y(), depth);
+	}
+	bool hiz_range_rejected(eflib::vec2 const& stored_range, float min_z, float max_z) const;
+	bool hiz_square_rejected(
+		std::vector<eflib::vec2> const& bounds, size_t bounds_x_count, size_t bounds_size,
+		size_t x, size_t y, size_t size, float min_z, float max_z) const;
 
 public:
 	void initialize	(render_stages const* stages);
@@ -105,15 +218,31 @@ public:
 	~framebuffer(void);
 
 	bool		early_z_enabled() const { return early_z_enabled_; } 
-
-	void		render_sample(cpp_blend_shader* cpp_bs, size_t x, size_t y, size_t i_sample, const ps_output& ps, float depth, bool front_face);
-	void		render_sample_quad(cpp_blend_shader* cpp_bs, size_t x, size_t y, uint64_t quad_mask, ps_output const* quad, float const* depth, bool front_face, float const* aa_offset);
-    uint64_t	early_z_test(size_t x, size_t y, float depth, float const* aa_z_offset);
-	uint64_t	early_z_test(size_t x, size_t y, uint32_t px_mask, float depth, float const* aa_z_offset);
-	uint64_t	early_z_test_quad(size_t x, size_t y, float const* depth, float const* aa_z_offset);
-	uint64_t	early_z_test_quad(size_t x, size_t y, uint64_t quad_mask, float const* depth, float const* aa_z_offset);
-
-	static void clear_depth_stencil(surface* tar, uint32_t flag, float depth, uint32_t stencil);
+	// Blend state writes source colors of all targets as they are, so only the nearest fragment is visible.
+	bool		blend_replaces() const;
+
+	// Samples are blended by cpp_bs if it is bound, or by bs_unit compiled from blending shader,
+	// otherwise by blend state.
+	void		render_sample(cpp_blend_shader* cpp_bs, blend_shader_unit* bs_unit, size_t x, size_t y, size_t i_sample, const ps_output& ps, float depth, bool front_face);
+	void		render_sample_quad(cpp_blend_shader* cpp_bs, blend_shader_unit* bs_unit, size_t x, size_t y, uint64_t quad_mask, ps_output const* quad, float const* depth, bool front_face, float const* aa_offset);
+	// Blends shaded sample whose depth was tested and written already.
+	void		blend_sample(cpp_blend_shader* cpp_bs, blend_shader_unit* bs_unit, size_t x, size_t y, size_t i_sample, ps_output const& ps);
+	void		blend_sample_quad(cpp_blend_shader* cpp_bs, blend_shader_unit* bs_unit, size_t x, size_t y, uint64_t quad_mask, ps_output const* quad);
+	// Early tests evaluate depth and stencil tests and write depth and stencil before shading.
+    uint64_t	early_z_test(size_t x, size_t y, float depth, float const* aa_z_offset, bool front_face);
+	uint64_t	early_z_test(size_t x, size_t y, uint32_t px_mask, float depth, float const* aa_z_offset, bool front_face);
+	uint64_t	early_z_test_quad(size_t x, size_t y, float const* depth, float const* aa_z_offset, bool front_face);
+	uint64_t	early_z_test_quad(size_t x, size_t y, uint64_t quad_mask, float const* depth, float const* aa_z_offset, bool front_face);
+
+	// Returns true if all pixels in square (x, y, size) are occluded by Hi-Z for primitive in [min_z, max_z].
+	// Square is aligned to and a multiple of Hi-Z tile or sub-tile.
+	bool		hiz_enabled() const { return hiz_enabled_; }
+	bool		hiz_tile_rejected(size_t x, size_t y, size_t size, float min_z, float max_z) const;
+	bool		hiz_subtile_rejected(size_t x, size_t y, size_t size, float min_z, float max_z) const;
+	// Tightens the bounds of Hi-Z tiles and sub-tiles which were written in square (x, y, size).
+	void		hiz_refresh_tile(size_t x, size_t y, size_t size);
+
+	void		clear_depth_stencil(surface* tar, uint32_t flag, float depth, uint32_t stencil);
 };
 
 END_NS_SALVIAR();
\ No newline at end of file
@@ -4,6 +4,7 @@
 
 #include <salviar/include/enums.h>
 #include <salviar/include/async_object.h>
+#include <salviar/include/vertex_cache.h>
 
 #include <eflib/include/memory/pool.h>
 
@@ -11,6 +12,9 @@
 #include <boost/shared_array.hpp>
 #include <eflib/include/platform/boost_end.h>
 
+#include <utility>
+#include <vector>
+
 BEGIN_NS_SALVIAR();
 
 struct vs_output_op;
@@ -27,10 +31,17 @@ struct geom_setup_context
 	size_t				prim_size;
 	size_t				prim_count;
 	bool				(*cull)(float area);
+	float				guard_band;
 
     async_object*       pipeline_stat;
     accumulate_fn<uint64_t>::type
                         acc_cinvocations;
+
+    async_object*       internal_stat;
+    accumulate_fn<uint64_t>::type
+                        acc_guard_band_accepted_prims;
+    accumulate_fn<uint64_t>::type
+                        acc_clipped_prims;
 };
 
 /*
@@ -59,11 +70,19 @@ public:
 		return compact_start_time_;
 	}
 
+	// Vertexes produced by vertex cache and clipper in this draw, as (first, count) ranges.
+	// Every vertex of verts() is in exactly one range, so they could be transformed without de-duplication.
+	std::vector<vs_output_range> const& produced_verts() const
+	{
+		return produced_verts_;
+	}
+
 private:
 	typedef eflib::pool::reserved_pool<vs_output> vs_output_pool;
 
 	void clip_geometries();
 	void compact_geometries();
+	void gather_produced_verts();
 	
 	void threaded_clip_geometries(thread_context const* thread_ctx);
 	void threaded_compact_geometries(thread_context const* thread_ctx);
@@ -84,6 +103,9 @@ private:
 
 	int32_t								clipping_package_count_;
 
+	std::vector<vs_output_range>
+										produced_verts_;
+
 	size_t								thread_count_;
 	uint64_t							compact_start_time_;
 
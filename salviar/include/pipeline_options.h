@@ -0,0 +1,64 @@
+#pragma once
+
+#include <salviar/include/salviar_forward.h>
+
+#include <eflib/include/platform/typedefs.h>
+
+BEGIN_NS_SALVIAR();
+
+enum class tile_schedule_modes: uint32_t
+{
+	in_order,			// Tiles are distributed to threads in index order.
+	heaviest_first		// Tiles are sorted by estimated cost, so the heaviest tiles do not finish last.
+};
+
+enum class binning_modes: uint32_t
+{
+	immediate,			// Each draw is rasterized after it is binned.
+	deferred			// Draws are binned until flush or change of targets, then each tile is rasterized through all of them.
+};
+
+enum class shading_modes: uint32_t
+{
+	forward,			// Pixels are shaded while triangles are rasterized.
+	visibility_buffer	// Opaque draws only write depth and ids of triangles, and visible pixels are shaded once by flushing.
+};
+
+// Tuning knobs of pipeline. They do not change rendering results
+// except precision of triangles outside of guard band, and z pre-pass.
+struct pipeline_options
+{
+	tile_schedule_modes		tile_schedule;
+	binning_modes			binning;
+	uint32_t				tile_size;		// Tile size of rasterizer: 32, 64 or 128. 0 picks the fastest one by auto-tuning.
+
+	// Guard band in multiples of viewport half extent. Triangles crossing viewport sides inside of guard band
+	// are rasterized without clipping, and only those exceeding guard band are clipped on x and y.
+	// 0 disables clipping on x and y.
+	float					guard_band;
+
+	// Visibility buffer is used by draws of JIT shaders with depth test and write but no stencil.
+	// Other draws are shaded forward after pending draws are flushed.
+	shading_modes			shading;
+
+	// Solid triangles only write depth, as z pre-pass of opaque geometry. Pixel shader and color targets are ignored.
+	// Without it, depth only pipeline is still taken by draws which have no color target and no C++ pixel shader.
+	bool					z_prepass;
+
+	// Each thread copies targets of its tile to a contiguous local buffer, rasterizes all binned primitives
+	// of the tile against it, and writes it back once. It keeps overdraw of a tile in cache.
+	bool					tile_cache;
+
+	// Multi-sample color targets store one sample of fully covered pixels whose samples are equal,
+	// so that they are blended and resolved once.
+	bool					msaa_compression;
+
+	pipeline_options():
+		tile_schedule(tile_schedule_modes::in_order), binning(binning_modes::immediate), tile_size(64), guard_band(8.0f),
+		shading(shading_modes::forward), z_prepass(false), tile_cache(false),
+		msaa_compression(false)
+	{
+	}
+};
+
+END_NS_SALVIAR();
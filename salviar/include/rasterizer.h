@@ -5,11 +5,15 @@
 #include <salviar/include/decl.h>
 #include <salviar/include/enums.h>
 #include <salviar/include/shader.h>
+#include <salviar/include/shader_regs_op.h>
 #include <salviar/include/framebuffer.h>
 #include <salviar/include/raster_state.h>
+#include <salviar/include/pipeline_options.h>
 #include <salviar/include/geom_setup_engine.h>
+#include <salviar/include/visibility_buffer.h>
 #include <salviar/include/async_object.h>
 
+#include <eflib/include/memory/allocator.h>
 #include <eflib/include/memory/atomic.h>
 #include <eflib/include/memory/pool.h>
 
@@ -19,48 +23,120 @@
 #include <boost/shared_ptr.hpp>
 #include <eflib/include/platform/boost_end.h>
 
+#include <deque>
+
 BEGIN_NS_SALVIAR();
 
 typedef eflib::pool::reserved_pool<vs_output> vs_output_pool;
 
 struct scanline_info;
 class  pixel_shader_unit;
+class  blend_shader_unit;
 class  vs_output;
 class  host;
-struct vs_output_op;
 struct clip_context;
 class  shader_reflection;
 
 struct pixel_statistic;
+struct quad_package;
 struct drawing_triangle_context;
+struct rasterizer_kernels;
+struct triangle_setup_batch;
 
 struct drawing_shader_context
 {
-    cpp_pixel_shader*	cpp_ps;
-	pixel_shader_unit*	ps_unit;
-	cpp_blend_shader*	cpp_bs;
+    cpp_pixel_shader*			cpp_ps;
+	pixel_shader_unit*			ps_unit;
+	cpp_blend_shader*			cpp_bs;
+	blend_shader_unit*			bs_unit;
+	shader_reflection const*	vs_reflection;
+};
+
+// Primitives dispatched by one thread, grouped by tile.
+// Storage is flat and kept across draws, so dispatching does not allocate once it is warmed up.
+class tile_bins
+{
+public:
+	void reset(size_t tile_count);
+	void push(uint32_t tile_id, uint32_t prim);
+	// Groups primitives by tile with a stable counting sort, so each tile keeps dispatching order.
+	void sort_by_tile();
+
+	uint32_t const* tile_begin(size_t tile_id) const	{ return prims_.data() + tile_offsets_[tile_id]; }
+	uint32_t const* tile_end(size_t tile_id) const		{ return prims_.data() + tile_offsets_[tile_id + 1]; }
+	uint32_t		tile_size(size_t tile_id) const		{ return tile_offsets_[tile_id + 1] - tile_offsets_[tile_id]; }
+	uint32_t		full_count(size_t tile_id) const	{ return full_counts_[tile_id]; }
+
+private:
+	std::vector<uint32_t>	entry_tiles_;
+	std::vector<uint32_t>	entry_prims_;
+	std::vector<uint32_t>	tile_offsets_;		// Primitives of tile i are prims_[tile_offsets_[i], tile_offsets_[i+1]).
+	std::vector<uint32_t>	prims_;
+	std::vector<uint32_t>	full_counts_;		// Count of primitives which cover the whole tile.
+};
+
+// Vertex kept by binned draw. Contents are copied by vs_output_op, because vs_output is not copyable.
+struct binned_vertex
+{
+	vs_output	vert;
+
+	binned_vertex() {}
+	binned_vertex(binned_vertex const& /*rhs*/)
+	{
+	}
+	binned_vertex& operator = (binned_vertex const& /*rhs*/)
+	{
+		return *this;
+	}
+};
+
+// Draw which is set up and binned into tiles, but not rasterized yet.
+// It keeps everything read by rasterization, so later draws could be set up before it is rasterized.
+struct binned_draw
+{
+	prim_type							prim;
+	std::vector<triangle_info>			tri_infos;
+	std::vector<eflib::vec4, eflib::aligned_allocator<eflib::vec4, 16>>
+										derivatives;		// ddx and ddy of triangles. Each has position and interpolated live attributes only.
+	std::vector<binned_vertex>			first_verts;		// Copies of triangle_info::v0, because vertexes are reused by later draws.
+	std::vector<tile_bins>				threaded_bins;		// Primitives dispatched by each thread.
+	vs_output_op const*					vso_ops;
+	bool								has_centroid;
+	bool								deferred;			// Writes visibility buffer instead of shading.
+	bool								depth_only;			// Only depth is interpolated, tested and written.
+	uint32_t							deferred_draw_id;
+	shader_reflection const*			vs_reflection;
+	shader_object_ptr					vx_shader;
+	std::vector<cpp_pixel_shader_ptr>	threaded_cpp_ps;
+	std::vector<pixel_shader_unit_ptr>	threaded_psu;
+	std::vector<blend_shader_unit_ptr>	threaded_bsu;
+	cpp_blend_shader_ptr				cpp_bs;
 };
 
 struct rasterize_multi_prim_context
 {
+	binned_draw const*				draw;
 	std::vector<uint32_t> const*	sorted_prims;
 	viewport const*					tile_vp;
     pixel_statistic*                pixel_stat;
+	quad_package*					quads;
     drawing_shader_context          shaders;
 };
 
 struct rasterize_prim_context
 {
+	binned_draw const*				draw;
 	uint32_t						prim_id;
 	viewport const*					tile_vp;
     pixel_statistic*                pixel_stat;
+	quad_package*					quads;
     drawing_shader_context          shaders;
 };
 
 class rasterizer
 {
 private:
-	static const int MAX_NUM_MULTI_SAMPLES = 4;
+	static const int MAX_NUM_MULTI_SAMPLES = 16;
 
 	// Status per drawing.
 	uint32_t						num_vs_output_attributes_;
@@ -71,6 +147,7 @@ private:
 
 	raster_state*					state_;
 	pixel_shader_unit*				ps_proto_;
+	blend_shader_unit*				bs_proto_;
 	cpp_vertex_shader*				cpp_vs_;
 	cpp_pixel_shader*				cpp_ps_;
 	cpp_blend_shader*				cpp_bs_;
@@ -93,22 +170,65 @@ private:
     accumulate_fn<uint64_t>::type   acc_cprimitives_;
     accumulate_fn<uint64_t>::type   acc_ps_invocations_;
     accumulate_fn<uint64_t>::type   acc_backend_input_pixels_;
+    accumulate_fn<uint64_t>::type   acc_hiz_tile_tests_;
+    accumulate_fn<uint64_t>::type   acc_hiz_tile_rejections_;
+    accumulate_fn<uint64_t>::type   acc_hiz_subtile_tests_;
+    accumulate_fn<uint64_t>::type   acc_hiz_subtile_rejections_;
+    accumulate_fn<uint64_t>::type   acc_guard_band_accepted_prims_;
+    accumulate_fn<uint64_t>::type   acc_clipped_prims_;
 
 	time_stamp_fn::type				fetch_time_stamp_;
 	accumulate_fn<uint64_t>::type	acc_vp_trans_;
 	accumulate_fn<uint64_t>::type	acc_tri_dispatch_;
+	accumulate_fn<uint64_t>::type	acc_tile_schedule_;
 	accumulate_fn<uint64_t>::type	acc_ras_;
 	accumulate_fn<uint64_t>::type	acc_clipping_;
 	accumulate_fn<uint64_t>::type	acc_compact_clip_;
+	accumulate_fn<uint64_t>::type	acc_ras_idle_;
+	accumulate_fn<uint64_t>::type	acc_ras_tile_cost_;
+	accumulate_fn<uint64_t>::type	acc_ras_max_tile_cost_;
+
+	rasterizer_kernels const*		kernels_;				// Edge function kernels selected by CPU features.
 
 	// Intermediate data
 	prim_type						prim_;
 	uint32_t						prim_size_;
+	tile_schedule_modes				tile_schedule_;
+	binning_modes					binning_;
+	uint32_t						tile_size_;
+	float							guard_band_;
+	shading_modes					shading_;
+	bool							depth_writable_;		// Depth test and write are enabled without stencil.
+	bool							z_prepass_;
+	bool							tile_cache_;			// Tiles of binned draws are rendered into thread local caches.
+	bool							depth_only_;			// Current draw writes depth only.
+	uint32_t						derivative_regs_;		// Registers of derivatives stored per triangle of current draw.
+	render_state const*				draw_state_;			// State of current draw. It is valid until the draw is finished.
 	eflib::vec2						samples_pattern_[MAX_NUM_MULTI_SAMPLES];
-
-	std::vector<std::vector<std::vector<uint32_t>>>
-									threaded_tiled_prims_;		// vector<prim> prims = thread_tiled_prims[ThreadID][TileID]
-	std::vector<triangle_info>		tri_infos_;
+	int32_t							sample_offsets_[MAX_NUM_MULTI_SAMPLES * 2];	// Samples pattern in sub-pixels.
+
+	std::vector<std::vector<uint32_t>>
+									threaded_sorted_prims_;		// Merged primitives of the tile being rasterized by each thread.
+	std::vector<uint32_t>			tile_order_;				// Tiles in order of distribution to threads.
+	std::vector<uint64_t>			tile_costs_;				// Estimated cost of rasterizing each tile.
+	std::vector<uint64_t>			threaded_ras_finish_times_;
+	std::vector<size_t>				projected_range_offsets_;	// Offsets of vertex ranges being projected.
+	std::vector<std::vector<byte, eflib::aligned_allocator<byte, 64>>>
+									threaded_tile_caches_;		// Cached targets of the tile being rasterized by each thread.
+	std::vector<surface*>			cached_targets_;			// Targets cached by tile while binned draws are rasterized.
+
+	// Draws are rasterized together tile by tile. Storage is kept across frames.
+	std::vector<binned_draw>		binned_draws_;
+	size_t							binned_draw_count_;
+	binned_draw*					current_draw_;				// Draw which is being set up.
+
+	// Targets, depth stencil and blend states shared by binned draws.
+	std::vector<surface_ptr>		binned_color_targets_;
+	surface_ptr						binned_ds_target_;
+	depth_stencil_state_ptr			binned_ds_state_;
+	blend_state_ptr					binned_bl_state_;
+	int32_t							binned_stencil_ref_;
+	bool							binned_output_depth_;
 
 	vs_output**						clipped_verts_;
 	size_t							clipped_verts_count_;
@@ -119,42 +239,69 @@ private:
 	size_t							tile_count_;
 
 	shader_reflection const*		vs_reflection_;
+	uint32_t						ps_live_attributes_;	// Mask of VS output attributes read by pixel shader.
+	std::deque<vs_output_op>		vso_op_variants_;		// Output ops with modifiers and live attributes of draws. Deque keeps them in place.
 
-	std::vector<cpp_pixel_shader*>	threaded_cpp_ps_;
-	std::vector<pixel_shader_unit*>	threaded_psu_;
+	visibility_buffer				vis_buffer_;
+	bool							deferred_;				// Current draw writes visibility buffer instead of shading.
+	deferred_triangle*				deferred_triangles_;
 
-	boost::function< void (rasterizer*, rasterize_multi_prim_context*)>
-									rasterize_prims_;
 	geom_setup_engine				gse_;
 
 	void threaded_dispatch_primitive(thread_context const*);
 	void threaded_rasterize_multi_prim(thread_context const*);
+	void rasterize_binned_prims(rasterize_multi_prim_context const*);
+	void threaded_shade_visibility_tiles(thread_context const*);
+
+	bool hiz_subtile_rejected(
+		int left, int top, int size, drawing_triangle_context const* triangle_ctx);
 
 	void draw_full_tile(
 		int left, int top, int right, int bottom,
 		drawing_shader_context const* shaders,
 		drawing_triangle_context const* triangle_ctx);
+	void draw_small_triangle(
+		int tile_left, int tile_top, int tile_right, int tile_bottom,
+		drawing_shader_context const* shaders,
+		drawing_triangle_context const* triangle_ctx);
 	void draw_partial_tile(
 		int left, int top,
-		const eflib::vec4* edge_factors,
 		drawing_shader_context const* shaders,
         drawing_triangle_context const* triangle_ctx);
-	void subdivide_tile(
-        int left, int top, const eflib::rect<uint32_t>& cur_region, const eflib::vec4* edge_factors,
-		uint32_t* test_regions, uint32_t& test_region_size, float x_min, float x_max, float y_min, float y_max,
-		const float* rej_to_acc, const float* evalue, const float* step_x, const float* step_y);
 
+	void draw_depth_quad(
+		uint32_t left, uint32_t top, uint64_t quad_mask, drawing_triangle_context const* triangle_ctx);
 	void draw_full_quad(
 		uint32_t left, uint32_t top,
 		drawing_shader_context const* shaders, drawing_triangle_context const* triangle_ctx);
 	void draw_quad(
 		uint32_t left, uint32_t top, uint64_t quad_mask,
 		drawing_shader_context const* shaders, drawing_triangle_context const* triangle_ctx);
-
-	void viewport_and_project_transform(vs_output** vertexes, size_t num_verts);
-	void compute_triangle_info(uint32_t prim_id);
-
+	void collect_quad(
+		uint32_t left, uint32_t top, uint64_t quad_mask, float const* depth,
+		drawing_shader_context const* shaders, drawing_triangle_context const* triangle_ctx);
+	void shade_quad_package(quad_package* package, drawing_shader_context const* shaders, pixel_statistic* pixel_stat);
+	// Shades visible triangles of quad in visibility buffer. Returns count of pixel shader invocations.
+	uint64_t shade_visibility_quad(uint32_t left, uint32_t top, size_t thread_id);
+
+	void viewport_and_project_transform(std::vector<vs_output_range> const& ranges);
+	void compute_triangle_infos(uint32_t first_prim_id, uint32_t prim_count);
+	void finish_triangle_info(
+		uint32_t prim_id, vs_output const* const* reordered_verts,
+		triangle_setup_batch const* batch, int lane);
+	void schedule_tiles();
+
+	vs_output_op const* bind_vs_output_op(uint32_t attr_count, uint32_t const* modifiers, uint32_t live_attributes);
+	uint32_t compute_ps_live_attributes() const;
 	void prepare_draw();
+	bool can_defer_draw() const;
+	bool can_draw_depth_only() const;
+	bool can_bin_draw() const;
+	bool bins_compatible(render_state const* state) const;
+	uint32_t select_tile_size(render_state const* state) const;
+	void rasterize_binned_draws();
+	void attach_tile_caches(size_t thread_id, size_t left, size_t top);
+	void detach_tile_caches(size_t left, size_t top);
 public:
 	//inherited
 	void initialize	(render_stages const* stages);
@@ -166,12 +313,16 @@ public:
 
 	//drawer
 	void rasterize_line(rasterize_prim_context const*);
+	template <int TileSize>
 	void rasterize_triangle(rasterize_prim_context const*);
 
 	void rasterize_multi_line(rasterize_multi_prim_context const*);
+	template <int TileSize>
 	void rasterize_multi_triangle(rasterize_multi_prim_context const*);
 
 	void draw();
+	// Rasterizes binned draws, and shades pending draws of visibility buffer.
+	void flush();
 
 	void update_prim_info(render_state const* state);
 };
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <salviar/include/salviar_forward.h>
+
+#include <eflib/include/platform/config.h>
+#include <eflib/include/platform/typedefs.h>
+
+BEGIN_NS_SALVIAR();
+
+// Vertex positions are snapped to 1/SUBPIXEL_SCALE pixel, and edge equations are
+// evaluated exactly in integer at this precision.
+int const SUBPIXEL_BITS		= 4;
+int const SUBPIXEL_SCALE	= 1 << SUBPIXEL_BITS;
+
+// Edge equations of a triangle relative to origin of a tile, in sub-pixel units:
+//		E(x, y) = value + x * dx + y * dy
+// Sample is covered if E >= 0 for all three edges. Fill rule has been folded into value.
+// Triangle setup clamps value and limits dx, dy, so stepping inside a tile never overflows.
+struct tile_edges
+{
+	EFLIB_ALIGN(16) int32_t value[4];
+	EFLIB_ALIGN(16) int32_t dx[4];
+	EFLIB_ALIGN(16) int32_t dy[4];
+};
+
+// Triangles are set up in batches, with their positions in structure of arrays. Lane i is triangle i of batch.
+// Vertex 0 of each triangle is the pivot of attribute interpolation.
+// Batch is as wide as AVX-512 registers, and narrower kernels make several passes.
+int const TRIANGLE_SETUP_BATCH_SIZE = 16;
+
+struct triangle_setup_batch
+{
+	// Inputs: screen positions of 3 vertexes.
+	EFLIB_ALIGN(64) float x[3][TRIANGLE_SETUP_BATCH_SIZE];
+	EFLIB_ALIGN(64) float y[3][TRIANGLE_SETUP_BATCH_SIZE];
+	EFLIB_ALIGN(64) float z[3][TRIANGLE_SETUP_BATCH_SIZE];
+
+	// Outputs
+	EFLIB_ALIGN(64) float area[TRIANGLE_SETUP_BATCH_SIZE];		// cross(v2 - v0, v1 - v0), positive if triangle is front face.
+	EFLIB_ALIGN(64) float inv_area[TRIANGLE_SETUP_BATCH_SIZE];
+	EFLIB_ALIGN(64) float bounding_box[4][TRIANGLE_SETUP_BATCH_SIZE];	// x_min, x_max, y_min, y_max
+	EFLIB_ALIGN(64) float depth_range[2][TRIANGLE_SETUP_BATCH_SIZE];	// z_min, z_max
+};
+
+// Edge function kernels of triangle rasterizer.
+//
+// All kernels of a set have same results but different SIMD width.
+// The wider kernels are compiled with their own instruction set flags,
+// so parameters are plain data which does not need shared inline functions.
+struct rasterizer_kernels
+{
+	// Computes coverage of the 4x4 pixels block at (x, y) pixels of tile.
+	// Bit i of pixel_mask[y * 4 + x] is set if sample i of pixel (x, y) is covered.
+	// sample_offsets are 2 int32 (x, y) per sample in sub-pixels.
+	void (*compute_pixel_mask)(
+		uint32_t* pixel_mask, uint32_t x, uint32_t y,
+		tile_edges const* edges, int32_t const* sample_offsets, uint32_t sample_count
+		);
+
+	// Splits region of tile into 4x4 sub-regions of (new_w, new_h) pixels and appends
+	// the sub-regions which are not trivially rejected to test_regions.
+	// Sub-region is packed as x | (y << 8) | (trivially_accepted << 31).
+	// bounding_box is (x_min, x_max, y_min, y_max) of triangle relative to tile in sub-pixels.
+	void (*subdivide_region)(
+		uint32_t* test_regions, uint32_t& test_region_size,
+		uint32_t region_x, uint32_t region_y, uint32_t new_w, uint32_t new_h,
+		tile_edges const* edges, int32_t const* bounding_box
+		);
+
+	// Computes outputs of batch from positions of all lanes. Unused lanes must be filled with finite positions.
+	void (*setup_triangles)(triangle_setup_batch* batch);
+
+	char const* name;
+};
+
+// Returns the widest kernels supported by running CPU. It is selected at the first call.
+rasterizer_kernels const* select_rasterizer_kernels();
+
+rasterizer_kernels const* rasterizer_kernels_generic();
+#if !defined(EFLIB_NO_SIMD)
+rasterizer_kernels const* rasterizer_kernels_sse();
+rasterizer_kernels const* rasterizer_kernels_avx2();
+rasterizer_kernels const* rasterizer_kernels_avx512();
+#endif
+
+END_NS_SALVIAR();
@@ -6,6 +6,7 @@
 #include <salviar/include/colors.h>
 #include <salviar/include/format.h>
 #include <salviar/include/viewport.h>
+#include <salviar/include/pipeline_options.h>
 #include <salviar/include/stream_state.h>
 #include <salviar/include/shader_cbuffer.h>
 
@@ -23,12 +24,14 @@ EFLIB_DECLARE_CLASS_SHARED_PTR(surface);
 EFLIB_DECLARE_CLASS_SHARED_PTR(input_layout);
 EFLIB_DECLARE_CLASS_SHARED_PTR(counter);
 EFLIB_DECLARE_CLASS_SHARED_PTR(depth_stencil_state);
+EFLIB_DECLARE_CLASS_SHARED_PTR(blend_state);
 EFLIB_DECLARE_CLASS_SHARED_PTR(raster_state);
 EFLIB_DECLARE_CLASS_SHARED_PTR(shader_object);
 EFLIB_DECLARE_CLASS_SHARED_PTR(cpp_blend_shader);
 EFLIB_DECLARE_CLASS_SHARED_PTR(cpp_pixel_shader);
 EFLIB_DECLARE_CLASS_SHARED_PTR(cpp_vertex_shader);
 EFLIB_DECLARE_CLASS_SHARED_PTR(pixel_shader_unit);
+EFLIB_DECLARE_CLASS_SHARED_PTR(blend_shader_unit);
 EFLIB_DECLARE_STRUCT_SHARED_PTR(stream_state);
 EFLIB_DECLARE_CLASS_SHARED_PTR(async_object);
 
@@ -42,7 +45,8 @@ enum class command_id
     clear_depth_stencil,
     clear_color,
     async_begin,
-    async_end
+    async_end,
+    flush
 };
 
 struct render_state
@@ -64,6 +68,7 @@ struct render_state
 
 	int32_t						stencil_ref;
 	depth_stencil_state_ptr		ds_state;
+	blend_state_ptr				bl_state;
 
 	cpp_vertex_shader_ptr		cpp_vs;
 	cpp_pixel_shader_ptr		cpp_ps;
@@ -71,13 +76,18 @@ struct render_state
 
 	shader_object_ptr			vx_shader;
 	shader_object_ptr			px_shader;
+	shader_object_ptr			bl_shader;
 
 	shader_cbuffer  		    vx_cbuffer;
 	shader_cbuffer	    	    px_cbuffer;
+	shader_cbuffer	    	    bl_cbuffer;
 
 	vs_input_op*				vsi_ops;
 
+	pipeline_options			options;
+
 	pixel_shader_unit_ptr		ps_proto;
+	blend_shader_unit_ptr		bs_proto;
 
 	std::vector<surface_ptr>	color_targets;
 	surface_ptr					depth_stencil_target;
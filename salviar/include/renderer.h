@@ -7,6 +7,7 @@
 #include <salviar/include/format.h>
 #include <salviar/include/shader.h>
 #include <salviar/include/viewport.h>
+#include <salviar/include/pipeline_options.h>
 
 #include <eflib/include/math/collision_detection.h>
 #include <eflib/include/utility/shared_declaration.h>
@@ -80,11 +81,15 @@ public:
     virtual result set_ps_variable( std::string const& name, void const* data, size_t sz ) = 0;
     virtual result set_ps_sampler( std::string const& name, sampler_ptr const& samp ) = 0;
     virtual result set_blend_shader(cpp_blend_shader_ptr const& hbs) = 0;
+    virtual result set_blend_shader_code( shader_object_ptr const& ) = 0;
+    virtual result set_bs_variable( std::string const& name, void const* data, size_t sz ) = 0;
+    virtual result set_blend_state(blend_state_ptr const& bs) = 0;
     virtual result set_pixel_shader(cpp_pixel_shader_ptr const& hps) = 0;
     virtual result set_pixel_shader_code( shader_object_ptr const& ) = 0;
     virtual result set_depth_stencil_state(depth_stencil_state_ptr const& dss, int32_t stencil_ref) = 0;
     virtual result set_render_targets(size_t color_target_count, surface_ptr const* color_targets, surface_ptr const& ds_target) = 0;
     virtual result set_viewport(viewport const& vp) = 0;
+    virtual result set_pipeline_options(pipeline_options const& options) = 0;
 
     template <typename T>
     result set_vs_variable( std::string const& name, T const* data )
@@ -96,6 +101,11 @@ public:
     {
         return set_ps_variable( name, static_cast<void const*>(data), sizeof(T) );
     }
+    template <typename T>
+    result set_bs_variable( std::string const& name, T const* data )
+    {
+        return set_bs_variable( name, static_cast<void const*>(data), sizeof(T) );
+    }
 
     // State get
     virtual buffer_ptr	            get_index_buffer() const = 0;
@@ -107,7 +117,10 @@ public:
     virtual cpp_pixel_shader_ptr    get_pixel_shader() const = 0;
     virtual shader_object_ptr       get_pixel_shader_code() const = 0;
     virtual cpp_blend_shader_ptr    get_blend_shader() const = 0;
+    virtual shader_object_ptr       get_blend_shader_code() const = 0;
+    virtual blend_state_ptr         get_blend_state() const = 0;
     virtual viewport	            get_viewport() const = 0;
+    virtual pipeline_options        get_pipeline_options() const = 0;
 
     //render operations
     virtual result begin(async_object_ptr const& async_obj) = 0;
@@ -69,10 +69,18 @@ public:
 
 	virtual result                  set_blend_shader(cpp_blend_shader_ptr const& hbs);
 	virtual cpp_blend_shader_ptr    get_blend_shader() const;
+	virtual result                  set_blend_shader_code( shader_object_ptr const& );
+	virtual shader_object_ptr       get_blend_shader_code() const;
+	virtual result                  set_bs_variable( std::string const& name, void const* data, size_t sz );
+	virtual result                  set_blend_state(blend_state_ptr const& bs);
+	virtual blend_state_ptr         get_blend_state() const;
 
 	virtual result                  set_viewport(viewport const& vp);
 	virtual viewport                get_viewport() const;
 
+	virtual result                  set_pipeline_options(pipeline_options const& options);
+	virtual pipeline_options        get_pipeline_options() const;
+
 	virtual result                  set_render_targets(size_t color_target_count, surface_ptr const* color_targets, surface_ptr const& ds_target);
 
     virtual result                  draw(size_t startpos, size_t primcnt);
@@ -62,6 +62,8 @@ enum system_values
 	sv_target,
 	sv_depth,
 
+	sv_dest_target,		// Color of render target which is read by blending shader.
+
 	sv_customized
 };
 
@@ -98,6 +100,8 @@ public:
 			sv = sv_target;
 		} else if ( lower_name == "depth" || lower_name == "sv_depth" ) {
 			sv = sv_depth;
+		} else if ( lower_name == "dest_color" || lower_name == "sv_dest_target" ) {
+			sv = sv_dest_target;
 		} else if ( lower_name == "blend_indices" ){
 			sv = sv_blend_indices;
 		} else if ( lower_name == "blend_weights" ){
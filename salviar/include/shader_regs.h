@@ -138,18 +138,16 @@ struct triangle_info
 	vs_output const*			v0;
 	bool						front_face;
 	EFLIB_ALIGN(16)	eflib::vec4	bounding_box;
-	EFLIB_ALIGN(16)	eflib::vec4	edge_factors[3];
-	vs_output					ddx;
-	vs_output					ddy;
-
-	triangle_info() {}
-	triangle_info(triangle_info const& /*rhs*/)
-	{
-	}
-	triangle_info& operator = (triangle_info const& /*rhs*/)
-	{
-		return *this;
-	}
+	int32_t						edge_dx[3];		// Edge equations in sub-pixels: E = dx * x + dy * y - c, covered if E >= 0 on all edges.
+	int32_t						edge_dy[3];
+	int64_t						edge_c[3];		// Fill rule is folded into c.
+	eflib::vec2					depth_range;	// (min z, max z) of vertices, for hierarchical Z.
+	bool						is_small;		// All covered samples are in the 4x4 pixels block at (small_x, small_y).
+	int32_t						small_x;
+	int32_t						small_y;
+	uint64_t					small_quad_masks[4];	// Coverage of 2x2 quads of small block.
+	vs_output const*			ddx;			// Only registers of live attributes are stored, in derivatives of draw.
+	vs_output const*			ddy;
 };
 
 #if defined(EFLIB_MSVC)
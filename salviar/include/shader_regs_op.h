@@ -6,6 +6,7 @@
 BEGIN_NS_SALVIAR();
 
 struct viewport;
+struct vs_output_op;
 class  vs_output;
 
 struct vs_input_op
@@ -25,17 +26,18 @@ namespace vs_output_functions
 	typedef vs_output& (*construct)		(vs_output& out, vec4 const& position, vec4 const* attrs);
 	typedef vs_output& (*copy)			(vs_output& out, const vs_output& in);
 
-	typedef vs_output& (*project)		(vs_output& out, const vs_output& in);
-	typedef vs_output& (*unproject)		(vs_output& out, const vs_output& in);
+	// Functions which depend on interpolation modifiers or live attributes read them from op.
+	typedef vs_output& (*project)		(vs_output_op const& op, vs_output& out, const vs_output& in);
+	typedef vs_output& (*unproject)		(vs_output_op const& op, vs_output& out, const vs_output& in);
 
 	typedef vs_output& (*add)			(vs_output& out, const vs_output& vso0, const vs_output& vso1);
 	typedef vs_output& (*sub)			(vs_output& out, const vs_output& vso0, const vs_output& vso1);
 	typedef vs_output& (*mul)			(vs_output& out, const vs_output& vso0, float f);
 	typedef vs_output& (*div)			(vs_output& out, const vs_output& vso0, float f);
 
-	typedef void (*compute_derivative)	(vs_output& ddx, vs_output& ddy, vs_output const& e01, vs_output const& e02, float inv_area);
+	typedef void (*compute_derivative)	(vs_output_op const& op, vs_output& ddx, vs_output& ddy, vs_output const& e01, vs_output const& e02, float inv_area);
 
-	typedef vs_output& (*lerp)			(vs_output& out, const vs_output& start, const vs_output& end, float step);
+	typedef vs_output& (*lerp)			(vs_output_op const& op, vs_output& out, const vs_output& start, const vs_output& end, float step);
 	typedef vs_output& (*step_2d_unproj)(
 		vs_output& out, vs_output const& start,
 		float step0, vs_output const& derivation0,
@@ -44,8 +46,20 @@ namespace vs_output_functions
 		vs_output* out, vs_output const& start,
 		float step0, vs_output const& derivation0,
 		float step1, vs_output const& derivation1);
+	typedef vs_output& (*step_2d_unproj_attr)(
+		vs_output_op const& op,
+		vs_output& out, vs_output const& start,
+		float step0, vs_output const& derivation0,
+		float step1, vs_output const& derivation1);
+	typedef vs_output& (*step_2d_unproj_attr_quad)(
+		vs_output_op const& op,
+		vs_output* out, vs_output const& start,
+		float step0, vs_output const& derivation0,
+		float step1, vs_output const& derivation1);
 }
 
+// Ops returned by get_vs_output_op are prototypes, which have default modifiers and all attributes live.
+// Rasterizer copies them to set modifiers and live attributes of draws.
 struct vs_output_op
 {
 	vs_output_functions::construct		construct;
@@ -61,10 +75,11 @@ struct vs_output_op
 
 	vs_output_functions::lerp			lerp;
     vs_output_functions::step_2d_unproj	step_2d_unproj_pos;
-    vs_output_functions::step_2d_unproj	step_2d_unproj_attr;
+    vs_output_functions::step_2d_unproj_attr
+										step_2d_unproj_attr;
 	vs_output_functions::step_2d_unproj_quad
 										step_2d_unproj_pos_quad;
-	vs_output_functions::step_2d_unproj_quad
+	vs_output_functions::step_2d_unproj_attr_quad
 										step_2d_unproj_attr_quad;
 
 	vs_output_functions::compute_derivative
@@ -72,10 +87,30 @@ struct vs_output_op
 
 	typedef boost::array<uint32_t, MAX_VS_OUTPUT_ATTRS> interpolation_modifier_array;
 	interpolation_modifier_array		attribute_modifiers;
+
+	// Attributes read by pixel shader, grouped by interpolation mode.
+	// Attributes which are not read are not interpolated.
+	typedef boost::array<uint32_t, MAX_VS_OUTPUT_ATTRS> attribute_index_array;
+	uint32_t							live_attributes;
+	attribute_index_array				perspective_attrs;
+	attribute_index_array				noperspective_attrs;
+	attribute_index_array				flat_attrs;
+	uint32_t							perspective_attrs_count;
+	uint32_t							noperspective_attrs_count;
+	uint32_t							flat_attrs_count;
+
+	// Derivatives store position and interpolated live attributes only.
+	// derivative_regs maps attribute to its register in derivatives,
+	// and derivative_srcs maps register in derivatives to register in vs_output.
+	typedef boost::array<uint32_t, MAX_VS_OUTPUT_ATTRS+1> register_index_array;
+	attribute_index_array				derivative_regs;
+	register_index_array				derivative_srcs;
+	uint32_t							derivative_regs_count;
 };
 
 vs_input_op& get_vs_input_op(uint32_t n);
-vs_output_op& get_vs_output_op(uint32_t n);
+vs_output_op const& get_vs_output_op(uint32_t n);
+void update_live_attributes(vs_output_op& op, uint32_t attr_count, uint32_t live_attributes);
 float compute_area(const vs_output& v0, const vs_output& v1, const vs_output& v2);
 void viewport_transform(eflib::vec4& position, viewport const& vp);
 
@@ -9,6 +9,7 @@
 #include <salviar/include/salviar_forward.h>
 
 #include <salviar/include/decl.h>
+#include <salviar/include/renderer_capacity.h>
 
 #include <eflib/include/platform/boost_begin.h>
 #include <boost/shared_ptr.hpp>
@@ -50,6 +51,10 @@ public:
 	void update( vs_output* inputs, shader_reflection const* vs_abi );
 	void execute(ps_output* outs, float* depths);
 
+	// Shades quads which are laid out one by one in inputs, outs and depths.
+	// Layouts are looked up once for all quads.
+	void execute_quads( vs_output* inputs, shader_reflection const* vs_abi, ps_output* outs, float* depths, size_t quad_count );
+
 public:
 	shader_object const* code;
 
@@ -62,6 +67,58 @@ public:
 
 	aligned_vector stream_odata;
 	aligned_vector buffer_odata;
+
+private:
+	void invoke_package();
+};
+
+// Executes blending shader on a quad. Source colors are pixel shader outputs (sv_target),
+// and destination colors (sv_dest_target) are loaded by caller into the input package.
+class blend_shader_unit
+{
+public:
+	blend_shader_unit();
+	~blend_shader_unit();
+
+	blend_shader_unit( blend_shader_unit const& );
+	blend_shader_unit& operator = ( blend_shader_unit const& );
+
+	boost::shared_ptr<blend_shader_unit> clone() const;
+
+	void initialize( shader_object const* );
+	void reset_pointers();
+
+	void set_variable( std::string const&, void const* data );
+
+	// Masks of render targets which are read as destination or written by shader.
+	uint32_t dest_target_mask() const	{ return dest_target_mask_; }
+	uint32_t output_target_mask() const	{ return output_target_mask_; }
+
+	// Address of destination color in input package. Target must be in dest_target_mask().
+	float* dest_color(size_t i_pixel, size_t target_index);
+
+	// Sources and results are pixels of quad.
+	void execute( ps_output const* const* sources, ps_output* results );
+
+public:
+	shader_object const* code;
+
+	typedef std::vector<char, eflib::aligned_allocator<char, 32> > aligned_vector;
+
+	aligned_vector stream_data;
+	aligned_vector buffer_data;
+
+	aligned_vector stream_odata;
+	aligned_vector buffer_odata;
+
+private:
+	void update_layouts();
+
+	uint32_t	dest_target_mask_;
+	uint32_t	output_target_mask_;
+	size_t		src_offsets_   [MAX_RENDER_TARGETS];
+	size_t		dest_offsets_  [MAX_RENDER_TARGETS];
+	size_t		output_offsets_[MAX_RENDER_TARGETS];
 };
 
 EFLIB_DECLARE_CLASS_SHARED_PTR(vx_shader_unit);
@@ -13,7 +13,11 @@
 
 #include <vector>
 
+// Tiled surfaces store texels in 4x4 blocks of 32x32 tiles, which keeps 2D neighborhoods in cache lines.
+// Mapped data is linear in both layouts.
+#ifndef SALVIA_TILED_SURFACE
 #define SALVIA_TILED_SURFACE 0
+#endif
 
 BEGIN_NS_SALVIAR();
 
@@ -22,6 +26,14 @@ struct internal_mapped_resource;
 class surface;
 typedef boost::shared_ptr<surface> surface_ptr;
 
+// Clears are recorded per tile of CLEAR_TILE_SIZE and texels are filled on first write.
+// It is the smallest rasterizer tile size, so a clear tile is never written by two threads.
+static uint32_t const CLEAR_TILE_BITS = 5;
+static uint32_t const CLEAR_TILE_SIZE = 1UL << CLEAR_TILE_BITS;
+
+// Resolves a run of pixels, whose samples are contiguous, to a run of single sample pixels.
+typedef void (*resolve_pixels_fn)(byte* dst, byte const* src, size_t count, size_t sample_count);
+
 class surface
 {
 public:
@@ -32,7 +44,8 @@ public:
 	result map(internal_mapped_resource& mapped, map_mode mm);
 	result unmap(internal_mapped_resource& mapped, map_mode mm);
 
-	void resolve(surface& target);
+	// Resolves in parallel by tiles. Colors of 8-bit targets are averaged in linear space if srgb is set.
+	void resolve(surface& target, bool srgb = false);
 	surface_ptr make_mip_surface(filter_type filter);
 
 	void transfer(pixel_format srcfmt, const eflib::rect<size_t>& dest_rect, void* pdata);
@@ -68,6 +81,8 @@ public:
 		return format_;
 	}
 
+	// Writable address fills the texel's tile if it is still cleared.
+	// Read-only address of a cleared tile points to the clear value.
     void*         texel_address(size_t x, size_t y, size_t sample);
 	void const*   texel_address(size_t x, size_t y, size_t sample) const;
 
@@ -81,7 +96,47 @@ public:
 	void		  fill_texels(size_t sx, size_t sy, size_t width, size_t height, const color_rgba32f& color);
     void		  fill_texels(color_rgba32f const& color);
 
+	// Clearing whole surface only records the clear value in every tile.
+	void		  clear(color_rgba32f const& color);
+	bool		  tile_cleared(size_t x, size_t y) const;
+	color_rgba32f clear_color() const
+	{
+		return clear_color_;
+	}
+
+	// Fills texels of cleared tiles, so that memory of surface is complete.
+	void		  materialize();
+	void		  materialize(size_t sx, size_t sy, size_t width, size_t height);
+
+	// A square tile could be redirected to a contiguous buffer while one thread renders it,
+	// and it is written back once by detaching. Caches have to be enabled before tiles are attached,
+	// and all tiles have to be detached before caches are disabled.
+	size_t		  tile_cache_size(size_t tile_size) const;
+	void		  enable_tile_caches(bool enabled);
+	void		  attach_tile_cache(size_t left, size_t top, size_t tile_size, byte* buffer);
+	void		  detach_tile_cache(size_t left, size_t top, size_t tile_size);
+
+	// Compressed multi-sample surface flags pixels whose samples are all equal, and only sample 0 of them is stored.
+	// Writable address of a flagged pixel decompresses it, so it is safe to write any sample.
+	// Uniform address flags the pixel and points to sample 0, which represents all samples.
+	// Compression is not applied while tile caches are enabled.
+	void		  set_compression(bool enabled);
+	bool		  compressed() const
+	{
+		return compression_ && !tile_caches_enabled_;
+	}
+	bool		  pixel_uniform(size_t x, size_t y) const;
+	void*		  uniform_texel_address(size_t x, size_t y);
+
 private:
+	struct tile_cache
+	{
+		byte*		data;
+		size_t		left;
+		size_t		top;
+		size_t		width;
+	};
+
 	int				elem_size_;
 	int				sample_count_;
 	eflib::int4		size_;
@@ -89,18 +144,42 @@ private:
 	std::vector<byte, eflib::aligned_allocator<byte, 16>>
 					datas_;
 
+	size_t			clear_tile_x_count_;
+	size_t			clear_tile_y_count_;
+	std::vector<uint8_t>
+					tiles_cleared_;
+	bool			clear_pending_;		// Some tiles may still be cleared.
+	color_rgba32f	clear_color_;
+	byte			clear_texel_[4 * 4 * sizeof(float)];
+
+	// Caches of tiles per clear tile. Only the thread which attached a cache accesses its entries.
+	bool			tile_caches_enabled_;
+	std::vector<tile_cache>
+					tile_caches_;
+
+	// One flag per pixel if compression is enabled.
+	bool			compression_;
+	std::vector<uint8_t>
+					uniform_pixels_;
+
 #if SALVIA_TILED_SURFACE
-	size_t			tile_width_;
-	size_t			tile_height_;
+	size_t			tile_size_[2];
 	bool			tile_mode_;
 #endif
 
 	size_t texel_offset(size_t x, size_t y, size_t sample) const;
-
-#if SALVIA_TILED_SURFACE
-	void tile	(internal_mapped_resource const& mapped);
-	void untile	(internal_mapped_resource& mapped);
-#endif
+	size_t contiguous_texels(size_t x, size_t count) const;		// Texels from x in a row which are contiguous in storage.
+	bool   tiled() const;
+	void   fill_tile(byte* data, size_t tile_x, size_t tile_y) const;
+	void   resolve_tile(surface& target, resolve_pixels_fn kernel, size_t tile_x, size_t tile_y) const;
+	void   materialize_tile(size_t x, size_t y);
+	void   decompress_pixel(size_t x, size_t y);
+	void   decompress();
+	void   reset_uniform_pixels(size_t sx, size_t sy, size_t width, size_t height);
+
+	// Copies region between storage and linear rows of all samples. Pitch of 0 writes the same row to all rows.
+	void   read_texels(size_t sx, size_t sy, size_t width, size_t height, byte* linear, size_t linear_pitch) const;
+	void   write_texels(size_t sx, size_t sy, size_t width, size_t height, byte const* linear, size_t linear_pitch);
 
 	pixel_format_convertor::pixel_convertor         to_rgba32_func_;
 	pixel_format_convertor::pixel_convertor         from_rgba32_func_;
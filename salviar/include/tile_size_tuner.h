@@ -0,0 +1,22 @@
+#pragma once
+
+#include <salviar/include/salviar_forward.h>
+
+#include <eflib/include/platform/typedefs.h>
+
+BEGIN_NS_SALVIAR();
+
+uint32_t const MIN_TILE_SIZE		= 32;
+uint32_t const DEFAULT_TILE_SIZE	= 64;
+uint32_t const MAX_TILE_SIZE		= 128;
+
+// Returns true if rasterizer has kernels for tiles of this size.
+bool		is_supported_tile_size(uint32_t tile_size);
+
+// Benchmarks supported tile sizes and returns the fastest one.
+// Benchmark imitates overdraw of tiles in a buffer which has the size and bytes per pixel of bound targets,
+// and tiles are processed by thread_count threads as rasterizer does.
+// Result is cached, so benchmark is run only once per arguments.
+uint32_t	tune_tile_size(uint32_t width, uint32_t height, uint32_t bytes_per_pixel, uint32_t thread_count);
+
+END_NS_SALVIAR();
@@ -23,6 +23,7 @@ struct render_stages;
 struct render_state;
 
 typedef size_t cache_entry_index;
+typedef std::pair<vs_output*, size_t> vs_output_range;	// First vertex and count of contiguous vertexes.
 
 EFLIB_DECLARE_CLASS_SHARED_PTR(vertex_cache);
 
@@ -35,6 +36,8 @@ public:
 	virtual void prepare_vertices() = 0;
 	virtual void fetch3(vs_output** v, cache_entry_index id, uint32_t thread_id) = 0;
 	virtual void update_statistic() = 0;
+	// Appends vertexes transformed for current draw. Each of them is in one range only.
+	virtual void append_transformed_vertices(std::vector<vs_output_range>& ranges) const = 0;
 
 	virtual ~vertex_cache(){}
 };
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <salviar/include/salviar_forward.h>
+
+#include <salviar/include/decl.h>
+#include <salviar/include/shader_regs.h>
+#include <salviar/include/shader_regs_op.h>
+
+#include <eflib/include/utility/shared_declaration.h>
+
+#include <vector>
+#include <memory.h>
+
+BEGIN_NS_SALVIAR();
+
+EFLIB_DECLARE_CLASS_SHARED_PTR(pixel_shader_unit);
+EFLIB_DECLARE_CLASS_SHARED_PTR(blend_shader_unit);
+
+class  shader_reflection;
+struct render_state;
+
+#if defined(EFLIB_MSVC)
+#pragma warning(push)
+#pragma warning(disable: 4324)	// warning C4324: Structure was padded due to __declspec(align())
+#endif
+
+// Part of triangle_info which is needed for shading after the draw is finished.
+struct deferred_triangle
+{
+	vs_output					v0;
+	vs_output					ddx;
+	vs_output					ddy;
+
+	deferred_triangle() {}
+	deferred_triangle(deferred_triangle const& rhs)
+	{
+		copy_from(rhs);
+	}
+	deferred_triangle& operator = (deferred_triangle const& rhs)
+	{
+		copy_from(rhs);
+		return *this;
+	}
+
+private:
+	// vs_output is not copyable, so registers are copied directly.
+	void copy_from(deferred_triangle const& rhs)
+	{
+		size_t const regs_size = sizeof(eflib::vec4) * (MAX_VS_OUTPUT_ATTRS + 1);
+		memcpy(v0.raw_data(),  rhs.v0.raw_data(),  regs_size);
+		memcpy(ddx.raw_data(), rhs.ddx.raw_data(), regs_size);
+		memcpy(ddy.raw_data(), rhs.ddy.raw_data(), regs_size);
+	}
+};
+
+#if defined(EFLIB_MSVC)
+#pragma warning(pop)
+#endif
+
+// Everything of a draw which is used by shading pass.
+// Shaders are held here because states of renderer could be changed by later draws.
+struct deferred_draw
+{
+	std::vector<deferred_triangle>		triangles;			// Indexed by primitive id of the draw.
+	vs_output_op const*					vso_ops;
+	shader_object_ptr					vx_shader;
+	shader_object_ptr					px_shader;
+	shader_reflection const*			vs_reflection;
+	cpp_blend_shader_ptr				cpp_bs;
+	std::vector<pixel_shader_unit_ptr>	threaded_psu;		// Clones of pixel shader with constants of the draw.
+	std::vector<blend_shader_unit_ptr>	threaded_bsu;		// Clones of blending shader, which are empty if it is not used.
+};
+
+// Visibility buffer keeps (draw id, primitive id) of the nearest triangle per sample.
+// Draws write ids instead of running pixel shader, and pending draws are shaded together
+// by flushing, so pixel shader runs only once per visible pixel.
+// All pending draws share render targets.
+class visibility_buffer
+{
+public:
+	static uint64_t const INVALID_ID = ~uint64_t(0);
+
+	visibility_buffer();
+
+	bool		empty() const { return draw_count_ == 0; }
+	size_t		draw_count() const { return draw_count_; }
+	size_t		width() const { return width_; }
+	size_t		height() const { return height_; }
+	size_t		sample_count() const { return sample_count_; }
+
+	// Returns true if draws of state are rendered to the same targets as pending draws.
+	bool		compatible(render_state const* state) const;
+
+	// Appends a draw. Ids are cleared if it is the first pending draw.
+	uint32_t		add_draw(render_state const* state);
+	deferred_draw&	draw(uint32_t draw_id) { return draws_[draw_id]; }
+
+	void write_quad(size_t x, size_t y, uint64_t quad_mask, uint32_t draw_id, uint32_t prim_id)
+	{
+		for(int i = 0; i < 4; ++i)
+		{
+			size_t const px = x + (i & 1);
+			size_t const py = y + (i >> 1);
+			uint32_t px_mask = static_cast<uint32_t>( (quad_mask >> (MAX_SAMPLE_COUNT * i)) & SAMPLE_MASK );
+			if(px_mask == 0 || px >= width_ || py >= height_)
+			{
+				continue;
+			}
+
+			uint64_t* pixel_ids = ids_.data() + (py * width_ + px) * sample_count_;
+			for(size_t i_sample = 0; i_sample < sample_count_; ++i_sample)
+			{
+				if( px_mask & (1U << i_sample) )
+				{
+					pixel_ids[i_sample] = (static_cast<uint64_t>(draw_id) << 32) | prim_id;
+				}
+			}
+		}
+	}
+
+	// Returns INVALID_ID for pixels out of buffer.
+	uint64_t id(size_t x, size_t y, size_t i_sample) const
+	{
+		if(x >= width_ || y >= height_)
+		{
+			return INVALID_ID;
+		}
+		return ids_[(y * width_ + x) * sample_count_ + i_sample];
+	}
+
+	// Drops pending draws after they are shaded. Storage is kept for next frame.
+	void reset();
+
+private:
+	std::vector<uint64_t>		ids_;
+	std::vector<deferred_draw>	draws_;
+	size_t						draw_count_;
+
+	size_t						width_;
+	size_t						height_;
+	size_t						sample_count_;
+	std::vector<surface*>		color_targets_;
+	surface*					ds_target_;
+};
+
+END_NS_SALVIAR();
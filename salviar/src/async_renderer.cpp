@@ -40,6 +40,9 @@ public:
 
 	virtual result flush()
 	{
+        state_->cmd = command_id::flush;
+        commit_state_and_command();
+
         while(object_count_in_pool() != MAX_COMMAND_QUEUE)
         {
             boost::thread::yield();
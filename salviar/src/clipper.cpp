@@ -14,7 +14,7 @@ using namespace eflib;
 using namespace std;
 
 clip_context::clip_context()
-	: vert_pool(NULL), prim(pt_none), vso_ops(NULL), cull(NULL)
+	: vert_pool(NULL), prim(pt_none), vso_ops(NULL), cull(NULL), guard_band(0.0f)
 {
 }
 
@@ -25,12 +25,29 @@ clipper::clipper()
 
 	// Far plane
 	planes_[1] = vec4(0.0f, 0.0f, -1.0f, 1.0f);
+
+	num_planes_ = 2;
 }
 
 void clipper::set_context(clip_context const* ctxt)
 {
 	ctxt_ = *ctxt;
 
+	// Guard band planes: -guard_band * w <= x, y <= guard_band * w
+	if(ctxt->guard_band > 0.0f)
+	{
+		float const gb = ctxt->guard_band;
+		planes_[2] = vec4( 1.0f,  0.0f, 0.0f, gb);
+		planes_[3] = vec4(-1.0f,  0.0f, 0.0f, gb);
+		planes_[4] = vec4( 0.0f,  1.0f, 0.0f, gb);
+		planes_[5] = vec4( 0.0f, -1.0f, 0.0f, gb);
+		num_planes_ = 6;
+	}
+	else
+	{
+		num_planes_ = 2;
+	}
+
 	// Select clipping function
 	switch(ctxt->prim)
 	{
@@ -49,7 +66,7 @@ void clipper::clip_wireframe_triangle(vs_output** /*tri_verts*/, clip_results* /
 void clipper::clip_solid_triangle(vs_output** tri_verts, clip_results* results)
 {
 	// Clip triangles to vertex of result polygon
-	vs_output*	tri_clipped_verts[5];
+	vs_output*	tri_clipped_verts[MAX_CLIPPED_POLY_VERTS];
 	clip_results tri_clip_results;
 	tri_clip_results.clipped_verts = tri_clipped_verts;
 
@@ -58,7 +75,9 @@ void clipper::clip_solid_triangle(vs_output** tri_verts, clip_results* results)
 	// clip_triangle_to_poly_simple (tri_verts, &tri_clip_results);
 
 	// Re-topo/subdivde polygon to triangles.
-	assert(tri_clip_results.num_clipped_verts <= 5 || tri_clip_results.num_clipped_verts == 0xFF);
+	assert(tri_clip_results.num_clipped_verts <= MAX_CLIPPED_POLY_VERTS || tri_clip_results.num_clipped_verts == 0xFF);
+	results->is_clipped = tri_clip_results.is_clipped;
+	results->is_accepted = tri_clip_results.is_accepted;
 	if (tri_clip_results.num_clipped_verts == 0xFF)
 	{
 		results->num_clipped_verts = 3;
@@ -85,7 +104,7 @@ void clipper::clip_solid_triangle(vs_output** tri_verts, clip_results* results)
 	results->is_front = tri_clip_results.is_front;
 
 	vs_output** clipped_cursor = results->clipped_verts;
-	for(size_t i_tri = 1; i_tri < results->num_clipped_verts-1; ++i_tri)
+	for(size_t i_tri = 1; i_tri < tri_clip_results.num_clipped_verts-1; ++i_tri)
 	{
 		*(clipped_cursor+0) = tri_clipped_verts[0];
 		if (results->is_front)
@@ -117,26 +136,47 @@ inline bool compute_front(vec4 const& pos0, vec4 const& pos1, vec4 const& pos2)
 
 void clipper::clip_triangle_to_poly_general(vs_output** tri_verts, clip_results* results) const
 {
-	vs_output*	clipped_verts[2][5];
+	vs_output*	clipped_verts[2][MAX_CLIPPED_POLY_VERTS];
 	uint32_t	num_clipped_verts[2];
 
-	// Quick test
-	bool in_frustum = true;
-	for(size_t i_plane = 0; i_plane < planes_.size(); ++i_plane)
+	results->is_clipped = false;
+	results->is_accepted = false;
+
+	// Quick test by out codes.
+	// Bits of clipping planes are followed by 4 bits of viewport sides, which are used for rejection only.
+	uint32_t const VIEWPORT_SIDES_SHIFT = static_cast<uint32_t>(plane_num);
+	uint32_t any_outside = 0;
+	uint32_t all_outside = ~0U;
+	for(size_t i_vert = 0; i_vert < 3; ++i_vert)
 	{
-		for(size_t i_vert = 0; i_vert < 3; ++i_vert)
+		vec4 const& pos = tri_verts[i_vert]->position();
+
+		uint32_t outside = 0;
+		for(size_t i_plane = 0; i_plane < num_planes_; ++i_plane)
 		{
-			float d = dot_prod4( planes_[i_plane], tri_verts[i_vert]->position() );
-			if(d < 0)
+			if( dot_prod4(planes_[i_plane], pos) < 0.0f )
 			{
-				in_frustum = false;
-				break;
+				outside |= (1U << i_plane);
 			}
 		}
-		if (!in_frustum) break;
+		outside |= static_cast<uint32_t>( pos.x() < -pos.w() ) << (VIEWPORT_SIDES_SHIFT + 0);
+		outside |= static_cast<uint32_t>( pos.x() >  pos.w() ) << (VIEWPORT_SIDES_SHIFT + 1);
+		outside |= static_cast<uint32_t>( pos.y() < -pos.w() ) << (VIEWPORT_SIDES_SHIFT + 2);
+		outside |= static_cast<uint32_t>( pos.y() >  pos.w() ) << (VIEWPORT_SIDES_SHIFT + 3);
+
+		any_outside |= outside;
+		all_outside &= outside;
+	}
+
+	// All vertexes are outside of one plane.
+	if(all_outside != 0)
+	{
+		results->num_clipped_verts = 0;
+		return;
 	}
 
-	if(in_frustum)
+	// Triangle which is not crossing near plane is culled by its vertexes.
+	if( (any_outside & 1) == 0 )
 	{
 		results->is_front = compute_front(
 			tri_verts[0]->position(),
@@ -149,7 +189,12 @@ void clipper::clip_triangle_to_poly_general(vs_output** tri_verts, clip_results*
 			results->num_clipped_verts = 0;
 			return;
 		}
+	}
 
+	// Triangle which crosses viewport sides only is rasterized directly.
+	if( (any_outside & ( (1U << VIEWPORT_SIDES_SHIFT) - 1 )) == 0 )
+	{
+		results->is_accepted = (any_outside >> VIEWPORT_SIDES_SHIFT) != 0;
 		results->num_clipped_verts = 0xFF;
 		return;
 	}
@@ -164,8 +209,14 @@ void clipper::clip_triangle_to_poly_general(vs_output** tri_verts, clip_results*
 	size_t src_stage = 0;
 	size_t dest_stage = 1;
 
-	for(size_t i_plane = 0; i_plane < planes_.size(); ++i_plane)
+	for(size_t i_plane = 0; i_plane < num_planes_; ++i_plane)
 	{
+		// Polygon is inside of the plane if all vertexes of triangle are inside.
+		if( (any_outside & (1U << i_plane)) == 0 )
+		{
+			continue;
+		}
+
 		num_clipped_verts[dest_stage] = 0;
 
 		if (num_clipped_verts[src_stage] != 0)
@@ -188,9 +239,10 @@ void clipper::clip_triangle_to_poly_general(vs_output** tri_verts, clip_results*
 				if(d[1] < 0.0f)
 				{
 					vs_output* pclipped = ctxt_.vert_pool->alloc();
+					results->is_clipped = true;
 
 					//LERP
-					ctxt_.vso_ops->lerp(*pclipped, *clipped_verts[src_stage][i], *clipped_verts[src_stage][j], d[0] / (d[0] - d[1]));
+					ctxt_.vso_ops->lerp(*ctxt_.vso_ops, *pclipped, *clipped_verts[src_stage][i], *clipped_verts[src_stage][j], d[0] / (d[0] - d[1]));
 
 					clipped_verts[dest_stage][num_clipped_verts[dest_stage]] = pclipped;
 					++ num_clipped_verts[dest_stage];
@@ -201,9 +253,10 @@ void clipper::clip_triangle_to_poly_general(vs_output** tri_verts, clip_results*
 				if(d[1] >= 0.0f)
 				{
 					vs_output* pclipped = ctxt_.vert_pool->alloc();
+					results->is_clipped = true;
 
 					//LERP
-					ctxt_.vso_ops->lerp(*pclipped, *clipped_verts[src_stage][j], *clipped_verts[src_stage][i], d[1] / (d[1] - d[0]));
+					ctxt_.vso_ops->lerp(*ctxt_.vso_ops, *pclipped, *clipped_verts[src_stage][j], *clipped_verts[src_stage][i], d[1] / (d[1] - d[0]));
 
 					clipped_verts[dest_stage][num_clipped_verts[dest_stage]] = pclipped;
 					++ num_clipped_verts[dest_stage];
@@ -246,7 +299,7 @@ void clipper::clip_triangle_to_poly_general(vs_output** tri_verts, clip_results*
 	}
 
 	uint32_t num_final_clipped_verts = num_clipped_verts[src_stage];
-	assert(num_final_clipped_verts <= 5);
+	assert(num_final_clipped_verts <= MAX_CLIPPED_POLY_VERTS);
 
 	results->num_clipped_verts = num_final_clipped_verts;
 	for(size_t i = 0; i < num_final_clipped_verts; ++i)
@@ -257,10 +310,11 @@ void clipper::clip_triangle_to_poly_general(vs_output** tri_verts, clip_results*
 
 void clipper::clip_triangle_to_poly_simple(vs_output** tri_verts, clip_results* results) const
 {
-	vs_output*	clipped_verts[2][5];
+	vs_output*	clipped_verts[2][MAX_CLIPPED_POLY_VERTS];
 	uint32_t	num_clipped_verts[2];
 	
 	results->is_clipped = false;
+	results->is_accepted = false;
 
 	// Quick test
 	bool less_z[] =
@@ -371,7 +425,7 @@ void clipper::clip_triangle_to_poly_simple(vs_output** tri_verts, clip_results*
 	size_t src_stage = 0;
 	size_t dest_stage = 1;
 
-	for(size_t i_plane = 0; i_plane < planes_.size(); ++i_plane)
+	for(size_t i_plane = 0; i_plane < num_planes_; ++i_plane)
 	{
 		num_clipped_verts[dest_stage] = 0;
 
@@ -398,7 +452,7 @@ void clipper::clip_triangle_to_poly_simple(vs_output** tri_verts, clip_results*
 					results->is_clipped = true;
 
 					//LERP
-					ctxt_.vso_ops->lerp(*pclipped, *clipped_verts[src_stage][i], *clipped_verts[src_stage][j], d[0] / (d[0] - d[1]));
+					ctxt_.vso_ops->lerp(*ctxt_.vso_ops, *pclipped, *clipped_verts[src_stage][i], *clipped_verts[src_stage][j], d[0] / (d[0] - d[1]));
 
 					clipped_verts[dest_stage][num_clipped_verts[dest_stage]] = pclipped;
 					++ num_clipped_verts[dest_stage];
@@ -412,7 +466,7 @@ void clipper::clip_triangle_to_poly_simple(vs_output** tri_verts, clip_results*
 					results->is_clipped = true;
 
 					//LERP
-					ctxt_.vso_ops->lerp(*pclipped, *clipped_verts[src_stage][j], *clipped_verts[src_stage][i], d[1] / (d[1] - d[0]));
+					ctxt_.vso_ops->lerp(*ctxt_.vso_ops, *pclipped, *clipped_verts[src_stage][j], *clipped_verts[src_stage][i], d[1] / (d[1] - d[0]));
 
 					clipped_verts[dest_stage][num_clipped_verts[dest_stage]] = pclipped;
 					++ num_clipped_verts[dest_stage];
@@ -455,7 +509,7 @@ void clipper::clip_triangle_to_poly_simple(vs_output** tri_verts, clip_results*
 	}
 
 	uint32_t num_final_clipped_verts = num_clipped_verts[src_stage];
-	assert(num_final_clipped_verts <= 5);
+	assert(num_final_clipped_verts <= MAX_CLIPPED_POLY_VERTS);
 
 	results->num_clipped_verts = num_final_clipped_verts;
 	for(size_t i = 0; i < num_final_clipped_verts; ++i)
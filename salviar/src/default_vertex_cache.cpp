@@ -146,7 +146,7 @@ class precomputed_vertex_cache : public vertex_cache_impl
 {
 public:
 	precomputed_vertex_cache()
-		: transformed_verts_capacity_ (0)
+		: transformed_verts_capacity_ (0), transformed_verts_count_(0)
 	{
 	}
 
@@ -195,6 +195,8 @@ public:
 		}
 #endif
 
+		transformed_verts_count_ = verts_count;
+
         // Accumulate query counters.
         acc_ia_vertices_( pipeline_stat_, static_cast<uint64_t>(prim_count_*prim_size_) );
         acc_vs_invocations_( pipeline_stat_, static_cast<uint64_t>(verts_count) );
@@ -251,6 +253,14 @@ public:
 	{
 		// do nothing
 	}
+
+	void append_transformed_vertices(std::vector<vs_output_range>& ranges) const override
+	{
+		if(transformed_verts_count_ > 0)
+		{
+			ranges.push_back( vs_output_range(transformed_verts_.get(), transformed_verts_count_) );
+		}
+	}
 private:
 	void generate_indices(thread_context const* thread_ctx)
 	{
@@ -364,6 +374,7 @@ private:
 
 	shared_array<vs_output> transformed_verts_;
 	size_t					transformed_verts_capacity_;
+	size_t					transformed_verts_count_;
 
 	vector<int32_t>			used_verts_;
 
@@ -458,6 +469,17 @@ public:
 			cache.vs_during = 0;
 		}
 	}
+
+	void append_transformed_vertices(std::vector<vs_output_range>& ranges) const override
+	{
+		for(auto const& cache: caches_)
+		{
+			if(cache.vso_pool.size() > 0)
+			{
+				ranges.push_back( vs_output_range(cache.vso_pool.data(), cache.vso_pool.size()) );
+			}
+		}
+	}
 private:
 	static const int ENTRY_SIZE = 128;
 	
@@ -638,6 +660,17 @@ public:
 			l2_hitting_ += cache.l2_hitting;
 		}
 	}
+
+	void append_transformed_vertices(std::vector<vs_output_range>& ranges) const override
+	{
+		for(auto const& cache: caches_)
+		{
+			if(cache.vso_pool.size() > 0)
+			{
+				ranges.push_back( vs_output_range(cache.vso_pool.data(), cache.vso_pool.size()) );
+			}
+		}
+	}
 private:
 	static int const		SHARED_ENTRY_SIZE = 1024;
 	static int const		ENTRY_SIZE = 32;
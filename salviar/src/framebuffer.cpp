@@ -2,13 +2,16 @@
 #include <salviar/include/shader.h>
 #include <salviar/include/shader_regs.h>
 #include <salviar/include/shader_regs_op.h>
+#include <salviar/include/shader_unit.h>
 #include <salviar/include/surface.h>
 #include <salviar/include/render_state.h>
 #include <salviar/include/renderer.h>
 
 #include <eflib/include/math/collision_detection.h>
+#include <eflib/include/platform/intrin.h>
 
 #include <algorithm>
+#include <limits>
 
 BEGIN_NS_SALVIAR();
 
@@ -42,6 +45,12 @@ public:
 	static void 	write_depth_stencil(void* /*ds_data*/, float /*depth*/, uint32_t /*stencil*/)
     {
     }
+
+	// Rounds depth to precision of format, so depth is tested as same as it is stored.
+	static float	quantize_depth(float depth)
+	{
+		return depth;
+	}
 };
 
 template <> class depth_stencil_accessor<pixel_format_color_rg32f>
@@ -102,6 +111,135 @@ public:
         stencil_u = stencil;
         reinterpret_cast<color_rg32f*>(ds_data)->g = stencil_f;
     }
+
+	static float	quantize_depth(float depth)
+	{
+		return depth;
+	}
+};
+
+// Packed depth formats store unsigned normalized or float depth, and formats except D24S8 have no stencil.
+template <> class depth_stencil_accessor<pixel_format_color_d16>
+{
+public:
+	static float 	read_depth(void const* ds_data)
+    {
+        return reinterpret_cast<color_d16 const*>(ds_data)->depth();
+    }
+
+	static uint32_t	read_stencil(void const* /*ds_data*/)
+    {
+        return 0;
+    }
+
+	static void 	read_depth_stencil(float& depth, uint32_t& stencil, void const* ds_data)
+    {
+        depth = read_depth(ds_data);
+        stencil = 0;
+    }
+
+	static void 	write_depth(void* ds_data, float depth)
+    {
+        *reinterpret_cast<color_d16*>(ds_data) = color_rgba32f(depth, 0.0f, 0.0f, 0.0f);
+    }
+
+	static void		write_stencil(void* /*ds_data*/, uint32_t /*stencil*/)
+    {
+    }
+
+	static void 	write_depth_stencil(void* ds_data, float depth, uint32_t /*stencil*/)
+    {
+        write_depth(ds_data, depth);
+    }
+
+	static float	quantize_depth(float depth)
+	{
+		color_d16 d = color_rgba32f(depth, 0.0f, 0.0f, 0.0f);
+		return d.depth();
+	}
+};
+
+template <> class depth_stencil_accessor<pixel_format_color_d24s8>
+{
+public:
+	static float 	read_depth(void const* ds_data)
+    {
+        return reinterpret_cast<color_d24s8 const*>(ds_data)->depth();
+    }
+
+	static uint32_t	read_stencil(void const* ds_data)
+    {
+        return reinterpret_cast<color_d24s8 const*>(ds_data)->stencil();
+    }
+
+	static void 	read_depth_stencil(float& depth, uint32_t& stencil, void const* ds_data)
+    {
+        color_d24s8 const* ds = reinterpret_cast<color_d24s8 const*>(ds_data);
+        depth = ds->depth();
+        stencil = ds->stencil();
+    }
+
+	static void 	write_depth(void* ds_data, float depth)
+    {
+        color_d24s8* ds = reinterpret_cast<color_d24s8*>(ds_data);
+        write_depth_stencil( ds_data, depth, ds->stencil() );
+    }
+
+	static void		write_stencil(void* ds_data, uint32_t stencil)
+    {
+        color_d24s8* ds = reinterpret_cast<color_d24s8*>(ds_data);
+        ds->ds = (ds->ds & 0xFFFFFF) | ( (stencil & 0xFF) << 24 );
+    }
+
+	static void 	write_depth_stencil(void* ds_data, float depth, uint32_t stencil)
+    {
+        *reinterpret_cast<color_d24s8*>(ds_data) = color_rgba32f( depth, static_cast<float>(stencil & 0xFF), 0.0f, 0.0f );
+    }
+
+	static float	quantize_depth(float depth)
+	{
+		color_d24s8 d = color_rgba32f(depth, 0.0f, 0.0f, 0.0f);
+		return d.depth();
+	}
+};
+
+template <> class depth_stencil_accessor<pixel_format_color_d32f>
+{
+public:
+	static float 	read_depth(void const* ds_data)
+    {
+        return reinterpret_cast<color_d32f const*>(ds_data)->d;
+    }
+
+	static uint32_t	read_stencil(void const* /*ds_data*/)
+    {
+        return 0;
+    }
+
+	static void 	read_depth_stencil(float& depth, uint32_t& stencil, void const* ds_data)
+    {
+        depth = read_depth(ds_data);
+        stencil = 0;
+    }
+
+	static void 	write_depth(void* ds_data, float depth)
+    {
+        reinterpret_cast<color_d32f*>(ds_data)->d = depth;
+    }
+
+	static void		write_stencil(void* /*ds_data*/, uint32_t /*stencil*/)
+    {
+    }
+
+	static void 	write_depth_stencil(void* ds_data, float depth, uint32_t /*stencil*/)
+    {
+        write_depth(ds_data, depth);
+    }
+
+	static float	quantize_depth(float depth)
+	{
+		return depth;
+	}
 };
 
 uint32_t mask_stencil_0(uint32_t /*stencil*/, uint32_t /*mask*/)
@@ -172,7 +310,7 @@ uint32_t sop_incr_sat(uint32_t /*ref*/, uint32_t cur_stencil){
 }
 
 uint32_t sop_decr_sat(uint32_t /*ref*/, uint32_t cur_stencil){
-	return std::max<uint32_t>(0, cur_stencil - 1);
+	return cur_stencil == 0 ? 0 : cur_stencil - 1;
 }
 
 uint32_t sop_invert(uint32_t /*ref*/, uint32_t cur_stencil){
@@ -351,9 +489,35 @@ bool depth_stencil_state::stencil_test(bool front_face, uint32_t ref, uint32_t c
 	return stencil_test_[!front_face](ref, cur_stencil);
 }
 
+// Operations are ordered by fail, pass and depth fail.
+static int stencil_operation_index(bool front_face, bool depth_pass, bool stencil_pass)
+{
+	return (!front_face) * 3 + ( stencil_pass ? (depth_pass ? 1 : 2) : 0 );
+}
+
 uint32_t depth_stencil_state::stencil_operation(bool front_face, bool depth_pass, bool stencil_pass, uint32_t ref, uint32_t cur_stencil) const
 {
-	return stencil_op_[(!front_face) * 3 + (!depth_pass) + static_cast<int>(stencil_pass)](ref, cur_stencil);
+	return stencil_op_[stencil_operation_index(front_face, depth_pass, stencil_pass)](ref, cur_stencil);
+}
+
+bool depth_stencil_state::stencil_writable(bool front_face, bool depth_pass, bool stencil_pass) const
+{
+	return stencil_op_[stencil_operation_index(front_face, depth_pass, stencil_pass)] != sop_keep;
+}
+
+blend_state::blend_state(blend_desc const& desc)
+	: desc_(desc)
+{
+}
+
+blend_desc const& blend_state::get_desc() const
+{
+	return desc_;
+}
+
+render_target_blend_desc const& blend_state::target_desc(size_t target_index) const
+{
+	return desc_.independent_blend_enable ? desc_.render_target[target_index] : desc_.render_target[0];
 }
 
 // frame buffer
@@ -407,221 +571,1608 @@ void write_depth_1_stencil_1(void* ds_data, float depth, uint32_t stencil, uint3
     depth_stencil_accessor<Format>::write_depth_stencil(ds_data, depth, stencil & stencil_mask);
 }
 
-void framebuffer::initialize(render_stages const* /*stages*/)
+typedef void  (*read_depth_stencil_fn)(float& depth, uint32_t& stencil, uint32_t stencil_mask, void const* ds_data);
+typedef void  (*write_depth_stencil_fn)(void* ds_data, float depth, uint32_t stencil, uint32_t stencil_mask);
+typedef float (*quantize_depth_fn)(float depth);
+
+template <uint32_t Format>
+read_depth_stencil_fn select_read_depth_stencil(bool read_depth, bool read_stencil)
 {
+	if(read_depth)
+	{
+		return read_stencil ? read_depth_1_stencil_1<Format> : read_depth_1_stencil_0<Format>;
+	}
+	return read_stencil ? read_depth_0_stencil_1<Format> : read_depth_0_stencil_0;
 }
 
-void framebuffer::update(render_state* state)
+template <uint32_t Format>
+write_depth_stencil_fn select_write_depth_stencil(bool write_depth, bool write_stencil)
 {
-    bool ds_state_changed = (ds_state_ != state->ds_state.get());
-    bool ds_format_changed = true;
-    if( ds_target_ != nullptr
-        && state->depth_stencil_target.get() != nullptr
-        && state->depth_stencil_target->get_pixel_format() == ds_target_->get_pixel_format()
-        )
-    {
-        ds_format_changed = false;
-    }
-
-	ds_state_	= state->ds_state.get();
-    stencil_read_mask_  = ds_state_->get_desc().stencil_read_mask;
-    stencil_write_mask_ = ds_state_->get_desc().stencil_write_mask;
-    stencil_ref_= ds_state_->mask_stencil(state->stencil_ref, stencil_read_mask_);
-    
-    assert(state->color_targets.size() <= MAX_RENDER_TARGETS);
-    memset( color_targets_, 0, sizeof(color_targets_) );
-    for(size_t i = 0; i < state->color_targets.size(); ++i)
-    {
-        color_targets_[i] = state->color_targets[i].get();
-    }
-
-    ds_target_ = state->depth_stencil_target.get();
-    sample_count_ = static_cast<uint32_t>(state->target_sample_count);
-	px_full_mask_ = (1UL << sample_count_) - 1;
-
-    bool output_depth_enabled = false;
-    if(!state->vx_shader)
-    {
-        if(state->cpp_ps && state->cpp_ps->output_depth())
-        {
-            output_depth_enabled = true;
-        }
-    }
-
-    update_ds_rw_functions(ds_format_changed, ds_state_changed, output_depth_enabled);
+	if(write_depth)
+	{
+		return write_stencil ? write_depth_1_stencil_1<Format> : write_depth_1_stencil_0<Format>;
+	}
+	return write_stencil ? write_depth_0_stencil_1<Format> : write_depth_0_stencil_0;
 }
 
-void framebuffer::update_ds_rw_functions(bool ds_format_changed, bool ds_state_changed, bool output_depth_enabled)
+static bool is_depth_stencil_format(pixel_format fmt)
 {
-    if(!ds_format_changed && !ds_state_changed)
-    {
-        return;
-    }
-
-    read_depth_stencil_  = read_depth_0_stencil_0; 
-    write_depth_stencil_ = write_depth_0_stencil_0;
-
-    if(ds_target_ == nullptr)
-    {
-        return;
-    }
-
-    bool read_depth = false;
-    bool read_stencil = false;
-    bool write_depth = false;
-    bool write_stencil = false;
-
-    switch(ds_target_->get_pixel_format())
-    {
-    case pixel_format_color_rg32f:
-        if(ds_state_->get_desc().depth_enable)
-        {
-            if( ds_state_->get_desc().depth_func != compare_function_never
-                && ds_state_->get_desc().depth_func != compare_function_always )
-            {
-                read_depth = true;
-            }
-
-            if(ds_state_->get_desc().depth_write_mask && ds_state_->get_desc().depth_func != compare_function_never)
-            {
-                write_depth = true;
-            }
-        }
-
-        read_stencil = write_stencil = ds_state_->get_desc().stencil_enable;
-
-        if(read_depth)
-        {
-            if(read_stencil)
-            {
-                read_depth_stencil_ = read_depth_1_stencil_1<pixel_format_color_rg32f>;
-            }
-            else
-            {
-                read_depth_stencil_ = read_depth_1_stencil_0<pixel_format_color_rg32f>;
-            }
-        }
-        else
-        {
-            if(read_stencil)
-            {
-                read_depth_stencil_ = read_depth_0_stencil_1<pixel_format_color_rg32f>;
-            }
-            else
-            {
-                read_depth_stencil_ = read_depth_0_stencil_0;
-            }
-        }
-        
-        if(write_depth)
-        {
-            if(write_stencil)
-            {
-                write_depth_stencil_ = write_depth_1_stencil_1<pixel_format_color_rg32f>;
-            }
-            else
-            {
-                write_depth_stencil_ = write_depth_1_stencil_0<pixel_format_color_rg32f>;
-            }
-        }
-        else
-        {
-            if(write_stencil)
-            {
-                write_depth_stencil_ = write_depth_0_stencil_1<pixel_format_color_rg32f>;
-            }
-            else
-            {
-                write_depth_stencil_ = write_depth_0_stencil_0;
-            }
-        }
-        break;
-    default:
-        return;
-    }
-
-    early_z_enabled_ = !ds_state_->get_desc().stencil_enable && !output_depth_enabled;
+	switch(fmt)
+	{
+	case pixel_format_color_rg32f:
+	case pixel_format_color_d16:
+	case pixel_format_color_d24s8:
+	case pixel_format_color_d32f:
+		return true;
+	default:
+		return false;
+	}
 }
 
-framebuffer::framebuffer()
+static read_depth_stencil_fn select_read_depth_stencil(pixel_format fmt, bool read_depth, bool read_stencil)
 {
-    for(size_t i = 0; i < MAX_RENDER_TARGETS; ++i)
-    {
-        color_targets_[i] = nullptr;
-    }
-
-    ds_target_ = nullptr;
-	ds_state_ = nullptr;
-	stencil_ref_ = 0;
-    stencil_read_mask_ = 0;
-    stencil_write_mask_ = 0;
-    
-	read_depth_stencil_ = nullptr;
-	write_depth_stencil_ = nullptr;
+	switch(fmt)
+	{
+	case pixel_format_color_rg32f:
+		return select_read_depth_stencil<pixel_format_color_rg32f>(read_depth, read_stencil);
+	case pixel_format_color_d16:
+		return select_read_depth_stencil<pixel_format_color_d16>(read_depth, read_stencil);
+	case pixel_format_color_d24s8:
+		return select_read_depth_stencil<pixel_format_color_d24s8>(read_depth, read_stencil);
+	case pixel_format_color_d32f:
+		return select_read_depth_stencil<pixel_format_color_d32f>(read_depth, read_stencil);
+	default:
+		return read_depth_0_stencil_0;
+	}
 }
 
-framebuffer::~framebuffer()
+static write_depth_stencil_fn select_write_depth_stencil(pixel_format fmt, bool write_depth, bool write_stencil)
 {
+	switch(fmt)
+	{
+	case pixel_format_color_rg32f:
+		return select_write_depth_stencil<pixel_format_color_rg32f>(write_depth, write_stencil);
+	case pixel_format_color_d16:
+		return select_write_depth_stencil<pixel_format_color_d16>(write_depth, write_stencil);
+	case pixel_format_color_d24s8:
+		return select_write_depth_stencil<pixel_format_color_d24s8>(write_depth, write_stencil);
+	case pixel_format_color_d32f:
+		return select_write_depth_stencil<pixel_format_color_d32f>(write_depth, write_stencil);
+	default:
+		return write_depth_0_stencil_0;
+	}
 }
 
-void framebuffer::render_sample(cpp_blend_shader* cpp_bs, size_t x, size_t y, size_t i_sample, const ps_output& ps, float depth, bool front_face)
+static float (*select_read_depth(pixel_format fmt))(void const* ds_data)
 {
-	EFLIB_ASSERT(cpp_bs, "Blend shader is null or invalid.");
-	if(!cpp_bs) return;
-
-	//composing output
-    pixel_accessor target_pixel(color_targets_, ds_target_);
-	target_pixel.set_pos(x, y);
-    
-	if(early_z_enabled_)
+	switch(fmt)
 	{
-		cpp_bs->execute(i_sample, target_pixel, ps);
-		return;
+	case pixel_format_color_rg32f:
+		return &depth_stencil_accessor<pixel_format_color_rg32f>::read_depth;
+	case pixel_format_color_d16:
+		return &depth_stencil_accessor<pixel_format_color_d16>::read_depth;
+	case pixel_format_color_d24s8:
+		return &depth_stencil_accessor<pixel_format_color_d24s8>::read_depth;
+	case pixel_format_color_d32f:
+		return &depth_stencil_accessor<pixel_format_color_d32f>::read_depth;
+	default:
+		return nullptr;
 	}
+}
 
-    void* ds_data = target_pixel.depth_stencil_address(i_sample);
-    float       old_depth;
-    uint32_t    old_stencil;
-    read_depth_stencil_(old_depth, old_stencil, stencil_read_mask_, ds_data);
-
-    bool depth_passed	= ds_state_->depth_test(depth, old_depth);
-    bool stencil_passed = ds_state_->stencil_test(front_face, stencil_ref_, old_stencil);
-
-	if (depth_passed && stencil_passed)
+static quantize_depth_fn select_quantize_depth(pixel_format fmt)
+{
+	switch(fmt)
 	{
-		int32_t new_stencil = ds_state_->stencil_operation(front_face, depth_passed, stencil_passed, stencil_ref_, old_stencil);
-		cpp_bs->execute(i_sample, target_pixel, ps);
-        write_depth_stencil_(ds_data, depth, new_stencil, stencil_write_mask_);
+	case pixel_format_color_d16:
+		return &depth_stencil_accessor<pixel_format_color_d16>::quantize_depth;
+	case pixel_format_color_d24s8:
+		return &depth_stencil_accessor<pixel_format_color_d24s8>::quantize_depth;
+	default:
+		return &depth_stencil_accessor<pixel_format_color_rg32f>::quantize_depth;
 	}
 }
 
-void framebuffer::render_sample_quad(cpp_blend_shader* cpp_bs, size_t x, size_t y, uint64_t sample_mask, ps_output const* quad, float const* depth, bool front_face, float const* aa_offset)
+// Quad early-z test
+//   Depth-stencil samples of rg32f are (depth, stencil bits) pairs. Samples of a pixel are contiguous,
+//   and the pixels of a quad row are neighbors, so a SSE register holds two samples.
+//   Depth is tested in even lanes and stencil in odd lanes, and masked stores keep the untouched half.
+//   Packed formats (D16, D24S8, D32F) hold one sample per lane, so a register holds four samples.
+//   Unsigned normalized depth is compared in integer units, which are exact in float.
+struct early_z_quad_context
 {
-	EFLIB_ASSERT(cpp_bs, "Blend shader is null or invalid.");
-	if(!cpp_bs) return;
+	void*				rows[2];
+	uint64_t			quad_mask;
+	float const*		depth;
+	float const*		aa_z_offset;
+	bool				write_depth;
+
+	uint32_t			stencil_ref;
+	uint32_t			stencil_read_mask;
+	uint32_t			stencil_write_mask;
+	compare_function	stencil_func;
+	stencil_op			stencil_fail_op;
+	stencil_op			stencil_depth_fail_op;
+	stencil_op			stencil_pass_op;
+
+	// Bounds of written depth, for widening Hi-Z.
+	float				min_z;
+	float				max_z;
+};
 
-	for(int i = 0; i < 4; ++i)
+#if !defined(EFLIB_NO_SIMD)
+namespace early_z_kernels
+{
+	EFLIB_ALIGN(16) static uint32_t const COVERAGE_LANES[4][4] =
 	{
-		size_t pixel_x = x + (i & 1);
-		size_t pixel_y = y + ( (i & 2) >> 1 );
+		{0x00000000, 0x00000000, 0x00000000, 0x00000000},
+		{0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0x00000000},
+		{0x00000000, 0x00000000, 0xFFFFFFFF, 0xFFFFFFFF},
+		{0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}
+	};
 
-		uint64_t px_sample_mask = sample_mask & SAMPLE_MASK;
-		sample_mask >>= MAX_SAMPLE_COUNT;
+	template <compare_function Func> __m128 compare_depth(__m128 lhs, __m128 rhs);
 
-		if(px_sample_mask == 0)
-		{
-			continue;
-		}
-			
+	template <> inline __m128 compare_depth<compare_function_never>(__m128 /*lhs*/, __m128 /*rhs*/)
+	{
+		return _mm_setzero_ps();
+	}
+
+	template <> inline __m128 compare_depth<compare_function_less>(__m128 lhs, __m128 rhs)
+	{
+		return _mm_cmplt_ps(lhs, rhs);
+	}
+
+	template <> inline __m128 compare_depth<compare_function_equal>(__m128 lhs, __m128 rhs)
+	{
+		return _mm_cmpeq_ps(lhs, rhs);
+	}
+
+	template <> inline __m128 compare_depth<compare_function_less_equal>(__m128 lhs, __m128 rhs)
+	{
+		return _mm_cmple_ps(lhs, rhs);
+	}
+
+	template <> inline __m128 compare_depth<compare_function_greater>(__m128 lhs, __m128 rhs)
+	{
+		return _mm_cmpgt_ps(lhs, rhs);
+	}
+
+	template <> inline __m128 compare_depth<compare_function_not_equal>(__m128 lhs, __m128 rhs)
+	{
+		return _mm_cmpneq_ps(lhs, rhs);
+	}
+
+	template <> inline __m128 compare_depth<compare_function_greater_equal>(__m128 lhs, __m128 rhs)
+	{
+		return _mm_cmpge_ps(lhs, rhs);
+	}
+
+	template <> inline __m128 compare_depth<compare_function_always>(__m128 /*lhs*/, __m128 /*rhs*/)
+	{
+		return _mm_castsi128_ps( _mm_set1_epi32(-1) );
+	}
+
+	// Stencil values are masked to 8 bits, so signed comparisons are correct.
+	inline __m128i compare_stencil(compare_function func, __m128i ref, __m128i cur)
+	{
+		__m128i const all = _mm_set1_epi32(-1);
+		switch(func)
+		{
+		case compare_function_never:
+			return _mm_setzero_si128();
+		case compare_function_less:
+			return _mm_cmplt_epi32(ref, cur);
+		case compare_function_equal:
+			return _mm_cmpeq_epi32(ref, cur);
+		case compare_function_less_equal:
+			return _mm_xor_si128(_mm_cmpgt_epi32(ref, cur), all);
+		case compare_function_greater:
+			return _mm_cmpgt_epi32(ref, cur);
+		case compare_function_not_equal:
+			return _mm_xor_si128(_mm_cmpeq_epi32(ref, cur), all);
+		case compare_function_greater_equal:
+			return _mm_xor_si128(_mm_cmplt_epi32(ref, cur), all);
+		default:
+			return all;
+		}
+	}
+
+	inline __m128i stencil_operation(stencil_op op, __m128i ref, __m128i cur)
+	{
+		__m128i const one	= _mm_set1_epi32(1);
+		__m128i const max	= _mm_set1_epi32(0xFF);
+		switch(op)
+		{
+		case stencil_op_zero:
+			return _mm_setzero_si128();
+		case stencil_op_replace:
+			return ref;
+		case stencil_op_incr_sat:
+			{
+				__m128i incr = _mm_add_epi32(cur, one);
+				__m128i saturated = _mm_cmpgt_epi32(incr, max);
+				return _mm_or_si128( _mm_and_si128(saturated, max), _mm_andnot_si128(saturated, incr) );
+			}
+		case stencil_op_decr_sat:
+			return _mm_andnot_si128( _mm_cmpeq_epi32( cur, _mm_setzero_si128() ), _mm_sub_epi32(cur, one) );
+		case stencil_op_invert:
+			return _mm_xor_si128( cur, _mm_set1_epi32(-1) );
+		case stencil_op_incr_wrap:
+			return _mm_and_si128( _mm_add_epi32(cur, one), max );
+		case stencil_op_decr_wrap:
+			return _mm_and_si128( _mm_sub_epi32(cur, one), max );
+		default:
+			return cur;
+		}
+	}
+
+	inline __m128i stencil_write_lanes(stencil_op op, __m128i lanes)
+	{
+		return op == stencil_op_keep ? _mm_setzero_si128() : lanes;
+	}
+
+	// Partially covered registers are loaded and stored through a buffer, and only texels of covered lanes
+	// are accessed. Uncovered pixel of a quad may be out of surface, or in the next row of linear storage,
+	// where it belongs to a tile of another thread.
+	inline void copy_covered_lanes(void* dst, void const* src, uint32_t covered, uint32_t lane_count, size_t lane_size)
+	{
+		for(uint32_t lane = 0; lane < lane_count; ++lane)
+		{
+			if( covered & (1UL << lane) )
+			{
+				memcpy( static_cast<uint8_t*>(dst) + lane * lane_size, static_cast<uint8_t const*>(src) + lane * lane_size, lane_size );
+			}
+		}
+	}
+
+	template <compare_function DepthFunc, uint32_t SampleCount, bool StencilEnable>
+	uint64_t test_quad(early_z_quad_context& ctx)
+	{
+		__m128 const depth_lanes = _mm_castsi128_ps( _mm_set_epi32(0, -1, 0, -1) );
+		__m128 const depth_write_lanes = ctx.write_depth ? depth_lanes : _mm_setzero_ps();
+
+		__m128i stencil_ref			= _mm_set1_epi32(ctx.stencil_ref);
+		__m128i stencil_read_mask	= _mm_set1_epi32(ctx.stencil_read_mask);
+		__m128i stencil_write_mask	= _mm_set1_epi32(ctx.stencil_write_mask);
+
+		uint64_t passed = 0;
+		ctx.min_z = std::numeric_limits<float>::max();
+		ctx.max_z = -std::numeric_limits<float>::max();
+
+		for(uint32_t row = 0; row < 2; ++row)
+		{
+			float* ds_data = static_cast<float*>(ctx.rows[row]);
+
+			for(uint32_t i_reg = 0; i_reg < SampleCount; ++i_reg)
+			{
+				// Register holds samples A and B of the row.
+				uint32_t const row_sample_a	= i_reg * 2;
+				uint32_t const row_sample_b	= row_sample_a + 1;
+				uint32_t const px_a			= row * 2 + row_sample_a / SampleCount;
+				uint32_t const px_b			= row * 2 + row_sample_b / SampleCount;
+				uint32_t const sample_a		= row_sample_a % SampleCount;
+				uint32_t const sample_b		= row_sample_b % SampleCount;
+				uint32_t const bit_a		= px_a * MAX_SAMPLE_COUNT + sample_a;
+				uint32_t const bit_b		= px_b * MAX_SAMPLE_COUNT + sample_b;
+
+				uint32_t covered =
+					  static_cast<uint32_t>( (ctx.quad_mask >> bit_a) & 1 )
+					| static_cast<uint32_t>( ( (ctx.quad_mask >> bit_b) & 1 ) << 1 );
+				if(covered == 0)
+				{
+					continue;
+				}
+
+				float depth_a = ctx.depth[px_a];
+				float depth_b = ctx.depth[px_b];
+				if(SampleCount > 1)
+				{
+					depth_a += ctx.aa_z_offset[sample_a];
+					depth_b += ctx.aa_z_offset[sample_b];
+				}
+
+				// Register holds (depth, stencil) texels of samples A and B.
+				float* reg_data = ds_data + i_reg * 4;
+				EFLIB_ALIGN(16) float texels[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+
+				__m128 new_ds		= _mm_set_ps(0.0f, depth_b, 0.0f, depth_a);
+				__m128 old_ds;
+				if(covered == 3)
+				{
+					old_ds = _mm_loadu_ps(reg_data);
+				}
+				else
+				{
+					copy_covered_lanes(texels, reg_data, covered, 2, sizeof(float) * 2);
+					old_ds = _mm_load_ps(texels);
+				}
+				__m128 cover_lanes	= _mm_load_ps( reinterpret_cast<float const*>(COVERAGE_LANES[covered]) );
+				__m128 depth_passed	= _mm_and_ps( compare_depth<DepthFunc>(new_ds, old_ds), cover_lanes );
+
+				__m128 passed_lanes;
+				__m128 result;
+				if(StencilEnable)
+				{
+					__m128i cur_stencil		= _mm_and_si128(_mm_castps_si128(old_ds), stencil_read_mask);
+					__m128i stencil_passed	= compare_stencil(ctx.stencil_func, stencil_ref, cur_stencil);
+					__m128i depth_passed_s	= _mm_castps_si128( _mm_shuffle_ps(depth_passed, depth_passed, _MM_SHUFFLE(2, 2, 0, 0)) );
+					__m128i cover_s			= _mm_castps_si128(cover_lanes);
+
+					__m128i fail_lanes		= _mm_andnot_si128(stencil_passed, cover_s);
+					__m128i depth_fail_lanes= _mm_andnot_si128(depth_passed_s, _mm_and_si128(stencil_passed, cover_s));
+					__m128i pass_lanes		= _mm_and_si128(depth_passed_s, _mm_and_si128(stencil_passed, cover_s));
+
+					__m128i new_stencil = _mm_or_si128(
+						_mm_or_si128(
+							_mm_and_si128( fail_lanes, stencil_operation(ctx.stencil_fail_op, stencil_ref, cur_stencil) ),
+							_mm_and_si128( depth_fail_lanes, stencil_operation(ctx.stencil_depth_fail_op, stencil_ref, cur_stencil) )
+							),
+						_mm_and_si128( pass_lanes, stencil_operation(ctx.stencil_pass_op, stencil_ref, cur_stencil) )
+						);
+					new_stencil = _mm_and_si128(new_stencil, stencil_write_mask);
+
+					__m128i stencil_lanes = _mm_or_si128(
+						_mm_or_si128(
+							stencil_write_lanes(ctx.stencil_fail_op, fail_lanes),
+							stencil_write_lanes(ctx.stencil_depth_fail_op, depth_fail_lanes)
+							),
+						stencil_write_lanes(ctx.stencil_pass_op, pass_lanes)
+						);
+					stencil_lanes = _mm_andnot_si128( _mm_castps_si128(depth_lanes), stencil_lanes );
+
+					__m128 pass_lanes_f = _mm_castsi128_ps(pass_lanes);
+					passed_lanes = _mm_and_ps( _mm_shuffle_ps(pass_lanes_f, pass_lanes_f, _MM_SHUFFLE(3, 3, 1, 1)), depth_lanes );
+
+					__m128 depth_written	= _mm_and_ps(passed_lanes, depth_write_lanes);
+					__m128 stencil_written	= _mm_castsi128_ps(stencil_lanes);
+					result = _mm_or_ps(
+						_mm_or_ps( _mm_and_ps(depth_written, new_ds), _mm_and_ps(stencil_written, _mm_castsi128_ps(new_stencil)) ),
+						_mm_andnot_ps( _mm_or_ps(depth_written, stencil_written), old_ds )
+						);
+				}
+				else
+				{
+					passed_lanes = _mm_and_ps(depth_passed, depth_lanes);
+
+					__m128 depth_written = _mm_and_ps(passed_lanes, depth_write_lanes);
+					result = _mm_or_ps( _mm_and_ps(depth_written, new_ds), _mm_andnot_ps(depth_written, old_ds) );
+				}
+
+				if(covered == 3)
+				{
+					_mm_storeu_ps(reg_data, result);
+				}
+				else
+				{
+					_mm_store_ps(texels, result);
+					copy_covered_lanes(reg_data, texels, covered, 2, sizeof(float) * 2);
+				}
+
+				int passed_bits = _mm_movemask_ps(passed_lanes);
+				if(passed_bits & 0x1)
+				{
+					passed |= 1ULL << bit_a;
+					ctx.min_z = std::min(ctx.min_z, depth_a);
+					ctx.max_z = std::max(ctx.max_z, depth_a);
+				}
+				if(passed_bits & 0x4)
+				{
+					passed |= 1ULL << bit_b;
+					ctx.min_z = std::min(ctx.min_z, depth_b);
+					ctx.max_z = std::max(ctx.max_z, depth_b);
+				}
+			}
+		}
+
+		return passed;
+	}
+
+	EFLIB_ALIGN(16) static uint32_t const SAMPLE_LANES[16][4] =
+	{
+		{0x00000000, 0x00000000, 0x00000000, 0x00000000},
+		{0xFFFFFFFF, 0x00000000, 0x00000000, 0x00000000},
+		{0x00000000, 0xFFFFFFFF, 0x00000000, 0x00000000},
+		{0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0x00000000},
+		{0x00000000, 0x00000000, 0xFFFFFFFF, 0x00000000},
+		{0xFFFFFFFF, 0x00000000, 0xFFFFFFFF, 0x00000000},
+		{0x00000000, 0xFFFFFFFF, 0xFFFFFFFF, 0x00000000},
+		{0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x00000000},
+		{0x00000000, 0x00000000, 0x00000000, 0xFFFFFFFF},
+		{0xFFFFFFFF, 0x00000000, 0x00000000, 0xFFFFFFFF},
+		{0x00000000, 0xFFFFFFFF, 0x00000000, 0xFFFFFFFF},
+		{0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0xFFFFFFFF},
+		{0x00000000, 0x00000000, 0xFFFFFFFF, 0xFFFFFFFF},
+		{0xFFFFFFFF, 0x00000000, 0xFFFFFFFF, 0xFFFFFFFF},
+		{0x00000000, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF},
+		{0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}
+	};
+
+	// Packed texels are loaded to and stored from 32-bit lanes. Only 2 or 4 texels are accessed at once.
+	template <uint32_t Format> struct packed_depth;
+
+	template <> struct packed_depth<pixel_format_color_d32f>
+	{
+		static uint32_t const TEXEL_SIZE = 4;
+
+		static __m128i load(void const* addr, uint32_t count)
+		{
+			return count == 4
+				? _mm_loadu_si128( static_cast<__m128i const*>(addr) )
+				: _mm_loadl_epi64( static_cast<__m128i const*>(addr) );
+		}
+
+		static void store(void* addr, __m128i texels, uint32_t count)
+		{
+			if(count == 4)
+			{
+				_mm_storeu_si128(static_cast<__m128i*>(addr), texels);
+			}
+			else
+			{
+				_mm_storel_epi64(static_cast<__m128i*>(addr), texels);
+			}
+		}
+
+		static __m128 depth(__m128i texels)
+		{
+			return _mm_castsi128_ps(texels);
+		}
+
+		static __m128i stencil(__m128i /*texels*/)
+		{
+			return _mm_setzero_si128();
+		}
+
+		static __m128 quantize(__m128 depth)
+		{
+			return depth;
+		}
+
+		static __m128i pack(__m128 depth, __m128i /*stencil*/)
+		{
+			return _mm_castps_si128(depth);
+		}
+
+		static float depth_scale()
+		{
+			return 1.0f;
+		}
+	};
+
+	template <> struct packed_depth<pixel_format_color_d24s8>
+	{
+		static uint32_t const TEXEL_SIZE = 4;
+
+		static __m128i load(void const* addr, uint32_t count)
+		{
+			return packed_depth<pixel_format_color_d32f>::load(addr, count);
+		}
+
+		static void store(void* addr, __m128i texels, uint32_t count)
+		{
+			packed_depth<pixel_format_color_d32f>::store(addr, texels, count);
+		}
+
+		static __m128 depth(__m128i texels)
+		{
+			return _mm_cvtepi32_ps( _mm_and_si128( texels, _mm_set1_epi32(0xFFFFFF) ) );
+		}
+
+		static __m128i stencil(__m128i texels)
+		{
+			return _mm_srli_epi32(texels, 24);
+		}
+
+		static __m128 quantize(__m128 depth)
+		{
+			depth = _mm_min_ps( _mm_max_ps( depth, _mm_setzero_ps() ), _mm_set_ps1(1.0f) );
+			return _mm_cvtepi32_ps( _mm_cvtps_epi32( _mm_mul_ps( depth, _mm_set_ps1(16777215.0f) ) ) );
+		}
+
+		static __m128i pack(__m128 depth, __m128i stencil)
+		{
+			return _mm_or_si128( _mm_cvtps_epi32(depth), _mm_slli_epi32(stencil, 24) );
+		}
+
+		static float depth_scale()
+		{
+			return 1.0f / 16777215;
+		}
+	};
+
+	template <> struct packed_depth<pixel_format_color_d16>
+	{
+		static uint32_t const TEXEL_SIZE = 2;
+
+		static __m128i load(void const* addr, uint32_t count)
+		{
+			__m128i texels;
+			if(count == 4)
+			{
+				texels = _mm_loadl_epi64( static_cast<__m128i const*>(addr) );
+			}
+			else
+			{
+				int32_t two_texels;
+				memcpy( &two_texels, addr, sizeof(two_texels) );
+				texels = _mm_cvtsi32_si128(two_texels);
+			}
+			return _mm_unpacklo_epi16( texels, _mm_setzero_si128() );
+		}
+
+		static void store(void* addr, __m128i texels, uint32_t count)
+		{
+			// Narrows to 16 bits with signed saturation, by biasing unsigned values to signed range.
+			__m128i const bias = _mm_set1_epi32(0x8000);
+			texels = _mm_packs_epi32( _mm_sub_epi32(texels, bias), _mm_sub_epi32(texels, bias) );
+			texels = _mm_add_epi16( texels, _mm_set1_epi16( static_cast<short>(0x8000) ) );
+			if(count == 4)
+			{
+				_mm_storel_epi64(static_cast<__m128i*>(addr), texels);
+			}
+			else
+			{
+				int32_t two_texels = _mm_cvtsi128_si32(texels);
+				memcpy( addr, &two_texels, sizeof(two_texels) );
+			}
+		}
+
+		static __m128 depth(__m128i texels)
+		{
+			return _mm_cvtepi32_ps(texels);
+		}
+
+		static __m128i stencil(__m128i /*texels*/)
+		{
+			return _mm_setzero_si128();
+		}
+
+		static __m128 quantize(__m128 depth)
+		{
+			depth = _mm_min_ps( _mm_max_ps( depth, _mm_setzero_ps() ), _mm_set_ps1(1.0f) );
+			return _mm_cvtepi32_ps( _mm_cvtps_epi32( _mm_mul_ps( depth, _mm_set_ps1(65535.0f) ) ) );
+		}
+
+		static __m128i pack(__m128 depth, __m128i /*stencil*/)
+		{
+			return _mm_cvtps_epi32(depth);
+		}
+
+		static float depth_scale()
+		{
+			return 1.0f / 65535;
+		}
+	};
+
+	// Samples of a quad row are tested in registers of four lanes, or two lanes if there is one sample per pixel.
+	template <uint32_t Format, compare_function DepthFunc, uint32_t SampleCount, bool StencilEnable>
+	uint64_t test_quad_packed(early_z_quad_context& ctx)
+	{
+		typedef packed_depth<Format> texel;
+
+		uint32_t const ROW_SAMPLES	= SampleCount * 2;
+		uint32_t const LANES		= ROW_SAMPLES < 4 ? ROW_SAMPLES : 4;
+		uint32_t const ALL_LANES	= (1UL << LANES) - 1;
+
+		__m128 const depth_write_lanes = ctx.write_depth ? _mm_castsi128_ps( _mm_set1_epi32(-1) ) : _mm_setzero_ps();
+
+		__m128i stencil_ref			= _mm_set1_epi32(ctx.stencil_ref);
+		__m128i stencil_read_mask	= _mm_set1_epi32(ctx.stencil_read_mask);
+		__m128i stencil_write_mask	= _mm_set1_epi32(ctx.stencil_write_mask);
+
+		uint64_t passed = 0;
+		ctx.min_z = std::numeric_limits<float>::max();
+		ctx.max_z = -std::numeric_limits<float>::max();
+
+		for(uint32_t row = 0; row < 2; ++row)
+		{
+			uint8_t* ds_data = static_cast<uint8_t*>(ctx.rows[row]);
+
+			for(uint32_t i_reg = 0; i_reg * LANES < ROW_SAMPLES; ++i_reg)
+			{
+				EFLIB_ALIGN(16) float depth[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+				uint32_t bits[4] = {0, 0, 0, 0};
+				uint32_t covered = 0;
+
+				for(uint32_t lane = 0; lane < LANES; ++lane)
+				{
+					uint32_t const row_sample	= i_reg * LANES + lane;
+					uint32_t const px			= row * 2 + row_sample / SampleCount;
+					uint32_t const sample		= row_sample % SampleCount;
+
+					bits[lane]	= px * MAX_SAMPLE_COUNT + sample;
+					depth[lane]	= ctx.depth[px];
+					if(SampleCount > 1)
+					{
+						depth[lane] += ctx.aa_z_offset[sample];
+					}
+					covered |= static_cast<uint32_t>( (ctx.quad_mask >> bits[lane]) & 1 ) << lane;
+				}
+
+				if(covered == 0)
+				{
+					continue;
+				}
+
+				void*	addr		= ds_data + i_reg * LANES * texel::TEXEL_SIZE;
+				EFLIB_ALIGN(16) uint8_t texels[16] = {0};
+				__m128i	old_texels;
+				if(covered == ALL_LANES)
+				{
+					old_texels = texel::load(addr, LANES);
+				}
+				else
+				{
+					copy_covered_lanes(texels, addr, covered, LANES, texel::TEXEL_SIZE);
+					old_texels = texel::load(texels, LANES);
+				}
+				__m128	old_depth	= texel::depth(old_texels);
+				__m128i	old_stencil	= texel::stencil(old_texels);
+				__m128	new_depth	= texel::quantize( _mm_load_ps(depth) );
+				__m128	cover_lanes	= _mm_load_ps( reinterpret_cast<float const*>(SAMPLE_LANES[covered]) );
+				__m128	depth_passed= _mm_and_ps( compare_depth<DepthFunc>(new_depth, old_depth), cover_lanes );
+
+				__m128	passed_lanes;
+				__m128i	stencil = old_stencil;
+				if(StencilEnable)
+				{
+					__m128i cur_stencil		= _mm_and_si128(old_stencil, stencil_read_mask);
+					__m128i stencil_passed	= compare_stencil(ctx.stencil_func, stencil_ref, cur_stencil);
+					__m128i depth_passed_s	= _mm_castps_si128(depth_passed);
+					__m128i cover_s			= _mm_castps_si128(cover_lanes);
+
+					__m128i fail_lanes		= _mm_andnot_si128(stencil_passed, cover_s);
+					__m128i depth_fail_lanes= _mm_andnot_si128(depth_passed_s, _mm_and_si128(stencil_passed, cover_s));
+					__m128i pass_lanes		= _mm_and_si128(depth_passed_s, stencil_passed);
+
+					__m128i new_stencil = _mm_or_si128(
+						_mm_or_si128(
+							_mm_and_si128( fail_lanes, stencil_operation(ctx.stencil_fail_op, stencil_ref, cur_stencil) ),
+							_mm_and_si128( depth_fail_lanes, stencil_operation(ctx.stencil_depth_fail_op, stencil_ref, cur_stencil) )
+							),
+						_mm_and_si128( pass_lanes, stencil_operation(ctx.stencil_pass_op, stencil_ref, cur_stencil) )
+						);
+					new_stencil = _mm_and_si128(new_stencil, stencil_write_mask);
+
+					__m128i stencil_lanes = _mm_or_si128(
+						_mm_or_si128(
+							stencil_write_lanes(ctx.stencil_fail_op, fail_lanes),
+							stencil_write_lanes(ctx.stencil_depth_fail_op, depth_fail_lanes)
+							),
+						stencil_write_lanes(ctx.stencil_pass_op, pass_lanes)
+						);
+
+					stencil = _mm_or_si128( _mm_and_si128(stencil_lanes, new_stencil), _mm_andnot_si128(stencil_lanes, old_stencil) );
+					passed_lanes = _mm_castsi128_ps(pass_lanes);
+				}
+				else
+				{
+					passed_lanes = depth_passed;
+				}
+
+				__m128 depth_written = _mm_and_ps(passed_lanes, depth_write_lanes);
+				__m128 result_depth  = _mm_or_ps( _mm_and_ps(depth_written, new_depth), _mm_andnot_ps(depth_written, old_depth) );
+				if(covered == ALL_LANES)
+				{
+					texel::store( addr, texel::pack(result_depth, stencil), LANES );
+				}
+				else
+				{
+					texel::store( texels, texel::pack(result_depth, stencil), LANES );
+					copy_covered_lanes(addr, texels, covered, LANES, texel::TEXEL_SIZE);
+				}
+
+				int passed_bits = _mm_movemask_ps(passed_lanes);
+				if(passed_bits != 0)
+				{
+					// Bounds are of stored depth, so Hi-Z is consistent with surface.
+					EFLIB_ALIGN(16) float stored_depth[4];
+					_mm_store_ps( stored_depth, _mm_mul_ps( new_depth, _mm_set_ps1( texel::depth_scale() ) ) );
+
+					for(uint32_t lane = 0; lane < LANES; ++lane)
+					{
+						if( passed_bits & (1 << lane) )
+						{
+							passed |= 1ULL << bits[lane];
+							ctx.min_z = std::min(ctx.min_z, stored_depth[lane]);
+							ctx.max_z = std::max(ctx.max_z, stored_depth[lane]);
+						}
+					}
+				}
+			}
+		}
+
+		return passed;
+	}
+
+	typedef uint64_t (*test_quad_fn)(early_z_quad_context& ctx);
+
+	// Kernels of depth stencil format.
+	template <uint32_t Format>
+	struct quad_kernels
+	{
+		template <compare_function DepthFunc, uint32_t SampleCount, bool StencilEnable>
+		static uint64_t test(early_z_quad_context& ctx)
+		{
+			return test_quad_packed<Format, DepthFunc, SampleCount, StencilEnable>(ctx);
+		}
+	};
+
+	template <>
+	struct quad_kernels<pixel_format_color_rg32f>
+	{
+		template <compare_function DepthFunc, uint32_t SampleCount, bool StencilEnable>
+		static uint64_t test(early_z_quad_context& ctx)
+		{
+			return test_quad<DepthFunc, SampleCount, StencilEnable>(ctx);
+		}
+	};
+
+	template <uint32_t Format, compare_function DepthFunc, bool StencilEnable>
+	test_quad_fn select_test_quad(uint32_t sample_count)
+	{
+		switch(sample_count)
+		{
+		case 1:
+			return &quad_kernels<Format>::template test<DepthFunc, 1, StencilEnable>;
+		case 2:
+			return &quad_kernels<Format>::template test<DepthFunc, 2, StencilEnable>;
+		case 4:
+			return &quad_kernels<Format>::template test<DepthFunc, 4, StencilEnable>;
+		case 8:
+			return &quad_kernels<Format>::template test<DepthFunc, 8, StencilEnable>;
+		case 16:
+			return &quad_kernels<Format>::template test<DepthFunc, 16, StencilEnable>;
+		default:
+			return nullptr;
+		}
+	}
+
+	template <uint32_t Format, bool StencilEnable>
+	test_quad_fn select_test_quad(compare_function depth_func, uint32_t sample_count)
+	{
+		switch(depth_func)
+		{
+		case compare_function_never:
+			return select_test_quad<Format, compare_function_never, StencilEnable>(sample_count);
+		case compare_function_less:
+			return select_test_quad<Format, compare_function_less, StencilEnable>(sample_count);
+		case compare_function_equal:
+			return select_test_quad<Format, compare_function_equal, StencilEnable>(sample_count);
+		case compare_function_less_equal:
+			return select_test_quad<Format, compare_function_less_equal, StencilEnable>(sample_count);
+		case compare_function_greater:
+			return select_test_quad<Format, compare_function_greater, StencilEnable>(sample_count);
+		case compare_function_not_equal:
+			return select_test_quad<Format, compare_function_not_equal, StencilEnable>(sample_count);
+		case compare_function_greater_equal:
+			return select_test_quad<Format, compare_function_greater_equal, StencilEnable>(sample_count);
+		default:
+			return select_test_quad<Format, compare_function_always, StencilEnable>(sample_count);
+		}
+	}
+
+	template <bool StencilEnable>
+	test_quad_fn select_test_quad(pixel_format fmt, compare_function depth_func, uint32_t sample_count)
+	{
+		switch(fmt)
+		{
+		case pixel_format_color_rg32f:
+			return select_test_quad<pixel_format_color_rg32f, StencilEnable>(depth_func, sample_count);
+		case pixel_format_color_d16:
+			return select_test_quad<pixel_format_color_d16, StencilEnable>(depth_func, sample_count);
+		case pixel_format_color_d24s8:
+			return select_test_quad<pixel_format_color_d24s8, StencilEnable>(depth_func, sample_count);
+		case pixel_format_color_d32f:
+			return select_test_quad<pixel_format_color_d32f, StencilEnable>(depth_func, sample_count);
+		default:
+			return nullptr;
+		}
+	}
+}
+#endif
+
+// Fixed-function blending
+//   Kernels blend a quad to one render target. Color of a sample is held in one SSE register,
+//   and the common formats are loaded and stored without going through pixel convertors.
+struct blend_quad_context
+{
+	surface*						target;
+	uint32_t						target_index;
+	render_target_blend_desc const*	desc;
+	size_t							x;
+	size_t							y;
+	uint64_t						quad_mask;
+	uint32_t						full_mask;		// Mask of all samples of a pixel.
+	ps_output const*				pixels[4];
+};
+
+enum blend_mode
+{
+	blend_mode_replace,		// Blending is disabled, or source is blended by (one, zero).
+	blend_mode_alpha,		// Source and dest are blended by (src_alpha, inv_src_alpha) with addition.
+	blend_mode_generic
+};
+
+static blend_mode classify_blend(render_target_blend_desc const& desc)
+{
+	if(!desc.blend_enable)
+	{
+		return blend_mode_replace;
+	}
+
+	if(    desc.src_blend == blend_one && desc.dest_blend == blend_zero && desc.blend_op_color == blend_op_add
+		&& desc.src_blend_alpha == blend_one && desc.dest_blend_alpha == blend_zero && desc.blend_op_alpha == blend_op_add )
+	{
+		return blend_mode_replace;
+	}
+
+	if(    desc.src_blend == blend_src_alpha && desc.dest_blend == blend_inv_src_alpha && desc.blend_op_color == blend_op_add
+		&& desc.src_blend_alpha == blend_src_alpha && desc.dest_blend_alpha == blend_inv_src_alpha && desc.blend_op_alpha == blend_op_add )
+	{
+		return blend_mode_alpha;
+	}
+
+	return blend_mode_generic;
+}
+
+namespace blend_kernels
+{
+	typedef void (*blend_quad_fn)(blend_quad_context const& ctx);
+
+	// Scalar kernel for formats without specialization. Texels are converted by surface.
+	static float blend_factor_value(blend_factor factor, float const* src, float const* dst, int channel)
+	{
+		switch(factor)
+		{
+		case blend_zero:
+			return 0.0f;
+		case blend_src_color:
+			return src[channel];
+		case blend_inv_src_color:
+			return 1.0f - src[channel];
+		case blend_src_alpha:
+			return src[3];
+		case blend_inv_src_alpha:
+			return 1.0f - src[3];
+		case blend_dest_alpha:
+			return dst[3];
+		case blend_inv_dest_alpha:
+			return 1.0f - dst[3];
+		case blend_dest_color:
+			return dst[channel];
+		case blend_inv_dest_color:
+			return 1.0f - dst[channel];
+		case blend_src_alpha_sat:
+			return channel == 3 ? 1.0f : std::min(src[3], 1.0f - dst[3]);
+		default:
+			return 1.0f;
+		}
+	}
+
+	static float blend_channel(render_target_blend_desc const& desc, float const* src, float const* dst, int channel)
+	{
+		bool const is_alpha = (channel == 3);
+		blend_op const op = is_alpha ? desc.blend_op_alpha : desc.blend_op_color;
+		float const s = src[channel] * blend_factor_value(is_alpha ? desc.src_blend_alpha : desc.src_blend, src, dst, channel);
+		float const d = dst[channel] * blend_factor_value(is_alpha ? desc.dest_blend_alpha : desc.dest_blend, src, dst, channel);
+
+		switch(op)
+		{
+		case blend_op_subtract:
+			return s - d;
+		case blend_op_rev_subtract:
+			return d - s;
+		case blend_op_min:
+			return std::min(src[channel], dst[channel]);
+		case blend_op_max:
+			return std::max(src[channel], dst[channel]);
+		default:
+			return s + d;
+		}
+	}
+
+	void blend_quad_any_format(blend_quad_context const& ctx)
+	{
+		render_target_blend_desc const& desc = *ctx.desc;
+		bool const blend_enabled = (classify_blend(desc) != blend_mode_replace);
+
+		for(int i = 0; i < 4; ++i)
+		{
+			uint32_t px_mask = static_cast<uint32_t>( (ctx.quad_mask >> (MAX_SAMPLE_COUNT * i)) & SAMPLE_MASK );
+			size_t const px = ctx.x + (i & 1);
+			size_t const py = ctx.y + (i >> 1);
+			float const* src = &(ctx.pixels[i]->color[ctx.target_index][0]);
+
+			uint32_t i_samp;
+			while ( _xmm_bsf(&i_samp, px_mask) )
+			{
+				color_rgba32f dst_color = ctx.target->get_texel(px, py, i_samp);
+				float const* dst = &dst_color.r;
+
+				float result[4];
+				for(int channel = 0; channel < 4; ++channel)
+				{
+					if( (desc.write_mask & (1UL << channel)) == 0 )
+					{
+						result[channel] = dst[channel];
+					}
+					else
+					{
+						result[channel] = blend_enabled ? blend_channel(desc, src, dst, channel) : src[channel];
+					}
+				}
+
+				ctx.target->set_texel( px, py, i_samp, color_rgba32f(result[0], result[1], result[2], result[3]) );
+				px_mask &= px_mask - 1;
+			}
+		}
+	}
+
+#if !defined(EFLIB_NO_SIMD)
+	EFLIB_ALIGN(16) static uint32_t const WRITE_MASK_LANES[16][4] =
+	{
+		{0x00000000, 0x00000000, 0x00000000, 0x00000000},
+		{0xFFFFFFFF, 0x00000000, 0x00000000, 0x00000000},
+		{0x00000000, 0xFFFFFFFF, 0x00000000, 0x00000000},
+		{0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0x00000000},
+		{0x00000000, 0x00000000, 0xFFFFFFFF, 0x00000000},
+		{0xFFFFFFFF, 0x00000000, 0xFFFFFFFF, 0x00000000},
+		{0x00000000, 0xFFFFFFFF, 0xFFFFFFFF, 0x00000000},
+		{0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0x00000000},
+		{0x00000000, 0x00000000, 0x00000000, 0xFFFFFFFF},
+		{0xFFFFFFFF, 0x00000000, 0x00000000, 0xFFFFFFFF},
+		{0x00000000, 0xFFFFFFFF, 0x00000000, 0xFFFFFFFF},
+		{0xFFFFFFFF, 0xFFFFFFFF, 0x00000000, 0xFFFFFFFF},
+		{0x00000000, 0x00000000, 0xFFFFFFFF, 0xFFFFFFFF},
+		{0xFFFFFFFF, 0x00000000, 0xFFFFFFFF, 0xFFFFFFFF},
+		{0x00000000, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF},
+		{0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF, 0xFFFFFFFF}
+	};
+
+	// Texel is unpacked to and packed from (r, g, b, a) in register.
+	// Conversions are the same as color_rgba8 and color_bgra8.
+	template <pixel_format Fmt> struct blend_texel;
+
+	template <> struct blend_texel<pixel_format_color_rgba32f>
+	{
+		typedef __m128 packed_type;
+
+		static __m128 unpack(void const* addr)
+		{
+			return _mm_loadu_ps( static_cast<float const*>(addr) );
+		}
+
+		static packed_type pack(__m128 color)
+		{
+			return color;
+		}
+
+		static void store(void* addr, packed_type texel)
+		{
+			_mm_storeu_ps(static_cast<float*>(addr), texel);
+		}
+	};
+
+	inline __m128 unpack_unorm8(void const* addr)
+	{
+		int32_t texel;
+		memcpy(&texel, addr, sizeof(texel));
+		__m128i const zero = _mm_setzero_si128();
+		__m128i channels = _mm_unpacklo_epi16( _mm_unpacklo_epi8(_mm_cvtsi32_si128(texel), zero), zero );
+		return _mm_mul_ps( _mm_cvtepi32_ps(channels), _mm_set_ps1(1.0f / 255) );
+	}
+
+	inline uint32_t pack_unorm8(__m128 color)
+	{
+		__m128 const f255 = _mm_set_ps1(255.0f);
+		color = _mm_min_ps( _mm_max_ps( _mm_mul_ps(color, f255), _mm_setzero_ps() ), f255 );
+		__m128i channels = _mm_cvtps_epi32(color);
+		channels = _mm_packs_epi32(channels, channels);
+		channels = _mm_packus_epi16(channels, channels);
+		return static_cast<uint32_t>( _mm_cvtsi128_si32(channels) );
+	}
+
+	template <> struct blend_texel<pixel_format_color_rgba8>
+	{
+		typedef uint32_t packed_type;
+
+		static __m128 unpack(void const* addr)
+		{
+			return unpack_unorm8(addr);
+		}
+
+		static packed_type pack(__m128 color)
+		{
+			return pack_unorm8(color);
+		}
+
+		static void store(void* addr, packed_type texel)
+		{
+			memcpy(addr, &texel, sizeof(texel));
+		}
+	};
+
+	template <> struct blend_texel<pixel_format_color_bgra8>
+	{
+		typedef uint32_t packed_type;
+
+		static __m128 unpack(void const* addr)
+		{
+			__m128 bgra = unpack_unorm8(addr);
+			return _mm_shuffle_ps(bgra, bgra, _MM_SHUFFLE(3, 0, 1, 2));
+		}
+
+		static packed_type pack(__m128 color)
+		{
+			return pack_unorm8( _mm_shuffle_ps(color, color, _MM_SHUFFLE(3, 0, 1, 2)) );
+		}
+
+		static void store(void* addr, packed_type texel)
+		{
+			memcpy(addr, &texel, sizeof(texel));
+		}
+	};
+
+	inline __m128 splat_alpha(__m128 color)
+	{
+		return _mm_shuffle_ps(color, color, _MM_SHUFFLE(3, 3, 3, 3));
+	}
+
+	inline __m128 blend_factor_value(blend_factor factor, __m128 src, __m128 dst)
+	{
+		__m128 const one = _mm_set_ps1(1.0f);
+		switch(factor)
+		{
+		case blend_zero:
+			return _mm_setzero_ps();
+		case blend_src_color:
+			return src;
+		case blend_inv_src_color:
+			return _mm_sub_ps(one, src);
+		case blend_src_alpha:
+			return splat_alpha(src);
+		case blend_inv_src_alpha:
+			return _mm_sub_ps( one, splat_alpha(src) );
+		case blend_dest_alpha:
+			return splat_alpha(dst);
+		case blend_inv_dest_alpha:
+			return _mm_sub_ps( one, splat_alpha(dst) );
+		case blend_dest_color:
+			return dst;
+		case blend_inv_dest_color:
+			return _mm_sub_ps(one, dst);
+		case blend_src_alpha_sat:
+			{
+				// (f, f, f, 1)
+				__m128 f = _mm_min_ps( splat_alpha(src), _mm_sub_ps(one, splat_alpha(dst)) );
+				__m128 rgb_lanes = _mm_load_ps( reinterpret_cast<float const*>(WRITE_MASK_LANES[color_write_enable_red | color_write_enable_green | color_write_enable_blue]) );
+				return _mm_or_ps( _mm_and_ps(rgb_lanes, f), _mm_andnot_ps(rgb_lanes, one) );
+			}
+		default:
+			return one;
+		}
+	}
+
+	inline __m128 blend_operation(blend_op op, __m128 src, __m128 src_factor, __m128 dst, __m128 dst_factor)
+	{
+		switch(op)
+		{
+		case blend_op_subtract:
+			return _mm_sub_ps( _mm_mul_ps(src, src_factor), _mm_mul_ps(dst, dst_factor) );
+		case blend_op_rev_subtract:
+			return _mm_sub_ps( _mm_mul_ps(dst, dst_factor), _mm_mul_ps(src, src_factor) );
+		case blend_op_min:
+			return _mm_min_ps(src, dst);
+		case blend_op_max:
+			return _mm_max_ps(src, dst);
+		default:
+			return _mm_add_ps( _mm_mul_ps(src, src_factor), _mm_mul_ps(dst, dst_factor) );
+		}
+	}
+
+	template <blend_mode Mode>
+	__m128 blend(render_target_blend_desc const& desc, __m128 src, __m128 dst);
+
+	template <>
+	inline __m128 blend<blend_mode_replace>(render_target_blend_desc const& /*desc*/, __m128 src, __m128 /*dst*/)
+	{
+		return src;
+	}
+
+	template <>
+	inline __m128 blend<blend_mode_alpha>(render_target_blend_desc const& /*desc*/, __m128 src, __m128 dst)
+	{
+		__m128 alpha = splat_alpha(src);
+		return _mm_add_ps( _mm_mul_ps(src, alpha), _mm_mul_ps( dst, _mm_sub_ps(_mm_set_ps1(1.0f), alpha) ) );
+	}
+
+	template <>
+	inline __m128 blend<blend_mode_generic>(render_target_blend_desc const& desc, __m128 src, __m128 dst)
+	{
+		__m128 color = blend_operation(
+			desc.blend_op_color,
+			src, blend_factor_value(desc.src_blend, src, dst),
+			dst, blend_factor_value(desc.dest_blend, src, dst)
+			);
+		__m128 alpha = blend_operation(
+			desc.blend_op_alpha,
+			src, blend_factor_value(desc.src_blend_alpha, src, dst),
+			dst, blend_factor_value(desc.dest_blend_alpha, src, dst)
+			);
+
+		// (color.r, color.g, color.b, alpha.a)
+		__m128 ba = _mm_shuffle_ps(color, alpha, _MM_SHUFFLE(3, 3, 2, 2));
+		return _mm_shuffle_ps(color, ba, _MM_SHUFFLE(3, 0, 1, 0));
+	}
+
+	template <pixel_format Fmt, blend_mode Mode>
+	void blend_quad(blend_quad_context const& ctx)
+	{
+		typedef blend_texel<Fmt> texel;
+
+		render_target_blend_desc const& desc = *ctx.desc;
+		uint32_t const write_mask = desc.write_mask & color_write_enable_all;
+		__m128 const write_lanes = _mm_load_ps( reinterpret_cast<float const*>(WRITE_MASK_LANES[write_mask]) );
+		size_t const texel_size = color_infos[Fmt].size;
+
+		for(int i = 0; i < 4; ++i)
+		{
+			uint32_t px_mask = static_cast<uint32_t>( (ctx.quad_mask >> (MAX_SAMPLE_COUNT * i)) & SAMPLE_MASK );
+			if(px_mask == 0)
+			{
+				continue;
+			}
+
+			size_t const px = ctx.x + (i & 1);
+			size_t const py = ctx.y + (i >> 1);
+			__m128 src = _mm_loadu_ps( &(ctx.pixels[i]->color[ctx.target_index][0]) );
+
+			// Fully covered pixel keeps a compressed pixel uniform, or makes it uniform if all channels are replaced.
+			// Its representative sample is blended once.
+			if( px_mask == ctx.full_mask && ctx.target->compressed()
+				&& ( (Mode == blend_mode_replace && write_mask == color_write_enable_all) || ctx.target->pixel_uniform(px, py) )
+				)
+			{
+				void* addr = ctx.target->uniform_texel_address(px, py);
+				__m128 dst = texel::unpack(addr);
+				__m128 result = blend<Mode>(desc, src, dst);
+				result = _mm_or_ps( _mm_and_ps(write_lanes, result), _mm_andnot_ps(write_lanes, dst) );
+				texel::store( addr, texel::pack(result) );
+				continue;
+			}
+
+			// Samples of a pixel are contiguous.
+			uint8_t* px_data = static_cast<uint8_t*>( ctx.target->texel_address(px, py, 0) );
+
+			uint32_t i_samp;
+			if(Mode == blend_mode_replace && write_mask == color_write_enable_all)
+			{
+				// Same texel is written to all covered samples.
+				typename texel::packed_type packed = texel::pack(src);
+				while ( _xmm_bsf(&i_samp, px_mask) )
+				{
+					texel::store(px_data + i_samp * texel_size, packed);
+					px_mask &= px_mask - 1;
+				}
+				continue;
+			}
+
+			while ( _xmm_bsf(&i_samp, px_mask) )
+			{
+				void* addr = px_data + i_samp * texel_size;
+				__m128 dst = texel::unpack(addr);
+				__m128 result = blend<Mode>(desc, src, dst);
+				result = _mm_or_ps( _mm_and_ps(write_lanes, result), _mm_andnot_ps(write_lanes, dst) );
+				texel::store( addr, texel::pack(result) );
+				px_mask &= px_mask - 1;
+			}
+		}
+	}
+
+	template <pixel_format Fmt>
+	void store_color(void* addr, float const* color)
+	{
+		blend_texel<Fmt>::store( addr, blend_texel<Fmt>::pack( _mm_loadu_ps(color) ) );
+	}
+
+	template <pixel_format Fmt>
+	blend_quad_fn select_blend_quad(blend_mode mode)
+	{
+		switch(mode)
+		{
+		case blend_mode_replace:
+			return blend_quad<Fmt, blend_mode_replace>;
+		case blend_mode_alpha:
+			return blend_quad<Fmt, blend_mode_alpha>;
+		default:
+			return blend_quad<Fmt, blend_mode_generic>;
+		}
+	}
+#endif
+
+	// Colors of render target are read and written directly by blending shader.
+	void read_target_color(surface* target, size_t x, size_t y, size_t sample, float* color)
+	{
+#if !defined(EFLIB_NO_SIMD)
+		switch( target->get_pixel_format() )
+		{
+		case pixel_format_color_rgba32f:
+			_mm_storeu_ps( color, blend_texel<pixel_format_color_rgba32f>::unpack( target->texel_address(x, y, sample) ) );
+			return;
+		case pixel_format_color_rgba8:
+			_mm_storeu_ps( color, blend_texel<pixel_format_color_rgba8>::unpack( target->texel_address(x, y, sample) ) );
+			return;
+		case pixel_format_color_bgra8:
+			_mm_storeu_ps( color, blend_texel<pixel_format_color_bgra8>::unpack( target->texel_address(x, y, sample) ) );
+			return;
+		default:
+			break;
+		}
+#endif
+		color_rgba32f texel = target->get_texel(x, y, sample);
+		memcpy( color, &texel.r, sizeof(color_rgba32f) );
+	}
+
+	void write_target_color(surface* target, size_t x, size_t y, size_t sample, float const* color)
+	{
+#if !defined(EFLIB_NO_SIMD)
+		switch( target->get_pixel_format() )
+		{
+		case pixel_format_color_rgba32f:
+			store_color<pixel_format_color_rgba32f>( target->texel_address(x, y, sample), color );
+			return;
+		case pixel_format_color_rgba8:
+			store_color<pixel_format_color_rgba8>( target->texel_address(x, y, sample), color );
+			return;
+		case pixel_format_color_bgra8:
+			store_color<pixel_format_color_bgra8>( target->texel_address(x, y, sample), color );
+			return;
+		default:
+			break;
+		}
+#endif
+		target->set_texel( x, y, sample, color_rgba32f(color[0], color[1], color[2], color[3]) );
+	}
+
+	blend_quad_fn select_blend_quad(pixel_format fmt, blend_mode mode)
+	{
+#if !defined(EFLIB_NO_SIMD)
+		switch(fmt)
+		{
+		case pixel_format_color_rgba32f:
+			return select_blend_quad<pixel_format_color_rgba32f>(mode);
+		case pixel_format_color_rgba8:
+			return select_blend_quad<pixel_format_color_rgba8>(mode);
+		case pixel_format_color_bgra8:
+			return select_blend_quad<pixel_format_color_bgra8>(mode);
+		default:
+			break;
+		}
+#else
+		EFLIB_UNREF_DECLARATOR(fmt);
+		EFLIB_UNREF_DECLARATOR(mode);
+#endif
+		return blend_quad_any_format;
+	}
+}
+
+void framebuffer::initialize(render_stages const* /*stages*/)
+{
+}
+
+void framebuffer::update(render_state* state)
+{
+    bool ds_state_changed = (ds_state_ != state->ds_state.get());
+    bool ds_format_changed = true;
+    if( ds_target_ != nullptr
+        && state->depth_stencil_target.get() != nullptr
+        && state->depth_stencil_target->get_pixel_format() == ds_target_->get_pixel_format()
+        )
+    {
+        ds_format_changed = false;
+    }
+
+	ds_state_	= state->ds_state.get();
+    stencil_read_mask_  = ds_state_->get_desc().stencil_read_mask;
+    stencil_write_mask_ = ds_state_->get_desc().stencil_write_mask;
+    stencil_ref_= ds_state_->mask_stencil(state->stencil_ref, stencil_read_mask_);
+    
+    assert(state->color_targets.size() <= MAX_RENDER_TARGETS);
+    memset( color_targets_, 0, sizeof(color_targets_) );
+    for(size_t i = 0; i < state->color_targets.size(); ++i)
+    {
+        color_targets_[i] = state->color_targets[i].get();
+    }
+
+    ds_target_ = state->depth_stencil_target.get();
+    sample_count_ = static_cast<uint32_t>(state->target_sample_count);
+	px_full_mask_ = (1UL << sample_count_) - 1;
+
+	// Only color is compressed. Early-z reads samples of depth from storage directly.
+	for(size_t i = 0; i < state->color_targets.size(); ++i)
+	{
+		if(color_targets_[i] != nullptr)
+		{
+			color_targets_[i]->set_compression(state->options.msaa_compression);
+		}
+	}
+	if(ds_target_ != nullptr)
+	{
+		ds_target_->set_compression(false);
+	}
+
+    bool output_depth_enabled = false;
+    if(!state->vx_shader)
+    {
+        if(state->cpp_ps && state->cpp_ps->output_depth())
+        {
+            output_depth_enabled = true;
+        }
+    }
+
+    update_ds_rw_functions(ds_format_changed, ds_state_changed);
+
+	// Depth and stencil are tested before shading unless pixel shader outputs depth.
+	early_z_enabled_ =
+		ds_target_ != nullptr && is_depth_stencil_format( ds_target_->get_pixel_format() )
+		&& !output_depth_enabled;
+	update_early_z_quad();
+	update_hiz(state->depth_stencil_target, output_depth_enabled);
+
+	blend_state_ = state->bl_state.get();
+	update_blend_quads();
+}
+
+void framebuffer::update_ds_rw_functions(bool ds_format_changed, bool ds_state_changed)
+{
+    if(!ds_format_changed && !ds_state_changed)
+    {
+        return;
+    }
+
+    read_depth_stencil_  = read_depth_0_stencil_0; 
+    write_depth_stencil_ = write_depth_0_stencil_0;
+    write_depth_         = write_depth_0_stencil_0;
+    write_stencil_       = write_depth_0_stencil_0;
+    quantize_depth_      = select_quantize_depth(pixel_format_color_rg32f);
+
+    if(ds_target_ == nullptr)
+    {
+        return;
+    }
+
+    pixel_format fmt = ds_target_->get_pixel_format();
+    if( !is_depth_stencil_format(fmt) )
+    {
+        return;
+    }
+
+    bool read_depth = false;
+    bool write_depth = false;
+
+    if(ds_state_->get_desc().depth_enable)
+    {
+        if( ds_state_->get_desc().depth_func != compare_function_never
+            && ds_state_->get_desc().depth_func != compare_function_always )
+        {
+            read_depth = true;
+        }
+
+        if(ds_state_->get_desc().depth_write_mask && ds_state_->get_desc().depth_func != compare_function_never)
+        {
+            write_depth = true;
+        }
+    }
+
+    bool read_stencil = ds_state_->get_desc().stencil_enable;
+    bool write_stencil = read_stencil;
+
+    read_depth_stencil_  = select_read_depth_stencil(fmt, read_depth, read_stencil);
+    write_depth_stencil_ = select_write_depth_stencil(fmt, write_depth, write_stencil);
+    write_depth_         = select_write_depth_stencil(fmt, write_depth, false);
+    write_stencil_       = select_write_depth_stencil(fmt, false, write_stencil);
+    quantize_depth_      = select_quantize_depth(fmt);
+}
+
+void framebuffer::update_early_z_quad()
+{
+	early_z_quad_ = nullptr;
+	early_z_write_depth_ = false;
+
+	if( ds_target_ == nullptr || !is_depth_stencil_format( ds_target_->get_pixel_format() ) )
+	{
+		return;
+	}
+
+	depth_stencil_desc const& desc = ds_state_->get_desc();
+	early_z_write_depth_ = desc.depth_enable && desc.depth_write_mask && desc.depth_func != compare_function_never;
+
+#if !defined(EFLIB_NO_SIMD)
+	compare_function depth_func = desc.depth_enable ? desc.depth_func : compare_function_always;
+	if(desc.stencil_enable)
+	{
+		early_z_quad_ = early_z_kernels::select_test_quad<true>(ds_target_->get_pixel_format(), depth_func, sample_count_);
+	}
+	else
+	{
+		early_z_quad_ = early_z_kernels::select_test_quad<false>(ds_target_->get_pixel_format(), depth_func, sample_count_);
+	}
+#endif
+}
+
+void framebuffer::update_blend_quads()
+{
+	for(size_t i = 0; i < MAX_RENDER_TARGETS; ++i)
+	{
+		blend_quads_[i] = nullptr;
+
+		surface* target = color_targets_[i];
+		if(target == nullptr || blend_state_ == nullptr)
+		{
+			continue;
+		}
+
+		render_target_blend_desc const& desc = blend_state_->target_desc(i);
+		if( (desc.write_mask & color_write_enable_all) == 0 )
+		{
+			continue;
+		}
+
+		blend_quads_[i] = blend_kernels::select_blend_quad( target->get_pixel_format(), classify_blend(desc) );
+	}
+}
+
+bool framebuffer::blend_replaces() const
+{
+	if(blend_state_ == nullptr)
+	{
+		return true;
+	}
+
+	for(size_t i = 0; i < MAX_RENDER_TARGETS; ++i)
+	{
+		if( color_targets_[i] != nullptr && classify_blend( blend_state_->target_desc(i) ) != blend_mode_replace )
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+void framebuffer::blend_quad(size_t x, size_t y, uint64_t quad_mask, ps_output const* const* pixels)
+{
+	blend_quad_context ctx;
+	ctx.x = x;
+	ctx.y = y;
+	ctx.quad_mask = quad_mask;
+	ctx.full_mask = px_full_mask_;
+	for(int i = 0; i < 4; ++i)
+	{
+		ctx.pixels[i] = pixels[i];
+	}
+
+	for(uint32_t i = 0; i < MAX_RENDER_TARGETS; ++i)
+	{
+		if(blend_quads_[i] == nullptr)
+		{
+			continue;
+		}
+
+		ctx.target = color_targets_[i];
+		ctx.target_index = i;
+		ctx.desc = &blend_state_->target_desc(i);
+		blend_quads_[i](ctx);
+	}
+}
+
+framebuffer::framebuffer()
+{
+    for(size_t i = 0; i < MAX_RENDER_TARGETS; ++i)
+    {
+        color_targets_[i] = nullptr;
+    }
+
+    ds_target_ = nullptr;
+	ds_state_ = nullptr;
+	stencil_ref_ = 0;
+    stencil_read_mask_ = 0;
+    stencil_write_mask_ = 0;
+	early_z_enabled_ = false;
+    
+	read_depth_stencil_ = nullptr;
+	write_depth_stencil_ = nullptr;
+	write_depth_ = nullptr;
+	write_stencil_ = nullptr;
+	quantize_depth_ = select_quantize_depth(pixel_format_color_rg32f);
+	early_z_quad_ = nullptr;
+	early_z_write_depth_ = false;
+
+	blend_state_ = nullptr;
+	for(size_t i = 0; i < MAX_RENDER_TARGETS; ++i)
+	{
+		blend_quads_[i] = nullptr;
+	}
+
+	hiz_enabled_ = false;
+	hiz_write_ = false;
+	hiz_depth_func_ = compare_function_always;
+	hiz_tile_x_count_ = 0;
+	hiz_subtile_x_count_ = 0;
+	hiz_read_depth_ = nullptr;
+	hiz_quantize_depth_ = select_quantize_depth(pixel_format_color_rg32f);
+}
+
+framebuffer::~framebuffer()
+{
+}
+
+void framebuffer::render_sample(cpp_blend_shader* cpp_bs, blend_shader_unit* bs_unit, size_t x, size_t y, size_t i_sample, const ps_output& ps, float depth, bool front_face)
+{
+	if(early_z_enabled_)
+	{
+		blend_sample(cpp_bs, bs_unit, x, y, i_sample, ps);
+		return;
+	}
+
+	//composing output
+    pixel_accessor target_pixel(color_targets_, ds_target_);
+	target_pixel.set_pos(x, y);
+
+    void* ds_data = target_pixel.depth_stencil_address(i_sample);
+    float       old_depth;
+    uint32_t    old_stencil;
+    read_depth_stencil_(old_depth, old_stencil, stencil_read_mask_, ds_data);
+
+    // Depth is compared at the precision of target.
+    depth = quantize_depth_(depth);
+    bool depth_passed	= ds_state_->depth_test(depth, old_depth);
+    bool stencil_passed = ds_state_->stencil_test(front_face, stencil_ref_, old_stencil);
+
+	if (depth_passed && stencil_passed)
+	{
+		int32_t new_stencil = ds_state_->stencil_operation(front_face, depth_passed, stencil_passed, stencil_ref_, old_stencil);
+		blend_sample(cpp_bs, bs_unit, x, y, i_sample, ps);
+        write_depth_stencil_(ds_data, depth, new_stencil, stencil_write_mask_);
+		if(hiz_write_)
+		{
+			widen_hiz(x, y, depth);
+		}
+	}
+}
+
+void framebuffer::render_sample_quad(cpp_blend_shader* cpp_bs, blend_shader_unit* bs_unit, size_t x, size_t y, uint64_t sample_mask, ps_output const* quad, float const* depth, bool front_face, float const* aa_offset)
+{
+	if(early_z_enabled_)
+	{
+		// Samples in mask have passed early-z, only blending is left.
+		blend_sample_quad(cpp_bs, bs_unit, x, y, sample_mask, quad);
+		return;
+	}
+
+	for(int i = 0; i < 4; ++i)
+	{
+		size_t pixel_x = x + (i & 1);
+		size_t pixel_y = y + ( (i & 2) >> 1 );
+
+		uint64_t px_sample_mask = sample_mask & SAMPLE_MASK;
+		sample_mask >>= MAX_SAMPLE_COUNT;
+
+		if(px_sample_mask == 0)
+		{
+			continue;
+		}
+			
 		if(sample_count_ == 1)
 		{
-			render_sample(cpp_bs, pixel_x, pixel_y, 0, quad[i], depth[i], front_face);
+			render_sample(cpp_bs, bs_unit, pixel_x, pixel_y, 0, quad[i], depth[i], front_face);
 		}
 		else if(px_sample_mask == px_full_mask_)
 		{
 			for(uint32_t i_samp = 0; i_samp < sample_count_; ++i_samp)
 			{
-				render_sample(cpp_bs, pixel_x, pixel_y, i_samp, quad[i], depth[i]+aa_offset[i_samp], front_face);
+				render_sample(cpp_bs, bs_unit, pixel_x, pixel_y, i_samp, quad[i], depth[i]+aa_offset[i_samp], front_face);
 			}
 		}
 		else
@@ -629,66 +2180,198 @@ void framebuffer::render_sample_quad(cpp_blend_shader* cpp_bs, size_t x, size_t
 			uint32_t i_samp;
 			while ( _xmm_bsf(&i_samp, (uint32_t)px_sample_mask) )
 			{
-				render_sample(cpp_bs, pixel_x, pixel_y, i_samp, quad[i], depth[i]+aa_offset[i_samp], front_face);
+				render_sample(cpp_bs, bs_unit, pixel_x, pixel_y, i_samp, quad[i], depth[i]+aa_offset[i_samp], front_face);
 				px_sample_mask &= px_sample_mask - 1;
 			}
 		}
 	}
 }
 
-uint64_t framebuffer::early_z_test(size_t x, size_t y, float depth, float const* aa_z_offset)
+void framebuffer::blend_sample(cpp_blend_shader* cpp_bs, blend_shader_unit* bs_unit, size_t x, size_t y, size_t i_sample, ps_output const& ps)
+{
+	if(cpp_bs)
+	{
+		pixel_accessor target_pixel(color_targets_, ds_target_);
+		target_pixel.set_pos(x, y);
+		cpp_bs->execute(i_sample, target_pixel, ps);
+		return;
+	}
+
+	// Sample is blended as the only covered one of its quad.
+	size_t const i_pixel = (y & 1) * 2 + (x & 1);
+	ps_output const* pixels[4] = { &ps, &ps, &ps, &ps };
+	uint64_t const quad_mask = uint64_t(1) << (i_pixel * MAX_SAMPLE_COUNT + i_sample);
+	if(bs_unit)
+	{
+		blend_quad_shader(bs_unit, x & ~size_t(1), y & ~size_t(1), quad_mask, pixels);
+		return;
+	}
+	blend_quad(x & ~size_t(1), y & ~size_t(1), quad_mask, pixels);
+}
+
+void framebuffer::blend_sample_quad(cpp_blend_shader* cpp_bs, blend_shader_unit* bs_unit, size_t x, size_t y, uint64_t quad_mask, ps_output const* quad)
+{
+	if(cpp_bs)
+	{
+		uint32_t slot;
+		while ( _xmm_bsf(&slot, quad_mask) )
+		{
+			uint32_t const i = slot / MAX_SAMPLE_COUNT;
+			blend_sample(cpp_bs, bs_unit, x + (i & 1), y + (i >> 1), slot % MAX_SAMPLE_COUNT, quad[i]);
+			quad_mask &= quad_mask - 1;
+		}
+		return;
+	}
+
+	ps_output const* pixels[4] = { quad + 0, quad + 1, quad + 2, quad + 3 };
+	if(bs_unit)
+	{
+		blend_quad_shader(bs_unit, x, y, quad_mask, pixels);
+		return;
+	}
+	blend_quad(x, y, quad_mask, pixels);
+}
+
+void framebuffer::blend_quad_shader(blend_shader_unit* bs_unit, size_t x, size_t y, uint64_t quad_mask, ps_output const* const* pixels)
+{
+	uint32_t px_masks[4];
+	uint32_t samples_mask = 0;
+	for(int i = 0; i < 4; ++i)
+	{
+		px_masks[i] = static_cast<uint32_t>( (quad_mask >> (MAX_SAMPLE_COUNT * i)) & SAMPLE_MASK );
+		samples_mask |= px_masks[i];
+	}
+
+	// Shader is executed on the quad once per sample index.
+	// Destination colors are loaded into shader inputs only for covered pixels.
+	ps_output results[4];
+	uint32_t i_samp;
+	while ( _xmm_bsf(&i_samp, samples_mask) )
+	{
+		uint32_t const samp_bit = 1UL << i_samp;
+
+		uint32_t target_index;
+		uint32_t targets = bs_unit->dest_target_mask();
+		while ( _xmm_bsf(&target_index, targets) )
+		{
+			surface* target = color_targets_[target_index];
+			for(int i = 0; i < 4; ++i)
+			{
+				if( target != nullptr && (px_masks[i] & samp_bit) )
+				{
+					blend_kernels::read_target_color( target, x + (i & 1), y + (i >> 1), i_samp, bs_unit->dest_color(i, target_index) );
+				}
+			}
+			targets &= targets - 1;
+		}
+
+		bs_unit->execute(pixels, results);
+
+		targets = bs_unit->output_target_mask();
+		while ( _xmm_bsf(&target_index, targets) )
+		{
+			surface* target = color_targets_[target_index];
+			for(int i = 0; i < 4; ++i)
+			{
+				if( target != nullptr && (px_masks[i] & samp_bit) )
+				{
+					blend_kernels::write_target_color( target, x + (i & 1), y + (i >> 1), i_samp, &(results[i].color[target_index][0]) );
+				}
+			}
+			targets &= targets - 1;
+		}
+
+		samples_mask &= samples_mask - 1;
+	}
+}
+
+bool framebuffer::early_z_test_sample(pixel_accessor& target_pixel, size_t x, size_t y, size_t i_sample, float depth, bool front_face)
+{
+	void* ds_data = target_pixel.depth_stencil_address(i_sample);
+	float       old_depth;
+	uint32_t    old_stencil;
+	read_depth_stencil_(old_depth, old_stencil, stencil_read_mask_, ds_data);
+
+	depth = quantize_depth_(depth);
+	bool depth_passed	= ds_state_->depth_test(depth, old_depth);
+	bool stencil_passed = ds_state_->stencil_test(front_face, stencil_ref_, old_stencil);
+
+	uint32_t new_stencil = 0;
+	bool stencil_written = ds_state_->stencil_writable(front_face, depth_passed, stencil_passed);
+	if(stencil_written)
+	{
+		new_stencil = ds_state_->stencil_operation(front_face, depth_passed, stencil_passed, stencil_ref_, old_stencil);
+	}
+
+	if(depth_passed && stencil_passed)
+	{
+		if(stencil_written)
+		{
+			write_depth_stencil_(ds_data, depth, new_stencil, stencil_write_mask_);
+		}
+		else
+		{
+			write_depth_(ds_data, depth, 0, 0);
+		}
+
+		if(hiz_write_)
+		{
+			widen_hiz(x, y, depth);
+		}
+		return true;
+	}
+
+	if(stencil_written)
+	{
+		write_stencil_(ds_data, 0.0f, new_stencil, stencil_write_mask_);
+	}
+	return false;
+}
+
+uint64_t framebuffer::early_z_test(size_t x, size_t y, float depth, float const* aa_z_offset, bool front_face)
 {
     pixel_accessor target_pixel(color_targets_, ds_target_);
 	target_pixel.set_pos(x, y);
     
 	if(sample_count_ == 1)
 	{
-		void* ds_data = target_pixel.depth_stencil_address(0);
-        float       old_depth;
-        uint32_t    old_stencil;
-        read_depth_stencil_(old_depth, old_stencil, stencil_read_mask_, ds_data);
-        if( ds_state_->depth_test(depth, old_depth) )
-		{
-			assert( !ds_state_->get_desc().stencil_enable );
-			write_depth_stencil_(ds_data, depth, 0, 0);
-			return 1;
-		}
-		return 0;
+		return early_z_test_sample(target_pixel, x, y, 0, depth, front_face) ? 1 : 0;
 	}
 
 	uint64_t mask = 0;
     for(size_t i = 0; i < sample_count_; ++i)
     {
-        void* ds_data = target_pixel.depth_stencil_address(i);
-        float       old_depth;
-        uint32_t    old_stencil;
-        read_depth_stencil_(old_depth, old_stencil, stencil_read_mask_, ds_data);
-		float new_depth = aa_z_offset[i] + depth;
-		bool depth_test_passed = ds_state_->depth_test(new_depth, old_depth);
-        mask |= ( depth_test_passed ? 1 : 0 ) << i;
-		if(depth_test_passed)
-		{
-			write_depth_stencil_(ds_data, new_depth, 0, 0);
-		}
+		bool passed = early_z_test_sample(target_pixel, x, y, i, aa_z_offset[i] + depth, front_face);
+        mask |= ( passed ? 1ULL : 0ULL ) << i;
     }
 
     return mask;
 }
 
-uint64_t framebuffer::early_z_test_quad(size_t x, size_t y, float const* depth, float const* aa_z_offset)
+uint64_t framebuffer::early_z_test_quad(size_t x, size_t y, float const* depth, float const* aa_z_offset, bool front_face)
 {
+	if(early_z_quad_ != nullptr)
+	{
+		uint64_t quad_full_mask =
+			( static_cast<uint64_t>(px_full_mask_) << (MAX_SAMPLE_COUNT * 0) ) |
+			( static_cast<uint64_t>(px_full_mask_) << (MAX_SAMPLE_COUNT * 1) ) |
+			( static_cast<uint64_t>(px_full_mask_) << (MAX_SAMPLE_COUNT * 2) ) |
+			( static_cast<uint64_t>(px_full_mask_) << (MAX_SAMPLE_COUNT * 3) );
+		return early_z_test_quad(x, y, quad_full_mask, depth, aa_z_offset, front_face);
+	}
+
 	return 
-		( early_z_test(x+0, y+0, depth[0], aa_z_offset) << (MAX_SAMPLE_COUNT * 0) ) |
-		( early_z_test(x+1, y+0, depth[1], aa_z_offset) << (MAX_SAMPLE_COUNT * 1) )	|
-		( early_z_test(x+0, y+1, depth[2], aa_z_offset) << (MAX_SAMPLE_COUNT * 2) )	|
-		( early_z_test(x+1, y+1, depth[3], aa_z_offset) << (MAX_SAMPLE_COUNT * 3) );
+		( early_z_test(x+0, y+0, depth[0], aa_z_offset, front_face) << (MAX_SAMPLE_COUNT * 0) ) |
+		( early_z_test(x+1, y+0, depth[1], aa_z_offset, front_face) << (MAX_SAMPLE_COUNT * 1) )	|
+		( early_z_test(x+0, y+1, depth[2], aa_z_offset, front_face) << (MAX_SAMPLE_COUNT * 2) )	|
+		( early_z_test(x+1, y+1, depth[3], aa_z_offset, front_face) << (MAX_SAMPLE_COUNT * 3) );
 }
 
-uint64_t framebuffer::early_z_test(size_t x, size_t y, uint32_t px_mask, float depth, float const* aa_z_offset)
+uint64_t framebuffer::early_z_test(size_t x, size_t y, uint32_t px_mask, float depth, float const* aa_z_offset, bool front_face)
 {
 	if(px_mask == px_full_mask_)
 	{
-		return early_z_test(x, y, depth, aa_z_offset);
+		return early_z_test(x, y, depth, aa_z_offset, front_face);
 	}
 
 	pixel_accessor target_pixel(color_targets_, ds_target_);
@@ -698,85 +2381,336 @@ uint64_t framebuffer::early_z_test(size_t x, size_t y, uint32_t px_mask, float d
 	uint32_t i_samp;
 	while ( _xmm_bsf(&i_samp, (uint32_t)px_mask) )
 	{
-		void* ds_data = target_pixel.depth_stencil_address(i_samp);
-		float       old_depth;
-		uint32_t    old_stencil;
-		read_depth_stencil_(old_depth, old_stencil, stencil_read_mask_, ds_data);
-		float new_depth = aa_z_offset[i_samp] + depth;
-		bool depth_test_passed = ds_state_->depth_test(new_depth, old_depth);
-        mask |= ( depth_test_passed ? 1 : 0 ) << i_samp;
-		if(depth_test_passed)
-		{
-			write_depth_stencil_(ds_data, new_depth, 0, 0);
-		}
+		bool passed = early_z_test_sample(target_pixel, x, y, i_samp, aa_z_offset[i_samp] + depth, front_face);
+        mask |= ( passed ? 1ULL : 0ULL ) << i_samp;
+		px_mask &= px_mask - 1;
 	}
 
 	return mask;
 }
 
-uint64_t framebuffer::early_z_test_quad(size_t x, size_t y, uint64_t quad_mask, float const* depth, float const* aa_z_offset)
+uint64_t framebuffer::early_z_test_quad(size_t x, size_t y, uint64_t quad_mask, float const* depth, float const* aa_z_offset, bool front_face)
 {
+	if(early_z_quad_ != nullptr)
+	{
+		// Quads are aligned to 2 pixels, so both pixels of a quad row are contiguous in surface.
+		// Row without coverage may be out of surface, so its address is not taken.
+		depth_stencil_desc const& desc = ds_state_->get_desc();
+		depth_stencil_op_desc const& face = front_face ? desc.front_face : desc.back_face;
+
+		uint64_t const row_mask		= (1ULL << (MAX_SAMPLE_COUNT * 2)) - 1;
+
+		early_z_quad_context ctx;
+		ctx.rows[0]					= (quad_mask & row_mask) ? ds_target_->texel_address(x, y + 0, 0) : nullptr;
+		ctx.rows[1]					= ( (quad_mask >> (MAX_SAMPLE_COUNT * 2)) & row_mask ) ? ds_target_->texel_address(x, y + 1, 0) : nullptr;
+		ctx.quad_mask				= quad_mask;
+		ctx.depth					= depth;
+		ctx.aa_z_offset				= aa_z_offset;
+		ctx.write_depth				= early_z_write_depth_;
+		ctx.stencil_ref				= stencil_ref_;
+		ctx.stencil_read_mask		= stencil_read_mask_;
+		ctx.stencil_write_mask		= stencil_write_mask_;
+		ctx.stencil_func			= face.stencil_func;
+		ctx.stencil_fail_op			= face.stencil_fail_op;
+		ctx.stencil_depth_fail_op	= face.stencil_depth_fail_op;
+		ctx.stencil_pass_op			= face.stencil_pass_op;
+
+		uint64_t mask = early_z_quad_(ctx);
+		if( hiz_write_ && ctx.write_depth && ctx.min_z <= ctx.max_z )
+		{
+			widen_hiz(x, y, ctx.min_z);
+			widen_hiz(x, y, ctx.max_z);
+		}
+		return mask;
+	}
+
 	uint32_t px_mask;
 	
 	uint64_t mask = 0;
 	px_mask = static_cast<uint32_t>( ( quad_mask >> (MAX_SAMPLE_COUNT * 0) ) & SAMPLE_MASK );
-	mask |= ( px_mask == 0 ? 0 : early_z_test(x+0, y+0, px_mask, depth[0], aa_z_offset) ) << (MAX_SAMPLE_COUNT * 0);
+	mask |= ( px_mask == 0 ? 0 : early_z_test(x+0, y+0, px_mask, depth[0], aa_z_offset, front_face) ) << (MAX_SAMPLE_COUNT * 0);
 
 	px_mask = static_cast<uint32_t>( ( quad_mask >> (MAX_SAMPLE_COUNT * 1) ) & SAMPLE_MASK );
-	mask |= ( px_mask == 0 ? 0 : early_z_test(x+1, y+0, px_mask, depth[1], aa_z_offset) ) << (MAX_SAMPLE_COUNT * 1);
+	mask |= ( px_mask == 0 ? 0 : early_z_test(x+1, y+0, px_mask, depth[1], aa_z_offset, front_face) ) << (MAX_SAMPLE_COUNT * 1);
 
 	px_mask = static_cast<uint32_t>( ( quad_mask >> (MAX_SAMPLE_COUNT * 2) ) & SAMPLE_MASK );
-	mask |= ( px_mask == 0 ? 0 : early_z_test(x+0, y+1, px_mask, depth[2], aa_z_offset) ) << (MAX_SAMPLE_COUNT * 2);
+	mask |= ( px_mask == 0 ? 0 : early_z_test(x+0, y+1, px_mask, depth[2], aa_z_offset, front_face) ) << (MAX_SAMPLE_COUNT * 2);
 
 	px_mask = static_cast<uint32_t>( ( quad_mask >> (MAX_SAMPLE_COUNT * 3) ) & SAMPLE_MASK );
-	mask |= ( px_mask == 0 ? 0 : early_z_test(x+1, y+1, px_mask, depth[3], aa_z_offset) ) << (MAX_SAMPLE_COUNT * 3);
+	mask |= ( px_mask == 0 ? 0 : early_z_test(x+1, y+1, px_mask, depth[3], aa_z_offset, front_face) ) << (MAX_SAMPLE_COUNT * 3);
 
 	return mask;
 }
 
 void framebuffer::clear_depth_stencil(surface* tar, uint32_t flag, float depth, uint32_t stencil)
 {
-	auto clear_op = write_depth_0_stencil_0;
+	pixel_format fmt = tar->get_pixel_format();
+	if( !is_depth_stencil_format(fmt) )
+	{
+		EFLIB_ASSERT_UNIMPLEMENTED();
+		return;
+	}
 
-	switch(tar->get_pixel_format())
-    {
-    case pixel_format_color_rg32f:
+	auto clear_op = select_write_depth_stencil( fmt, (flag & clear_depth) != 0, (flag & clear_stencil) != 0 );
+
+	// Texels are filled directly if all channels of format are cleared.
+	bool has_stencil = (fmt == pixel_format_color_rg32f || fmt == pixel_format_color_d24s8);
+	bool fill_all = (flag & clear_depth) && ( !has_stencil || (flag & clear_stencil) );
+
+	if(fill_all && fmt == pixel_format_color_rg32f)
+	{
+		union
+		{
+			float stencil_f;
+			uint32_t stencil_u;
+		};
+		stencil_u = stencil;
+		tar->fill_texels( color_rgba32f(depth, stencil_f, 0.0f, 0.0f) );
+	}
+	else if(fill_all)
+	{
+		tar->fill_texels( color_rgba32f( depth, static_cast<float>(stencil & 0xFF), 0.0f, 0.0f ) );
+	}
+	else
+	{
+		size_t const width			= static_cast<size_t>( tar->width() );
+		size_t const height			= static_cast<size_t>( tar->height() );
+		size_t const sample_count	= static_cast<size_t>( tar->sample_count() );
+		for(size_t y = 0; y < height; ++y)
 		{
-			switch(flag)
+			for(size_t x = 0; x < width; ++x)
 			{
-			case (clear_depth | clear_stencil):
-				clear_op = write_depth_1_stencil_1<pixel_format_color_rg32f>;
-				break;
-			case clear_depth:
-				clear_op = write_depth_1_stencil_0<pixel_format_color_rg32f>;
-				break;
-			case clear_stencil:
-				clear_op = write_depth_0_stencil_1<pixel_format_color_rg32f>;
-				break;
-			default:
-				EFLIB_ASSERT_UNIMPLEMENTED();
+				for(size_t sample = 0; sample < sample_count; ++sample)
+				{
+					clear_op(tar->texel_address(x, y, sample), depth, stencil, 0xFFFFFFFFU);
+				}
 			}
-			break;
 		}
+	}
+
+	// All depth of cleared target is same, so the bounds are exact.
+	if( (flag & clear_depth) && tar == hiz_target_.get() )
+	{
+		depth = select_quantize_depth(fmt)(depth);
+		std::fill( hiz_tiles_.begin(), hiz_tiles_.end(), vec2(depth, depth) );
+		std::fill( hiz_subtiles_.begin(), hiz_subtiles_.end(), vec2(depth, depth) );
+		std::fill( hiz_subtiles_dirty_.begin(), hiz_subtiles_dirty_.end(), 0 );
+	}
+}
+
+void framebuffer::update_hiz(surface_ptr const& ds_target, bool output_depth_enabled)
+{
+	hiz_enabled_ = false;
+	hiz_write_ = false;
+
+	if(!ds_target)
+	{
+		return;
+	}
+
+	hiz_read_depth_ = select_read_depth( ds_target->get_pixel_format() );
+	if(hiz_read_depth_ == nullptr)
+	{
+		hiz_target_.reset();
+		return;
+	}
+	hiz_quantize_depth_ = select_quantize_depth( ds_target->get_pixel_format() );
+
+	// Bounds are reset only if target was switched, and they are computed when tiles are refreshed.
+	if(ds_target != hiz_target_)
+	{
+		hiz_target_ = ds_target;
+		reset_hiz();
+	}
+
+	depth_stencil_desc const& desc = ds_state_->get_desc();
+	hiz_depth_func_ = desc.depth_func;
+	hiz_write_ = desc.depth_enable && desc.depth_write_mask && desc.depth_func != compare_function_never;
+
+	if(!early_z_enabled_ || output_depth_enabled || !desc.depth_enable)
+	{
+		return;
+	}
+
+	// Rejected pixels must not need stencil operations of failed tests.
+	if( desc.stencil_enable && (
+		   desc.front_face.stencil_fail_op != stencil_op_keep || desc.front_face.stencil_depth_fail_op != stencil_op_keep
+		|| desc.back_face.stencil_fail_op  != stencil_op_keep || desc.back_face.stencil_depth_fail_op  != stencil_op_keep) )
+	{
+		return;
+	}
+
+	switch(hiz_depth_func_)
+	{
+	case compare_function_less:
+	case compare_function_less_equal:
+	case compare_function_greater:
+	case compare_function_greater_equal:
+	case compare_function_equal:
+		hiz_enabled_ = true;
+		break;
+	default:
+		break;
+	}
+}
+
+// Bounds of all tiles are unknown, and an unknown range never rejects anything.
+// Sub-tiles are dirty, so they are read from surface by the first refresh of their tiles.
+void framebuffer::reset_hiz()
+{
+	size_t width  = static_cast<size_t>( hiz_target_->width() );
+	size_t height = static_cast<size_t>( hiz_target_->height() );
+
+	hiz_tile_x_count_		= (width + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE;
+	hiz_subtile_x_count_	= (width + HIZ_SUBTILE_SIZE - 1) / HIZ_SUBTILE_SIZE;
+
+	size_t tile_y_count		= (height + HIZ_TILE_SIZE - 1) / HIZ_TILE_SIZE;
+	size_t subtile_y_count	= (height + HIZ_SUBTILE_SIZE - 1) / HIZ_SUBTILE_SIZE;
+
+	vec2 const unknown_range( -std::numeric_limits<float>::max(), std::numeric_limits<float>::max() );
+	hiz_tiles_.assign(hiz_tile_x_count_ * tile_y_count, unknown_range);
+	hiz_subtiles_.assign(hiz_subtile_x_count_ * subtile_y_count, unknown_range);
+	hiz_subtiles_dirty_.assign(hiz_subtiles_.size(), 1);
+}
+
+void framebuffer::compute_hiz_subtile(size_t subtile_x, size_t subtile_y)
+{
+	size_t const left	= subtile_x * HIZ_SUBTILE_SIZE;
+	size_t const top	= subtile_y * HIZ_SUBTILE_SIZE;
+	size_t const right	= std::min<size_t>( left + HIZ_SUBTILE_SIZE, hiz_target_->width() );
+	size_t const bottom	= std::min<size_t>( top  + HIZ_SUBTILE_SIZE, hiz_target_->height() );
+	size_t const sample_count = hiz_target_->sample_count();
+
+	float min_z = std::numeric_limits<float>::max();
+	float max_z = -std::numeric_limits<float>::max();
+
+	// Reads through const surface, so cleared tiles are not filled.
+	surface const& ds = *hiz_target_;
+	for(size_t y = top; y < bottom; ++y)
+	{
+		for(size_t x = left; x < right; ++x)
+		{
+			for(size_t i_sample = 0; i_sample < sample_count; ++i_sample)
+			{
+				float z = hiz_read_depth_( ds.texel_address(x, y, i_sample) );
+				min_z = std::min(min_z, z);
+				max_z = std::max(max_z, z);
+			}
+		}
+	}
+
+	size_t subtile_index = subtile_y * hiz_subtile_x_count_ + subtile_x;
+	hiz_subtiles_[subtile_index] = vec2(min_z, max_z);
+	hiz_subtiles_dirty_[subtile_index] = 0;
+}
+
+void framebuffer::hiz_refresh_tile(size_t x, size_t y, size_t size)
+{
+	if(!hiz_target_)
+	{
+		return;
+	}
+
+	size_t const tile_right		= std::min<size_t>( (x + size) / HIZ_TILE_SIZE, hiz_tile_x_count_ );
+	size_t const tile_bottom	= std::min<size_t>( (y + size) / HIZ_TILE_SIZE, hiz_tiles_.size() / hiz_tile_x_count_ );
+	for(size_t tile_y = y / HIZ_TILE_SIZE; tile_y < tile_bottom; ++tile_y)
+	{
+		for(size_t tile_x = x / HIZ_TILE_SIZE; tile_x < tile_right; ++tile_x)
+		{
+			refresh_hiz_tile(tile_x, tile_y);
+		}
+	}
+}
+
+void framebuffer::refresh_hiz_tile(size_t tile_x, size_t tile_y)
+{
+	size_t const subtile_left	= tile_x * (HIZ_TILE_SIZE / HIZ_SUBTILE_SIZE);
+	size_t const subtile_top	= tile_y * (HIZ_TILE_SIZE / HIZ_SUBTILE_SIZE);
+	size_t const subtile_right	= std::min<size_t>(
+		subtile_left + HIZ_TILE_SIZE / HIZ_SUBTILE_SIZE, hiz_subtile_x_count_ );
+	size_t const subtile_bottom	= std::min<size_t>(
+		subtile_top  + HIZ_TILE_SIZE / HIZ_SUBTILE_SIZE, hiz_subtiles_.size() / hiz_subtile_x_count_ );
+
+	float min_z = std::numeric_limits<float>::max();
+	float max_z = -std::numeric_limits<float>::max();
+
+	for(size_t subtile_y = subtile_top; subtile_y < subtile_bottom; ++subtile_y)
+	{
+		for(size_t subtile_x = subtile_left; subtile_x < subtile_right; ++subtile_x)
+		{
+			size_t subtile_index = subtile_y * hiz_subtile_x_count_ + subtile_x;
+			if(hiz_subtiles_dirty_[subtile_index])
+			{
+				compute_hiz_subtile(subtile_x, subtile_y);
+			}
+
+			vec2 const& subtile_range = hiz_subtiles_[subtile_index];
+			min_z = std::min(min_z, subtile_range.x());
+			max_z = std::max(max_z, subtile_range.y());
+		}
+	}
+
+	hiz_tiles_[tile_y * hiz_tile_x_count_ + tile_x] = vec2(min_z, max_z);
+}
+
+bool framebuffer::hiz_range_rejected(vec2 const& stored_range, float min_z, float max_z) const
+{
+	switch(hiz_depth_func_)
+	{
+	case compare_function_less:
+		return min_z >= stored_range.y();
+	case compare_function_less_equal:
+		return min_z >  stored_range.y();
+	case compare_function_greater:
+		return max_z <= stored_range.x();
+	case compare_function_greater_equal:
+		return max_z <  stored_range.x();
+	case compare_function_equal:
+		return max_z < stored_range.x() || min_z > stored_range.y();
 	default:
-		EFLIB_ASSERT_UNIMPLEMENTED();
+		return false;
+	}
+}
+
+// Square is rejected only if all bounds inside are rejected. Parts out of target have nothing to draw.
+bool framebuffer::hiz_square_rejected(
+	std::vector<vec2> const& bounds, size_t bounds_x_count, size_t bounds_size,
+	size_t x, size_t y, size_t size, float min_z, float max_z) const
+{
+	size_t const width	= hiz_target_->width();
+	size_t const height	= hiz_target_->height();
+	if( x >= width || y >= height )
+	{
+		return false;
 	}
 
-	for(size_t y = 0; y < tar->height(); ++y)
+	// Quantization is monotonic, so quantized range still bounds the quantized depths of pixels.
+	min_z = hiz_quantize_depth_(min_z);
+	max_z = hiz_quantize_depth_(max_z);
+
+	size_t const right	= std::min<size_t>(x + size, width);
+	size_t const bottom	= std::min<size_t>(y + size, height);
+	for(size_t by = y / bounds_size; by * bounds_size < bottom; ++by)
 	{
-		for(size_t x = 0; x < tar->width(); ++x)
+		for(size_t bx = x / bounds_size; bx * bounds_size < right; ++bx)
 		{
-			pixel_accessor target_pixel(nullptr, tar);
-			target_pixel.set_pos(x, y);
-			for(size_t sample = 0; sample < tar->sample_count(); ++sample)
+			if( !hiz_range_rejected(bounds[by * bounds_x_count + bx], min_z, max_z) )
 			{
-				void* addr = target_pixel.depth_stencil_address(sample);
-				clear_op(addr, depth, stencil, 0xFFFFFFFFU);
+				return false;
 			}
 		}
 	}
+	return true;
 }
 
+bool framebuffer::hiz_tile_rejected(size_t x, size_t y, size_t size, float min_z, float max_z) const
+{
+	return hiz_square_rejected(hiz_tiles_, hiz_tile_x_count_, HIZ_TILE_SIZE, x, y, size, min_z, max_z);
+}
 
+bool framebuffer::hiz_subtile_rejected(size_t x, size_t y, size_t size, float min_z, float max_z) const
+{
+	return hiz_square_rejected(hiz_subtiles_, hiz_subtile_x_count_, HIZ_SUBTILE_SIZE, x, y, size, min_z, max_z);
+}
 
 END_NS_SALVIAR();
@@ -36,6 +36,7 @@ void geom_setup_engine::execute(geom_setup_context const* ctxt, uint64_t (*fetch
 	clip_geometries();
 	compact_start_time_ = fetch_time_stamp();
 	compact_geometries();
+	gather_produced_verts();
 }
 
 void geom_setup_engine::clip_geometries()
@@ -51,10 +52,10 @@ void geom_setup_engine::clip_geometries()
 	}
 
 	// Initialize resource used by clipper.
-	if( clipped_verts_cap_ < ctxt_->prim_count * 3 * 3)
+	if( clipped_verts_cap_ < ctxt_->prim_count * MAX_CLIPPED_VERTS)
 	{
-		clipped_verts_.reset(new vs_output* [ctxt_->prim_count * 3 * 3]);	// Every triangle can clipped out 3 triangles at most.
-		clipped_verts_cap_ = ctxt_->prim_count * 3 * 3;
+		clipped_verts_.reset(new vs_output* [ctxt_->prim_count * MAX_CLIPPED_VERTS]);
+		clipped_verts_cap_ = ctxt_->prim_count * MAX_CLIPPED_VERTS;
 	}
 
 	if(!vso_pools_)
@@ -62,10 +63,12 @@ void geom_setup_engine::clip_geometries()
 		vso_pools_.reset(new vs_output_pool[thread_count_]);
 	}
 
+	// Each clipping plane generates 2 verts at most.
+	size_t const num_clipping_planes = ctxt_->guard_band > 0.0f ? plane_num : 2;
 	for(size_t i = 0; i < thread_count_; ++ i)
 	{
 		vso_pools_[i].clear();
-		vso_pools_[i].reserve(ctxt_->prim_count * 4, 16);	// Two clipping plane. In extreme case, there are 4 verts generated by clipper.
+		vso_pools_[i].reserve(ctxt_->prim_count * num_clipping_planes * 2, 16);
 	}
 
 	// Execute threads
@@ -84,6 +87,7 @@ void geom_setup_engine::threaded_clip_geometries(thread_context const* thread_ct
 	clip_ctxt.vso_ops	= ctxt_->vso_ops;
 	clip_ctxt.cull		= ctxt_->cull;
 	clip_ctxt.prim		= ctxt_->prim;
+	clip_ctxt.guard_band= ctxt_->guard_band;
 
 	clipper clp;
 	clp.set_context(&clip_ctxt);
@@ -91,13 +95,15 @@ void geom_setup_engine::threaded_clip_geometries(thread_context const* thread_ct
 	clip_results clip_rslt;
 
     uint32_t clip_invocations = 0;
+	uint32_t guard_band_accepted_prims = 0;
+	uint32_t clipped_prims = 0;
 
 	thread_context::package_cursor cur = thread_ctx->next_package();
 	while( cur.valid() )
 	{
 		std::pair<int32_t, int32_t> prim_range = cur.item_range();
 
-		clip_rslt.clipped_verts		  = clipped_verts_.get() + prim_range.first * 9;
+		clip_rslt.clipped_verts		  = clipped_verts_.get() + prim_range.first * MAX_CLIPPED_VERTS;
 		uint32_t& clipped_verts_count = clipped_package_verts_count_[ cur.package_index() ];
 
 		clipped_verts_count = 0;
@@ -111,6 +117,12 @@ void geom_setup_engine::threaded_clip_geometries(thread_context const* thread_ct
                 ++clip_invocations;
 				clp.clip(pv, &clip_rslt);
 
+				if (clip_rslt.num_clipped_verts > 0)
+				{
+					guard_band_accepted_prims += clip_rslt.is_accepted ? 1 : 0;
+					clipped_prims += clip_rslt.is_clipped ? 1 : 0;
+				}
+
 				// Step output to next range, sum total clipped verts count
 				clip_rslt.clipped_verts += clip_rslt.num_clipped_verts;
 				clipped_verts_count += clip_rslt.num_clipped_verts;
@@ -125,6 +137,8 @@ void geom_setup_engine::threaded_clip_geometries(thread_context const* thread_ct
 	}
 
     ctxt_->acc_cinvocations(ctxt_->pipeline_stat, clip_invocations);
+	ctxt_->acc_guard_band_accepted_prims(ctxt_->internal_stat, guard_band_accepted_prims);
+	ctxt_->acc_clipped_prims(ctxt_->internal_stat, clipped_prims);
 }
 
 void geom_setup_engine::compact_geometries()
@@ -156,6 +170,21 @@ void geom_setup_engine::compact_geometries()
 		);
 }
 
+void geom_setup_engine::gather_produced_verts()
+{
+	produced_verts_.clear();
+	ctxt_->dvc->append_transformed_vertices(produced_verts_);
+
+	// Pools of clipper hold vertexes generated by clipping only.
+	for(size_t i = 0; i < thread_count_; ++ i)
+	{
+		if(vso_pools_[i].size() > 0)
+		{
+			produced_verts_.push_back( std::make_pair(vso_pools_[i].data(), vso_pools_[i].size()) );
+		}
+	}
+}
+
 void geom_setup_engine::threaded_compact_geometries(thread_context const* thread_ctx)
 {
 	thread_context::package_cursor current_package = thread_ctx->next_package();
@@ -167,7 +196,7 @@ void geom_setup_engine::threaded_compact_geometries(thread_context const* thread
 		for (int32_t i = compact_range.first; i < compact_range.second; ++ i)
 		{
 			vs_output** compacted_addr	= compacted_verts_.get() + clipped_package_compacted_addresses_[i];
-			vs_output** sparse_addr		= clipped_verts_.get() + GEOMETRY_SETUP_PACKAGE_SIZE * i * 9;
+			vs_output** sparse_addr		= clipped_verts_.get() + GEOMETRY_SETUP_PACKAGE_SIZE * i * MAX_CLIPPED_VERTS;
 			size_t		copy_size		= clipped_package_verts_count_[i] * sizeof(vs_output*);
 
 			memcpy(compacted_addr, sparse_addr, copy_size);
@@ -3,6 +3,7 @@
 #include <salviar/include/clipper.h>
 #include <salviar/include/framebuffer.h>
 #include <salviar/include/host.h>
+#include <salviar/include/rasterizer_kernels.h>
 #include <salviar/include/render_state.h>
 #include <salviar/include/render_stages.h>
 #include <salviar/include/shader_reflection.h>
@@ -12,6 +13,7 @@
 #include <salviar/include/shader_regs_op.h>
 #include <salviar/include/thread_pool.h>
 #include <salviar/include/thread_context.h>
+#include <salviar/include/tile_size_tuner.h>
 #include <salviar/include/vertex_cache.h>
 
 #include <eflib/include/diagnostics/log.h>
@@ -25,10 +27,6 @@
 
 #include <algorithm>
 
-#if defined(EFLIB_MSVC)
-#include <ppl.h>
-#endif
-
 using eflib::num_available_threads;
 
 using boost::atomic;
@@ -41,15 +39,52 @@ using namespace std;
 using namespace eflib;
 using namespace boost;
 
-int const TILE_SIZE = 64;
 int const DISPATCH_PRIMITIVE_PACKAGE_SIZE = 8;
 int const VP_PROJ_TRANSFORM_PAKCAGE_SIZE = 8;
 int const RASTERIZE_PRIMITIVE_PACKAGE_SIZE = 1;
 
+// Estimated costs of a primitive in a tile. A fully covered tile shades all pixels,
+// and a partially covered tile is often small, but still costs subdivision and coverage tests.
+uint64_t const FULL_TILE_PRIM_COST		= 4;
+uint64_t const PARTIAL_TILE_PRIM_COST	= 1;
+
+static_assert(
+	MIN_TILE_SIZE % HIZ_TILE_SIZE == 0 && HIZ_TILE_SIZE % HIZ_SUBTILE_SIZE == 0,
+	"Hierarchical Z tiles must be aligned with rasterizer tiles."
+	);
+
+static_assert(
+	MIN_TILE_SIZE % CLEAR_TILE_SIZE == 0,
+	"Clear tiles of surface must be aligned with rasterizer tiles."
+	);
+
 struct pixel_statistic
 {
     uint64_t ps_invocations;
     uint64_t backend_input_pixels;
+    uint64_t hiz_tile_tests;
+    uint64_t hiz_tile_rejections;
+    uint64_t hiz_subtile_tests;
+    uint64_t hiz_subtile_rejections;
+};
+
+uint32_t const QUAD_PACKAGE_SIZE = 8;
+
+// Covered quads from triangles of a tile, which are waiting for pixel shader.
+// JIT pixel shader still runs once per quad, but layouts of shader are looked up once per package.
+// Each quad keeps its own pixels, so derivatives are computed in the quad as before.
+// Quads are blended in the order they were collected, so blending order of each pixel is kept.
+struct quad_package
+{
+	vs_output	pixels[QUAD_PACKAGE_SIZE * 4];
+	ps_output	outs[QUAD_PACKAGE_SIZE * 4];
+	float		depths[QUAD_PACKAGE_SIZE * 4];
+	float		aa_z_offsets[QUAD_PACKAGE_SIZE][MAX_SAMPLE_COUNT];
+	uint64_t	masks[QUAD_PACKAGE_SIZE];
+	uint32_t	lefts[QUAD_PACKAGE_SIZE];
+	uint32_t	tops[QUAD_PACKAGE_SIZE];
+	bool		front_faces[QUAD_PACKAGE_SIZE];
+	uint32_t	size;
 };
 
 struct drawing_triangle_context
@@ -57,8 +92,42 @@ struct drawing_triangle_context
     float const*			aa_z_offset;
 	triangle_info const*	tri_info;
     pixel_statistic*		pixel_stat;
+	tile_edges const*		edges;			// Edge equations relative to (tile_x, tile_y).
+	int						tile_x;
+	int						tile_y;
+	uint32_t				prim_id;
+	quad_package*			quads;
+	binned_draw const*		draw;
 };
 
+// Edge deltas are limited to MAX_EDGE_DELTA_BITS, so the edge function stepping
+// across a whole tile is held by int32 without overflow.
+int const MAX_EDGE_DELTA_BITS = 18;
+int32_t const MAX_TILE_EDGE_VALUE = 1 << 30;
+
+static_assert(
+	(int64_t(1) << MAX_EDGE_DELTA_BITS) * MAX_TILE_SIZE * SUBPIXEL_SCALE * 2 <= MAX_TILE_EDGE_VALUE,
+	"Edge function may overflow in tile."
+	);
+
+// Clamping keeps the sign, and value which is clamped could not change its sign in tile.
+static int32_t clamp_tile_edge_value(int64_t v)
+{
+	return static_cast<int32_t>( std::max<int64_t>( std::min<int64_t>(v, MAX_TILE_EDGE_VALUE), -MAX_TILE_EDGE_VALUE ) );
+}
+
+// Packs sample masks of the quad in a 4x4 pixels mask as a quad mask.
+// Quads are numbered in row major order.
+static uint64_t pack_quad_mask(uint32_t const* pixel_mask, int quad)
+{
+	int const quad_start = ((quad & 1) << 1) | ((quad & 2) << 2);
+	return
+		( (pixel_mask[quad_start+0] & static_cast<uint64_t>(SAMPLE_MASK)) << (MAX_SAMPLE_COUNT * 0) ) |
+		( (pixel_mask[quad_start+1] & static_cast<uint64_t>(SAMPLE_MASK)) << (MAX_SAMPLE_COUNT * 1) ) |
+		( (pixel_mask[quad_start+4] & static_cast<uint64_t>(SAMPLE_MASK)) << (MAX_SAMPLE_COUNT * 2) ) |
+		( (pixel_mask[quad_start+5] & static_cast<uint64_t>(SAMPLE_MASK)) << (MAX_SAMPLE_COUNT * 3) );
+}
+
 /*************************************************
  *   Steps for line rasterization
  *			1 Find major direction and computing distance and differential on major direction.
@@ -130,7 +199,7 @@ void rasterizer::rasterize_line(rasterize_prim_context const* ctx)
 		vso_ops_->copy(px_end, *end);
 		float step = sx + 0.5f - start->position().x();
 		vs_output px_in;
-		vso_ops_->lerp(px_in, px_start, px_end, step / diff_dir);
+		vso_ops_->lerp(*vso_ops_, px_in, px_start, px_end, step / diff_dir);
 
 		// Draw line with x major DDA.
 		vs_output unprojed;
@@ -147,7 +216,7 @@ void rasterizer::rasterize_line(rasterize_prim_context const* ctx)
 			}
 
 			// Render pixel.
-			vso_ops_->unproject(unprojed, px_in);
+			vso_ops_->unproject(*vso_ops_, unprojed, px_in);
 
 #if 0
 			if(cpp_ps->execute(unprojed, px_out))
@@ -157,7 +226,7 @@ void rasterizer::rasterize_line(rasterize_prim_context const* ctx)
 #endif
 			// Increment ddx
 			++ step;
-			vso_ops_->lerp(px_in, px_start, px_end, step / diff_dir);
+			vso_ops_->lerp(*vso_ops_, px_in, px_start, px_end, step / diff_dir);
 		}
 	}
 	else //y major
@@ -187,7 +256,7 @@ void rasterizer::rasterize_line(rasterize_prim_context const* ctx)
 		vso_ops_->copy(px_end, *end);
 		float step = sy + 0.5f - start->position().y();
 		vs_output px_in;
-		vso_ops_->lerp(px_in, px_start, px_end, step / diff_dir);
+		vso_ops_->lerp(*vso_ops_, px_in, px_start, px_end, step / diff_dir);
 
 		vs_output unprojed;
 		for(int iPixel = sy; iPixel < ey; ++iPixel)
@@ -201,7 +270,7 @@ void rasterizer::rasterize_line(rasterize_prim_context const* ctx)
 				continue;
 			}
 
-			vso_ops_->unproject(unprojed, px_in);
+			vso_ops_->unproject(*vso_ops_, unprojed, px_in);
 
 #if 0
 			if(cpp_ps->execute(unprojed, px_out))
@@ -210,7 +279,7 @@ void rasterizer::rasterize_line(rasterize_prim_context const* ctx)
 			}
 #endif
 			++ step;
-			vso_ops_->lerp(px_in, px_start, px_end, step / diff_dir);
+			vso_ops_->lerp(*vso_ops_, px_in, px_start, px_end, step / diff_dir);
 		}
 	}
 }
@@ -224,8 +293,16 @@ void rasterizer::initialize(render_stages const* stages)
 
 void rasterizer::update(render_state const* state)
 {
+	// Pending draws are rasterized and shaded before targets or depth stencil states are changed.
+	if( !bins_compatible(state) || !vis_buffer_.compatible(state) )
+	{
+		flush();
+	}
+
+	draw_state_				= state;
 	state_		            = state->ras_state.get();
 	ps_proto_	            = state->ps_proto.get();
+	bs_proto_	            = state->bs_proto.get();
 	cpp_vs_					= state->cpp_vs.get();
 	cpp_ps_		            = state->cpp_ps.get();
 	cpp_bs_		            = state->cpp_bs.get();
@@ -241,6 +318,7 @@ void rasterizer::update(render_state const* state)
 	prim_reorderable_		= false;
 	
 	vs_reflection_ = state->vx_shader ? state->vx_shader->get_reflection() : nullptr;
+	ps_live_attributes_ = compute_ps_live_attributes();
 
 	update_prim_info(state);
 
@@ -266,11 +344,23 @@ void rasterizer::update(render_state const* state)
 
     if(internal_stat_)
     {
-        acc_backend_input_pixels_ = &async_internal_statistics::accumulate<internal_statistics_id::backend_input_pixels>;
+        acc_backend_input_pixels_   = &async_internal_statistics::accumulate<internal_statistics_id::backend_input_pixels>;
+        acc_hiz_tile_tests_         = &async_internal_statistics::accumulate<internal_statistics_id::hiz_tile_tests>;
+        acc_hiz_tile_rejections_    = &async_internal_statistics::accumulate<internal_statistics_id::hiz_tile_rejections>;
+        acc_hiz_subtile_tests_      = &async_internal_statistics::accumulate<internal_statistics_id::hiz_subtile_tests>;
+        acc_hiz_subtile_rejections_ = &async_internal_statistics::accumulate<internal_statistics_id::hiz_subtile_rejections>;
+        acc_guard_band_accepted_prims_ = &async_internal_statistics::accumulate<internal_statistics_id::guard_band_accepted_prims>;
+        acc_clipped_prims_          = &async_internal_statistics::accumulate<internal_statistics_id::clipped_prims>;
     }
     else
     {
-        acc_backend_input_pixels_ = &accumulate_fn<uint64_t>::null;
+        acc_backend_input_pixels_   = &accumulate_fn<uint64_t>::null;
+        acc_hiz_tile_tests_         = &accumulate_fn<uint64_t>::null;
+        acc_hiz_tile_rejections_    = &accumulate_fn<uint64_t>::null;
+        acc_hiz_subtile_tests_      = &accumulate_fn<uint64_t>::null;
+        acc_hiz_subtile_rejections_ = &accumulate_fn<uint64_t>::null;
+        acc_guard_band_accepted_prims_ = &accumulate_fn<uint64_t>::null;
+        acc_clipped_prims_          = &accumulate_fn<uint64_t>::null;
     }
 
 	if(pipeline_prof_)
@@ -278,9 +368,13 @@ void rasterizer::update(render_state const* state)
 		fetch_time_stamp_	= &async_pipeline_profiles::time_stamp;
 		acc_vp_trans_		= &async_pipeline_profiles::accumulate<pipeline_profile_id::vp_trans>;
 		acc_tri_dispatch_	= &async_pipeline_profiles::accumulate<pipeline_profile_id::tri_dispatch>;
+		acc_tile_schedule_	= &async_pipeline_profiles::accumulate<pipeline_profile_id::tile_schedule>;
 		acc_ras_			= &async_pipeline_profiles::accumulate<pipeline_profile_id::ras>;
 		acc_clipping_		= &async_pipeline_profiles::accumulate<pipeline_profile_id::clipping>;
 		acc_compact_clip_	= &async_pipeline_profiles::accumulate<pipeline_profile_id::compact_clip>;
+		acc_ras_idle_		= &async_pipeline_profiles::accumulate<pipeline_profile_id::ras_idle>;
+		acc_ras_tile_cost_	= &async_pipeline_profiles::accumulate<pipeline_profile_id::ras_tile_cost>;
+		acc_ras_max_tile_cost_ = &async_pipeline_profiles::accumulate<pipeline_profile_id::ras_max_tile_cost>;
 	}
 	else
 	{
@@ -289,162 +383,185 @@ void rasterizer::update(render_state const* state)
 		acc_compact_clip_   = &accumulate_fn<uint64_t>::null;
 		acc_vp_trans_		= &accumulate_fn<uint64_t>::null;
 		acc_tri_dispatch_	= &accumulate_fn<uint64_t>::null;
+		acc_tile_schedule_	= &accumulate_fn<uint64_t>::null;
 		acc_ras_			= &accumulate_fn<uint64_t>::null;
+		acc_ras_idle_		= &accumulate_fn<uint64_t>::null;
+		acc_ras_tile_cost_	= &accumulate_fn<uint64_t>::null;
+		acc_ras_max_tile_cost_ = &accumulate_fn<uint64_t>::null;
+	}
+
+	tile_schedule_ = state->options.tile_schedule;
+	binning_ = state->options.binning;
+	guard_band_ = std::max(state->options.guard_band, 0.0f);
+	shading_ = state->options.shading;
+	z_prepass_ = state->options.z_prepass;
+	tile_cache_ = state->options.tile_cache;
+
+	depth_writable_ = false;
+	if(state->ds_state)
+	{
+		depth_stencil_desc const& ds_desc = state->ds_state->get_desc();
+		depth_writable_ = ds_desc.depth_enable && ds_desc.depth_write_mask && !ds_desc.stencil_enable;
 	}
+
+	tile_size_ = select_tile_size(state);
 }
 
-void rasterizer::draw_full_tile(
-	int tile_left, int tile_top, int tile_right, int tile_bottom,
-	drawing_shader_context const* shaders,
-	drawing_triangle_context const* triangle_ctx)
+uint32_t rasterizer::select_tile_size(render_state const* state) const
 {
-	for(int top = tile_top; top < tile_bottom; top += 2)
+	// Tile size is tuned by bound targets when it is not specified.
+	if( is_supported_tile_size(state->options.tile_size) )
 	{
-		for(int left = tile_left; left < tile_right; left += 2)
+		return state->options.tile_size;
+	}
+
+	uint32_t bytes_per_pixel = 0;
+	for(auto const& color_target: state->color_targets)
+	{
+		if(color_target)
 		{
-			draw_full_quad(left, top, shaders, triangle_ctx);
+			bytes_per_pixel += static_cast<uint32_t>( color_target->pitch() / color_target->width() );
 		}
 	}
+	if(state->depth_stencil_target)
+	{
+		bytes_per_pixel += static_cast<uint32_t>( state->depth_stencil_target->pitch() / state->depth_stencil_target->width() );
+	}
+
+	return tune_tile_size(
+		static_cast<uint32_t>(state->target_vp.w), static_cast<uint32_t>(state->target_vp.h),
+		bytes_per_pixel, num_available_threads()
+		);
 }
 
-void rasterizer::draw_partial_tile(
-	int left, int top,
-	const eflib::vec4* edge_factors,
-	drawing_shader_context const* shaders,
-    drawing_triangle_context const* triangle_ctx)
+bool rasterizer::bins_compatible(render_state const* state) const
 {
-    auto& v0 = *triangle_ctx->tri_info->v0;
-
-	const uint32_t full_mask = (1UL << target_sample_count_) - 1;
-
-#ifndef EFLIB_NO_SIMD
-	const __m128 mtx = _mm_set_ps(1, 0, 1, 0);
-	const __m128 mty = _mm_set_ps(1, 1, 0, 0);
-
-	__m128 medge0 = _mm_load_ps(&edge_factors[0].x());
-	__m128 medge1 = _mm_load_ps(&edge_factors[1].x());
-	__m128 medge2 = _mm_load_ps(&edge_factors[2].x());
+	if(binned_draw_count_ == 0)
+	{
+		return true;
+	}
 
-	__m128 mtmp = _mm_unpacklo_ps(medge0, medge1);
-	__m128 medgex = _mm_shuffle_ps(mtmp, medge2, _MM_SHUFFLE(3, 0, 1, 0));
-	__m128 medgey = _mm_shuffle_ps(mtmp, medge2, _MM_SHUFFLE(3, 1, 3, 2));
-	mtmp = _mm_unpackhi_ps(medge0, medge1);
-	__m128 medgez = _mm_shuffle_ps(mtmp, medge2, _MM_SHUFFLE(3, 2, 1, 0));
+	// Binned draws are rasterized with the same framebuffer states.
+	bool const output_depth = !state->vx_shader && state->cpp_ps && state->cpp_ps->output_depth();
+	if( state->color_targets != binned_color_targets_ || state->depth_stencil_target != binned_ds_target_
+		|| state->ds_state != binned_ds_state_ || state->stencil_ref != binned_stencil_ref_
+		|| state->bl_state != binned_bl_state_
+		|| output_depth != binned_output_depth_ )
+	{
+		return false;
+	}
 
-	__m128 mleft = _mm_set1_ps(left);
-	__m128 mtop = _mm_set1_ps(top);
-	__m128 mevalue3 = _mm_sub_ps(medgez, _mm_add_ps(_mm_mul_ps(mleft, medgex), _mm_mul_ps(mtop, medgey)));
-#endif
+	// They share tiles too.
+	uint32_t const tile_size = select_tile_size(state);
+	return tile_size == tile_size_
+		&& static_cast<size_t>(state->vp.w + tile_size - 1) / tile_size == tile_x_count_
+		&& static_cast<size_t>(state->vp.h + tile_size - 1) / tile_size == tile_y_count_;
+}
 
-	EFLIB_ALIGN(16) uint32_t pixel_mask[4 * 4];
+bool rasterizer::hiz_subtile_rejected(
+	int left, int top, int size, drawing_triangle_context const* triangle_ctx)
+{
+	if( !frame_buffer_->hiz_enabled() )
+	{
+		return false;
+	}
 
-#if !defined(EFLIB_NO_SIMD)
-	__m128i zero = _mm_setzero_si128();
-	_mm_store_si128(reinterpret_cast<__m128i*>(pixel_mask + 0), zero);
-	_mm_store_si128(reinterpret_cast<__m128i*>(pixel_mask + 4), zero);
-	_mm_store_si128(reinterpret_cast<__m128i*>(pixel_mask + 8), zero);
-	_mm_store_si128(reinterpret_cast<__m128i*>(pixel_mask + 12), zero);
-#else
-	memset(pixel_mask, 0, sizeof(pixel_mask));
-#endif
+	vec2 const& depth_range = triangle_ctx->tri_info->depth_range;
+	++triangle_ctx->pixel_stat->hiz_subtile_tests;
 
-#if !defined(EFLIB_NO_SIMD)
-	for (size_t i_sample = 0; i_sample < target_sample_count_; ++ i_sample)
+	// Region aligned to Hi-Z tiles is tested by fewer bounds.
+	bool rejected = (size % HIZ_TILE_SIZE == 0)
+		? frame_buffer_->hiz_tile_rejected(left, top, size, depth_range.x(), depth_range.y())
+		: frame_buffer_->hiz_subtile_rejected(left, top, size, depth_range.x(), depth_range.y());
+	if(rejected)
 	{
-		const vec2& sp = samples_pattern_[i_sample];
-		__m128 mspx = _mm_set1_ps(sp.x());
-		__m128 mspy = _mm_set1_ps(sp.y());
+		++triangle_ctx->pixel_stat->hiz_subtile_rejections;
+		return true;
+	}
+	return false;
+}
 
-		for(int iy = 0; iy < 4; ++ iy)
+void rasterizer::draw_full_tile(
+	int tile_left, int tile_top, int tile_right, int tile_bottom,
+	drawing_shader_context const* shaders,
+	drawing_triangle_context const* triangle_ctx)
+{
+	// Walk full tile by Hi-Z sub-tiles, so occluded sub-tiles could be skipped as a whole.
+	for(int subtile_top = tile_top; subtile_top < tile_bottom; subtile_top += HIZ_SUBTILE_SIZE)
+	{
+		int const subtile_bottom = min<int>(subtile_top + HIZ_SUBTILE_SIZE, tile_bottom);
+		for(int subtile_left = tile_left; subtile_left < tile_right; subtile_left += HIZ_SUBTILE_SIZE)
 		{
-			__m128 my = _mm_add_ps(mspy, _mm_set1_ps(iy));
-			__m128 mx = _mm_add_ps(mspx, _mm_set_ps(3, 2, 1, 0));
-			
-			__m128 mask_rej = _mm_setzero_ps();
+			if( hiz_subtile_rejected(subtile_left, subtile_top, HIZ_SUBTILE_SIZE, triangle_ctx) )
 			{
-				__m128 mstepx = _mm_shuffle_ps(medgex, medgex, _MM_SHUFFLE(0, 0, 0, 0));
-				__m128 mstepy = _mm_shuffle_ps(medgey, medgey, _MM_SHUFFLE(0, 0, 0, 0));
-				__m128 msteprej = _mm_add_ps(_mm_mul_ps(mx, mstepx), _mm_mul_ps(my, mstepy));
-
-				__m128 mevalue = _mm_shuffle_ps(mevalue3, mevalue3, _MM_SHUFFLE(0, 0, 0, 0));
-
-				mask_rej = _mm_or_ps(mask_rej, _mm_cmplt_ps(msteprej, mevalue));
+				continue;
 			}
-			{
-				__m128 mstepx = _mm_shuffle_ps(medgex, medgex, _MM_SHUFFLE(1, 1, 1, 1));
-				__m128 mstepy = _mm_shuffle_ps(medgey, medgey, _MM_SHUFFLE(1, 1, 1, 1));
-				__m128 msteprej = _mm_add_ps(_mm_mul_ps(mx, mstepx), _mm_mul_ps(my, mstepy));
 
-				__m128 mevalue = _mm_shuffle_ps(mevalue3, mevalue3, _MM_SHUFFLE(1, 1, 1, 1));
-
-				mask_rej = _mm_or_ps(mask_rej, _mm_cmplt_ps(msteprej, mevalue));
-			}
+			int const subtile_right = min<int>(subtile_left + HIZ_SUBTILE_SIZE, tile_right);
+			for(int top = subtile_top; top < subtile_bottom; top += 2)
 			{
-				__m128 mstepx = _mm_shuffle_ps(medgex, medgex, _MM_SHUFFLE(2, 2, 2, 2));
-				__m128 mstepy = _mm_shuffle_ps(medgey, medgey, _MM_SHUFFLE(2, 2, 2, 2));
-				__m128 msteprej = _mm_add_ps(_mm_mul_ps(mx, mstepx), _mm_mul_ps(my, mstepy));
-
-				__m128 mevalue = _mm_shuffle_ps(mevalue3, mevalue3, _MM_SHUFFLE(2, 2, 2, 2));
-
-				mask_rej = _mm_or_ps(mask_rej, _mm_cmplt_ps(msteprej, mevalue));
+				for(int left = subtile_left; left < subtile_right; left += 2)
+				{
+					draw_full_quad(left, top, shaders, triangle_ctx);
+				}
 			}
-
-			__m128 sample_mask = _mm_castsi128_ps(_mm_set1_epi32(1UL << i_sample));
-			sample_mask = _mm_andnot_ps(mask_rej, sample_mask);
-
-			__m128 stored_mask = _mm_load_ps( reinterpret_cast<float*>(pixel_mask + iy * 4) );
-			stored_mask = _mm_or_ps(sample_mask, stored_mask);
-			_mm_store_ps(reinterpret_cast<float*>(pixel_mask + iy * 4), stored_mask);
 		}
 	}
-#else
-	float evalue[3];
-	for (int e = 0; e < 3; ++ e)
-	{
-		evalue[e] = edge_factors[e].z() - (left * edge_factors[e].x() + top * edge_factors[e].y());
-	}
+}
+
+void rasterizer::draw_small_triangle(
+	int tile_left, int tile_top, int tile_right, int tile_bottom,
+	drawing_shader_context const* shaders,
+	drawing_triangle_context const* triangle_ctx)
+{
+	triangle_info const* tri_info = triangle_ctx->tri_info;
+	int const right  = min<int>( tile_right,  fast_floori(target_vp_->x + target_vp_->w) );
+	int const bottom = min<int>( tile_bottom, fast_floori(target_vp_->y + target_vp_->h) );
 
-	for(int iy = 0; iy < 4; ++iy)
+	for(int quad = 0; quad < 4; ++quad)
 	{
-		// Rasterizer.
-		for(size_t ix = 0; ix < 4; ++ix)
+		uint64_t const quad_mask = tri_info->small_quad_masks[quad];
+		if(quad_mask == 0)
 		{
-			for (int i_sample = 0; i_sample < target_sample_count_; ++ i_sample)
-			{
-				vec2  const& sp = samples_pattern_[i_sample];
-				float const  fx = ix + sp.x();
-				float const  fy = iy + sp.y();
-				bool inside = true;
-				for (int e = 0; e < 3; ++ e)
-				{
-					if (fx * edge_factors[e].x() + fy * edge_factors[e].y() < evalue[e])
-					{
-						inside = false;
-						break;
-					}
-				}
+			continue;
+		}
 
-				if (inside)
-				{
-					pixel_mask[iy * 4 + ix] |= 1UL << i_sample;
-				}
-			}
+		// Block may straddle tiles, and each quad is drawn by the tile which owns it.
+		int const left = tri_info->small_x + ((quad & 1) << 1);
+		int const top  = tri_info->small_y + (quad & 2);
+		if(left < tile_left || left >= right || top < tile_top || top >= bottom)
+		{
+			continue;
+		}
+
+		if(quad_mask == quad_full_mask_)
+		{
+			draw_full_quad(left, top, shaders, triangle_ctx);
+		}
+		else
+		{
+			draw_quad(left, top, quad_mask, shaders, triangle_ctx);
 		}
 	}
-#endif
+}
+
+void rasterizer::draw_partial_tile(
+	int left, int top,
+	drawing_shader_context const* shaders,
+    drawing_triangle_context const* triangle_ctx)
+{
+	EFLIB_ALIGN(16) uint32_t pixel_mask[4 * 4];
+	kernels_->compute_pixel_mask(
+		pixel_mask, left - triangle_ctx->tile_x, top - triangle_ctx->tile_y,
+		triangle_ctx->edges, sample_offsets_, static_cast<uint32_t>(target_sample_count_)
+		);
 
     for(int quad = 0; quad < 4; ++quad)
     {
 		int const quad_x = (quad & 1) << 1;
 		int const quad_y = (quad & 2);
 
-		int const quad_start = quad_x | (quad_y << 2);
-
-		uint64_t quad_mask = 
-			( (pixel_mask[quad_start+0] & static_cast<uint64_t>(SAMPLE_MASK)) << (MAX_SAMPLE_COUNT * 0) ) |
-			( (pixel_mask[quad_start+1] & static_cast<uint64_t>(SAMPLE_MASK)) << (MAX_SAMPLE_COUNT * 1) ) |
-			( (pixel_mask[quad_start+4] & static_cast<uint64_t>(SAMPLE_MASK)) << (MAX_SAMPLE_COUNT * 2) ) |
-			( (pixel_mask[quad_start+5] & static_cast<uint64_t>(SAMPLE_MASK)) << (MAX_SAMPLE_COUNT * 3) );
+		uint64_t quad_mask = pack_quad_mask(pixel_mask, quad);
 
 		// No sample need to render.
         if(quad_mask == 0)
@@ -463,157 +580,6 @@ void rasterizer::draw_partial_tile(
     }
 }
 
-void rasterizer::subdivide_tile(
-    int left, int top,
-    const eflib::rect<uint32_t>& cur_region,
-	const vec4* edge_factors,
-    uint32_t* test_regions, uint32_t& test_region_size,
-    float x_min, float x_max, float y_min, float y_max,
-	const float* rej_to_acc, const float* evalue,
-    const float* step_x, const float* step_y)
-{
-	const uint32_t new_w = cur_region.w;
-	const uint32_t new_h = cur_region.h;
-
-#ifndef EFLIB_NO_SIMD
-	static const union
-	{
-		int maski;
-		float maskf;
-	} MASK = { 0x80000000 };
-	static const __m128 SIGN_MASK = _mm_set1_ps(MASK.maskf);
-
-	__m128 medge0 = _mm_load_ps(&edge_factors[0].x());
-	__m128 medge1 = _mm_load_ps(&edge_factors[1].x());
-	__m128 medge2 = _mm_load_ps(&edge_factors[2].x());
-
-	__m128 mtmp = _mm_unpacklo_ps(medge0, medge1);
-	__m128 medgex = _mm_shuffle_ps(mtmp, medge2, _MM_SHUFFLE(3, 0, 1, 0));
-	__m128 medgey = _mm_shuffle_ps(mtmp, medge2, _MM_SHUFFLE(3, 1, 3, 2));
-	mtmp = _mm_unpackhi_ps(medge0, medge1);
-
-	__m128 mstepx3 = _mm_load_ps(step_x);
-	__m128 mstepy3 = _mm_load_ps(step_y);
-	__m128 mrej2acc3 = _mm_load_ps(rej_to_acc);
-
-	__m128 mleft = _mm_set1_ps(left);
-	__m128 mtop = _mm_set1_ps(top);
-	__m128 mevalue3 = _mm_sub_ps(_mm_load_ps(evalue), _mm_add_ps(_mm_mul_ps(mleft, medgex), _mm_mul_ps(mtop, medgey)));
-
-	for(int iy = 0; iy < 4; ++ iy){
-		__m128 my = _mm_mul_ps(mstepy3, _mm_set1_ps(iy));
-
-		__m128 mask_rej = _mm_setzero_ps();
-		__m128 mask_acc = _mm_setzero_ps();
-
-		// Trival rejection & acception
-		{
-			__m128 mstepx = _mm_mul_ps(_mm_shuffle_ps(mstepx3, mstepx3, _MM_SHUFFLE(0, 0, 0, 0)), _mm_set_ps(3, 2, 1, 0));
-			__m128 mstepy = _mm_shuffle_ps(my, my, _MM_SHUFFLE(0, 0, 0, 0));
-
-			__m128 mrej2acc = _mm_shuffle_ps(mrej2acc3, mrej2acc3, _MM_SHUFFLE(0, 0, 0, 0));
-
-			__m128 msteprej = _mm_add_ps(mstepx, mstepy);
-			__m128 mstepacc = _mm_add_ps(msteprej, mrej2acc);
-
-			__m128 mevalue = _mm_shuffle_ps(mevalue3, mevalue3, _MM_SHUFFLE(0, 0, 0, 0));
-
-			mask_rej = _mm_or_ps(mask_rej, _mm_cmplt_ps(msteprej, mevalue));
-			mask_acc = _mm_or_ps(mask_acc, _mm_cmplt_ps(mstepacc, mevalue));
-		}
-		{
-			__m128 mstepx = _mm_mul_ps(_mm_shuffle_ps(mstepx3, mstepx3, _MM_SHUFFLE(1, 1, 1, 1)), _mm_set_ps(3, 2, 1, 0));
-			__m128 mstepy = _mm_shuffle_ps(my, my, _MM_SHUFFLE(1, 1, 1, 1));
-
-			__m128 mrej2acc = _mm_shuffle_ps(mrej2acc3, mrej2acc3, _MM_SHUFFLE(1, 1, 1, 1));
-
-			__m128 msteprej = _mm_add_ps(mstepx, mstepy);
-			__m128 mstepacc = _mm_add_ps(msteprej, mrej2acc);
-
-			__m128 mevalue = _mm_shuffle_ps(mevalue3, mevalue3, _MM_SHUFFLE(1, 1, 1, 1));
-
-			mask_rej = _mm_or_ps(mask_rej, _mm_cmplt_ps(msteprej, mevalue));
-			mask_acc = _mm_or_ps(mask_acc, _mm_cmplt_ps(mstepacc, mevalue));
-		}
-		{
-			__m128 mstepx = _mm_mul_ps(_mm_shuffle_ps(mstepx3, mstepx3, _MM_SHUFFLE(2, 2, 2, 2)), _mm_set_ps(3, 2, 1, 0));
-			__m128 mstepy = _mm_shuffle_ps(my, my, _MM_SHUFFLE(2, 2, 2, 2));
-
-			__m128 mrej2acc = _mm_shuffle_ps(mrej2acc3, mrej2acc3, _MM_SHUFFLE(2, 2, 2, 2));
-
-			__m128 msteprej = _mm_add_ps(mstepx, mstepy);
-			__m128 mstepacc = _mm_add_ps(msteprej, mrej2acc);
-
-			__m128 mevalue = _mm_shuffle_ps(mevalue3, mevalue3, _MM_SHUFFLE(2, 2, 2, 2));
-
-			mask_rej = _mm_or_ps(mask_rej, _mm_cmplt_ps(msteprej, mevalue));
-			mask_acc = _mm_or_ps(mask_acc, _mm_cmplt_ps(mstepacc, mevalue));
-		}
-		mask_acc = _mm_andnot_ps(mask_acc, SIGN_MASK);
-
-		__m128i mineww = _mm_set1_epi32(new_w);
-		__m128i minewh = _mm_set1_epi32(new_h);
-		__m128i mix = _mm_set_epi32(3 * new_w, 2 * new_w, 1 * new_w, 0 * new_h);
-		__m128i miy = _mm_set1_epi32(iy * new_h);
-		mix = _mm_add_epi32(mix, _mm_set1_epi32(cur_region.x));
-		miy = _mm_add_epi32(miy, _mm_set1_epi32(cur_region.y));
-		__m128i miregion = _mm_or_si128(mix, _mm_slli_epi32(miy, 8));
-		miregion = _mm_or_si128(miregion, _mm_castps_si128(mask_acc));
-
-		EFLIB_ALIGN(16) uint32_t region_code[4];
-		_mm_store_si128(reinterpret_cast<__m128i*>(&region_code[0]), miregion);
-
-		mask_rej = _mm_or_ps(mask_rej, _mm_cmpge_ps(_mm_set1_ps(x_min), _mm_cvtepi32_ps(_mm_add_epi32(mix, mineww))));
-		mask_rej = _mm_or_ps(mask_rej, _mm_cmplt_ps(_mm_set1_ps(x_max), _mm_cvtepi32_ps(mix)));
-		mask_rej = _mm_or_ps(mask_rej, _mm_cmpge_ps(_mm_set1_ps(y_min), _mm_cvtepi32_ps(_mm_add_epi32(miy, minewh))));
-		mask_rej = _mm_or_ps(mask_rej, _mm_cmplt_ps(_mm_set1_ps(y_max), _mm_cvtepi32_ps(miy)));
-
-		int rejections = ~_mm_movemask_ps(mask_rej) & 0xF;
-		uint32_t t;
-		while (_xmm_bsf(&t, (uint32_t)rejections))
-		{
-			assert(t < 4);
-
-			test_regions[test_region_size] = region_code[t];
-			++ test_region_size;
-
-			rejections &= rejections - 1;
-		}
-	}
-#else
-	float evalue1[3];
-	for (int e = 0; e < 3; ++ e){
-		evalue1[e] = evalue[e] - (left * edge_factors[e].x() + top * edge_factors[e].y());
-	}
-
-	for (int ty = 0; ty < 4; ++ ty){
-		uint32_t y = cur_region.y + new_h * ty;
-		for (int tx = 0; tx < 4; ++ tx){
-			uint32_t x = cur_region.x + new_w * tx;
-
-			if ((x_min < x + new_w) && (x_max >= x)
-				&& (y_min < y + new_h) && (y_max >= y))
-			{
-				int rejection = 0;
-				int acception = 1;
-
-				// Trivial rejection & acception
-				for (int e = 0; e < 3; ++ e){
-					float step = tx * step_x[e] + ty * step_y[e];
-					rejection |= (step < evalue1[e]);
-					acception &= (step + rej_to_acc[e] >= evalue1[e]);
-				}
-
-				if (!rejection){
-					test_regions[test_region_size] = x + (y << 8) + (acception << 31);
-					++ test_region_size;
-				}
-			}
-		}
-	}
-#endif
-}
-
 /*************************************************
 *   Steps of triangle rasterization
 *			1 Generate scan line and compute derivation of scanlines
@@ -627,6 +593,7 @@ void rasterizer::subdivide_tile(
 *			2 x, y, z components of wpos have been devided by 'clip w'.
 *			3 positon.w() == 1.0f / 'clip w'
 **************************************************/
+template <int TileSize>
 void rasterizer::rasterize_triangle(rasterize_prim_context const* ctx)
 {
 	// Extract to local variables
@@ -635,20 +602,8 @@ void rasterizer::rasterize_triangle(rasterize_prim_context const* ctx)
 	viewport  const&	vp				= *ctx->tile_vp;
 	uint32_t			prim_id			= ctx->prim_id >> 1;
 	uint32_t			full			= ctx->prim_id & 1;
-	vs_output const&	v0				= *clipped_verts_[prim_id*3+0];
-	vs_output const&	v1				= *clipped_verts_[prim_id*3+1];
-	vs_output const&	v2				= *clipped_verts_[prim_id*3+2];
 
-	triangle_info const* tri_info     = tri_infos_.data() + prim_id;
-	eflib::vec4 const*	 edge_factors = tri_info->edge_factors;
-	bool const mark_x[3] = 
-	{
-		edge_factors[0].x() > 0, edge_factors[1].x() > 0, edge_factors[2].x() > 0
-	};
-	bool const mark_y[3] = 
-	{
-		edge_factors[0].y() > 0, edge_factors[1].y() > 0, edge_factors[2].y() > 0
-	};
+	triangle_info const* tri_info     = ctx->draw->tri_infos.data() + prim_id;
 
 	enum TRI_VS_TILE 
 	{
@@ -658,44 +613,24 @@ void rasterizer::rasterize_triangle(rasterize_prim_context const* ctx)
 		TVT_PIXEL
 	};
 
-	float const x_min = tri_info->bounding_box[0] - vp.x;
-	float const x_max = tri_info->bounding_box[1] - vp.x;
-	float const y_min = tri_info->bounding_box[2] - vp.y;
-	float const y_max = tri_info->bounding_box[3] - vp.y;
-
-	/*************************************************
-	*   Draw triangles with Larrabee algorithm .
-	*************************************************/
-
-	uint32_t test_regions[2][TILE_SIZE / 2 * TILE_SIZE / 2];
-	uint32_t test_region_size[2] = { 0, 0 };
-	test_regions[0][0] = (full << 31);
-	test_region_size[0] = 1;
-	int src_stage = 0;
-	int dst_stage = !src_stage;
-
 	const int vpleft0 = fast_floori(vp.x);
 	const int vpright0 = fast_floori(vp.x + vp.w);
 	const int vptop0 = fast_floori(vp.y);
 	const int vpbottom0 = fast_floori(vp.y + vp.h);
 
-	uint32_t subtile_w = fast_floori(vp.w);
-	uint32_t subtile_h = fast_floori(vp.h);
-
-	EFLIB_ALIGN(16) float step_x[4];
-	EFLIB_ALIGN(16) float step_y[4];
-	EFLIB_ALIGN(16) float rej_to_acc[4];
-	EFLIB_ALIGN(16) float evalue[4];
-	float part_evalue[4];
-	for (int e = 0; e < 3; ++ e)
+	// Whole tile is occluded.
+	if ( frame_buffer_->hiz_enabled() )
 	{
-		step_x[e] = TILE_SIZE * edge_factors[e].x();
-		step_y[e] = TILE_SIZE * edge_factors[e].y();
-		rej_to_acc[e] = -abs(step_x[e]) - abs(step_y[e]);
-		part_evalue[e] = mark_x[e] * TILE_SIZE * edge_factors[e].x() + mark_y[e] * TILE_SIZE * edge_factors[e].y();
-		evalue[e] = edge_factors[e].z() - part_evalue[e];
+		++ctx->pixel_stat->hiz_tile_tests;
+		if ( frame_buffer_->hiz_tile_rejected(vpleft0, vptop0, TileSize, tri_info->depth_range.x(), tri_info->depth_range.y()) )
+		{
+			++ctx->pixel_stat->hiz_tile_rejections;
+			return;
+		}
 	}
-	step_x[3] = step_y[3] = 0;
+
+	uint32_t subtile_w = TileSize;
+	uint32_t subtile_h = TileSize;
 
 	float aa_z_offset[MAX_NUM_MULTI_SAMPLES];
 	if (target_sample_count_ > 1)
@@ -703,7 +638,7 @@ void rasterizer::rasterize_triangle(rasterize_prim_context const* ctx)
 		for (unsigned long i_sample = 0; i_sample < target_sample_count_; ++ i_sample)
 		{
 			const vec2& sp = samples_pattern_[i_sample];
-			aa_z_offset[i_sample] = (sp.x() - 0.5f) * tri_info->ddx.position().z() + (sp.y() - 0.5f) * tri_info->ddy.position().z();
+			aa_z_offset[i_sample] = (sp.x() - 0.5f) * tri_info->ddx->position().z() + (sp.y() - 0.5f) * tri_info->ddy->position().z();
 		}
 	}
     else
@@ -715,11 +650,61 @@ void rasterizer::rasterize_triangle(rasterize_prim_context const* ctx)
     tri_ctx.aa_z_offset = aa_z_offset;
     tri_ctx.pixel_stat  = ctx->pixel_stat;
 	tri_ctx.tri_info	= tri_info;
+	tri_ctx.edges		= nullptr;
+	tri_ctx.tile_x		= vpleft0;
+	tri_ctx.tile_y		= vptop0;
+	tri_ctx.prim_id		= prim_id;
+	tri_ctx.quads		= ctx->quads;
+	tri_ctx.draw		= ctx->draw;
 	if (cpp_ps != nullptr)
 	{
 		cpp_ps->update_front_face(tri_info->front_face);
 	}
 
+	// Small triangle has its coverage already, and it is drawn by quads directly.
+	if (tri_info->is_small)
+	{
+		draw_small_triangle(vpleft0, vptop0, vpright0, vpbottom0, &ctx->shaders, &tri_ctx);
+		return;
+	}
+
+	// Bounding box relative to tile in sub-pixels: x_min, x_max, y_min, y_max
+	int32_t const bounding_box[4] =
+	{
+		clamp_tile_edge_value( static_cast<int64_t>(tri_info->bounding_box[0] * SUBPIXEL_SCALE) - vpleft0 * SUBPIXEL_SCALE ),
+		clamp_tile_edge_value( static_cast<int64_t>(tri_info->bounding_box[1] * SUBPIXEL_SCALE) - vpleft0 * SUBPIXEL_SCALE ),
+		clamp_tile_edge_value( static_cast<int64_t>(tri_info->bounding_box[2] * SUBPIXEL_SCALE) - vptop0  * SUBPIXEL_SCALE ),
+		clamp_tile_edge_value( static_cast<int64_t>(tri_info->bounding_box[3] * SUBPIXEL_SCALE) - vptop0  * SUBPIXEL_SCALE )
+	};
+
+	// Edge equations relative to tile.
+	tile_edges edges;
+	for (int e = 0; e < 3; ++ e)
+	{
+		int64_t value =
+			  static_cast<int64_t>(tri_info->edge_dx[e]) * (vpleft0 * SUBPIXEL_SCALE)
+			+ static_cast<int64_t>(tri_info->edge_dy[e]) * (vptop0  * SUBPIXEL_SCALE)
+			- tri_info->edge_c[e];
+		edges.value[e]	= clamp_tile_edge_value(value);
+		edges.dx[e]		= tri_info->edge_dx[e];
+		edges.dy[e]		= tri_info->edge_dy[e];
+	}
+	edges.value[3] = edges.dx[3] = edges.dy[3] = 0;
+
+	tri_ctx.edges		= &edges;
+
+	/*************************************************
+	*   Draw triangles with Larrabee algorithm .
+	*************************************************/
+
+	// Regions of a level are at least 4x4 pixels.
+	uint32_t test_regions[2][(TileSize / 4) * (TileSize / 4)];
+	uint32_t test_region_size[2] = { 0, 0 };
+	test_regions[0][0] = (full << 31);
+	test_region_size[0] = 1;
+	int src_stage = 0;
+	int dst_stage = !src_stage;
+
 	float target_vp_right = target_vp_->w + target_vp_->x;
 	float target_vp_bottom = target_vp_->h +  + target_vp_->y;
 
@@ -730,15 +715,6 @@ void rasterizer::rasterize_triangle(rasterize_prim_context const* ctx)
 		subtile_w /= 4;
 		subtile_h /= 4;
 
-		for (int e = 0; e < 3; ++ e)
-		{
-			step_x[e] *= 0.25f;
-			step_y[e] *= 0.25f;
-			rej_to_acc[e] *= 0.25f;
-			part_evalue[e] *= 0.25f;
-			evalue[e] = edge_factors[e].z() - part_evalue[e];
-		}
-
 		for (size_t ivp = 0; ivp < test_region_size[src_stage]; ++ ivp)
 		{
 			const uint32_t packed_region = test_regions[src_stage][ivp];
@@ -757,8 +733,17 @@ void rasterizer::rasterize_triangle(rasterize_prim_context const* ctx)
 				continue;
 			}
 
-			// For one pixel region
-			if ((TVT_PARTIAL == intersect) && (cur_region.w <= 1) && (cur_region.h <= 1))
+			// Region is covered by Hi-Z sub-tiles. Whole tile has been tested already.
+			uint32_t const region_size = cur_region.w * 4;
+			if ( region_size < static_cast<uint32_t>(TileSize) && region_size >= HIZ_SUBTILE_SIZE
+				&& hiz_subtile_rejected(vpleft, vptop, region_size, &tri_ctx) )
+			{
+				continue;
+			}
+
+			// Regions of 4x4 or 8x8 pixels are not subdivided any more.
+			// Tile size of power of 4 ends with 4x4 regions, others end with 8x8 regions.
+			if ((TVT_PARTIAL == intersect) && (cur_region.w <= 2) && (cur_region.h <= 2))
 			{
 				intersect = TVT_PIXEL;
 			}
@@ -780,17 +765,21 @@ void rasterizer::rasterize_triangle(rasterize_prim_context const* ctx)
 
 			case TVT_PIXEL:
 				// The tile is small enough for pixel level matching.
-				this->draw_partial_tile(vpleft, vptop, edge_factors, &ctx->shaders, &tri_ctx);
+				for (uint32_t block_top = vptop; block_top < vptop + region_size && block_top < target_vp_bottom; block_top += 4)
+				{
+					for (uint32_t block_left = vpleft; block_left < vpleft + region_size && block_left < target_vp_right; block_left += 4)
+					{
+						this->draw_partial_tile(block_left, block_top, &ctx->shaders, &tri_ctx);
+					}
+				}
 				break;
 
 			default:
 				// Only a part of the triangle is inside the tile. So subdivide the tile into small ones.
-				this->subdivide_tile(
-					vpleft, vptop,
-					cur_region, edge_factors,
+				kernels_->subdivide_region(
 					test_regions[dst_stage], test_region_size[dst_stage],
-					x_min, x_max, y_min, y_max,
-					rej_to_acc, evalue, step_x, step_y);
+					cur_region.x, cur_region.y, cur_region.w, cur_region.h,
+					&edges, bounding_box);
 				break;
 			}
 		}
@@ -802,81 +791,206 @@ void rasterizer::rasterize_triangle(rasterize_prim_context const* ctx)
 
 rasterizer::rasterizer()
 {
+	kernels_ = select_rasterizer_kernels();
+	tile_size_ = DEFAULT_TILE_SIZE;
+	shading_ = shading_modes::forward;
+	depth_writable_ = false;
+	z_prepass_ = false;
+	tile_cache_ = false;
+	depth_only_ = false;
+	derivative_regs_ = 1;
+	draw_state_ = nullptr;
+	binning_ = binning_modes::immediate;
+	binned_draw_count_ = 0;
+	current_draw_ = nullptr;
+	binned_stencil_ref_ = 0;
+	binned_output_depth_ = false;
+	deferred_ = false;
+	deferred_triangles_ = nullptr;
 }
 
 rasterizer::~rasterizer()
 {
 }
 
-void rasterizer::threaded_dispatch_primitive(thread_context const* thread_ctx)
+void tile_bins::reset(size_t tile_count)
+{
+	entry_tiles_.clear();
+	entry_prims_.clear();
+	tile_offsets_.assign(tile_count + 1, 0);
+	full_counts_.assign(tile_count, 0);
+}
+
+void tile_bins::push(uint32_t tile_id, uint32_t prim)
+{
+	entry_tiles_.push_back(tile_id);
+	entry_prims_.push_back(prim);
+	++tile_offsets_[tile_id + 1];
+	full_counts_[tile_id] += (prim & 1);
+}
+
+void tile_bins::sort_by_tile()
 {
-	vector<vector<uint32_t>>& tiled_prims = threaded_tiled_prims_[thread_ctx->thread_id];
-	for(auto& prims: tiled_prims)
+	size_t const tile_count = tile_offsets_.size() - 1;
+	for (size_t i = 0; i < tile_count; ++ i)
 	{
-		prims.clear();
+		tile_offsets_[i + 1] += tile_offsets_[i];
 	}
 
-	thread_context::package_cursor current_package = thread_ctx->next_package();
-	while ( current_package.valid() )
-	{
-		auto prim_range = current_package.item_range();
+	prims_.resize(entry_prims_.size());
 
-		for (int32_t i = prim_range.first; i < prim_range.second; ++ i)
-		{
-			if (3 == prim_size_)
-			{
-				compute_triangle_info(i);
-			}
+	// Scatter with a cursor per tile. Cursor of tile i ends at the beginning of tile i + 1,
+	// so offsets are restored by shifting them after scattering.
+	for (size_t i = 0; i < entry_prims_.size(); ++ i)
+	{
+		prims_[tile_offsets_[entry_tiles_[i]]++] = entry_prims_[i];
+	}
 
-			triangle_info const* tri_info = tri_infos_.data() + i;
-			
-			if (tri_info->v0 == nullptr)
-			{
-				continue;
-			}
-			float const x_min = tri_info->bounding_box[0];
-			float const x_max = tri_info->bounding_box[1];
-			float const y_min = tri_info->bounding_box[2];
-			float const y_max = tri_info->bounding_box[3];
+	for (size_t i = tile_count; i > 0; -- i)
+	{
+		tile_offsets_[i] = tile_offsets_[i - 1];
+	}
+	tile_offsets_[0] = 0;
+}
 
-			const int sx = std::min(fast_floori(std::max(0.0f, x_min) / TILE_SIZE),		static_cast<int>(tile_x_count_));
-			const int sy = std::min(fast_floori(std::max(0.0f, y_min) / TILE_SIZE),		static_cast<int>(tile_y_count_));
-			const int ex = std::min(fast_ceili (std::max(0.0f, x_max) / TILE_SIZE) + 1,	static_cast<int>(tile_x_count_));
-			const int ey = std::min(fast_ceili (std::max(0.0f, y_max) / TILE_SIZE) + 1,	static_cast<int>(tile_y_count_));
+// Merges primitive lists of all threads which are sorted already.
+static void merge_tile_prims(
+	std::vector<uint32_t>& prims, std::vector<tile_bins> const& bins, size_t tile_id)
+{
+	typedef std::pair<uint32_t const*, uint32_t const*> prim_range;
 
-			if ((sx + 1 == ex) && (sy + 1 == ey))
-			{
-				// Small primitive
-				tiled_prims[sy * tile_x_count_ + sx].push_back(i << 1);
-			}
-			else
-			{
-				if (3 == prim_size_)
-				{
-					vec4 const* edge_factors = tri_infos_[i].edge_factors;
+	size_t const MAX_MERGED_THREADS = 64;
 
-					bool const mark_x[3] =
-					{
-						edge_factors[0].x() > 0, edge_factors[1].x() > 0, edge_factors[2].x() > 0
-					};
+	prims.clear();
 
-					bool const mark_y[3] =
-					{
-						edge_factors[0].y() > 0, edge_factors[1].y() > 0, edge_factors[2].y() > 0
-					};
+	if (bins.size() > MAX_MERGED_THREADS)
+	{
+		for (size_t i = 0; i < bins.size(); ++ i)
+		{
+			prims.insert( prims.end(), bins[i].tile_begin(tile_id), bins[i].tile_end(tile_id) );
+		}
+		std::sort(prims.begin(), prims.end());
+		return;
+	}
+
+	// Threads are few, so a small heap of ranges on stack is enough.
+	prim_range heap[MAX_MERGED_THREADS];
+	size_t heap_size = 0;
+	for (size_t i = 0; i < bins.size(); ++ i)
+	{
+		prim_range range( bins[i].tile_begin(tile_id), bins[i].tile_end(tile_id) );
+		if (range.first != range.second)
+		{
+			heap[heap_size++] = range;
+		}
+	}
+
+	if (heap_size == 1)
+	{
+		prims.assign(heap[0].first, heap[0].second);
+		return;
+	}
+
+	auto greater_head = [](prim_range const& lhs, prim_range const& rhs) { return *lhs.first > *rhs.first; };
+	std::make_heap(heap, heap + heap_size, greater_head);
+	while (heap_size > 0)
+	{
+		std::pop_heap(heap, heap + heap_size, greater_head);
+		prim_range& range = heap[heap_size - 1];
+		prims.push_back(*range.first++);
+		if (range.first == range.second)
+		{
+			--heap_size;
+		}
+		else
+		{
+			std::push_heap(heap, heap + heap_size, greater_head);
+		}
+	}
+}
+
+void rasterizer::threaded_dispatch_primitive(thread_context const* thread_ctx)
+{
+	tile_bins& bins = current_draw_->threaded_bins[thread_ctx->thread_id];
+	bins.reset(tile_count_);
+
+	thread_context::package_cursor current_package = thread_ctx->next_package();
+	while ( current_package.valid() )
+	{
+		auto prim_range = current_package.item_range();
+
+		if (3 == prim_size_)
+		{
+			compute_triangle_infos(prim_range.first, prim_range.second - prim_range.first);
+		}
+
+		for (int32_t i = prim_range.first; i < prim_range.second; ++ i)
+		{
+			triangle_info* tri_info = current_draw_->tri_infos.data() + i;
+			
+			if (tri_info->v0 == nullptr)
+			{
+				continue;
+			}
+
+			// Vertexes are reused by later draws, so triangle is copied for shading pass.
+			if (deferred_)
+			{
+				deferred_triangle& dtri = deferred_triangles_[i];
+				vso_ops_->copy(dtri.v0, *tri_info->v0);
+				memcpy( dtri.ddx.raw_data(), tri_info->ddx->raw_data(), sizeof(vec4) * derivative_regs_ );
+				memcpy( dtri.ddy.raw_data(), tri_info->ddy->raw_data(), sizeof(vec4) * derivative_regs_ );
+			}
+
+			if (!current_draw_->first_verts.empty())
+			{
+				vs_output& first_vert = current_draw_->first_verts[i].vert;
+				vso_ops_->copy(first_vert, *tri_info->v0);
+				tri_info->v0 = &first_vert;
+			}
+
+			float const x_min = tri_info->bounding_box[0];
+			float const x_max = tri_info->bounding_box[1];
+			float const y_min = tri_info->bounding_box[2];
+			float const y_max = tri_info->bounding_box[3];
+
+			float const tile_size = static_cast<float>(tile_size_);
+			const int sx = std::min(fast_floori(std::max(0.0f, x_min) / tile_size),		static_cast<int>(tile_x_count_));
+			const int sy = std::min(fast_floori(std::max(0.0f, y_min) / tile_size),		static_cast<int>(tile_y_count_));
+			const int ex = std::min(fast_ceili (std::max(0.0f, x_max) / tile_size) + 1,	static_cast<int>(tile_x_count_));
+			const int ey = std::min(fast_ceili (std::max(0.0f, y_max) / tile_size) + 1,	static_cast<int>(tile_y_count_));
 
-					float step_x[3];
-					float step_y[3];
-					float rej_to_acc[3];
+			if ((sx + 1 == ex) && (sy + 1 == ey))
+			{
+				// Small primitive
+				bins.push(sy * tile_x_count_ + sx, i << 1);
+			}
+			else
+			{
+				if (3 == prim_size_)
+				{
+					// Edge functions are evaluated exactly in 64-bit integer and stepped from tile to tile.
+					int64_t const fixed_tile_size = static_cast<int64_t>(tile_size_) * SUBPIXEL_SCALE;
+
+					int64_t step_x[3];
+					int64_t step_y[3];
+					int64_t rej_offset[3];
+					int64_t acc_offset[3];
+					int64_t row_value[3];
 					for (int e = 0; e < 3; ++ e)
 					{
-						step_x[e] = TILE_SIZE * edge_factors[e].x();
-						step_y[e] = TILE_SIZE * edge_factors[e].y();
-						rej_to_acc[e] = -abs(step_x[e]) - abs(step_y[e]);
+						int64_t const dx = tri_info->edge_dx[e];
+						int64_t const dy = tri_info->edge_dy[e];
+						step_x[e] = dx * fixed_tile_size;
+						step_y[e] = dy * fixed_tile_size;
+						rej_offset[e] = std::max<int64_t>(step_x[e], 0) + std::max<int64_t>(step_y[e], 0);
+						acc_offset[e] = std::min<int64_t>(step_x[e], 0) + std::min<int64_t>(step_y[e], 0);
+						row_value[e] = step_x[e] * sx + step_y[e] * sy - tri_info->edge_c[e];
 					}
 
 					for (int y = sy; y < ey; ++ y)
 					{
+						int64_t value[3] = { row_value[0], row_value[1], row_value[2] };
 						for (int x = sx; x < ex; ++ x)
 						{
 							int rejection = 0;
@@ -885,16 +999,21 @@ void rasterizer::threaded_dispatch_primitive(thread_context const* thread_ctx)
 							// Trival rejection & acception
 							for (int e = 0; e < 3; ++ e)
 							{
-								float evalue = edge_factors[e].z() - ((x + mark_x[e]) * TILE_SIZE * edge_factors[e].x() + (y + mark_y[e]) * TILE_SIZE * edge_factors[e].y());
-								rejection |= (0 < evalue);
-								acception &= (rej_to_acc[e] >= evalue);
+								rejection |= (value[e] + rej_offset[e] < 0);
+								acception &= (value[e] + acc_offset[e] >= 0);
+								value[e] += step_x[e];
 							}
 
 							if (!rejection)
 							{
-								tiled_prims[y * tile_x_count_ + x].push_back((i << 1) | acception);
+								bins.push(y * tile_x_count_ + x, (i << 1) | acception);
 							}
 						}
+
+						for (int e = 0; e < 3; ++ e)
+						{
+							row_value[e] += step_y[e];
+						}
 					}
 				}
 				else
@@ -903,7 +1022,7 @@ void rasterizer::threaded_dispatch_primitive(thread_context const* thread_ctx)
 					{
 						for (int x = sx; x < ex; ++ x)
 						{
-							tiled_prims[y * tile_x_count_ + x].push_back(i << 1);
+							bins.push(y * tile_x_count_ + x, i << 1);
 						}
 					}
 				}
@@ -912,125 +1031,268 @@ void rasterizer::threaded_dispatch_primitive(thread_context const* thread_ctx)
 
 		current_package = thread_ctx->next_package();
 	}
+
+	bins.sort_by_tile();
 }
 
-void rasterizer::compute_triangle_info(uint32_t i)
+void rasterizer::compute_triangle_infos(uint32_t first_prim_id, uint32_t prim_count)
 {
-	triangle_info* tri_info = tri_infos_.data() + i;
-	tri_info->v0 = nullptr;
+	triangle_setup_batch batch;
+	vs_output const* reordered_verts[TRIANGLE_SETUP_BATCH_SIZE][3];
 
-	vs_output const* verts[3] =
+	for (uint32_t batch_start = 0; batch_start < prim_count; batch_start += TRIANGLE_SETUP_BATCH_SIZE)
 	{
-		clipped_verts_[i*prim_size_+0],
-		clipped_verts_[i*prim_size_+1],
-		clipped_verts_[i*prim_size_+2],
-	};
+		int const batch_size = static_cast<int>( std::min<uint32_t>(prim_count - batch_start, TRIANGLE_SETUP_BATCH_SIZE) );
 
-	vec4 const* vert_pos[3] =
-	{
-		&( verts[0]->position() ),
-		&( verts[1]->position() ),
-		&( verts[2]->position() )
-	};
+		// Gather positions of triangles into lanes.
+		for (int lane = 0; lane < TRIANGLE_SETUP_BATCH_SIZE; ++ lane)
+		{
+			// Unused lanes repeat the first triangle.
+			uint32_t const i = first_prim_id + batch_start + (lane < batch_size ? lane : 0);
 
-	// Reorder vertexes.
-	// Pick the vertex which is nearby center of viewport
-	// It will get more precision in interpolation.
-	double dist[3] =
-	{
-		fabs( vert_pos[0]->x() ) + fabs( vert_pos[0]->y() ),
-		fabs( vert_pos[1]->x() ) + fabs( vert_pos[1]->y() ),
-		fabs( vert_pos[2]->x() ) + fabs( vert_pos[2]->y() )
-	};
+			vs_output const* verts[3] =
+			{
+				clipped_verts_[i*prim_size_+0],
+				clipped_verts_[i*prim_size_+1],
+				clipped_verts_[i*prim_size_+2],
+			};
+
+			// Reorder vertexes.
+			// Pick the vertex which is nearby center of viewport
+			// It will get more precision in interpolation.
+			float dist[3] =
+			{
+				fabs( verts[0]->position().x() ) + fabs( verts[0]->position().y() ),
+				fabs( verts[1]->position().x() ) + fabs( verts[1]->position().y() ),
+				fabs( verts[2]->position().x() ) + fabs( verts[2]->position().y() )
+			};
 
-	int reordered_index[3];
-	if(dist[0] < dist[1])
-	{
-		if(dist[0] < dist[2])
+			int first_index;
+			if(dist[0] < dist[1])
+			{
+				first_index = dist[0] < dist[2] ? 0 : 2;
+			}
+			else
+			{
+				first_index = dist[1] < dist[2] ? 1 : 2;
+			}
+
+			for (int i_vert = 0; i_vert < 3; ++ i_vert)
+			{
+				vs_output const* v = verts[(first_index + i_vert) % 3];
+				reordered_verts[lane][i_vert] = v;
+				batch.x[i_vert][lane] = v->position().x();
+				batch.y[i_vert][lane] = v->position().y();
+				batch.z[i_vert][lane] = v->position().z();
+			}
+		}
+
+		kernels_->setup_triangles(&batch);
+
+		for (int lane = 0; lane < batch_size; ++ lane)
 		{
-			reordered_index[0] = 0;
+			finish_triangle_info(first_prim_id + batch_start + lane, reordered_verts[lane], &batch, lane);
 		}
-		else
+	}
+}
+
+// Computes edges, coverage of small triangle and derivatives of attributes, which could not be set up in batch.
+void rasterizer::finish_triangle_info(
+	uint32_t i, vs_output const* const* reordered_verts, triangle_setup_batch const* batch, int lane)
+{
+	triangle_info* tri_info = current_draw_->tri_infos.data() + i;
+	tri_info->v0 = nullptr;
+
+	// Return for zero-area triangle.
+	float const area = batch->area[lane];
+	if( equal<float>(area, 0.0f) ) return;
+
+	tri_info->front_face = area > 0.0f;
+
+	tri_info->bounding_box[0] = batch->bounding_box[0][lane];	// xmin
+	tri_info->bounding_box[1] = batch->bounding_box[1][lane];	// xmax
+	tri_info->bounding_box[2] = batch->bounding_box[2][lane];	// ymin
+	tri_info->bounding_box[3] = batch->bounding_box[3][lane];	// ymax
+
+	tri_info->depth_range[0] = batch->depth_range[0][lane];
+	tri_info->depth_range[1] = batch->depth_range[1][lane];
+
+	// Positions were snapped to sub-pixel grid, so they are converted to fixed point exactly.
+	int64_t fixed_x[3];
+	int64_t fixed_y[3];
+	for (int i_vert = 0; i_vert < 3; ++ i_vert)
+	{
+		fixed_x[i_vert] = static_cast<int64_t>(batch->x[i_vert][lane] * SUBPIXEL_SCALE);
+		fixed_y[i_vert] = static_cast<int64_t>(batch->y[i_vert][lane] * SUBPIXEL_SCALE);
+	}
+
+	for (int i_vert = 0; i_vert < 3; ++ i_vert)
+	{
+		// Edge function: x * (y0 - y1) + y * (x1 - x0) - (x1 * y0 - y1 * x0)
+		int const se = i_vert;
+		int const ee = (i_vert + 1) % 3;
+
+		int64_t a = fixed_y[se] - fixed_y[ee];
+		int64_t b = fixed_x[ee] - fixed_x[se];
+		int64_t c = fixed_x[ee] * fixed_y[se] - fixed_y[ee] * fixed_x[se];
+
+		// Top-left fill rule: samples on the edge are covered only if it is a left edge or a top edge.
+		bool const top_left = (a > 0) || (a == 0 && b > 0);
+
+		// Very long edges lose some sub-pixel precision to keep stepping in int32.
+		while ( std::max(std::abs(a), std::abs(b)) >= (int64_t(1) << MAX_EDGE_DELTA_BITS) )
 		{
-			reordered_index[0] = 2;
+			a /= 2;
+			b /= 2;
+			c /= 2;
 		}
+
+		tri_info->edge_dx[i_vert] = static_cast<int32_t>(a);
+		tri_info->edge_dy[i_vert] = static_cast<int32_t>(b);
+		tri_info->edge_c[i_vert] = top_left ? c : c + 1;
 	}
-	else
+
+	// Pixels which have samples inside the bounding box.
+	int32_t min_offset_x = SUBPIXEL_SCALE, max_offset_x = 0;
+	int32_t min_offset_y = SUBPIXEL_SCALE, max_offset_y = 0;
+	for (size_t i_sample = 0; i_sample < target_sample_count_; ++ i_sample)
+	{
+		min_offset_x = std::min(min_offset_x, sample_offsets_[i_sample * 2 + 0]);
+		max_offset_x = std::max(max_offset_x, sample_offsets_[i_sample * 2 + 0]);
+		min_offset_y = std::min(min_offset_y, sample_offsets_[i_sample * 2 + 1]);
+		max_offset_y = std::max(max_offset_y, sample_offsets_[i_sample * 2 + 1]);
+	}
+
+	int64_t const pixel_left	= ( std::min( std::min(fixed_x[0], fixed_x[1]), fixed_x[2] ) - max_offset_x + SUBPIXEL_SCALE - 1 ) >> SUBPIXEL_BITS;
+	int64_t const pixel_right	= ( std::max( std::max(fixed_x[0], fixed_x[1]), fixed_x[2] ) - min_offset_x ) >> SUBPIXEL_BITS;
+	int64_t const pixel_top		= ( std::min( std::min(fixed_y[0], fixed_y[1]), fixed_y[2] ) - max_offset_y + SUBPIXEL_SCALE - 1 ) >> SUBPIXEL_BITS;
+	int64_t const pixel_bottom	= ( std::max( std::max(fixed_y[0], fixed_y[1]), fixed_y[2] ) - min_offset_y ) >> SUBPIXEL_BITS;
+
+	// Triangle falls between samples.
+	if (pixel_left > pixel_right || pixel_top > pixel_bottom)
+	{
+		return;
+	}
+
+	// Coverage of small triangle is computed here for the whole quad aligned 4x4 block,
+	// so it skips region subdivision, and it is dropped before binning if no sample is covered.
+	int64_t const block_x = pixel_left & ~int64_t(1);
+	int64_t const block_y = pixel_top  & ~int64_t(1);
+	tri_info->is_small = (pixel_right < block_x + 4) && (pixel_bottom < block_y + 4);
+	if (tri_info->is_small)
 	{
-		if(dist[1] < dist[2])
+		tile_edges block_edges;
+		for (int e = 0; e < 3; ++ e)
 		{
-			reordered_index[0] = 1;
+			block_edges.value[e] = clamp_tile_edge_value(
+				  static_cast<int64_t>(tri_info->edge_dx[e]) * (block_x * SUBPIXEL_SCALE)
+				+ static_cast<int64_t>(tri_info->edge_dy[e]) * (block_y * SUBPIXEL_SCALE)
+				- tri_info->edge_c[e]
+				);
+			block_edges.dx[e] = tri_info->edge_dx[e];
+			block_edges.dy[e] = tri_info->edge_dy[e];
 		}
-		else
+		block_edges.value[3] = block_edges.dx[3] = block_edges.dy[3] = 0;
+
+		EFLIB_ALIGN(16) uint32_t pixel_mask[4 * 4];
+		kernels_->compute_pixel_mask(
+			pixel_mask, 0, 0, &block_edges, sample_offsets_, static_cast<uint32_t>(target_sample_count_)
+			);
+
+		uint64_t covered = 0;
+		for (int quad = 0; quad < 4; ++ quad)
+		{
+			tri_info->small_quad_masks[quad] = pack_quad_mask(pixel_mask, quad);
+			covered |= tri_info->small_quad_masks[quad];
+		}
+
+		if (covered == 0)
 		{
-			reordered_index[0] = 2;
+			return;
 		}
+
+		tri_info->small_x = static_cast<int32_t>(block_x);
+		tri_info->small_y = static_cast<int32_t>(block_y);
 	}
-	reordered_index[1] = ( reordered_index[0] + 1 ) % 3;
-	reordered_index[2] = ( reordered_index[1] + 1 ) % 3;
 
-	vs_output const* reordered_verts[3] = { verts[reordered_index[0]], verts[reordered_index[1]], verts[reordered_index[2]] };
+	// Compute difference of attributes. Only registers of live attributes are computed and stored.
+	size_t const regs = derivative_regs_;
+	vs_output* ddx = reinterpret_cast<vs_output*>( current_draw_->derivatives.data() + i * 2 * regs );
+	vs_output* ddy = reinterpret_cast<vs_output*>( current_draw_->derivatives.data() + (i * 2 + 1) * regs );
 
-	// Compute difference along edge.
 	vs_output e01, e02;
 	vso_ops_->sub(e01, *reordered_verts[1], *reordered_verts[0]);
 	vso_ops_->sub(e02, *reordered_verts[2], *reordered_verts[0]);
+	vso_ops_->compute_derivative(*vso_ops_, *ddx, *ddy, e01, e02, batch->inv_area[lane]);
 
-	// Compute area of triangle.
-	float area = cross_prod2(e02.position().xy(), e01.position().xy());
-	// Return for zero-area triangle.
-	if( equal<float>(area, 0.0f) ) return;
-
-	tri_info->front_face = area > 0.0f;
-	float inv_area = 1.0f / area;
+	tri_info->ddx = ddx;
+	tri_info->ddy = ddy;
+	tri_info->v0  = reordered_verts[0];
+}
 
-	// Compute bounding box
-	tri_info->bounding_box[0] = std::min( std::min( vert_pos[0]->x(), vert_pos[1]->x() ), vert_pos[2]->x() );	// xmin
-	tri_info->bounding_box[1] = std::max( std::max( vert_pos[0]->x(), vert_pos[1]->x() ), vert_pos[2]->x() );	// xmax
-	tri_info->bounding_box[2] = std::min( std::min( vert_pos[0]->y(), vert_pos[1]->y() ), vert_pos[2]->y() );	// ymin
-	tri_info->bounding_box[3] = std::max( std::max( vert_pos[0]->y(), vert_pos[1]->y() ), vert_pos[2]->y() );	// ymax
+void rasterizer::schedule_tiles()
+{
+	tile_costs_.assign(tile_count_, 0);
+	tile_order_.resize(tile_count_);
 
-	for (int i_vert = 0; i_vert < 3; ++ i_vert)
+	uint64_t total_cost = 0;
+	uint64_t max_cost = 0;
+	for (size_t i = 0; i < tile_count_; ++ i)
 	{
-		// Edge factors: x * (y1 - y0) - y * (x1 - x0) - (y1 * x0 - x1 * y0)
-		int const se = i_vert;
-		int const ee = (i_vert + 1) % 3;
+		uint64_t cost = 0;
+		for (size_t i_draw = 0; i_draw < binned_draw_count_; ++ i_draw)
+		{
+			for (auto const& bins: binned_draws_[i_draw].threaded_bins)
+			{
+				uint32_t full = bins.full_count(i);
+				cost += full * FULL_TILE_PRIM_COST + (bins.tile_size(i) - full) * PARTIAL_TILE_PRIM_COST;
+			}
+		}
 
-		vec4* edge_factors = tri_info->edge_factors;
-		edge_factors[i_vert].x(vert_pos[se]->y() - vert_pos[ee]->y()										);
-		edge_factors[i_vert].y(vert_pos[ee]->x() - vert_pos[se]->x()										);
-		edge_factors[i_vert].z(vert_pos[ee]->x() * vert_pos[se]->y() - vert_pos[ee]->y() * vert_pos[se]->x());
-		edge_factors[i_vert].w(0.0f);
+		tile_costs_[i] = cost;
+		tile_order_[i] = static_cast<uint32_t>(i);
+		total_cost += cost;
+		max_cost = std::max(max_cost, cost);
 	}
 
-	// Compute difference of attributes.
+	if (tile_schedule_ == tile_schedule_modes::heaviest_first)
 	{
-		vso_ops_->compute_derivative(tri_info->ddx, tri_info->ddy, e01, e02, inv_area);
+		std::vector<uint64_t> const& costs = tile_costs_;
+		std::stable_sort(
+			tile_order_.begin(), tile_order_.end(),
+			[&costs](uint32_t lhs, uint32_t rhs) { return costs[lhs] > costs[rhs]; }
+			);
 	}
 
-	tri_info->v0 = reordered_verts[0];
+	acc_ras_tile_cost_(pipeline_prof_, total_cost);
+	acc_ras_max_tile_cost_(pipeline_prof_, max_cost);
 }
 
 void rasterizer::threaded_rasterize_multi_prim(thread_context const* thread_ctx)
 {
 	viewport tile_vp;
-	tile_vp.w = TILE_SIZE;
-	tile_vp.h = TILE_SIZE;
+	tile_vp.w = static_cast<float>(tile_size_);
+	tile_vp.h = static_cast<float>(tile_size_);
 	tile_vp.minz = vp_->minz;
 	tile_vp.maxz = vp_->maxz;
 
-	std::vector<uint32_t> prims;
+	std::vector<uint32_t>& prims = threaded_sorted_prims_[thread_ctx->thread_id];
     pixel_statistic pixel_stat;
     pixel_stat.ps_invocations = 0;
     pixel_stat.backend_input_pixels = 0;
+    pixel_stat.hiz_tile_tests = 0;
+    pixel_stat.hiz_tile_rejections = 0;
+    pixel_stat.hiz_subtile_tests = 0;
+    pixel_stat.hiz_subtile_rejections = 0;
+
+	quad_package quads;
+	quads.size		= 0;
 
 	rasterize_multi_prim_context rast_ctxt;
-    rast_ctxt.shaders.cpp_ps	= threaded_cpp_ps_[thread_ctx->thread_id];
-    rast_ctxt.shaders.ps_unit	= threaded_psu_[thread_ctx->thread_id];
-    rast_ctxt.shaders.cpp_bs    = cpp_bs_;
 	rast_ctxt.tile_vp		    = &tile_vp;
 	rast_ctxt.sorted_prims	    = &prims;
     rast_ctxt.pixel_stat        = &pixel_stat;
+	rast_ctxt.quads				= &quads;
 
 	thread_context::package_cursor current_package = thread_ctx->next_package();
 	while ( current_package.valid() )
@@ -1038,34 +1300,63 @@ void rasterizer::threaded_rasterize_multi_prim(thread_context const* thread_ctx)
 		auto tile_range = current_package.item_range();
 		for (int32_t i = tile_range.first; i < tile_range.second; ++ i)
 		{
-			prims.clear();
-			for (size_t j = 0; j < threaded_tiled_prims_.size(); ++ j)
+			uint32_t const tile_id = tile_order_[i];
+
+			int y = tile_id / tile_x_count_;
+			int x = tile_id - y * tile_x_count_;
+
+			tile_vp.x = static_cast<float>(x * tile_size_);
+			tile_vp.y = static_cast<float>(y * tile_size_);
+
+			attach_tile_caches(thread_ctx->thread_id, x * tile_size_, y * tile_size_);
+
+			// Tile goes through all binned draws in order, so its targets stay in cache.
+			for (size_t i_draw = 0; i_draw < binned_draw_count_; ++ i_draw)
 			{
-				prims.insert(prims.end(), threaded_tiled_prims_[j][i].begin(), threaded_tiled_prims_[j][i].end());
-			}
-			std::sort(prims.begin(), prims.end());
+				binned_draw const& draw = binned_draws_[i_draw];
+				merge_tile_prims(prims, draw.threaded_bins, tile_id);
+				if (prims.empty())
+				{
+					continue;
+				}
 
-			int y = i / tile_x_count_;
-			int x = i - y * tile_x_count_;
+				rast_ctxt.draw					= &draw;
+				rast_ctxt.shaders.cpp_ps		= draw.threaded_cpp_ps[thread_ctx->thread_id].get();
+				rast_ctxt.shaders.ps_unit		= draw.threaded_psu[thread_ctx->thread_id].get();
+				rast_ctxt.shaders.cpp_bs		= draw.cpp_bs.get();
+				rast_ctxt.shaders.bs_unit		= draw.threaded_bsu[thread_ctx->thread_id].get();
+				rast_ctxt.shaders.vs_reflection	= draw.vs_reflection;
+				rast_ctxt.sorted_prims			= &prims;
 
-			tile_vp.x = static_cast<float>(x * TILE_SIZE);
-			tile_vp.y = static_cast<float>(y * TILE_SIZE);
+				rasterize_binned_prims(&rast_ctxt);
 
-			rast_ctxt.sorted_prims = &prims;
+				// Quads are shaded before shaders of next draw are used.
+				shade_quad_package(&quads, &rast_ctxt.shaders, &pixel_stat);
+			}
+
+			// Depth bounds of tile are tightened after all primitives were drawn.
+			frame_buffer_->hiz_refresh_tile(x * tile_size_, y * tile_size_, tile_size_);
 
-			rasterize_prims_(this, &rast_ctxt);
+			detach_tile_caches(x * tile_size_, y * tile_size_);
 
 			current_package = thread_ctx->next_package();
 		}
 	}
 
+	threaded_ras_finish_times_[thread_ctx->thread_id] = fetch_time_stamp_();
+
     acc_ps_invocations_(pipeline_stat_, pixel_stat.ps_invocations);
     acc_backend_input_pixels_(internal_stat_, pixel_stat.backend_input_pixels);
+    acc_hiz_tile_tests_(internal_stat_, pixel_stat.hiz_tile_tests);
+    acc_hiz_tile_rejections_(internal_stat_, pixel_stat.hiz_tile_rejections);
+    acc_hiz_subtile_tests_(internal_stat_, pixel_stat.hiz_subtile_tests);
+    acc_hiz_subtile_rejections_(internal_stat_, pixel_stat.hiz_subtile_rejections);
 }
 
 void rasterizer::rasterize_multi_line(rasterize_multi_prim_context const* ctx)
 {
 	rasterize_prim_context prim_ctxt;
+	prim_ctxt.draw		= ctx->draw;
     prim_ctxt.shaders	= ctx->shaders;
 	prim_ctxt.tile_vp	= ctx->tile_vp;
 
@@ -1076,17 +1367,47 @@ void rasterizer::rasterize_multi_line(rasterize_multi_prim_context const* ctx)
 	}
 }
 
+template <int TileSize>
 void rasterizer::rasterize_multi_triangle(rasterize_multi_prim_context const* ctx)
 {
 	rasterize_prim_context prim_ctxt;
+	prim_ctxt.draw		= ctx->draw;
     prim_ctxt.shaders   = ctx->shaders;
 	prim_ctxt.tile_vp	= ctx->tile_vp;
     prim_ctxt.pixel_stat= ctx->pixel_stat;
+	prim_ctxt.quads		= ctx->quads;
 
 	for (uint32_t prim_with_mask: *ctx->sorted_prims)
 	{
 		prim_ctxt.prim_id = prim_with_mask;
-		rasterize_triangle(&prim_ctxt);
+		rasterize_triangle<TileSize>(&prim_ctxt);
+	}
+}
+
+void rasterizer::rasterize_binned_prims(rasterize_multi_prim_context const* ctx)
+{
+	switch(ctx->draw->prim)
+	{
+	case pt_line:
+	case pt_wireframe_tri:
+		rasterize_multi_line(ctx);
+		break;
+	case pt_solid_tri:
+		switch(tile_size_)
+		{
+		case 32:
+			rasterize_multi_triangle<32>(ctx);
+			break;
+		case 128:
+			rasterize_multi_triangle<128>(ctx);
+			break;
+		default:
+			rasterize_multi_triangle<64>(ctx);
+			break;
+		}
+		break;
+	default:
+		EFLIB_ASSERT(false, "Primitive type is not correct.");
 	}
 }
 
@@ -1156,28 +1477,89 @@ void rasterizer::update_prim_info(render_state const* state)
 	}
 }
 
+vs_output_op const* rasterizer::bind_vs_output_op(uint32_t attr_count, uint32_t const* modifiers, uint32_t live_attributes)
+{
+	vs_output_op const& proto = get_vs_output_op(attr_count);
+	live_attributes &= (1UL << attr_count) - 1;
+
+	// Variants are never changed once they are added, so pending draws keep theirs
+	// and draws with different modifiers or live attributes could be binned together.
+	for(vs_output_op const& vso_op: vso_op_variants_)
+	{
+		if(    vso_op.construct == proto.construct
+			&& vso_op.live_attributes == live_attributes
+			&& std::equal(modifiers, modifiers + attr_count, vso_op.attribute_modifiers.begin()) )
+		{
+			return &vso_op;
+		}
+	}
+
+	vso_op_variants_.push_back(proto);
+	vs_output_op& vso_op = vso_op_variants_.back();
+	std::copy(modifiers, modifiers + attr_count, vso_op.attribute_modifiers.begin());
+	update_live_attributes(vso_op, attr_count, live_attributes);
+
+	return &vso_op;
+}
+
+// Attributes are mapped to pixel shader inputs in the same way as pixel_shader_unit does.
+uint32_t rasterizer::compute_ps_live_attributes() const
+{
+	uint32_t const all_attributes = 0xFFFFFFFF;
+
+	// C++ pixel shader could read any attribute.
+	if(cpp_ps_ != nullptr || ps_proto_ == nullptr)
+	{
+		return all_attributes;
+	}
+
+	uint32_t live_attributes = 0;
+	uint32_t register_index = 0;
+	for(sv_layout const* layout: ps_proto_->code->get_reflection()->layouts(su_stream_in))
+	{
+		if( layout->sv == semantic_value(sv_position) )
+		{
+			continue;
+		}
+
+		size_t attr_index = register_index++;
+		if(vs_reflection_)
+		{
+			sv_layout const* src_layout = vs_reflection_->input_sv_layout(layout->sv);
+			if(src_layout == nullptr)
+			{
+				return all_attributes;
+			}
+			attr_index = src_layout->logical_index;
+		}
+
+		live_attributes |= 1UL << attr_index;
+	}
+
+	return live_attributes;
+}
+
 void rasterizer::prepare_draw()
 {
 	// Set shader and interpolation attributes
+	uint32_t modifiers[MAX_VS_OUTPUT_ATTRS];
 	if(cpp_vs_)
 	{
 		num_vs_output_attributes_ = cpp_vs_->num_output_attributes();
-		auto vso_op = &get_vs_output_op(num_vs_output_attributes_);
 		for(uint32_t i = 0; i < num_vs_output_attributes_; ++i)
 		{
-			vso_op->attribute_modifiers[i] = cpp_vs_->output_attribute_modifiers(i);
+			modifiers[i] = cpp_vs_->output_attribute_modifiers(i);
 		}
-		vso_ops_ = vso_op;
+		vso_ops_ = bind_vs_output_op(num_vs_output_attributes_, modifiers, ps_live_attributes_);
 	}
 	else if(host_)
 	{
 		num_vs_output_attributes_ = host_->vs_output_attr_count();
-		auto vso_op = &get_vs_output_op(num_vs_output_attributes_);
 		for(uint32_t i = 0; i < num_vs_output_attributes_; ++i)
 		{
-			vso_op->attribute_modifiers[i] = vs_output::am_linear;
+			modifiers[i] = vs_output::am_linear;
 		}
-		vso_ops_ = vso_op;
+		vso_ops_ = bind_vs_output_op(num_vs_output_attributes_, modifiers, ps_live_attributes_);
 	}
 
     has_centroid_ = false;
@@ -1208,21 +1590,108 @@ void rasterizer::prepare_draw()
 		samples_pattern_[3] = vec2(0.625f, 0.875f);
 		break;
 
+	// Standard patterns of 8 and 16 samples, in 1/16 of pixel from pixel center.
+	case 8:
+	case 16:
+		{
+			static int const PATTERN_8[8][2] =
+			{
+				{ 1, -3}, {-1,  3}, { 5,  1}, {-3, -5}, {-5,  5}, {-7, -1}, { 3,  7}, { 7, -7}
+			};
+			static int const PATTERN_16[16][2] =
+			{
+				{ 1,  1}, {-1, -3}, {-3,  2}, { 4, -1}, {-5, -2}, { 2,  5}, { 5,  3}, { 3, -5},
+				{-2,  6}, { 0, -7}, {-4, -6}, {-6,  4}, {-8,  0}, { 7, -4}, { 6,  7}, {-7, -8}
+			};
+			int const (*pattern)[2] = (target_sample_count_ == 8) ? PATTERN_8 : PATTERN_16;
+			for (size_t i_sample = 0; i_sample < target_sample_count_; ++ i_sample)
+			{
+				samples_pattern_[i_sample] = vec2(0.5f + pattern[i_sample][0] / 16.0f, 0.5f + pattern[i_sample][1] / 16.0f);
+			}
+		}
+		break;
+
 	default:
 		break;
 	}
 
+	for (unsigned long i_sample = 0; i_sample < target_sample_count_; ++ i_sample)
+	{
+		sample_offsets_[i_sample * 2 + 0] = fast_roundi(samples_pattern_[i_sample].x() * SUBPIXEL_SCALE);
+		sample_offsets_[i_sample * 2 + 1] = fast_roundi(samples_pattern_[i_sample].y() * SUBPIXEL_SCALE);
+	}
+
 	// Compute tile count
-	tile_x_count_	= static_cast<size_t>(vp_->w + TILE_SIZE - 1) / TILE_SIZE;
-	tile_y_count_	= static_cast<size_t>(vp_->h + TILE_SIZE - 1) / TILE_SIZE;
+	tile_x_count_	= static_cast<size_t>(vp_->w + tile_size_ - 1) / tile_size_;
+	tile_y_count_	= static_cast<size_t>(vp_->h + tile_size_ - 1) / tile_size_;
 	tile_count_		= tile_x_count_ * tile_y_count_;
 }
 
+bool rasterizer::can_defer_draw() const
+{
+	// Depth of deferred draw is resolved by early-z, and only host shaders keep their states in the draw.
+	// Only the nearest fragment is shaded, so the draw has to be opaque.
+	return shading_ == shading_modes::visibility_buffer
+		&& prim_ == pt_solid_tri
+		&& cpp_vs_ == nullptr && ps_proto_ != nullptr
+		&& cpp_bs_ == nullptr && bs_proto_ == nullptr && frame_buffer_->blend_replaces()
+		&& depth_writable_ && frame_buffer_->early_z_enabled();
+}
+
+bool rasterizer::can_draw_depth_only() const
+{
+	if( prim_ != pt_solid_tri || !depth_writable_ || !frame_buffer_->early_z_enabled() )
+	{
+		return false;
+	}
+
+	if(z_prepass_)
+	{
+		return true;
+	}
+
+	// C++ pixel shader could discard pixels, so it is executed even if no color is written.
+	if(cpp_ps_ != nullptr)
+	{
+		return false;
+	}
+
+	for(auto const& color_target: draw_state_->color_targets)
+	{
+		if(color_target)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
 void rasterizer::draw()
 {
+	// Draw which is shaded forward is rendered after pending draws.
+	depth_only_ = can_draw_depth_only();
+	deferred_ = !depth_only_ && can_defer_draw();
+	bool const binned = (binning_ == binning_modes::deferred) && can_bin_draw();
+	if(!deferred_ && !vis_buffer_.empty())
+	{
+		flush();
+	}
+	if(!binned)
+	{
+		rasterize_binned_draws();
+	}
+
 	vert_cache_->prepare_vertices();
 	prepare_draw();
 
+	// Depth only draw carries position only, from clipping to rasterization.
+	if(depth_only_)
+	{
+		vso_ops_ = &get_vs_output_op(0);
+		has_centroid_ = false;
+	}
+	derivative_regs_ = vso_ops_->derivative_regs_count;
+
 	size_t num_threads	= num_available_threads();
 
 	geom_setup_context	geom_setup_ctx;
@@ -1235,6 +1704,10 @@ void rasterizer::draw()
 	geom_setup_ctx.vso_ops		    = vso_ops_;
     geom_setup_ctx.pipeline_stat    = pipeline_stat_;
     geom_setup_ctx.acc_cinvocations = acc_cinvocations_;
+	geom_setup_ctx.guard_band		= guard_band_;
+    geom_setup_ctx.internal_stat    = internal_stat_;
+    geom_setup_ctx.acc_guard_band_accepted_prims = acc_guard_band_accepted_prims_;
+    geom_setup_ctx.acc_clipped_prims = acc_clipped_prims_;
 
 	uint64_t clipping_start_time = fetch_time_stamp_();
 	gse_.execute(&geom_setup_ctx, fetch_time_stamp_);
@@ -1250,16 +1723,53 @@ void rasterizer::draw()
 
 	// Project and Transformed to Viewport
 	uint64_t vp_trans_start_time = fetch_time_stamp_();
-	viewport_and_project_transform(clipped_verts_, clipped_verts_count_);
+	viewport_and_project_transform( gse_.produced_verts() );
 	acc_vp_trans_(pipeline_prof_, fetch_time_stamp_() - vp_trans_start_time);
 
+	// Append draw to binned draws.
+	if(binned_draw_count_ == binned_draws_.size())
+	{
+		binned_draws_.resize(binned_draw_count_ + 1);
+	}
+	if(binned_draw_count_ == 0)
+	{
+		binned_color_targets_	= draw_state_->color_targets;
+		binned_ds_target_		= draw_state_->depth_stencil_target;
+		binned_ds_state_		= draw_state_->ds_state;
+		binned_bl_state_		= draw_state_->bl_state;
+		binned_stencil_ref_		= draw_state_->stencil_ref;
+		binned_output_depth_	= !draw_state_->vx_shader && cpp_ps_ && cpp_ps_->output_depth();
+	}
+	current_draw_ = &binned_draws_[binned_draw_count_++];
+
+	current_draw_->prim				= prim_;
+	current_draw_->vso_ops			= vso_ops_;
+	current_draw_->has_centroid		= has_centroid_;
+	current_draw_->deferred			= deferred_;
+	current_draw_->depth_only		= depth_only_;
+	current_draw_->vs_reflection	= vs_reflection_;
+	current_draw_->vx_shader		= draw_state_->vx_shader;
+	current_draw_->cpp_bs			= draw_state_->cpp_bs;
+
 	uint64_t tri_dispatch_start_time = fetch_time_stamp_();
 	// Dispatch primitives into tiles' bucket
-	threaded_tiled_prims_.resize(num_threads);
-	tri_infos_.resize(clipped_prims_count_);
-	for (size_t i = 0; i < num_threads; ++ i)
+	current_draw_->threaded_bins.resize(num_threads);
+	current_draw_->tri_infos.resize(clipped_prims_count_);
+	current_draw_->derivatives.resize(clipped_prims_count_ * 2 * derivative_regs_);
+	// Clipped vertexes are overwritten by next draw, so first vertexes of binned draw are kept in draw.
+	current_draw_->first_verts.resize(binned ? clipped_prims_count_ : 0);
+
+	if(deferred_)
 	{
-		threaded_tiled_prims_[i].resize(tile_count_);
+		current_draw_->deferred_draw_id = vis_buffer_.add_draw(draw_state_);
+		deferred_draw& d = vis_buffer_.draw(current_draw_->deferred_draw_id);
+		d.triangles.resize(clipped_prims_count_);
+		d.vso_ops		= vso_ops_;
+		d.vx_shader		= draw_state_->vx_shader;
+		d.px_shader		= draw_state_->px_shader;
+		d.vs_reflection	= vs_reflection_;
+		d.cpp_bs		= draw_state_->cpp_bs;
+		deferred_triangles_ = d.triangles.data();
 	}
 
 	// Execute dispatching primitive
@@ -1269,38 +1779,90 @@ void rasterizer::draw()
 		);
 	acc_tri_dispatch_(pipeline_prof_, fetch_time_stamp_() - tri_dispatch_start_time);
 
-	// Rasterize tiles
-	switch(prim_)
+	// Create shader clones per thread. They live until binned draws are rasterized.
+	current_draw_->threaded_cpp_ps.resize(num_threads);
+	current_draw_->threaded_psu.resize(num_threads);
+	current_draw_->threaded_bsu.resize(num_threads);
+
+	for (size_t i = 0; i < num_threads && !depth_only_; ++ i)
 	{
-	case pt_line:
-	case pt_wireframe_tri:
-		rasterize_prims_ = boost::mem_fn(&rasterizer::rasterize_multi_line);
-		break;
-	case pt_solid_tri:
-		rasterize_prims_ = boost::mem_fn(&rasterizer::rasterize_multi_triangle);
-		break;
-	default:
-		EFLIB_ASSERT(false, "Primitive type is not correct.");
+		if(cpp_ps_ != nullptr)
+		{
+			current_draw_->threaded_cpp_ps[i] = cpp_ps_->clone<cpp_pixel_shader>();
+		}
+		if(ps_proto_ != nullptr)
+		{
+			current_draw_->threaded_psu[i] = ps_proto_->clone();
+		}
+		if(bs_proto_ != nullptr)
+		{
+			current_draw_->threaded_bsu[i] = bs_proto_->clone();
+		}
 	}
 
-	std::vector<cpp_pixel_shader_ptr>	ppps(num_threads);
-	std::vector<pixel_shader_unit_ptr>	ppsu(num_threads);
+	if(deferred_)
+	{
+		deferred_draw& d = vis_buffer_.draw(current_draw_->deferred_draw_id);
+		d.threaded_psu = current_draw_->threaded_psu;
+		d.threaded_bsu = current_draw_->threaded_bsu;
+	}
 
-	threaded_cpp_ps_.resize(num_threads);
-	threaded_psu_.resize(num_threads);
+	current_draw_ = nullptr;
 
-	for (size_t i = 0; i < num_threads; ++ i)
+	if(!binned)
 	{
-		// create cpp_pixel_shader clone per thread from hps
-		if(cpp_ps_ != nullptr)
+		rasterize_binned_draws();
+	}
+}
+
+bool rasterizer::can_bin_draw() const
+{
+	// Lines are rasterized from clipped vertexes, which are not kept across draws.
+	return prim_ == pt_solid_tri;
+}
+
+void rasterizer::rasterize_binned_draws()
+{
+	if(binned_draw_count_ == 0)
+	{
+		return;
+	}
+
+	size_t num_threads = num_available_threads();
+
+	threaded_sorted_prims_.resize(num_threads);
+	threaded_ras_finish_times_.resize(num_threads);
+
+	uint64_t schedule_start_time = fetch_time_stamp_();
+	schedule_tiles();
+	acc_tile_schedule_(pipeline_prof_, fetch_time_stamp_() - schedule_start_time);
+
+	// Binned draws share targets, so caches of all targets are enabled for whole rasterization.
+	cached_targets_.clear();
+	if(tile_cache_)
+	{
+		for (auto const& target: binned_color_targets_)
 		{
-			ppps[i] = cpp_ps_->clone<cpp_pixel_shader>();
-			threaded_cpp_ps_[i] = ppps[i].get();
+			if (target)
+			{
+				cached_targets_.push_back( target.get() );
+			}
 		}
-		if(ps_proto_ != nullptr)
+		if (binned_ds_target_)
+		{
+			cached_targets_.push_back( binned_ds_target_.get() );
+		}
+
+		size_t cache_size = 0;
+		for (surface* target: cached_targets_)
 		{
-			ppsu[i] = ps_proto_->clone();
-			threaded_psu_[i] = ppsu[i].get();
+			target->enable_tile_caches(true);
+			cache_size += (target->tile_cache_size(tile_size_) + 63) & ~size_t(63);
+		}
+		threaded_tile_caches_.resize(num_threads);
+		for (auto& cache: threaded_tile_caches_)
+		{
+			cache.resize(cache_size);
 		}
 	}
 
@@ -1309,79 +1871,171 @@ void rasterizer::draw()
 		[this](thread_context const* thread_ctx){ this->threaded_rasterize_multi_prim(thread_ctx); },
 		tile_count_, RASTERIZE_PRIMITIVE_PACKAGE_SIZE, num_threads
 		);
-	acc_ras_(pipeline_prof_, fetch_time_stamp_() - ras_start_time);
+	uint64_t ras_end_time = fetch_time_stamp_();
 
-	// destroy all cpp_pixel_shader clone
+	for (surface* target: cached_targets_)
+	{
+		target->enable_tile_caches(false);
+	}
+	cached_targets_.clear();
+	acc_ras_(pipeline_prof_, ras_end_time - ras_start_time);
+
+	// Threads which finished earlier were idle until the last one finished.
+	uint64_t ras_idle_time = 0;
 	for (size_t i = 0; i < num_threads; ++ i)
 	{
-        ppps[i].reset();
+		ras_idle_time += ras_end_time - threaded_ras_finish_times_[i];
+	}
+	acc_ras_idle_(pipeline_prof_, ras_idle_time);
+
+	// Release shaders and targets held by binned draws. Storage of primitives is kept for next draws.
+	for (size_t i_draw = 0; i_draw < binned_draw_count_; ++ i_draw)
+	{
+		binned_draw& draw = binned_draws_[i_draw];
+		draw.vx_shader.reset();
+		draw.cpp_bs.reset();
+		draw.threaded_cpp_ps.clear();
+		draw.threaded_psu.clear();
+		draw.threaded_bsu.clear();
+	}
+	binned_draw_count_ = 0;
+
+	binned_color_targets_.clear();
+	binned_ds_target_.reset();
+	binned_ds_state_.reset();
+	binned_bl_state_.reset();
+}
+
+void rasterizer::attach_tile_caches(size_t thread_id, size_t left, size_t top)
+{
+	// Cache of each target starts at a cache line.
+	byte* buffer = cached_targets_.empty() ? nullptr : threaded_tile_caches_[thread_id].data();
+	for (surface* target: cached_targets_)
+	{
+		target->attach_tile_cache(left, top, tile_size_, buffer);
+		buffer += (target->tile_cache_size(tile_size_) + 63) & ~size_t(63);
+	}
+}
+
+void rasterizer::detach_tile_caches(size_t left, size_t top)
+{
+	for (surface* target: cached_targets_)
+	{
+		target->detach_tile_cache(left, top, tile_size_);
+	}
+}
+
+// Snaps screen position to sub-pixel grid, so that edge functions could be evaluated in fixed point exactly.
+// Positions far away from screen are clamped, they are only rasterized in guard band.
+static void snap_to_subpixel(vec4& position)
+{
+	float const max_coord = static_cast<float>(1 << 26);
+	for (int i = 0; i < 2; ++ i)
+	{
+		float v = std::max( std::min(position[i], max_coord), -max_coord );
+		position[i] = floorf(v * SUBPIXEL_SCALE + 0.5f) / SUBPIXEL_SCALE;
 	}
 }
 
 void threaded_viewport_and_project_transform(
-	vs_output_functions::project proj_fn,
-	vs_output** verts,
+	vs_output_op const* vso_ops,
+	std::vector<vs_output_range> const& ranges,
+	std::vector<size_t> const& range_offsets,
 	viewport const* vp,
 	thread_context const* thread_ctx)
 {
 	thread_context::package_cursor current_package = thread_ctx->next_package();
 	while ( current_package.valid() )
 	{
-		auto prim_range = current_package.item_range();
+		auto vert_range = current_package.item_range();
 
-		for (int32_t i = prim_range.first; i < prim_range.second; ++ i)
+		// Find range which contains first vertex of package, then walk through ranges.
+		size_t i_range = std::upper_bound(range_offsets.begin(), range_offsets.end(), static_cast<size_t>(vert_range.first))
+			- range_offsets.begin() - 1;
+		for (int32_t i = vert_range.first; i < vert_range.second; ++ i)
 		{
-			vs_output* vso = verts[i];
+			while (static_cast<size_t>(i) >= range_offsets[i_range + 1])
+			{
+				++ i_range;
+			}
+
+			vs_output* vso = ranges[i_range].first + (i - range_offsets[i_range]);
 			viewport_transform(vso->position(), *vp);
-			proj_fn(*vso, *vso);
+			snap_to_subpixel(vso->position());
+			vso_ops->project(*vso_ops, *vso, *vso);
 		}
 		current_package = thread_ctx->next_package();
 	}
 }
 
-void rasterizer::viewport_and_project_transform(vs_output** vertexes, size_t num_verts)
+void rasterizer::viewport_and_project_transform(std::vector<vs_output_range> const& ranges)
 {
-	vs_output_functions::project proj_fn = vso_ops_->project;
-
-	// Gathering vs_output need to be processed.
-	vector<vs_output*> sorted;
-	sorted.insert( sorted.end(), vertexes, vertexes+num_verts );
-
-#if defined(EFLIB_MSVC)
-	concurrency::parallel_sort( sorted.data(), sorted.data() + sorted.size() );
-#else
-	std::sort( sorted.begin(), sorted.end() );
-#endif
-
-	sorted.erase( std::unique(sorted.begin(), sorted.end()), sorted.end() );
-
-	vs_output** trans_proj_verts = sorted.data();
+	// Vertexes are transformed where they are produced, so each one is projected exactly once without sorting.
+	projected_range_offsets_.resize(ranges.size() + 1);
+	projected_range_offsets_[0] = 0;
+	for (size_t i = 0; i < ranges.size(); ++ i)
+	{
+		projected_range_offsets_[i + 1] = projected_range_offsets_[i] + ranges[i].second;
+	}
 
 	execute_threads(
-		[this, trans_proj_verts](thread_context const* thread_ctx)
+		[this, &ranges](thread_context const* thread_ctx)
 		{
-			threaded_viewport_and_project_transform(this->vso_ops_->project, trans_proj_verts, this->vp_, thread_ctx);
+			threaded_viewport_and_project_transform(this->vso_ops_, ranges, this->projected_range_offsets_, this->vp_, thread_ctx);
 		},
-		static_cast<int>( sorted.size() ), VP_PROJ_TRANSFORM_PAKCAGE_SIZE
+		static_cast<int>( projected_range_offsets_.back() ), VP_PROJ_TRANSFORM_PAKCAGE_SIZE
 	);
 }
 
+// Interpolates depth only, and tests and writes it by early-z.
+void rasterizer::draw_depth_quad(
+	uint32_t left, uint32_t top, uint64_t quad_mask, drawing_triangle_context const* triangle_ctx)
+{
+	triangle_info const* tri_info = triangle_ctx->tri_info;
+
+	float const dzdx = tri_info->ddx->position().z();
+	float const dzdy = tri_info->ddy->position().z();
+	float const dx = 0.5f + left - tri_info->v0->position().x();
+	float const dy = 0.5f + top  - tri_info->v0->position().y();
+
+	// Same steps as step_2d_unproj_pos_quad, so depth is identical to depth of shaded draw.
+	float depth[4];
+	depth[0] = tri_info->v0->position().z() + (dzdx * dx + dzdy * dy);
+	depth[1] = depth[0] + dzdx;
+	depth[2] = depth[0] + dzdy;
+	depth[3] = depth[1] + dzdy;
+
+	frame_buffer_->early_z_test_quad(left, top, quad_mask, depth, triangle_ctx->aa_z_offset, tri_info->front_face);
+}
+
 void rasterizer::draw_full_quad(
 	uint32_t left, uint32_t top,
 	drawing_shader_context const* shaders,
     drawing_triangle_context const* triangle_ctx
 	)
 {
+	if (triangle_ctx->draw->depth_only)
+	{
+		draw_depth_quad(left, top, quad_full_mask_, triangle_ctx);
+		return;
+	}
+
 #if 1
-	EFLIB_ALIGN(16) vs_output pixels[4];
+	EFLIB_ALIGN(16) vs_output quad_pixels[4];
+
+	// Quads for JIT pixel shader are stepped into the package directly.
+	quad_package* quads  = shaders->ps_unit ? triangle_ctx->quads : nullptr;
+	vs_output*    pixels = quads ? quads->pixels + quads->size * 4 : quad_pixels;
+
+	vs_output_op const* vso_ops = triangle_ctx->draw->vso_ops;
 
 	float const dx = 0.5f + left - triangle_ctx->tri_info->v0->position().x();
 	float const dy = 0.5f + top  - triangle_ctx->tri_info->v0->position().y();
 
-	vso_ops_->step_2d_unproj_pos_quad(
+	vso_ops->step_2d_unproj_pos_quad(
 		pixels, *triangle_ctx->tri_info->v0, 
-		dx, triangle_ctx->tri_info->ddx,
-		dy, triangle_ctx->tri_info->ddy
+		dx, *triangle_ctx->tri_info->ddx,
+		dy, *triangle_ctx->tri_info->ddy
 		);
 
 	uint64_t  quad_mask = quad_full_mask_;
@@ -1396,20 +2050,26 @@ void rasterizer::draw_full_quad(
 
 	if ( frame_buffer_->early_z_enabled() )
 	{
-		quad_mask = frame_buffer_->early_z_test_quad(left, top, depth, triangle_ctx->aa_z_offset);
+		quad_mask = frame_buffer_->early_z_test_quad(left, top, depth, triangle_ctx->aa_z_offset, triangle_ctx->tri_info->front_face);
 	}
 
 	if (quad_mask == 0)
 	{
 		return;
 	}
+
+	if (triangle_ctx->draw->deferred)
+	{
+		vis_buffer_.write_quad(left, top, quad_mask, triangle_ctx->draw->deferred_draw_id, triangle_ctx->prim_id);
+		return;
+	}
 	
 	triangle_ctx->pixel_stat->ps_invocations += 4;
 
-	vso_ops_->step_2d_unproj_attr_quad(
-		pixels, *triangle_ctx->tri_info->v0, 
-		dx, triangle_ctx->tri_info->ddx,
-		dy, triangle_ctx->tri_info->ddy
+	vso_ops->step_2d_unproj_attr_quad(
+		*vso_ops, pixels, *triangle_ctx->tri_info->v0, 
+		dx, *triangle_ctx->tri_info->ddx,
+		dy, *triangle_ctx->tri_info->ddy
 		);
 	          
 #if 0
@@ -1425,21 +2085,19 @@ void rasterizer::draw_full_quad(
 	printf("\n");
 #endif
 
-	if(shaders->ps_unit)
-	{
-		shaders->ps_unit->update(pixels, vs_reflection_);
-		shaders->ps_unit->execute(pso, depth);
-	}
-	else
+	if(quads)
 	{
-		quad_mask &= shaders->cpp_ps->execute(pixels, pso, depth);
+		collect_quad(left, top, quad_mask, depth, shaders, triangle_ctx);
+		return;
 	}
 
+	quad_mask &= shaders->cpp_ps->execute(pixels, pso, depth);
+
 	if(quad_mask != 0)
 	{
 		triangle_ctx->pixel_stat->backend_input_pixels += 4;
 		frame_buffer_->render_sample_quad(
-			shaders->cpp_bs, left, top, quad_mask,
+			shaders->cpp_bs, shaders->bs_unit, left, top, quad_mask,
 			pso, depth, triangle_ctx->tri_info->front_face, triangle_ctx->aa_z_offset
 			);
 	}
@@ -1451,17 +2109,28 @@ void rasterizer::draw_quad(
 	drawing_shader_context const* shaders,
 	drawing_triangle_context const* triangle_ctx)
 {
+	if (triangle_ctx->draw->depth_only)
+	{
+		draw_depth_quad(left, top, quad_mask, triangle_ctx);
+		return;
+	}
+
 #if 1
-	EFLIB_ALIGN(16) vs_output pixels[4];
+	EFLIB_ALIGN(16) vs_output quad_pixels[4];
+
+	// Quads for JIT pixel shader are stepped into the package directly.
+	quad_package* quads  = shaders->ps_unit ? triangle_ctx->quads : nullptr;
+	vs_output*    pixels = quads ? quads->pixels + quads->size * 4 : quad_pixels;
 
 	auto v0  =  triangle_ctx->tri_info->v0;
-	auto ddx = &triangle_ctx->tri_info->ddx; 
-	auto ddy = &triangle_ctx->tri_info->ddy;
+	auto ddx = triangle_ctx->tri_info->ddx;
+	auto ddy = triangle_ctx->tri_info->ddy;
+	auto vso_ops = triangle_ctx->draw->vso_ops;
 
 	float const quad_dx = 0.5f + left - v0->position().x();
 	float const quad_dy = 0.5f + top  - v0->position().y();
 
-	vso_ops_->step_2d_unproj_pos_quad(pixels, *v0, quad_dx, *ddx, quad_dy, *ddy);
+	vso_ops->step_2d_unproj_pos_quad(pixels, *v0, quad_dx, *ddx, quad_dy, *ddy);
 
 	ps_output pso[4];
 	float     depth[4] = 
@@ -1475,7 +2144,7 @@ void rasterizer::draw_quad(
 	uint64_t tested_quad_mask = quad_mask;
 	if ( frame_buffer_->early_z_enabled() )
 	{
-		tested_quad_mask = frame_buffer_->early_z_test_quad(left, top, quad_mask, depth, triangle_ctx->aa_z_offset);
+		tested_quad_mask = frame_buffer_->early_z_test_quad(left, top, quad_mask, depth, triangle_ctx->aa_z_offset, triangle_ctx->tri_info->front_face);
 	}
 
 	if(tested_quad_mask == 0)
@@ -1483,9 +2152,15 @@ void rasterizer::draw_quad(
 		return;
 	}
 
-	if(!has_centroid_)
+	if(triangle_ctx->draw->deferred)
 	{
-		vso_ops_->step_2d_unproj_attr_quad(pixels, *v0, quad_dx, *ddx, quad_dy, *ddy);
+		vis_buffer_.write_quad(left, top, tested_quad_mask, triangle_ctx->draw->deferred_draw_id, triangle_ctx->prim_id);
+		return;
+	}
+
+	if(!triangle_ctx->draw->has_centroid)
+	{
+		vso_ops->step_2d_unproj_attr_quad(*vso_ops, pixels, *v0, quad_dx, *ddx, quad_dy, *ddy);
 	}
 	else
 	{
@@ -1522,31 +2197,197 @@ void rasterizer::draw_quad(
 				dx += sp_centroid.x() - 0.5f;
 				dy += sp_centroid.y() - 0.5f;
 			}
-			vso_ops_->step_2d_unproj_attr(pixels[i_pixel], *v0, dx, *ddx, dy, *ddy);
+			vso_ops->step_2d_unproj_attr(*vso_ops, pixels[i_pixel], *v0, dx, *ddx, dy, *ddy);
 		}
 	}
 
 	triangle_ctx->pixel_stat->ps_invocations += 4;
 
-	if(shaders->ps_unit)
+	if(quads)
 	{
-		shaders->ps_unit->update(pixels, vs_reflection_);
-		shaders->ps_unit->execute(pso, depth);
-	}
-	else
-	{
-		tested_quad_mask &= shaders->cpp_ps->execute(pixels, pso, depth);
+		collect_quad(left, top, tested_quad_mask, depth, shaders, triangle_ctx);
+		return;
 	}
 
+	tested_quad_mask &= shaders->cpp_ps->execute(pixels, pso, depth);
+
 	if(quad_mask != 0)
 	{
 		triangle_ctx->pixel_stat->backend_input_pixels += 4;
 		frame_buffer_->render_sample_quad(
-			shaders->cpp_bs, left, top, tested_quad_mask,
+			shaders->cpp_bs, shaders->bs_unit, left, top, tested_quad_mask,
 			pso, depth, triangle_ctx->tri_info->front_face, triangle_ctx->aa_z_offset
 			);
 	}
 #endif
 }
 
+void rasterizer::collect_quad(
+	uint32_t left, uint32_t top, uint64_t quad_mask, float const* depth,
+	drawing_shader_context const* shaders, drawing_triangle_context const* triangle_ctx)
+{
+	// Pixels of quad were stepped into the slot already.
+	quad_package* quads = triangle_ctx->quads;
+	uint32_t const i_quad = quads->size++;
+
+	quads->lefts[i_quad]		= left;
+	quads->tops[i_quad]			= top;
+	quads->masks[i_quad]		= quad_mask;
+	quads->front_faces[i_quad]	= triangle_ctx->tri_info->front_face;
+	for (int i = 0; i < 4; ++ i)
+	{
+		quads->depths[i_quad * 4 + i] = depth[i];
+	}
+	for (size_t i_sample = 0; i_sample < target_sample_count_; ++ i_sample)
+	{
+		quads->aa_z_offsets[i_quad][i_sample] = triangle_ctx->aa_z_offset[i_sample];
+	}
+
+	if (quads->size >= QUAD_PACKAGE_SIZE)
+	{
+		shade_quad_package(quads, shaders, triangle_ctx->pixel_stat);
+	}
+}
+
+void rasterizer::shade_quad_package(quad_package* package, drawing_shader_context const* shaders, pixel_statistic* pixel_stat)
+{
+	if (package->size == 0)
+	{
+		return;
+	}
+
+	shaders->ps_unit->execute_quads(package->pixels, shaders->vs_reflection, package->outs, package->depths, package->size);
+
+	for (uint32_t i_quad = 0; i_quad < package->size; ++ i_quad)
+	{
+		pixel_stat->backend_input_pixels += 4;
+		frame_buffer_->render_sample_quad(
+			shaders->cpp_bs, shaders->bs_unit, package->lefts[i_quad], package->tops[i_quad], package->masks[i_quad],
+			package->outs + i_quad * 4, package->depths + i_quad * 4,
+			package->front_faces[i_quad], package->aa_z_offsets[i_quad]
+			);
+	}
+
+	package->size = 0;
+}
+
+void rasterizer::flush()
+{
+	rasterize_binned_draws();
+
+	if( vis_buffer_.empty() )
+	{
+		return;
+	}
+
+	size_t const tile_x_count = (vis_buffer_.width()  + tile_size_ - 1) / tile_size_;
+	size_t const tile_y_count = (vis_buffer_.height() + tile_size_ - 1) / tile_size_;
+
+	execute_threads(
+		[this](thread_context const* thread_ctx){ this->threaded_shade_visibility_tiles(thread_ctx); },
+		tile_x_count * tile_y_count, RASTERIZE_PRIMITIVE_PACKAGE_SIZE, num_available_threads()
+		);
+
+	vis_buffer_.reset();
+}
+
+void rasterizer::threaded_shade_visibility_tiles(thread_context const* thread_ctx)
+{
+	size_t const width			= vis_buffer_.width();
+	size_t const height			= vis_buffer_.height();
+	size_t const tile_x_count	= (width + tile_size_ - 1) / tile_size_;
+
+	uint64_t ps_invocations = 0;
+
+	thread_context::package_cursor current_package = thread_ctx->next_package();
+	while ( current_package.valid() )
+	{
+		auto tile_range = current_package.item_range();
+		for (int32_t i = tile_range.first; i < tile_range.second; ++ i)
+		{
+			uint32_t const tile_left	= static_cast<uint32_t>( (i % tile_x_count) * tile_size_ );
+			uint32_t const tile_top		= static_cast<uint32_t>( (i / tile_x_count) * tile_size_ );
+			uint32_t const tile_right	= static_cast<uint32_t>( std::min<size_t>(tile_left + tile_size_, width) );
+			uint32_t const tile_bottom	= static_cast<uint32_t>( std::min<size_t>(tile_top  + tile_size_, height) );
+
+			for (uint32_t top = tile_top; top < tile_bottom; top += 2)
+			{
+				for (uint32_t left = tile_left; left < tile_right; left += 2)
+				{
+					ps_invocations += shade_visibility_quad(left, top, thread_ctx->thread_id);
+				}
+			}
+		}
+
+		current_package = thread_ctx->next_package();
+	}
+
+	acc_ps_invocations_(pipeline_stat_, ps_invocations);
+}
+
+uint64_t rasterizer::shade_visibility_quad(uint32_t left, uint32_t top, size_t thread_id)
+{
+	// Slots of samples are laid out as quad mask.
+	uint64_t ids[4 * MAX_SAMPLE_COUNT];
+	uint64_t unshaded_mask = 0;
+	for (uint32_t i = 0; i < 4; ++ i)
+	{
+		for (uint32_t i_sample = 0; i_sample < vis_buffer_.sample_count(); ++ i_sample)
+		{
+			uint32_t const slot = i * MAX_SAMPLE_COUNT + i_sample;
+			ids[slot] = vis_buffer_.id(left + (i & 1), top + (i >> 1), i_sample);
+			if (ids[slot] != visibility_buffer::INVALID_ID)
+			{
+				unshaded_mask |= 1ULL << slot;
+			}
+		}
+	}
+
+	uint64_t ps_invocations = 0;
+
+	// Quad is shaded once per triangle which is visible in it.
+	uint32_t first_slot;
+	while ( _xmm_bsf(&first_slot, unshaded_mask) )
+	{
+		uint64_t const id = ids[first_slot];
+		uint64_t quad_mask = 0;
+		for (uint32_t slot = first_slot; slot < 4 * MAX_SAMPLE_COUNT; ++ slot)
+		{
+			if ( ( (unshaded_mask >> slot) & 1 ) && ids[slot] == id )
+			{
+				quad_mask |= 1ULL << slot;
+			}
+		}
+		unshaded_mask &= ~quad_mask;
+
+		deferred_draw const& d = vis_buffer_.draw( static_cast<uint32_t>(id >> 32) );
+		deferred_triangle const& tri = d.triangles[ static_cast<uint32_t>(id) ];
+
+		// Attributes are reconstructed from the first vertex and derivatives of triangle.
+		EFLIB_ALIGN(16) vs_output pixels[4];
+		float const dx = 0.5f + left - tri.v0.position().x();
+		float const dy = 0.5f + top  - tri.v0.position().y();
+		d.vso_ops->step_2d_unproj_pos_quad (pixels, tri.v0, dx, tri.ddx, dy, tri.ddy);
+		d.vso_ops->step_2d_unproj_attr_quad(*d.vso_ops, pixels, tri.v0, dx, tri.ddx, dy, tri.ddy);
+
+		ps_output pso[4];
+		float     depth[4] =
+		{
+			pixels[0].position().z(),
+			pixels[1].position().z(),
+			pixels[2].position().z(),
+			pixels[3].position().z()
+		};
+
+		pixel_shader_unit* psu = d.threaded_psu[thread_id].get();
+		psu->update(pixels, d.vs_reflection);
+		psu->execute(pso, depth);
+		ps_invocations += 4;
+
+		frame_buffer_->blend_sample_quad(d.cpp_bs.get(), d.threaded_bsu[thread_id].get(), left, top, quad_mask, pso);
+	}
+
+	return ps_invocations;
+}
+
 END_NS_SALVIAR();
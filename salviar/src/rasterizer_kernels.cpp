@@ -0,0 +1,355 @@
+#include <salviar/include/rasterizer_kernels.h>
+
+#include <eflib/include/platform/config.h>
+#include <eflib/include/platform/cpuinfo.h>
+#include <eflib/include/platform/intrin.h>
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+BEGIN_NS_SALVIAR();
+
+using namespace eflib;
+
+static void compute_pixel_mask_generic(
+	uint32_t* pixel_mask, uint32_t x, uint32_t y,
+	tile_edges const* edges, int32_t const* sample_offsets, uint32_t sample_count)
+{
+	memset(pixel_mask, 0, sizeof(uint32_t) * 16);
+
+	int32_t block_value[3];
+	for (int e = 0; e < 3; ++ e)
+	{
+		block_value[e] =
+			edges->value[e]
+			+ edges->dx[e] * static_cast<int32_t>(x * SUBPIXEL_SCALE)
+			+ edges->dy[e] * static_cast<int32_t>(y * SUBPIXEL_SCALE);
+	}
+
+	for (uint32_t i_sample = 0; i_sample < sample_count; ++ i_sample)
+	{
+		int32_t row_value[3];
+		for (int e = 0; e < 3; ++ e)
+		{
+			row_value[e] =
+				block_value[e]
+				+ edges->dx[e] * sample_offsets[i_sample * 2 + 0]
+				+ edges->dy[e] * sample_offsets[i_sample * 2 + 1];
+		}
+
+		for(int iy = 0; iy < 4; ++iy)
+		{
+			int32_t value[3] = { row_value[0], row_value[1], row_value[2] };
+			for(int ix = 0; ix < 4; ++ix)
+			{
+				if ( (value[0] | value[1] | value[2]) >= 0 )
+				{
+					pixel_mask[iy * 4 + ix] |= 1UL << i_sample;
+				}
+
+				for (int e = 0; e < 3; ++ e)
+				{
+					value[e] += edges->dx[e] * SUBPIXEL_SCALE;
+				}
+			}
+
+			for (int e = 0; e < 3; ++ e)
+			{
+				row_value[e] += edges->dy[e] * SUBPIXEL_SCALE;
+			}
+		}
+	}
+}
+
+static void subdivide_region_generic(
+	uint32_t* test_regions, uint32_t& test_region_size,
+	uint32_t region_x, uint32_t region_y, uint32_t new_w, uint32_t new_h,
+	tile_edges const* edges, int32_t const* bounding_box)
+{
+	int32_t const sub_w = static_cast<int32_t>(new_w * SUBPIXEL_SCALE);
+	int32_t const sub_h = static_cast<int32_t>(new_h * SUBPIXEL_SCALE);
+
+	// Trivial rejection is tested at the corner which has max E, and trivial acception at the corner which has min E.
+	int32_t step_x[3];
+	int32_t step_y[3];
+	int32_t row_rej[3];
+	int32_t rej_to_acc[3];
+	for (int e = 0; e < 3; ++ e)
+	{
+		step_x[e] = edges->dx[e] * sub_w;
+		step_y[e] = edges->dy[e] * sub_h;
+
+		int32_t region_value =
+			edges->value[e]
+			+ edges->dx[e] * static_cast<int32_t>(region_x * SUBPIXEL_SCALE)
+			+ edges->dy[e] * static_cast<int32_t>(region_y * SUBPIXEL_SCALE);
+		row_rej[e] = region_value + std::max(step_x[e], 0) + std::max(step_y[e], 0);
+		rej_to_acc[e] = -abs(step_x[e]) - abs(step_y[e]);
+	}
+
+	for (uint32_t ty = 0; ty < 4; ++ ty)
+	{
+		int32_t const y = static_cast<int32_t>( (region_y + new_h * ty) * SUBPIXEL_SCALE );
+		int32_t rej[3] = { row_rej[0], row_rej[1], row_rej[2] };
+
+		for (uint32_t tx = 0; tx < 4; ++ tx)
+		{
+			int32_t const x = static_cast<int32_t>( (region_x + new_w * tx) * SUBPIXEL_SCALE );
+
+			bool const in_bounding_box =
+				   bounding_box[0] < x + sub_w && bounding_box[1] >= x
+				&& bounding_box[2] < y + sub_h && bounding_box[3] >= y;
+
+			if ( in_bounding_box && (rej[0] | rej[1] | rej[2]) >= 0 )
+			{
+				uint32_t acception =
+					( (rej[0] + rej_to_acc[0]) | (rej[1] + rej_to_acc[1]) | (rej[2] + rej_to_acc[2]) ) >= 0 ? 1 : 0;
+				test_regions[test_region_size] =
+					(region_x + new_w * tx) | ( (region_y + new_h * ty) << 8 ) | (acception << 31);
+				++ test_region_size;
+			}
+
+			for (int e = 0; e < 3; ++ e)
+			{
+				rej[e] += step_x[e];
+			}
+		}
+
+		for (int e = 0; e < 3; ++ e)
+		{
+			row_rej[e] += step_y[e];
+		}
+	}
+}
+
+static void setup_triangles_generic(triangle_setup_batch* batch)
+{
+	for (int i = 0; i < TRIANGLE_SETUP_BATCH_SIZE; ++ i)
+	{
+		float const e01x = batch->x[1][i] - batch->x[0][i];
+		float const e01y = batch->y[1][i] - batch->y[0][i];
+		float const e02x = batch->x[2][i] - batch->x[0][i];
+		float const e02y = batch->y[2][i] - batch->y[0][i];
+
+		batch->area[i] = e02x * e01y - e02y * e01x;
+		batch->inv_area[i] = 1.0f / batch->area[i];
+
+		batch->bounding_box[0][i] = std::min( std::min(batch->x[0][i], batch->x[1][i]), batch->x[2][i] );
+		batch->bounding_box[1][i] = std::max( std::max(batch->x[0][i], batch->x[1][i]), batch->x[2][i] );
+		batch->bounding_box[2][i] = std::min( std::min(batch->y[0][i], batch->y[1][i]), batch->y[2][i] );
+		batch->bounding_box[3][i] = std::max( std::max(batch->y[0][i], batch->y[1][i]), batch->y[2][i] );
+
+		batch->depth_range[0][i] = std::min( std::min(batch->z[0][i], batch->z[1][i]), batch->z[2][i] );
+		batch->depth_range[1][i] = std::max( std::max(batch->z[0][i], batch->z[1][i]), batch->z[2][i] );
+	}
+}
+
+rasterizer_kernels const* rasterizer_kernels_generic()
+{
+	static rasterizer_kernels const kernels =
+	{
+		&compute_pixel_mask_generic,
+		&subdivide_region_generic,
+		&setup_triangles_generic,
+		"generic"
+	};
+	return &kernels;
+}
+
+#if !defined(EFLIB_NO_SIMD)
+
+static void compute_pixel_mask_sse(
+	uint32_t* pixel_mask, uint32_t x, uint32_t y,
+	tile_edges const* edges, int32_t const* sample_offsets, uint32_t sample_count)
+{
+	__m128i mpixel_mask[4] =
+	{
+		_mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128(), _mm_setzero_si128()
+	};
+
+	int32_t block_value[3];
+	__m128i mstepx[3];
+	__m128i mstepy[3];
+	for (int e = 0; e < 3; ++ e)
+	{
+		int32_t const dx = edges->dx[e] * SUBPIXEL_SCALE;
+		block_value[e] =
+			edges->value[e]
+			+ dx * static_cast<int32_t>(x)
+			+ edges->dy[e] * static_cast<int32_t>(y * SUBPIXEL_SCALE);
+		// SSE2 has no 32-bit multiplication, so lane offsets are computed in scalar.
+		mstepx[e] = _mm_set_epi32(dx * 3, dx * 2, dx, 0);
+		mstepy[e] = _mm_set1_epi32(edges->dy[e] * SUBPIXEL_SCALE);
+	}
+
+	for (uint32_t i_sample = 0; i_sample < sample_count; ++ i_sample)
+	{
+		int32_t const sx = sample_offsets[i_sample * 2 + 0];
+		int32_t const sy = sample_offsets[i_sample * 2 + 1];
+
+		__m128i mvalue[3];
+		for (int e = 0; e < 3; ++ e)
+		{
+			mvalue[e] = _mm_add_epi32(
+				_mm_set1_epi32(block_value[e] + edges->dx[e] * sx + edges->dy[e] * sy), mstepx[e]
+				);
+		}
+
+		__m128i msample_bit = _mm_set1_epi32(1UL << i_sample);
+
+		for(int iy = 0; iy < 4; ++iy)
+		{
+			// Sign bit is set if sample is outside of any edge.
+			__m128i mask_rej = _mm_srai_epi32( _mm_or_si128( _mm_or_si128(mvalue[0], mvalue[1]), mvalue[2] ), 31 );
+			mpixel_mask[iy] = _mm_or_si128( mpixel_mask[iy], _mm_andnot_si128(mask_rej, msample_bit) );
+
+			mvalue[0] = _mm_add_epi32(mvalue[0], mstepy[0]);
+			mvalue[1] = _mm_add_epi32(mvalue[1], mstepy[1]);
+			mvalue[2] = _mm_add_epi32(mvalue[2], mstepy[2]);
+		}
+	}
+
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(pixel_mask + 0), mpixel_mask[0]);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(pixel_mask + 4), mpixel_mask[1]);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(pixel_mask + 8), mpixel_mask[2]);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(pixel_mask + 12), mpixel_mask[3]);
+}
+
+static void subdivide_region_sse(
+	uint32_t* test_regions, uint32_t& test_region_size,
+	uint32_t region_x, uint32_t region_y, uint32_t new_w, uint32_t new_h,
+	tile_edges const* edges, int32_t const* bounding_box)
+{
+	int32_t const sub_w = static_cast<int32_t>(new_w * SUBPIXEL_SCALE);
+	int32_t const sub_h = static_cast<int32_t>(new_h * SUBPIXEL_SCALE);
+
+	__m128i mrej[3];
+	__m128i mrej2acc[3];
+	__m128i mstepy[3];
+	for (int e = 0; e < 3; ++ e)
+	{
+		int32_t const step_x = edges->dx[e] * sub_w;
+		int32_t const step_y = edges->dy[e] * sub_h;
+
+		int32_t region_value =
+			edges->value[e]
+			+ edges->dx[e] * static_cast<int32_t>(region_x * SUBPIXEL_SCALE)
+			+ edges->dy[e] * static_cast<int32_t>(region_y * SUBPIXEL_SCALE);
+		int32_t rej = region_value + std::max(step_x, 0) + std::max(step_y, 0);
+
+		mrej[e]		= _mm_add_epi32( _mm_set1_epi32(rej), _mm_set_epi32(step_x * 3, step_x * 2, step_x, 0) );
+		mrej2acc[e]	= _mm_set1_epi32( -abs(step_x) - abs(step_y) );
+		mstepy[e]	= _mm_set1_epi32(step_y);
+	}
+
+	// Columns out of bounding box.
+	__m128i const mix = _mm_set_epi32(region_x + new_w * 3, region_x + new_w * 2, region_x + new_w, region_x);
+	__m128i const mx = _mm_slli_epi32(mix, SUBPIXEL_BITS);
+	__m128i const mask_rej_x = _mm_or_si128(
+		_mm_cmpgt_epi32( _mm_set1_epi32(bounding_box[0]), _mm_add_epi32(mx, _mm_set1_epi32(sub_w - 1)) ),
+		_mm_cmpgt_epi32( mx, _mm_set1_epi32(bounding_box[1]) )
+		);
+	__m128i const msign = _mm_set1_epi32(0x80000000);
+
+	for(uint32_t iy = 0; iy < 4; ++iy)
+	{
+		uint32_t const row_y = region_y + new_h * iy;
+		int32_t  const y = static_cast<int32_t>(row_y * SUBPIXEL_SCALE);
+
+		if( bounding_box[2] < y + sub_h && bounding_box[3] >= y )
+		{
+			// Trival rejection & acception
+			__m128i mor_rej = _mm_or_si128( _mm_or_si128(mrej[0], mrej[1]), mrej[2] );
+			__m128i mor_acc = _mm_or_si128(
+				_mm_or_si128( _mm_add_epi32(mrej[0], mrej2acc[0]), _mm_add_epi32(mrej[1], mrej2acc[1]) ),
+				_mm_add_epi32(mrej[2], mrej2acc[2])
+				);
+
+			__m128i mask_rej = _mm_or_si128( _mm_srai_epi32(mor_rej, 31), mask_rej_x );
+
+			__m128i miregion = _mm_or_si128( mix, _mm_set1_epi32(row_y << 8) );
+			miregion = _mm_or_si128( miregion, _mm_andnot_si128(mor_acc, msign) );
+
+			EFLIB_ALIGN(16) uint32_t region_code[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(&region_code[0]), miregion);
+
+			int rejections = ~_mm_movemask_ps( _mm_castsi128_ps(mask_rej) ) & 0xF;
+			uint32_t t;
+			while (_xmm_bsf(&t, (uint32_t)rejections))
+			{
+				test_regions[test_region_size] = region_code[t];
+				++ test_region_size;
+
+				rejections &= rejections - 1;
+			}
+		}
+
+		mrej[0] = _mm_add_epi32(mrej[0], mstepy[0]);
+		mrej[1] = _mm_add_epi32(mrej[1], mstepy[1]);
+		mrej[2] = _mm_add_epi32(mrej[2], mstepy[2]);
+	}
+}
+
+// Batch is set up by two passes of 4 triangles.
+static void setup_triangles_sse(triangle_setup_batch* batch)
+{
+	for (int i = 0; i < TRIANGLE_SETUP_BATCH_SIZE; i += 4)
+	{
+		__m128 const mx0 = _mm_load_ps(&batch->x[0][i]);
+		__m128 const mx1 = _mm_load_ps(&batch->x[1][i]);
+		__m128 const mx2 = _mm_load_ps(&batch->x[2][i]);
+		__m128 const my0 = _mm_load_ps(&batch->y[0][i]);
+		__m128 const my1 = _mm_load_ps(&batch->y[1][i]);
+		__m128 const my2 = _mm_load_ps(&batch->y[2][i]);
+		__m128 const mz0 = _mm_load_ps(&batch->z[0][i]);
+		__m128 const mz1 = _mm_load_ps(&batch->z[1][i]);
+		__m128 const mz2 = _mm_load_ps(&batch->z[2][i]);
+
+		__m128 const me01x = _mm_sub_ps(mx1, mx0);
+		__m128 const me01y = _mm_sub_ps(my1, my0);
+		__m128 const me02x = _mm_sub_ps(mx2, mx0);
+		__m128 const me02y = _mm_sub_ps(my2, my0);
+
+		__m128 const marea = _mm_sub_ps( _mm_mul_ps(me02x, me01y), _mm_mul_ps(me02y, me01x) );
+		_mm_store_ps( &batch->area[i], marea );
+		_mm_store_ps( &batch->inv_area[i], _mm_div_ps(_mm_set1_ps(1.0f), marea) );
+
+		_mm_store_ps( &batch->bounding_box[0][i], _mm_min_ps( _mm_min_ps(mx0, mx1), mx2 ) );
+		_mm_store_ps( &batch->bounding_box[1][i], _mm_max_ps( _mm_max_ps(mx0, mx1), mx2 ) );
+		_mm_store_ps( &batch->bounding_box[2][i], _mm_min_ps( _mm_min_ps(my0, my1), my2 ) );
+		_mm_store_ps( &batch->bounding_box[3][i], _mm_max_ps( _mm_max_ps(my0, my1), my2 ) );
+
+		_mm_store_ps( &batch->depth_range[0][i], _mm_min_ps( _mm_min_ps(mz0, mz1), mz2 ) );
+		_mm_store_ps( &batch->depth_range[1][i], _mm_max_ps( _mm_max_ps(mz0, mz1), mz2 ) );
+	}
+}
+
+rasterizer_kernels const* rasterizer_kernels_sse()
+{
+	static rasterizer_kernels const kernels =
+	{
+		&compute_pixel_mask_sse,
+		&subdivide_region_sse,
+		&setup_triangles_sse,
+		"sse"
+	};
+	return &kernels;
+}
+
+#endif
+
+rasterizer_kernels const* select_rasterizer_kernels()
+{
+#if !defined(EFLIB_NO_SIMD)
+	static rasterizer_kernels const* kernels =
+		support_feature(cpu_avx512f)	? rasterizer_kernels_avx512()	:
+		support_feature(cpu_avx2)		? rasterizer_kernels_avx2()		:
+		rasterizer_kernels_sse();
+#else
+	static rasterizer_kernels const* kernels = rasterizer_kernels_generic();
+#endif
+	return kernels;
+}
+
+END_NS_SALVIAR();
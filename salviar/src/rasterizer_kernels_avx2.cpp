@@ -0,0 +1,221 @@
+// This file is compiled with AVX2 enabled.
+// Only the functions selected by select_rasterizer_kernels() could be executed.
+
+#include <salviar/include/rasterizer_kernels.h>
+
+#include <eflib/include/platform/config.h>
+
+#include <immintrin.h>
+
+BEGIN_NS_SALVIAR();
+
+#if !defined(EFLIB_NO_SIMD)
+
+// Eight lanes cover two rows of the 4x4 block (or of the 4x4 sub-regions):
+// lane i is at (i & 3, i >> 2).
+static void compute_pixel_mask_avx2(
+	uint32_t* pixel_mask, uint32_t x, uint32_t y,
+	tile_edges const* edges, int32_t const* sample_offsets, uint32_t sample_count)
+{
+	__m256i const mx = _mm256_set_epi32(3, 2, 1, 0, 3, 2, 1, 0);
+	__m256i const my = _mm256_set_epi32(1, 1, 1, 1, 0, 0, 0, 0);
+
+	__m256i mbase[3];
+	__m256i mdx[3];
+	__m256i mdy[3];
+	__m256i mstepy[3];
+	for (int e = 0; e < 3; ++ e)
+	{
+		mdx[e] = _mm256_set1_epi32(edges->dx[e]);
+		mdy[e] = _mm256_set1_epi32(edges->dy[e]);
+		mstepy[e] = _mm256_set1_epi32(edges->dy[e] * SUBPIXEL_SCALE * 2);
+
+		int32_t block_value =
+			edges->value[e]
+			+ edges->dx[e] * static_cast<int32_t>(x * SUBPIXEL_SCALE)
+			+ edges->dy[e] * static_cast<int32_t>(y * SUBPIXEL_SCALE);
+		mbase[e] = _mm256_add_epi32(
+			_mm256_set1_epi32(block_value),
+			_mm256_add_epi32(
+				_mm256_mullo_epi32( _mm256_slli_epi32(mx, SUBPIXEL_BITS), mdx[e] ),
+				_mm256_mullo_epi32( _mm256_slli_epi32(my, SUBPIXEL_BITS), mdy[e] )
+				)
+			);
+	}
+
+	__m256i mpixel_mask[2] = { _mm256_setzero_si256(), _mm256_setzero_si256() };
+
+	for (uint32_t i_sample = 0; i_sample < sample_count; ++ i_sample)
+	{
+		__m256i msx = _mm256_set1_epi32(sample_offsets[i_sample * 2 + 0]);
+		__m256i msy = _mm256_set1_epi32(sample_offsets[i_sample * 2 + 1]);
+		__m256i msample_bit = _mm256_set1_epi32(1UL << i_sample);
+
+		__m256i mvalue[3];
+		for (int e = 0; e < 3; ++ e)
+		{
+			mvalue[e] = _mm256_add_epi32(
+				mbase[e],
+				_mm256_add_epi32( _mm256_mullo_epi32(msx, mdx[e]), _mm256_mullo_epi32(msy, mdy[e]) )
+				);
+		}
+
+		for (int half = 0; half < 2; ++ half)
+		{
+			// Sign bit is set if sample is outside of any edge.
+			__m256i mask_rej = _mm256_srai_epi32(
+				_mm256_or_si256( _mm256_or_si256(mvalue[0], mvalue[1]), mvalue[2] ), 31
+				);
+			mpixel_mask[half] = _mm256_or_si256(
+				mpixel_mask[half], _mm256_andnot_si256(mask_rej, msample_bit)
+				);
+
+			for (int e = 0; e < 3; ++ e)
+			{
+				mvalue[e] = _mm256_add_epi32(mvalue[e], mstepy[e]);
+			}
+		}
+	}
+
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixel_mask + 0), mpixel_mask[0]);
+	_mm256_storeu_si256(reinterpret_cast<__m256i*>(pixel_mask + 8), mpixel_mask[1]);
+}
+
+static void subdivide_region_avx2(
+	uint32_t* test_regions, uint32_t& test_region_size,
+	uint32_t region_x, uint32_t region_y, uint32_t new_w, uint32_t new_h,
+	tile_edges const* edges, int32_t const* bounding_box)
+{
+	__m256i const mitx = _mm256_set_epi32(3, 2, 1, 0, 3, 2, 1, 0);
+	__m256i const mity = _mm256_set_epi32(1, 1, 1, 1, 0, 0, 0, 0);
+
+	int32_t const sub_w = static_cast<int32_t>(new_w * SUBPIXEL_SCALE);
+	int32_t const sub_h = static_cast<int32_t>(new_h * SUBPIXEL_SCALE);
+
+	__m256i mrej[3];
+	__m256i mrej2acc[3];
+	__m256i mstepy[3];
+	for (int e = 0; e < 3; ++ e)
+	{
+		int32_t const step_x = edges->dx[e] * sub_w;
+		int32_t const step_y = edges->dy[e] * sub_h;
+
+		int32_t region_value =
+			edges->value[e]
+			+ edges->dx[e] * static_cast<int32_t>(region_x * SUBPIXEL_SCALE)
+			+ edges->dy[e] * static_cast<int32_t>(region_y * SUBPIXEL_SCALE);
+		int32_t rej = region_value + (step_x > 0 ? step_x : 0) + (step_y > 0 ? step_y : 0);
+
+		mrej[e] = _mm256_add_epi32(
+			_mm256_set1_epi32(rej),
+			_mm256_add_epi32(
+				_mm256_mullo_epi32( mitx, _mm256_set1_epi32(step_x) ),
+				_mm256_mullo_epi32( mity, _mm256_set1_epi32(step_y) )
+				)
+			);
+		mrej2acc[e]	= _mm256_set1_epi32( -(step_x < 0 ? -step_x : step_x) - (step_y < 0 ? -step_y : step_y) );
+		mstepy[e]	= _mm256_set1_epi32(step_y * 2);
+	}
+
+	__m256i const mix = _mm256_add_epi32( _mm256_mullo_epi32(mitx, _mm256_set1_epi32(new_w)), _mm256_set1_epi32(region_x) );
+	__m256i const mx = _mm256_slli_epi32(mix, SUBPIXEL_BITS);
+	__m256i const mask_rej_x = _mm256_or_si256(
+		_mm256_cmpgt_epi32( _mm256_set1_epi32(bounding_box[0]), _mm256_add_epi32(mx, _mm256_set1_epi32(sub_w - 1)) ),
+		_mm256_cmpgt_epi32( mx, _mm256_set1_epi32(bounding_box[1]) )
+		);
+	__m256i const msub_h_1 = _mm256_set1_epi32(sub_h - 1);
+	__m256i const my_min = _mm256_set1_epi32(bounding_box[2]);
+	__m256i const my_max = _mm256_set1_epi32(bounding_box[3]);
+	__m256i const msign = _mm256_set1_epi32(0x80000000);
+
+	for (int iy = 0; iy < 4; iy += 2)
+	{
+		__m256i miy = _mm256_add_epi32(
+			_mm256_mullo_epi32( _mm256_add_epi32(mity, _mm256_set1_epi32(iy)), _mm256_set1_epi32(new_h) ),
+			_mm256_set1_epi32(region_y)
+			);
+		__m256i my = _mm256_slli_epi32(miy, SUBPIXEL_BITS);
+
+		// Trival rejection & acception
+		__m256i mor_rej = _mm256_or_si256( _mm256_or_si256(mrej[0], mrej[1]), mrej[2] );
+		__m256i mor_acc = _mm256_or_si256(
+			_mm256_or_si256( _mm256_add_epi32(mrej[0], mrej2acc[0]), _mm256_add_epi32(mrej[1], mrej2acc[1]) ),
+			_mm256_add_epi32(mrej[2], mrej2acc[2])
+			);
+
+		__m256i mask_rej = _mm256_or_si256( _mm256_srai_epi32(mor_rej, 31), mask_rej_x );
+		mask_rej = _mm256_or_si256( mask_rej, _mm256_cmpgt_epi32( my_min, _mm256_add_epi32(my, msub_h_1) ) );
+		mask_rej = _mm256_or_si256( mask_rej, _mm256_cmpgt_epi32( my, my_max ) );
+
+		__m256i miregion = _mm256_or_si256( mix, _mm256_slli_epi32(miy, 8) );
+		miregion = _mm256_or_si256( miregion, _mm256_andnot_si256(mor_acc, msign) );
+
+		EFLIB_ALIGN(32) uint32_t region_code[8];
+		_mm256_store_si256(reinterpret_cast<__m256i*>(&region_code[0]), miregion);
+
+		uint32_t rejections = ~_mm256_movemask_ps( _mm256_castsi256_ps(mask_rej) ) & 0xFF;
+		for (uint32_t t = 0; t < 8; ++ t)
+		{
+			if ( rejections & (1U << t) )
+			{
+				test_regions[test_region_size] = region_code[t];
+				++ test_region_size;
+			}
+		}
+
+		for (int e = 0; e < 3; ++ e)
+		{
+			mrej[e] = _mm256_add_epi32(mrej[e], mstepy[e]);
+		}
+	}
+}
+
+// Batch is set up by two passes of 8 triangles.
+static void setup_triangles_avx2(triangle_setup_batch* batch)
+{
+	for (int i = 0; i < TRIANGLE_SETUP_BATCH_SIZE; i += 8)
+	{
+		__m256 const mx0 = _mm256_load_ps(&batch->x[0][i]);
+		__m256 const mx1 = _mm256_load_ps(&batch->x[1][i]);
+		__m256 const mx2 = _mm256_load_ps(&batch->x[2][i]);
+		__m256 const my0 = _mm256_load_ps(&batch->y[0][i]);
+		__m256 const my1 = _mm256_load_ps(&batch->y[1][i]);
+		__m256 const my2 = _mm256_load_ps(&batch->y[2][i]);
+		__m256 const mz0 = _mm256_load_ps(&batch->z[0][i]);
+		__m256 const mz1 = _mm256_load_ps(&batch->z[1][i]);
+		__m256 const mz2 = _mm256_load_ps(&batch->z[2][i]);
+
+		__m256 const me01x = _mm256_sub_ps(mx1, mx0);
+		__m256 const me01y = _mm256_sub_ps(my1, my0);
+		__m256 const me02x = _mm256_sub_ps(mx2, mx0);
+		__m256 const me02y = _mm256_sub_ps(my2, my0);
+
+		__m256 const marea = _mm256_sub_ps( _mm256_mul_ps(me02x, me01y), _mm256_mul_ps(me02y, me01x) );
+		_mm256_store_ps( &batch->area[i], marea );
+		_mm256_store_ps( &batch->inv_area[i], _mm256_div_ps(_mm256_set1_ps(1.0f), marea) );
+
+		_mm256_store_ps( &batch->bounding_box[0][i], _mm256_min_ps( _mm256_min_ps(mx0, mx1), mx2 ) );
+		_mm256_store_ps( &batch->bounding_box[1][i], _mm256_max_ps( _mm256_max_ps(mx0, mx1), mx2 ) );
+		_mm256_store_ps( &batch->bounding_box[2][i], _mm256_min_ps( _mm256_min_ps(my0, my1), my2 ) );
+		_mm256_store_ps( &batch->bounding_box[3][i], _mm256_max_ps( _mm256_max_ps(my0, my1), my2 ) );
+
+		_mm256_store_ps( &batch->depth_range[0][i], _mm256_min_ps( _mm256_min_ps(mz0, mz1), mz2 ) );
+		_mm256_store_ps( &batch->depth_range[1][i], _mm256_max_ps( _mm256_max_ps(mz0, mz1), mz2 ) );
+	}
+}
+
+rasterizer_kernels const* rasterizer_kernels_avx2()
+{
+	static rasterizer_kernels const kernels =
+	{
+		&compute_pixel_mask_avx2,
+		&subdivide_region_avx2,
+		&setup_triangles_avx2,
+		"avx2"
+	};
+	return &kernels;
+}
+
+#endif
+
+END_NS_SALVIAR();
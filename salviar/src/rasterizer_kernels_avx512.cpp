@@ -0,0 +1,185 @@
+// This file is compiled with AVX-512F enabled.
+// Only the functions selected by select_rasterizer_kernels() could be executed.
+
+#include <salviar/include/rasterizer_kernels.h>
+
+#include <eflib/include/platform/config.h>
+
+#include <immintrin.h>
+
+BEGIN_NS_SALVIAR();
+
+#if !defined(EFLIB_NO_SIMD)
+
+// Sixteen lanes cover the whole 4x4 block (or all 4x4 sub-regions):
+// lane i is at (i & 3, i >> 2).
+static void compute_pixel_mask_avx512(
+	uint32_t* pixel_mask, uint32_t x, uint32_t y,
+	tile_edges const* edges, int32_t const* sample_offsets, uint32_t sample_count)
+{
+	__m512i const mx = _mm512_set_epi32(3, 2, 1, 0, 3, 2, 1, 0, 3, 2, 1, 0, 3, 2, 1, 0);
+	__m512i const my = _mm512_set_epi32(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+
+	__m512i mbase[3];
+	__m512i mdx[3];
+	__m512i mdy[3];
+	for (int e = 0; e < 3; ++ e)
+	{
+		mdx[e] = _mm512_set1_epi32(edges->dx[e]);
+		mdy[e] = _mm512_set1_epi32(edges->dy[e]);
+
+		int32_t block_value =
+			edges->value[e]
+			+ edges->dx[e] * static_cast<int32_t>(x * SUBPIXEL_SCALE)
+			+ edges->dy[e] * static_cast<int32_t>(y * SUBPIXEL_SCALE);
+		mbase[e] = _mm512_add_epi32(
+			_mm512_set1_epi32(block_value),
+			_mm512_add_epi32(
+				_mm512_mullo_epi32( _mm512_slli_epi32(mx, SUBPIXEL_BITS), mdx[e] ),
+				_mm512_mullo_epi32( _mm512_slli_epi32(my, SUBPIXEL_BITS), mdy[e] )
+				)
+			);
+	}
+
+	__m512i mpixel_mask = _mm512_setzero_si512();
+
+	for (uint32_t i_sample = 0; i_sample < sample_count; ++ i_sample)
+	{
+		__m512i msx = _mm512_set1_epi32(sample_offsets[i_sample * 2 + 0]);
+		__m512i msy = _mm512_set1_epi32(sample_offsets[i_sample * 2 + 1]);
+
+		__m512i mor = _mm512_setzero_si512();
+		for (int e = 0; e < 3; ++ e)
+		{
+			__m512i mvalue = _mm512_add_epi32(
+				mbase[e],
+				_mm512_add_epi32( _mm512_mullo_epi32(msx, mdx[e]), _mm512_mullo_epi32(msy, mdy[e]) )
+				);
+			mor = _mm512_or_si512(mor, mvalue);
+		}
+
+		// Covered if sign bit is clear on all edges.
+		__mmask16 covered = _mm512_cmpge_epi32_mask( mor, _mm512_setzero_si512() );
+		mpixel_mask = _mm512_mask_or_epi32(
+			mpixel_mask, covered, mpixel_mask, _mm512_set1_epi32(1UL << i_sample)
+			);
+	}
+
+	_mm512_storeu_si512(pixel_mask, mpixel_mask);
+}
+
+static void subdivide_region_avx512(
+	uint32_t* test_regions, uint32_t& test_region_size,
+	uint32_t region_x, uint32_t region_y, uint32_t new_w, uint32_t new_h,
+	tile_edges const* edges, int32_t const* bounding_box)
+{
+	__m512i const mitx = _mm512_set_epi32(3, 2, 1, 0, 3, 2, 1, 0, 3, 2, 1, 0, 3, 2, 1, 0);
+	__m512i const mity = _mm512_set_epi32(3, 3, 3, 3, 2, 2, 2, 2, 1, 1, 1, 1, 0, 0, 0, 0);
+	__m512i const mzero = _mm512_setzero_si512();
+
+	int32_t const sub_w = static_cast<int32_t>(new_w * SUBPIXEL_SCALE);
+	int32_t const sub_h = static_cast<int32_t>(new_h * SUBPIXEL_SCALE);
+
+	// Trival rejection & acception
+	__m512i mor_rej = mzero;
+	__m512i mor_acc = mzero;
+	for (int e = 0; e < 3; ++ e)
+	{
+		int32_t const step_x = edges->dx[e] * sub_w;
+		int32_t const step_y = edges->dy[e] * sub_h;
+
+		int32_t region_value =
+			edges->value[e]
+			+ edges->dx[e] * static_cast<int32_t>(region_x * SUBPIXEL_SCALE)
+			+ edges->dy[e] * static_cast<int32_t>(region_y * SUBPIXEL_SCALE);
+		int32_t rej = region_value + (step_x > 0 ? step_x : 0) + (step_y > 0 ? step_y : 0);
+		int32_t rej_to_acc = -(step_x < 0 ? -step_x : step_x) - (step_y < 0 ? -step_y : step_y);
+
+		__m512i mrej = _mm512_add_epi32(
+			_mm512_set1_epi32(rej),
+			_mm512_add_epi32(
+				_mm512_mullo_epi32( mitx, _mm512_set1_epi32(step_x) ),
+				_mm512_mullo_epi32( mity, _mm512_set1_epi32(step_y) )
+				)
+			);
+		mor_rej = _mm512_or_si512(mor_rej, mrej);
+		mor_acc = _mm512_or_si512( mor_acc, _mm512_add_epi32(mrej, _mm512_set1_epi32(rej_to_acc)) );
+	}
+
+	__mmask16 not_rejected	= _mm512_cmpge_epi32_mask(mor_rej, mzero);
+	__mmask16 accepted		= _mm512_cmpge_epi32_mask(mor_acc, mzero);
+
+	__m512i mix = _mm512_add_epi32( _mm512_mullo_epi32(mitx, _mm512_set1_epi32(new_w)), _mm512_set1_epi32(region_x) );
+	__m512i miy = _mm512_add_epi32( _mm512_mullo_epi32(mity, _mm512_set1_epi32(new_h)), _mm512_set1_epi32(region_y) );
+	__m512i mx = _mm512_slli_epi32(mix, SUBPIXEL_BITS);
+	__m512i my = _mm512_slli_epi32(miy, SUBPIXEL_BITS);
+
+	// Sub-regions out of bounding box are rejected too.
+	not_rejected = _mm512_mask_cmplt_epi32_mask(
+		not_rejected, _mm512_set1_epi32(bounding_box[0]), _mm512_add_epi32(mx, _mm512_set1_epi32(sub_w)) );
+	not_rejected = _mm512_mask_cmpge_epi32_mask(
+		not_rejected, _mm512_set1_epi32(bounding_box[1]), mx );
+	not_rejected = _mm512_mask_cmplt_epi32_mask(
+		not_rejected, _mm512_set1_epi32(bounding_box[2]), _mm512_add_epi32(my, _mm512_set1_epi32(sub_h)) );
+	not_rejected = _mm512_mask_cmpge_epi32_mask(
+		not_rejected, _mm512_set1_epi32(bounding_box[3]), my );
+
+	__m512i miregion = _mm512_or_epi32( mix, _mm512_slli_epi32(miy, 8) );
+	miregion = _mm512_mask_or_epi32( miregion, accepted, miregion, _mm512_set1_epi32(0x80000000) );
+
+	_mm512_mask_compressstoreu_epi32(test_regions + test_region_size, not_rejected, miregion);
+
+	uint32_t survivors = not_rejected;
+	while (survivors)
+	{
+		++ test_region_size;
+		survivors &= survivors - 1;
+	}
+}
+
+// Whole batch of 16 triangles is set up in one pass.
+static void setup_triangles_avx512(triangle_setup_batch* batch)
+{
+	__m512 const mx0 = _mm512_load_ps(batch->x[0]);
+	__m512 const mx1 = _mm512_load_ps(batch->x[1]);
+	__m512 const mx2 = _mm512_load_ps(batch->x[2]);
+	__m512 const my0 = _mm512_load_ps(batch->y[0]);
+	__m512 const my1 = _mm512_load_ps(batch->y[1]);
+	__m512 const my2 = _mm512_load_ps(batch->y[2]);
+	__m512 const mz0 = _mm512_load_ps(batch->z[0]);
+	__m512 const mz1 = _mm512_load_ps(batch->z[1]);
+	__m512 const mz2 = _mm512_load_ps(batch->z[2]);
+
+	__m512 const me01x = _mm512_sub_ps(mx1, mx0);
+	__m512 const me01y = _mm512_sub_ps(my1, my0);
+	__m512 const me02x = _mm512_sub_ps(mx2, mx0);
+	__m512 const me02y = _mm512_sub_ps(my2, my0);
+
+	__m512 const marea = _mm512_sub_ps( _mm512_mul_ps(me02x, me01y), _mm512_mul_ps(me02y, me01x) );
+	_mm512_store_ps( batch->area, marea );
+	_mm512_store_ps( batch->inv_area, _mm512_div_ps(_mm512_set1_ps(1.0f), marea) );
+
+	_mm512_store_ps( batch->bounding_box[0], _mm512_min_ps( _mm512_min_ps(mx0, mx1), mx2 ) );
+	_mm512_store_ps( batch->bounding_box[1], _mm512_max_ps( _mm512_max_ps(mx0, mx1), mx2 ) );
+	_mm512_store_ps( batch->bounding_box[2], _mm512_min_ps( _mm512_min_ps(my0, my1), my2 ) );
+	_mm512_store_ps( batch->bounding_box[3], _mm512_max_ps( _mm512_max_ps(my0, my1), my2 ) );
+
+	_mm512_store_ps( batch->depth_range[0], _mm512_min_ps( _mm512_min_ps(mz0, mz1), mz2 ) );
+	_mm512_store_ps( batch->depth_range[1], _mm512_max_ps( _mm512_max_ps(mz0, mz1), mz2 ) );
+}
+
+rasterizer_kernels const* rasterizer_kernels_avx512()
+{
+	static rasterizer_kernels const kernels =
+	{
+		&compute_pixel_mask_avx512,
+		&subdivide_region_avx512,
+		&setup_triangles_avx512,
+		"avx512"
+	};
+	return &kernels;
+}
+
+#endif
+
+END_NS_SALVIAR();
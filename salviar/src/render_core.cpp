@@ -32,6 +32,12 @@ void render_core::update(render_state_ptr const& state)
 
 result render_core::execute()
 {
+	// Pending draws of visibility buffer are shaded before other commands read or write targets.
+	if(state_->cmd != command_id::draw && state_->cmd != command_id::draw_index)
+	{
+		stages_.ras->flush();
+	}
+
     switch(state_->cmd)
     {
     case command_id::draw:
@@ -45,6 +51,8 @@ result render_core::execute()
         return async_start();
     case command_id::async_end:
         return async_stop();
+    case command_id::flush:
+        return result::ok;
     default:
         EFLIB_ASSERT(false, "Unused command id.");
     }
@@ -106,6 +114,16 @@ void render_core::apply_shader_cbuffer()
 			state_->ps_proto->set_sampler(samp.first, samp.second);
 		}
 	}
+
+	if(state_->bs_proto)
+	{
+		for(auto const& variable: state_->bl_cbuffer.variables())
+		{
+			auto const& var_name = variable.first;
+			auto const& var_data = variable.second;
+			state_->bs_proto->set_variable( var_name, state_->bl_cbuffer.data_pointer(var_data) );
+		}
+	}
 }
 
 result render_core::clear_color()
@@ -116,20 +134,10 @@ result render_core::clear_color()
 
 result render_core::clear_depth_stencil()
 {
-	if( state_->clear_f == (salviar::clear_depth | salviar::clear_stencil) )
-	{
-		auto ds_color = color_rgba32f(
-			    state_->clear_z, *reinterpret_cast<float*>(&state_->clear_stencil), 0.0f, 0.0f
-				);
-		state_->clear_ds_target->fill_texels(ds_color);
-	}
-	else
-	{
-		framebuffer::clear_depth_stencil(
-			state_->clear_ds_target.get(),
-			state_->clear_f, state_->clear_z, state_->clear_stencil
-			);
-	}
+	stages_.backend->clear_depth_stencil(
+		state_->clear_ds_target.get(),
+		state_->clear_f, state_->clear_z, state_->clear_stencil
+		);
     return result::ok;
 }
 
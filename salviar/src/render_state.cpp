@@ -40,6 +40,9 @@ void copy_using_state(render_state* dest, render_state const* src)
         dest->cmd                = src->cmd;
         dest->current_async      = src->current_async;
         break;
+    case command_id::flush:
+        dest->cmd                = src->cmd;
+        break;
     }
 }
 
@@ -164,6 +164,41 @@ cpp_blend_shader_ptr renderer_impl::get_blend_shader() const
 	return state_->cpp_bs;
 }
 
+result renderer_impl::set_blend_shader_code( shader_object_ptr const& code )
+{
+	state_->bl_shader = code;
+	state_->bs_proto.reset();
+	if(code)
+	{
+		state_->bs_proto.reset( new blend_shader_unit() );
+		state_->bs_proto->initialize( state_->bl_shader.get() );
+	}
+
+	return result::ok;
+}
+
+shader_object_ptr renderer_impl::get_blend_shader_code() const
+{
+	return state_->bl_shader;
+}
+
+result renderer_impl::set_bs_variable( std::string const& name, void const* data, size_t sz )
+{
+	state_->bl_cbuffer.set_variable(name, data, sz);
+	return result::ok;
+}
+
+result renderer_impl::set_blend_state(blend_state_ptr const& bs)
+{
+	state_->bl_state = bs;
+	return result::ok;
+}
+
+blend_state_ptr renderer_impl::get_blend_state() const
+{
+	return state_->bl_state;
+}
+
 result renderer_impl::set_viewport(const viewport& vp)
 {
     if( vp.x < 0 ||
@@ -184,6 +219,17 @@ viewport renderer_impl::get_viewport() const
 	return state_->vp;
 }
 
+result renderer_impl::set_pipeline_options(pipeline_options const& options)
+{
+	state_->options = options;
+	return result::ok;
+}
+
+pipeline_options renderer_impl::get_pipeline_options() const
+{
+	return state_->options;
+}
+
 //do not support get function for a while
 result renderer_impl::set_render_targets(size_t color_target_count, surface_ptr const* color_targets, surface_ptr const& ds_target)
 {
@@ -246,6 +292,9 @@ result renderer_impl::set_render_targets(size_t color_target_count, surface_ptr
         switch(ds_target->get_pixel_format())
         {
         case pixel_format_color_rg32f:
+        case pixel_format_color_d16:
+        case pixel_format_color_d24s8:
+        case pixel_format_color_d32f:
             break;
         default:
             return result::failed;
@@ -326,6 +375,7 @@ renderer_impl::renderer_impl()
 
 	state_->ras_state.reset(new raster_state(raster_desc()));
 	state_->ds_state.reset(new depth_stencil_state(depth_stencil_desc()));
+	state_->bl_state.reset(new blend_state(blend_desc()));
 
 	state_->vp.minz = 0.0f;
 	state_->vp.maxz = 1.0f;
@@ -38,7 +38,7 @@ vs_input_op vs_input_ops[MAX_VS_INPUT_ATTRS] = {
 	//gen_vs_input_op_n<15>()
 };
 
-vs_output_op vs_output_ops[MAX_VS_OUTPUT_ATTRS] = {
+vs_output_op const vs_output_ops[MAX_VS_OUTPUT_ATTRS] = {
 	gen_vs_output_op_n<0>(),
 	gen_vs_output_op_n<1>(),
 	gen_vs_output_op_n<2>(),
@@ -95,6 +95,12 @@ namespace vs_input_op_funcs
 
 namespace vs_output_op_funcs
 {
+	// Flat attributes are neither interpolated nor projected.
+	inline bool is_perspective(uint32_t modifiers)
+	{
+		return !( modifiers & (vs_output::am_noperspective | vs_output::am_nointerpolation) );
+	}
+
 	template <int N>
 	vs_output& construct_n(vs_output& out,
 			const eflib::vec4& position,
@@ -119,12 +125,12 @@ namespace vs_output_op_funcs
 	}
 
 	template <int N>
-	vs_output& project_n(vs_output& out, const vs_output& in)
+	vs_output& project_n(vs_output_op const& op, vs_output& out, const vs_output& in)
 	{
 		if (&out != &in){
 			for(size_t i_attr = 0; i_attr < N; ++i_attr){
 				out.attribute(i_attr) = in.attribute(i_attr);
-				if (!(vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_noperspective)){
+				if ( is_perspective(op.attribute_modifiers[i_attr]) ){
 					out.attribute(i_attr) *= in.position().w();
 				}
 			}
@@ -132,7 +138,7 @@ namespace vs_output_op_funcs
 		}
 		else{
 			for(size_t i_attr = 0; i_attr < N; ++i_attr){
-				if (!(vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_noperspective)){
+				if ( is_perspective(op.attribute_modifiers[i_attr]) ){
 					out.attribute(i_attr) *= in.position().w();
 				}
 			}
@@ -141,7 +147,7 @@ namespace vs_output_op_funcs
 	}
 
 	template <int N>
-	vs_output& unproject_n(vs_output& out, const vs_output& in)
+	vs_output& unproject_n(vs_output_op const& op, vs_output& out, const vs_output& in)
 	{
 		const float inv_w = 1.0f / in.position().w();
 #if defined(VSO_INTERP_SSE_ENABLED)
@@ -156,26 +162,26 @@ namespace vs_output_op_funcs
 			src = reinterpret_cast<__m128 const*>(&in.attribute(i_attr));
 			dst = reinterpret_cast<__m128*>(&out.attribute(i_attr));
 
-			if (vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_noperspective)
+			if ( is_perspective(op.attribute_modifiers[i_attr]) )
 			{
-				*dst = *src;
+				*dst = _mm_mul_ps(*src, inv_w4);
 			}
 			else
 			{
-				*dst = _mm_mul_ps(*src, inv_w4);
+				*dst = *src;
 			}
 		}
 #else
 		out.position() = in.position();
 		for(size_t i_attr = 0; i_attr < N; ++i_attr)
 		{
-			if (vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_noperspective)
+			if ( is_perspective(op.attribute_modifiers[i_attr]) )
 			{
-				out.attribute(i_attr) = in.attribute(i_attr);
+				out.attribute(i_attr) = in.attribute(i_attr) * inv_w;
 			}
 			else
 			{
-				out.attribute(i_attr) = in.attribute(i_attr) * inv_w;
+				out.attribute(i_attr) = in.attribute(i_attr);
 			}
 		}
 #endif
@@ -184,12 +190,12 @@ namespace vs_output_op_funcs
 	}
 
 	template <int N>
-	vs_output& lerp_n(vs_output& out, const vs_output& start, const vs_output& end, float step)
+	vs_output& lerp_n(vs_output_op const& op, vs_output& out, const vs_output& start, const vs_output& end, float step)
 	{
 		out.position() = start.position() + ( end.position() - start.position() ) * step;
 		for(size_t i_attr = 0; i_attr < N; ++i_attr){
 			out.attribute(i_attr) = start.attribute(i_attr);
-			if (!(vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_nointerpolation))
+			if (!(op.attribute_modifiers[i_attr] & vs_output::am_nointerpolation))
 			{
 				out.attribute(i_attr) += (end.attribute(i_attr) - start.attribute(i_attr)) * step;
 			}
@@ -228,6 +234,7 @@ namespace vs_output_op_funcs
 
     template <int N>
 	vs_output& step_2d_unproj_attr_n(
+		vs_output_op const& op,
 		vs_output& out, const vs_output& in,
 		float step0, const vs_output& derivation0,
 		float step1, const vs_output& derivation1
@@ -244,49 +251,64 @@ namespace vs_output_op_funcs
 		float inv_w = 1.0f / _xmm_extract_ps(out_m128[0], 3);
 		__m128 inv_w4 = _mm_load_ps1(&inv_w);
 
-		for(size_t i_attr = 0; i_attr < N; ++i_attr)
+		for(uint32_t i = 0; i < op.perspective_attrs_count; ++i)
 		{
-			__m128 interp_attr;
-			if (vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_nointerpolation)
-			{
-				interp_attr = in_m128[i_attr+1];
-			}
-			else
-			{
-				interp_attr = _mm_add_ps(
-					in_m128[i_attr + 1],
-					_mm_add_ps(
-						_mm_mul_ps(d0_m128[i_attr + 1], step0_m128),
-						_mm_mul_ps(d1_m128[i_attr + 1], step1_m128)
-						)
-					);
+			uint32_t i_attr = op.perspective_attrs[i];
+			uint32_t reg  = i_attr + 1;
+			uint32_t dreg = op.derivative_regs[i_attr];
+			out_m128[reg] = _mm_mul_ps(
+				_mm_add_ps(
+					in_m128[reg],
+					_mm_add_ps( _mm_mul_ps(d0_m128[dreg], step0_m128), _mm_mul_ps(d1_m128[dreg], step1_m128) )
+					),
+				inv_w4
+				);
+		}
 
-			}
+		for(uint32_t i = 0; i < op.noperspective_attrs_count; ++i)
+		{
+			uint32_t i_attr = op.noperspective_attrs[i];
+			uint32_t reg  = i_attr + 1;
+			uint32_t dreg = op.derivative_regs[i_attr];
+			out_m128[reg] = _mm_add_ps(
+				in_m128[reg],
+				_mm_add_ps( _mm_mul_ps(d0_m128[dreg], step0_m128), _mm_mul_ps(d1_m128[dreg], step1_m128) )
+				);
+		}
 
-			// Perspective
-			if (vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_noperspective)
-			{
-				out_m128[i_attr+1] = interp_attr;
-			}
-			else
-			{
-				out_m128[i_attr+1] = _mm_mul_ps(interp_attr, inv_w4);
-			}
+		for(uint32_t i = 0; i < op.flat_attrs_count; ++i)
+		{
+			uint32_t reg = op.flat_attrs[i] + 1;
+			out_m128[reg] = in_m128[reg];
 		}
 #else
-		for(size_t i_attr = 0; i_attr < N; ++i_attr)
+		float inv_w = 1.0f / out.position().w();
+
+		for(uint32_t i = 0; i < op.perspective_attrs_count; ++i)
 		{
-			if (vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_nointerpolation)
-			{
-				out.attribute(i_attr) = in.attribute(i_attr);
-			}
-			else
-			{
-				out.attribute(i_attr) =
-					in.attribute(i_attr)
-					+ (derivation0.attribute(i_attr) * step0)
-					+ (derivation1.attribute(i_attr) * step1);
-			}
+			uint32_t i_attr = op.perspective_attrs[i];
+			uint32_t dreg   = op.derivative_regs[i_attr];
+			out.attribute(i_attr) = (
+				in.attribute(i_attr)
+				+ (derivation0.raw_data()[dreg] * step0)
+				+ (derivation1.raw_data()[dreg] * step1)
+				) * inv_w;
+		}
+
+		for(uint32_t i = 0; i < op.noperspective_attrs_count; ++i)
+		{
+			uint32_t i_attr = op.noperspective_attrs[i];
+			uint32_t dreg   = op.derivative_regs[i_attr];
+			out.attribute(i_attr) =
+				in.attribute(i_attr)
+				+ (derivation0.raw_data()[dreg] * step0)
+				+ (derivation1.raw_data()[dreg] * step1);
+		}
+
+		for(uint32_t i = 0; i < op.flat_attrs_count; ++i)
+		{
+			uint32_t i_attr = op.flat_attrs[i];
+			out.attribute(i_attr) = in.attribute(i_attr);
 		}
 #endif
 
@@ -327,8 +349,11 @@ namespace vs_output_op_funcs
 		return *out;
 	}
 
+	// Interpolates attributes read by pixel shader only.
+	// Flat attributes are copied from the leading vertex.
 	template <int N>
 	vs_output& step_2d_unproj_attr_n_quad(
+		vs_output_op const& op,
 		vs_output* out, const vs_output& in,
 		float step0, const vs_output& derivation0,
 		float step1, const vs_output& derivation1
@@ -348,79 +373,73 @@ namespace vs_output_op_funcs
 		__m128		  step0_m128	= _mm_load_ps1(&step0);
 		__m128		  step1_m128	= _mm_load_ps1(&step1);
 
-		EFLIB_ALIGN(16) float w[] = 
-		{
-			_xmm_extract_ps(out00_m128[0], 3),
-			_xmm_extract_ps(out01_m128[0], 3),
-			_xmm_extract_ps(out10_m128[0], 3),
-			_xmm_extract_ps(out11_m128[0], 3)
-		};
-
-		__m128 inv_w4 = _mm_set_ps(
-			1.0f/w[0],
-			1.0f/w[1],
-			1.0f/w[2],
-			1.0f/w[3]
-			);
-
-		for(size_t i_attr = 0; i_attr < N; ++i_attr)
+		if(op.perspective_attrs_count > 0)
 		{
-			__m128 interp_attr00;
-			__m128 interp_attr01;
-			__m128 interp_attr10;
-			__m128 interp_attr11;
-
-			if (vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_nointerpolation)
+			EFLIB_ALIGN(16) float w[] = 
 			{
-				interp_attr00 = in_m128[i_attr+1];
-				interp_attr01 = in_m128[i_attr+1];
-				interp_attr10 = in_m128[i_attr+1];
-				interp_attr11 = in_m128[i_attr+1];
-			}
-			else
+				_xmm_extract_ps(out00_m128[0], 3),
+				_xmm_extract_ps(out01_m128[0], 3),
+				_xmm_extract_ps(out10_m128[0], 3),
+				_xmm_extract_ps(out11_m128[0], 3)
+			};
+
+			__m128 inv_w4 = _mm_div_ps( _mm_set_ps1(1.0f), _mm_load_ps(w) );
+			__m128 inv_w00 = _mm_shuffle_ps(inv_w4, inv_w4, _MM_SHUFFLE(0, 0, 0, 0));
+			__m128 inv_w01 = _mm_shuffle_ps(inv_w4, inv_w4, _MM_SHUFFLE(1, 1, 1, 1));
+			__m128 inv_w10 = _mm_shuffle_ps(inv_w4, inv_w4, _MM_SHUFFLE(2, 2, 2, 2));
+			__m128 inv_w11 = _mm_shuffle_ps(inv_w4, inv_w4, _MM_SHUFFLE(3, 3, 3, 3));
+
+			for(uint32_t i = 0; i < op.perspective_attrs_count; ++i)
 			{
-				interp_attr00 = _mm_add_ps(
-					in_m128[i_attr + 1],
-					_mm_add_ps(
-						_mm_mul_ps(d0_m128[i_attr + 1], step0_m128),
-						_mm_mul_ps(d1_m128[i_attr + 1], step1_m128)
-						)
+				uint32_t i_attr = op.perspective_attrs[i];
+				uint32_t reg  = i_attr + 1;
+				uint32_t dreg = op.derivative_regs[i_attr];
+
+				__m128 interp_attr00 = _mm_add_ps(
+					in_m128[reg],
+					_mm_add_ps( _mm_mul_ps(d0_m128[dreg], step0_m128), _mm_mul_ps(d1_m128[dreg], step1_m128) )
 					);
-				interp_attr01 = _mm_add_ps(interp_attr00, d0_m128[i_attr+1]);
-				interp_attr10 = _mm_add_ps(interp_attr00, d1_m128[i_attr+1]);
-				interp_attr11 = _mm_add_ps(interp_attr01, d1_m128[i_attr+1]);
+				__m128 interp_attr01 = _mm_add_ps(interp_attr00, d0_m128[dreg]);
+				__m128 interp_attr10 = _mm_add_ps(interp_attr00, d1_m128[dreg]);
+				__m128 interp_attr11 = _mm_add_ps(interp_attr01, d1_m128[dreg]);
+
+				out00_m128[reg] = _mm_mul_ps(interp_attr00, inv_w00);
+				out01_m128[reg] = _mm_mul_ps(interp_attr01, inv_w01);
+				out10_m128[reg] = _mm_mul_ps(interp_attr10, inv_w10);
+				out11_m128[reg] = _mm_mul_ps(interp_attr11, inv_w11);
 			}
+		}
 
-			// Perspective
-			if (vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_noperspective)
-			{
-				out00_m128[i_attr+1] = interp_attr00;
-				out01_m128[i_attr+1] = interp_attr01;
-				out10_m128[i_attr+1] = interp_attr10;
-				out11_m128[i_attr+1] = interp_attr11;
-			}
-			else
-			{
-				out00_m128[i_attr+1] = _mm_mul_ps(interp_attr00, _mm_shuffle_ps(inv_w4, inv_w4, _MM_SHUFFLE(3, 3, 3, 3)));
-				out01_m128[i_attr+1] = _mm_mul_ps(interp_attr01, _mm_shuffle_ps(inv_w4, inv_w4, _MM_SHUFFLE(2, 2, 2, 2)));
-				out10_m128[i_attr+1] = _mm_mul_ps(interp_attr10, _mm_shuffle_ps(inv_w4, inv_w4, _MM_SHUFFLE(1, 1, 1, 1)));
-				out11_m128[i_attr+1] = _mm_mul_ps(interp_attr11, _mm_shuffle_ps(inv_w4, inv_w4, _MM_SHUFFLE(0, 0, 0, 0)));
-			}
+		for(uint32_t i = 0; i < op.noperspective_attrs_count; ++i)
+		{
+			uint32_t i_attr = op.noperspective_attrs[i];
+			uint32_t reg  = i_attr + 1;
+			uint32_t dreg = op.derivative_regs[i_attr];
+
+			out00_m128[reg] = _mm_add_ps(
+				in_m128[reg],
+				_mm_add_ps( _mm_mul_ps(d0_m128[dreg], step0_m128), _mm_mul_ps(d1_m128[dreg], step1_m128) )
+				);
+			out01_m128[reg] = _mm_add_ps(out00_m128[reg], d0_m128[dreg]);
+			out10_m128[reg] = _mm_add_ps(out00_m128[reg], d1_m128[dreg]);
+			out11_m128[reg] = _mm_add_ps(out01_m128[reg], d1_m128[dreg]);
+		}
+
+		for(uint32_t i = 0; i < op.flat_attrs_count; ++i)
+		{
+			uint32_t reg = op.flat_attrs[i] + 1;
+
+			out00_m128[reg] = in_m128[reg];
+			out01_m128[reg] = in_m128[reg];
+			out10_m128[reg] = in_m128[reg];
+			out11_m128[reg] = in_m128[reg];
 		}
 #else
-		for(size_t i_attr = 0; i_attr < N; ++i_attr)
+		for(int i_pixel = 0; i_pixel < 4; ++i_pixel)
 		{
-			if (vs_output_ops[N].attribute_modifiers[i_attr] & vs_output::am_nointerpolation)
-			{
-				out.attribute(i_attr) = in.attribute(i_attr);
-			}
-			else
-			{
-				out.attribute(i_attr) =
-					in.attribute(i_attr)
-					+ (derivation0.attribute(i_attr) * step0)
-					+ (derivation1.attribute(i_attr) * step1);
-			}
+			float pixel_step0 = step0 + (i_pixel & 1);
+			float pixel_step1 = step1 + (i_pixel >> 1);
+			step_2d_unproj_attr_n<N>(op, out[i_pixel], in, pixel_step0, derivation0, pixel_step1, derivation1);
 		}
 #endif
 
@@ -481,10 +500,11 @@ namespace vs_output_op_funcs
 	}
 
 	template <int N>
-	void compute_derivative_n(vs_output& ddx, vs_output& ddy, vs_output const& e01, vs_output const& e02, float inv_area)
+	void compute_derivative_n(vs_output_op const& op, vs_output& ddx, vs_output& ddy, vs_output const& e01, vs_output const& e02, float inv_area)
 	{
 		// ddx = (e02 * e01.position.y - e02.position.y * e01) * inv_area;
 		// ddy = (e01 * e02.position.x - e01.position.x * e02) * inv_area;
+		// Only position and interpolated live attributes are computed, and they are stored compactly.
 
 #if !defined(EFLIB_NO_SIMD)
 		__m128*        mddx  = reinterpret_cast<__m128*>( ddx.raw_data() );
@@ -500,26 +520,29 @@ namespace vs_output_op_funcs
 
 		__m128 minv_area = _mm_set_ps1(inv_area);
 
-		for(int i = 0; i < N + 1; ++i)
+		for(uint32_t i = 0; i < op.derivative_regs_count; ++i)
 		{
+			uint32_t src = op.derivative_srcs[i];
+
 			__m128 x_diff = _mm_sub_ps(
-				_mm_mul_ps(me02[i], me01y),
-				_mm_mul_ps(me01[i], me02y)
+				_mm_mul_ps(me02[src], me01y),
+				_mm_mul_ps(me01[src], me02y)
 				);
 
 			__m128 y_diff = _mm_sub_ps(
-				_mm_mul_ps(me01[i], me02x),
-				_mm_mul_ps(me02[i], me01x)
+				_mm_mul_ps(me01[src], me02x),
+				_mm_mul_ps(me02[src], me01x)
 				);
 
 			mddx[i] = _mm_mul_ps(x_diff, minv_area);
 			mddy[i] = _mm_mul_ps(y_diff, minv_area);
 		}
 #else
-		for(int i = 0; i < N + 1; ++i)
+		for(uint32_t i = 0; i < op.derivative_regs_count; ++i)
 		{
-			ddx.raw_data()[i] = inv_area * ( e02.raw_data()[i] * e01.position().y() - e01.raw_data()[i] * e02.position().y() );
-			ddy.raw_data()[i] = inv_area * ( e01.raw_data()[i] * e02.position().x() - e02.raw_data()[i] * e01.position().x() );
+			uint32_t src = op.derivative_srcs[i];
+			ddx.raw_data()[i] = inv_area * ( e02.raw_data()[src] * e01.position().y() - e01.raw_data()[src] * e02.position().y() );
+			ddy.raw_data()[i] = inv_area * ( e01.raw_data()[src] * e02.position().x() - e02.raw_data()[src] * e01.position().x() );
 		}
 #endif
 	}
@@ -563,6 +586,9 @@ vs_output_op gen_vs_output_op_n()
 	ret.step_2d_unproj_attr_quad = step_2d_unproj_attr_n_quad<N>;
 	ret.compute_derivative = compute_derivative_n<N>;
 
+	ret.attribute_modifiers.fill(0);
+	update_live_attributes(ret, N, (1UL << N) - 1);
+
 	return ret;
 }
 
@@ -571,11 +597,50 @@ vs_input_op& get_vs_input_op(uint32_t n)
 	return vs_input_ops[n];
 }
 
-vs_output_op& get_vs_output_op(uint32_t n)
+vs_output_op const& get_vs_output_op(uint32_t n)
 {
 	return vs_output_ops[n];
 }
 
+void update_live_attributes(vs_output_op& op, uint32_t attr_count, uint32_t live_attributes)
+{
+	op.live_attributes = live_attributes;
+	op.perspective_attrs_count		= 0;
+	op.noperspective_attrs_count	= 0;
+	op.flat_attrs_count				= 0;
+
+	// Derivative of position is always stored in first register.
+	op.derivative_srcs[0]			= 0;
+	op.derivative_regs_count		= 1;
+
+	for(uint32_t i_attr = 0; i_attr < attr_count; ++i_attr)
+	{
+		if( (live_attributes & (1UL << i_attr)) == 0 )
+		{
+			continue;
+		}
+
+		uint32_t modifiers = op.attribute_modifiers[i_attr];
+		if(modifiers & vs_output::am_nointerpolation)
+		{
+			op.flat_attrs[op.flat_attrs_count++] = i_attr;
+			continue;
+		}
+
+		if(modifiers & vs_output::am_noperspective)
+		{
+			op.noperspective_attrs[op.noperspective_attrs_count++] = i_attr;
+		}
+		else
+		{
+			op.perspective_attrs[op.perspective_attrs_count++] = i_attr;
+		}
+
+		op.derivative_regs[i_attr] = op.derivative_regs_count;
+		op.derivative_srcs[op.derivative_regs_count++] = i_attr + 1;
+	}
+}
+
 void viewport_transform(vec4& position, const viewport& vp)
 {
 	float invw = (eflib::equal<float>(position[3], 0.0f)) ? 1.0f : 1.0f / position[3];
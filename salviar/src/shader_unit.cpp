@@ -8,6 +8,7 @@
 
 #include <eflib/include/diagnostics/assert.h>
 #include <eflib/include/math/math.h>
+#include <eflib/include/platform/intrin.h>
 
 #include <eflib/include/platform/boost_begin.h>
 #include <boost/make_shared.hpp>
@@ -56,29 +57,35 @@ pixel_shader_unit::pixel_shader_unit() : code(NULL)
 {
 }
 
-void pixel_shader_unit::reset_pointers()
+// Stream of package starts with pointers to data of elements.
+static void reset_package_pointers(pixel_shader_unit::aligned_vector& data_stream)
 {
-	aligned_vector* streams[] = {&stream_data, &stream_odata};
-
-	for(size_t i_stream = 0; i_stream < 2; ++i_stream)
+	void** pointer_start = reinterpret_cast<void**>( &(data_stream[0]) );
+	size_t pointers_size = PACKAGE_ELEMENT_COUNT * sizeof(void*);
+	size_t pixel_data_size = (data_stream.size() - pointers_size) / PACKAGE_ELEMENT_COUNT;
+	for(size_t i_pixel = 0; i_pixel < PACKAGE_ELEMENT_COUNT; ++i_pixel)
 	{
-		aligned_vector& data_stream(*streams[i_stream]);
-
-		void** pointer_start = reinterpret_cast<void**>( &(data_stream[0]) );
-		size_t pointers_size = PACKAGE_ELEMENT_COUNT * sizeof(void*);
-		size_t pixel_data_size = (data_stream.size() - pointers_size) / PACKAGE_ELEMENT_COUNT;
-		for(size_t i_pixel = 0; i_pixel < PACKAGE_ELEMENT_COUNT; ++i_pixel)
+		void* ppixel = NULL;
+		if(pixel_data_size > 0)
 		{
-			void* ppixel = NULL;
-			if(pixel_data_size > 0)
-			{
-				ppixel = &(data_stream[pointers_size+pixel_data_size*i_pixel]);
-			}
-			pointer_start[i_pixel] = ppixel;
+			ppixel = &(data_stream[pointers_size+pixel_data_size*i_pixel]);
 		}
+		pointer_start[i_pixel] = ppixel;
 	}
 }
 
+static void* package_element_address(pixel_shader_unit::aligned_vector const& data_stream, size_t i_pixel, size_t offset)
+{
+	uintptr_t pixel_addr = * reinterpret_cast<uintptr_t const*>( &(data_stream[i_pixel*sizeof(void*)]) );
+	return reinterpret_cast<void*>( pixel_addr + static_cast<uintptr_t>(offset) );
+}
+
+void pixel_shader_unit::reset_pointers()
+{
+	reset_package_pointers(stream_data);
+	reset_package_pointers(stream_odata);
+}
+
 pixel_shader_unit::pixel_shader_unit( pixel_shader_unit const& rhs )
 	:  code(rhs.code),
 	stream_data(rhs.stream_data), buffer_data(rhs.buffer_data),
@@ -115,61 +122,61 @@ shared_ptr<pixel_shader_unit> pixel_shader_unit::clone() const
 	}
 }
 
-void pixel_shader_unit::update( vs_output* inputs, shader_reflection const* vs_abi )
+// Input layouts of pixel shader, and indexes of vertex shader outputs which are read by them.
+static void collect_input_layouts(
+	shader_object const* code, shader_reflection const* vs_abi,
+	vector<sv_layout*>& infos, vector<size_t>& attr_indexes )
 {
-	vector<sv_layout*> infos = code->get_reflection()->layouts( su_stream_in );
+	infos = code->get_reflection()->layouts( su_stream_in );
+	attr_indexes.assign( infos.size(), 0 );
 
 	size_t register_index = 0;
-
-	for(sv_layout* info: infos)
+	for(size_t i_info = 0; i_info < infos.size(); ++i_info)
 	{
-		size_t pixel_data_size = info->total_size();
-		if( info->sv == semantic_value(sv_position) )
+		if( infos[i_info]->sv == semantic_value(sv_position) )
 		{
-			for ( size_t i_pixel = 0; i_pixel < PACKAGE_ELEMENT_COUNT; ++i_pixel )
-			{
-				uintptr_t pixel_addr = * reinterpret_cast<uintptr_t*>( &(stream_data[i_pixel*sizeof(void*)]) );
-				uintptr_t data_addr = pixel_addr + static_cast<uintptr_t>(info->offset);
-				void* pdata = reinterpret_cast<void*>(data_addr);
-				memset(pdata, 0, pixel_data_size);
-				memcpy(pdata, &( inputs[i_pixel].position() ), info->size);
-			}
+			continue;
 		}
-		else
-		{
-			size_t attr_index = 0;
-			if(vs_abi){
-				sv_layout* src_sv_layout = vs_abi->input_sv_layout(info->sv);
-				attr_index = static_cast<size_t>(src_sv_layout->logical_index);
-			} else {
-				attr_index = register_index++;
-			}
-
-			for(size_t i_pixel = 0; i_pixel < PACKAGE_ELEMENT_COUNT; ++i_pixel)
-			{
-				uintptr_t pixel_addr = * reinterpret_cast<uintptr_t*>( &(stream_data[i_pixel*sizeof(void*)]) );
-				uintptr_t data_addr = pixel_addr + static_cast<uintptr_t>(info->offset);
-				void* pdata = reinterpret_cast<void*>(data_addr);
 
-				memset(pdata, 0, pixel_data_size);
-				memcpy(pdata, &(inputs[i_pixel].attribute(attr_index)), info->size);
-			}
+		if(vs_abi){
+			sv_layout* src_sv_layout = vs_abi->input_sv_layout(infos[i_info]->sv);
+			attr_indexes[i_info] = static_cast<size_t>(src_sv_layout->logical_index);
+		} else {
+			attr_indexes[i_info] = register_index++;
 		}
 	}
 }
 
-void pixel_shader_unit::execute(ps_output* outs, float* depths)
+static void fill_inputs(
+	pixel_shader_unit::aligned_vector& stream_data, vs_output* inputs,
+	vector<sv_layout*> const& infos, vector<size_t> const& attr_indexes )
 {
-	void* psi = stream_data.empty() ? NULL : &(stream_data[0]);
-	void* pbi = buffer_data.empty() ? NULL : &(buffer_data[0]);
-	void* pso = stream_odata.empty() ? NULL : &(stream_odata[0]);
-	void* pbo = buffer_odata.empty() ? NULL : &(buffer_odata[0]);
+	for(size_t i_info = 0; i_info < infos.size(); ++i_info)
+	{
+		sv_layout* info = infos[i_info];
+		size_t pixel_data_size = info->total_size();
+		bool is_position = ( info->sv == semantic_value(sv_position) );
 
-	invoke( code->native_function(), psi, pbi, pso, pbo );
+		for ( size_t i_pixel = 0; i_pixel < PACKAGE_ELEMENT_COUNT; ++i_pixel )
+		{
+			uintptr_t pixel_addr = * reinterpret_cast<uintptr_t*>( &(stream_data[i_pixel*sizeof(void*)]) );
+			uintptr_t data_addr = pixel_addr + static_cast<uintptr_t>(info->offset);
+			void* pdata = reinterpret_cast<void*>(data_addr);
 
-	shader_reflection const* abii = code->get_reflection();
-	vector<sv_layout*> infos = abii->layouts( su_stream_out );
+			void const* src = is_position
+				? static_cast<void const*>( &( inputs[i_pixel].position() ) )
+				: static_cast<void const*>( &( inputs[i_pixel].attribute(attr_indexes[i_info]) ) );
 
+			memset(pdata, 0, pixel_data_size);
+			memcpy(pdata, src, info->size);
+		}
+	}
+}
+
+static void fetch_outputs(
+	pixel_shader_unit::aligned_vector const& stream_odata, vector<sv_layout*> const& infos,
+	ps_output* outs, float* depths )
+{
 	for(sv_layout* info: infos)
 	{
 		if( info->sv == semantic_value(sv_target) )
@@ -177,7 +184,7 @@ void pixel_shader_unit::execute(ps_output* outs, float* depths)
 			assert( info->value_type == lvt_f32v4 );
 			for (size_t i_pixel = 0; i_pixel < PACKAGE_ELEMENT_COUNT; ++i_pixel)
 			{
-				uintptr_t pixel_addr = * reinterpret_cast<uintptr_t*>( &(stream_odata[i_pixel*sizeof(void*)]) );
+				uintptr_t pixel_addr = * reinterpret_cast<uintptr_t const*>( &(stream_odata[i_pixel*sizeof(void*)]) );
 				uintptr_t data_addr = pixel_addr + static_cast<uintptr_t>(info->offset);
 				void* pdata = reinterpret_cast<void*>(data_addr);
 				void* pbuffer = &(outs[i_pixel].color[info->sv.get_index()]);
@@ -188,7 +195,7 @@ void pixel_shader_unit::execute(ps_output* outs, float* depths)
 		{
 			for (size_t i_pixel = 0; i_pixel < PACKAGE_ELEMENT_COUNT; ++i_pixel)
 			{
-				uintptr_t pixel_addr = * reinterpret_cast<uintptr_t*>( &(stream_odata[i_pixel*sizeof(void*)]) );
+				uintptr_t pixel_addr = * reinterpret_cast<uintptr_t const*>( &(stream_odata[i_pixel*sizeof(void*)]) );
 				uintptr_t data_addr = pixel_addr + static_cast<uintptr_t>(info->offset);
 				float* pdata = reinterpret_cast<float*>(data_addr);
 				depths[i_pixel] = *pdata;
@@ -197,6 +204,47 @@ void pixel_shader_unit::execute(ps_output* outs, float* depths)
 	}
 }
 
+void pixel_shader_unit::update( vs_output* inputs, shader_reflection const* vs_abi )
+{
+	vector<sv_layout*>	infos;
+	vector<size_t>		attr_indexes;
+	collect_input_layouts(code, vs_abi, infos, attr_indexes);
+	fill_inputs(stream_data, inputs, infos, attr_indexes);
+}
+
+void pixel_shader_unit::invoke_package()
+{
+	void* psi = stream_data.empty() ? NULL : &(stream_data[0]);
+	void* pbi = buffer_data.empty() ? NULL : &(buffer_data[0]);
+	void* pso = stream_odata.empty() ? NULL : &(stream_odata[0]);
+	void* pbo = buffer_odata.empty() ? NULL : &(buffer_odata[0]);
+
+	invoke( code->native_function(), psi, pbi, pso, pbo );
+}
+
+void pixel_shader_unit::execute(ps_output* outs, float* depths)
+{
+	invoke_package();
+	fetch_outputs( stream_odata, code->get_reflection()->layouts(su_stream_out), outs, depths );
+}
+
+void pixel_shader_unit::execute_quads(
+	vs_output* inputs, shader_reflection const* vs_abi, ps_output* outs, float* depths, size_t quad_count )
+{
+	vector<sv_layout*>	in_infos;
+	vector<size_t>		attr_indexes;
+	collect_input_layouts(code, vs_abi, in_infos, attr_indexes);
+	vector<sv_layout*>	out_infos = code->get_reflection()->layouts( su_stream_out );
+
+	for(size_t i_quad = 0; i_quad < quad_count; ++i_quad)
+	{
+		size_t const first_pixel = i_quad * PACKAGE_ELEMENT_COUNT;
+		fill_inputs(stream_data, inputs + first_pixel, in_infos, attr_indexes);
+		invoke_package();
+		fetch_outputs(stream_odata, out_infos, outs + first_pixel, depths + first_pixel);
+	}
+}
+
 void pixel_shader_unit::set_sampler( std::string const& name, sampler_ptr const& samp )
 {
 	if( std::find( used_samplers.begin(), used_samplers.end(), samp ) != used_samplers.end() )
@@ -208,4 +256,153 @@ void pixel_shader_unit::set_sampler( std::string const& name, sampler_ptr const&
 	set_variable(name, &psamp);
 }
 
+blend_shader_unit::blend_shader_unit()
+	: code(NULL), dest_target_mask_(0), output_target_mask_(0)
+{
+}
+
+blend_shader_unit::~blend_shader_unit()
+{
+}
+
+blend_shader_unit::blend_shader_unit( blend_shader_unit const& rhs )
+	: code(rhs.code)
+	, stream_data(rhs.stream_data), buffer_data(rhs.buffer_data)
+	, stream_odata(rhs.stream_odata), buffer_odata(rhs.buffer_odata)
+{
+	update_layouts();
+	reset_pointers();
+}
+
+blend_shader_unit& blend_shader_unit::operator=( blend_shader_unit const& rhs )
+{
+	code = rhs.code;
+	stream_data = rhs.stream_data;
+	buffer_data = rhs.buffer_data;
+	stream_odata = rhs.stream_odata;
+	buffer_odata = rhs.buffer_odata;
+
+	update_layouts();
+	reset_pointers();
+
+	return *this;
+}
+
+shared_ptr<blend_shader_unit> blend_shader_unit::clone() const
+{
+	return make_shared<blend_shader_unit>(*this);
+}
+
+void blend_shader_unit::initialize( shader_object const* code )
+{
+	this->code = code;
+	shader_reflection const* reflection = code->get_reflection();
+
+	this->stream_data.assign (
+		PACKAGE_ELEMENT_COUNT * ( sizeof(void*) + reflection->total_size(su_stream_in) ), 0 );
+	this->buffer_data.assign ( reflection->total_size(su_buffer_in), 0 );
+	this->stream_odata.assign(
+		PACKAGE_ELEMENT_COUNT * ( sizeof(void*) + reflection->total_size(su_stream_out) ), 0 );
+	this->buffer_odata.assign( reflection->total_size(su_buffer_out), 0 );
+
+	update_layouts();
+	reset_pointers();
+}
+
+void blend_shader_unit::reset_pointers()
+{
+	reset_package_pointers(stream_data);
+	reset_package_pointers(stream_odata);
+}
+
+void blend_shader_unit::update_layouts()
+{
+	dest_target_mask_ = 0;
+	output_target_mask_ = 0;
+	memset( src_offsets_, 0, sizeof(src_offsets_) );
+	memset( dest_offsets_, 0, sizeof(dest_offsets_) );
+	memset( output_offsets_, 0, sizeof(output_offsets_) );
+
+	if(code == NULL)
+	{
+		return;
+	}
+
+	for( sv_layout* info: code->get_reflection()->layouts(su_stream_in) )
+	{
+		uint32_t target_index = info->sv.get_index();
+		assert(target_index < MAX_RENDER_TARGETS);
+
+		if( info->sv.get_system_value() == sv_target )
+		{
+			src_offsets_[target_index] = info->offset;
+		}
+		else if( info->sv.get_system_value() == sv_dest_target )
+		{
+			dest_offsets_[target_index] = info->offset;
+			dest_target_mask_ |= (1UL << target_index);
+		}
+	}
+
+	for( sv_layout* info: code->get_reflection()->layouts(su_stream_out) )
+	{
+		if( info->sv.get_system_value() == sv_target )
+		{
+			uint32_t target_index = info->sv.get_index();
+			assert(target_index < MAX_RENDER_TARGETS);
+			assert(info->value_type == lvt_f32v4);
+			output_offsets_[target_index] = info->offset;
+			output_target_mask_ |= (1UL << target_index);
+		}
+	}
+}
+
+void blend_shader_unit::set_variable( std::string const& name, void const* data )
+{
+	sv_layout* vsi = code->get_reflection()->input_sv_layout(name);
+	memcpy( &buffer_data[vsi->offset], data, vsi->size );
+}
+
+float* blend_shader_unit::dest_color(size_t i_pixel, size_t target_index)
+{
+	assert( dest_target_mask_ & (1UL << target_index) );
+	return static_cast<float*>( package_element_address(stream_data, i_pixel, dest_offsets_[target_index]) );
+}
+
+void blend_shader_unit::execute( ps_output const* const* sources, ps_output* results )
+{
+	for( sv_layout* info: code->get_reflection()->layouts(su_stream_in) )
+	{
+		if( info->sv.get_system_value() != sv_target )
+		{
+			continue;
+		}
+
+		uint32_t target_index = info->sv.get_index();
+		for(size_t i_pixel = 0; i_pixel < PACKAGE_ELEMENT_COUNT; ++i_pixel)
+		{
+			void* pdata = package_element_address(stream_data, i_pixel, src_offsets_[target_index]);
+			memcpy( pdata, &(sources[i_pixel]->color[target_index]), info->size );
+		}
+	}
+
+	void* psi = stream_data.empty() ? NULL : &(stream_data[0]);
+	void* pbi = buffer_data.empty() ? NULL : &(buffer_data[0]);
+	void* pso = stream_odata.empty() ? NULL : &(stream_odata[0]);
+	void* pbo = buffer_odata.empty() ? NULL : &(buffer_odata[0]);
+	invoke( code->native_function(), psi, pbi, pso, pbo );
+
+	uint32_t output_mask = output_target_mask_;
+	uint32_t target_index;
+	while( _xmm_bsf(&target_index, output_mask) )
+	{
+		for(size_t i_pixel = 0; i_pixel < PACKAGE_ELEMENT_COUNT; ++i_pixel)
+		{
+			void const* pdata = package_element_address(stream_odata, i_pixel, output_offsets_[target_index]);
+			memcpy( &(results[i_pixel].color[target_index]), pdata, sizeof(eflib::vec4) );
+		}
+		output_mask &= output_mask - 1;
+	}
+}
+
 END_NS_SALVIAR();
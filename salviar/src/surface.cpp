@@ -1,10 +1,17 @@
 #include <salviar/include/surface.h>
 #include <salviar/include/internal_mapped_resource.h>
+#include <salviar/include/thread_context.h>
+
+#include <eflib/include/platform/intrin.h>
+#include <eflib/include/utility/unref_declarator.h>
 
 #include <eflib/include/platform/boost_begin.h>
 #include <boost/make_shared.hpp>
 #include <eflib/include/platform/boost_end.h>
 
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 #include <memory.h>
 
 using eflib::int4;
@@ -12,35 +19,242 @@ using eflib::int4;
 BEGIN_NS_SALVIAR();
 
 #if SALVIA_TILED_SURFACE
-const size_t TILE_BITS = 5;
-const size_t TILE_SIZE = 1UL << TILE_BITS;
-const size_t TILE_MASK = TILE_SIZE - 1;
+// Tiled surface stores tiles one after another, and texels of a tile in 4x4 blocks.
+// A 2x2 quad or a bilinear footprint of 32-bit texels is in one cache line mostly.
+// Tiles are clear tiles, so a cleared tile is a contiguous range of storage.
+const size_t TILE_BITS	= CLEAR_TILE_BITS;
+const size_t TILE_SIZE	= 1UL << TILE_BITS;
+const size_t TILE_MASK	= TILE_SIZE - 1;
+const size_t BLOCK_BITS	= 2;
+const size_t BLOCK_SIZE	= 1UL << BLOCK_BITS;
+const size_t BLOCK_MASK	= BLOCK_SIZE - 1;
 #endif
 
+// Package of tiles resolved by a thread at once.
+int32_t const RESOLVE_PACKAGE_SIZE = 4;
+
+namespace resolve_kernels
+{
+	// Pixels which have equal samples are copied, so the fully covered pixels skip averaging.
+	// Kernels of 8-bit formats are channel order agnostic, they are shared by rgba8 and bgra8.
+	void resolve_rgba32f(byte* dst, byte const* src, size_t count, size_t sample_count)
+	{
+		float const inv_samples = 1.0f / sample_count;
+		for(size_t i_px = 0; i_px < count; ++i_px)
+		{
+			float const* samples = reinterpret_cast<float const*>(src) + i_px * sample_count * 4;
+			float* px = reinterpret_cast<float*>(dst) + i_px * 4;
+#if !defined(EFLIB_NO_SIMD)
+			__m128 first	= _mm_loadu_ps(samples);
+			__m128 sum		= first;
+			__m128 equal	= _mm_castsi128_ps( _mm_set1_epi32(-1) );
+			for(size_t s = 1; s < sample_count; ++s)
+			{
+				__m128 sample = _mm_loadu_ps(samples + s * 4);
+				sum		= _mm_add_ps(sum, sample);
+				equal	= _mm_and_ps( equal, _mm_cmpeq_ps(sample, first) );
+			}
+			_mm_storeu_ps( px, _mm_movemask_ps(equal) == 0xF ? first : _mm_mul_ps( sum, _mm_set_ps1(inv_samples) ) );
+#else
+			bool equal = true;
+			float sum[4] = {samples[0], samples[1], samples[2], samples[3]};
+			for(size_t s = 1; s < sample_count; ++s)
+			{
+				for(int c = 0; c < 4; ++c)
+				{
+					sum[c] += samples[s * 4 + c];
+					equal = equal && samples[s * 4 + c] == samples[c];
+				}
+			}
+			for(int c = 0; c < 4; ++c)
+			{
+				px[c] = equal ? samples[c] : sum[c] * inv_samples;
+			}
+#endif
+		}
+	}
+
+	// Average is rounded to nearest. Sample count is a power of 2, so division is a shift.
+	template <uint32_t SampleCount>
+	void resolve_unorm8(byte* dst, byte const* src, size_t count, size_t /*sample_count*/)
+	{
+		uint32_t const SHIFT = SampleCount == 2 ? 1 : SampleCount == 4 ? 2 : SampleCount == 8 ? 3 : 4;
+
+		for(size_t i_px = 0; i_px < count; ++i_px)
+		{
+			uint32_t const* samples = reinterpret_cast<uint32_t const*>(src) + i_px * SampleCount;
+#if !defined(EFLIB_NO_SIMD)
+			__m128i const zero	= _mm_setzero_si128();
+			__m128i const first	= _mm_set1_epi32(samples[0]);
+			__m128i sum			= zero;
+			int equal_bits		= 0xFFFF;
+
+			if(SampleCount == 2)
+			{
+				__m128i texels = _mm_loadl_epi64( reinterpret_cast<__m128i const*>(samples) );
+				equal_bits = _mm_movemask_epi8( _mm_cmpeq_epi32(texels, first) ) | 0xFF00;
+				sum = _mm_unpacklo_epi8(texels, zero);
+			}
+			else
+			{
+				for(uint32_t s = 0; s < SampleCount; s += 4)
+				{
+					__m128i texels = _mm_loadu_si128( reinterpret_cast<__m128i const*>(samples + s) );
+					equal_bits &= _mm_movemask_epi8( _mm_cmpeq_epi32(texels, first) );
+					sum = _mm_add_epi16( sum, _mm_add_epi16( _mm_unpacklo_epi8(texels, zero), _mm_unpackhi_epi8(texels, zero) ) );
+				}
+			}
+
+			if(equal_bits == 0xFFFF)
+			{
+				memcpy(dst + i_px * 4, samples, 4);
+				continue;
+			}
+
+			sum = _mm_add_epi16( sum, _mm_srli_si128(sum, 8) );
+			sum = _mm_srli_epi16( _mm_add_epi16( sum, _mm_set1_epi16(SampleCount / 2) ), SHIFT );
+			int32_t px = _mm_cvtsi128_si32( _mm_packus_epi16(sum, zero) );
+			memcpy(dst + i_px * 4, &px, 4);
+#else
+			byte const* texels = reinterpret_cast<byte const*>(samples);
+			for(int c = 0; c < 4; ++c)
+			{
+				uint32_t sum = 0;
+				for(uint32_t s = 0; s < SampleCount; ++s)
+				{
+					sum += texels[s * 4 + c];
+				}
+				dst[i_px * 4 + c] = static_cast<byte>( (sum + SampleCount / 2) >> SHIFT );
+			}
+#endif
+		}
+	}
+
+	// sRGB colors are averaged in linear space, and alpha is averaged as is.
+	struct srgb_tables
+	{
+		float	to_linear[256];
+		byte	to_srgb[4096];		// Indexed by linear value in 12 bits.
+
+		srgb_tables()
+		{
+			for(int i = 0; i < 256; ++i)
+			{
+				float c = i / 255.0f;
+				to_linear[i] = c <= 0.04045f ? c / 12.92f : powf( (c + 0.055f) / 1.055f, 2.4f );
+			}
+			for(int i = 0; i < 4096; ++i)
+			{
+				float l = i / 4095.0f;
+				float c = l <= 0.0031308f ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+				to_srgb[i] = static_cast<byte>( c * 255.0f + 0.5f );
+			}
+		}
+	};
+
+	srgb_tables const& get_srgb_tables()
+	{
+		static srgb_tables tables;
+		return tables;
+	}
+
+	void resolve_srgb8(byte* dst, byte const* src, size_t count, size_t sample_count)
+	{
+		srgb_tables const& tables = get_srgb_tables();
+		float const inv_samples = 1.0f / sample_count;
+
+		for(size_t i_px = 0; i_px < count; ++i_px)
+		{
+			// Each sample is compared with the previous one, so all samples are equal if it matches.
+			byte const* samples = src + i_px * sample_count * 4;
+			if( std::equal(samples + 4, samples + sample_count * 4, samples) )
+			{
+				memcpy(dst + i_px * 4, samples, 4);
+				continue;
+			}
+
+			float sum[3] = {0.0f, 0.0f, 0.0f};
+			uint32_t alpha = 0;
+			for(size_t s = 0; s < sample_count; ++s)
+			{
+				sum[0] += tables.to_linear[ samples[s * 4 + 0] ];
+				sum[1] += tables.to_linear[ samples[s * 4 + 1] ];
+				sum[2] += tables.to_linear[ samples[s * 4 + 2] ];
+				alpha  += samples[s * 4 + 3];
+			}
+			for(int c = 0; c < 3; ++c)
+			{
+				int index = static_cast<int>(sum[c] * inv_samples * 4095.0f + 0.5f);
+				dst[i_px * 4 + c] = tables.to_srgb[ std::min(index, 4095) ];
+			}
+			dst[i_px * 4 + 3] = static_cast<byte>( (alpha + sample_count / 2) / sample_count );
+		}
+	}
+
+	resolve_pixels_fn select_resolve_kernel(pixel_format fmt, size_t sample_count, bool srgb)
+	{
+		switch(fmt)
+		{
+		case pixel_format_color_rgba32f:
+			return resolve_rgba32f;
+		case pixel_format_color_rgba8:
+		case pixel_format_color_bgra8:
+			if(srgb)
+			{
+				return resolve_srgb8;
+			}
+			switch(sample_count)
+			{
+			case 2:
+				return resolve_unorm8<2>;
+			case 4:
+				return resolve_unorm8<4>;
+			case 8:
+				return resolve_unorm8<8>;
+			case 16:
+				return resolve_unorm8<16>;
+			default:
+				return nullptr;
+			}
+		default:
+			return nullptr;
+		}
+	}
+}
+
 surface::surface(size_t w, size_t h, size_t samp_count, pixel_format fmt)
 		: format_(fmt)
 		, size_(static_cast<int>(w), static_cast<int>(h), 1, 0)
 		, sample_count_(samp_count), elem_size_(color_infos[fmt].size)
 {
 #if SALVIA_TILED_SURFACE
-	tile_size_[0] = (width + TILE_SIZE - 1) >> TILE_BITS;
-	tile_size_[1] = (height + TILE_SIZE - 1) >> TILE_BITS;
+	tile_size_[0] = (w + TILE_SIZE - 1) >> TILE_BITS;
+	tile_size_[1] = (h + TILE_SIZE - 1) >> TILE_BITS;
 
-	tile_mode_ = true;
-	if ((TILE_SIZE > size_[0]) || (TILE_SIZE > size_[1])){
-		tile_mode_ = false;
-	}
+	// Tiles of small surface are mostly padding, so it is kept linear.
+	tile_mode_ = w >= TILE_SIZE && h >= TILE_SIZE;
 
-	if (tile_mode_){
+	if (tile_mode_)
+	{
 		datas_.resize(tile_size_[0] * tile_size_[1] * TILE_SIZE * TILE_SIZE * sample_count_ * elem_size_);
 	}
-	else{
-		datas_.resize(size_[0] * size_[1] * sample_count_ * elem_size_);
+	else
+	{
+		datas_.resize( pitch() * h );
 	}
 #else
 	datas_.resize( pitch() * h );
 #endif
 
+	clear_tile_x_count_	= (w + CLEAR_TILE_SIZE - 1) >> CLEAR_TILE_BITS;
+	clear_tile_y_count_	= (h + CLEAR_TILE_SIZE - 1) >> CLEAR_TILE_BITS;
+	tiles_cleared_.assign(clear_tile_x_count_ * clear_tile_y_count_, 0);
+	clear_pending_		= false;
+	memset( clear_texel_, 0, sizeof(clear_texel_) );
+
+	tile_caches_enabled_ = false;
+	compression_ = false;
+
 	to_rgba32_func_         = pixel_format_convertor::get_convertor_func(pixel_format_color_rgba32f, format_);
 	from_rgba32_func_       = pixel_format_convertor::get_convertor_func(format_, pixel_format_color_rgba32f);
 	to_rgba32_array_func_   = pixel_format_convertor::get_array_convertor_func(pixel_format_color_rgba32f, format_);
@@ -55,10 +269,11 @@ surface::~surface()
 
 surface_ptr surface::make_mip_surface(filter_type filter)
 {
-	int mip_w = ( width()  + 1 ) / 2;
-	int mip_h = ( height() + 1 ) / 2;
+	size_t const mip_w = static_cast<size_t>( width()  + 1 ) / 2;
+	size_t const mip_h = static_cast<size_t>( height() + 1 ) / 2;
+	size_t const sample_count = static_cast<size_t>(sample_count_);
 
-	auto ret = boost::make_shared<surface>(mip_w, mip_h, sample_count_, format_);
+	auto ret = boost::make_shared<surface>(mip_w, mip_h, sample_count, format_);
 
 	switch (filter)
 	{
@@ -67,7 +282,7 @@ surface_ptr surface::make_mip_surface(filter_type filter)
         {
 			for(size_t x = 0; x < mip_w; ++x)
             {
-				for(size_t s = 0; s < sample_count_; ++s)
+				for(size_t s = 0; s < sample_count; ++s)
 				{
 					color_rgba32f c = get_texel(x*2, y*2, s);
 					ret->set_texel(x, y, s, c);
@@ -81,7 +296,7 @@ surface_ptr surface::make_mip_surface(filter_type filter)
         {
 			for(size_t x = 0; x < mip_w; ++x)
             {
-				for(size_t s = 0; s < sample_count_; ++s)
+				for(size_t s = 0; s < sample_count; ++s)
 				{
 					color_rgba32f c[4] =
 					{
@@ -106,21 +321,37 @@ surface_ptr surface::make_mip_surface(filter_type filter)
 
 result surface::map(internal_mapped_resource& mapped, map_mode mm)
 {
-#if SALVIA_TILED_SURFACE
-	// Unimplemented
-	this->untile(mapped_data_);
-#else
+	// Mapped data is always linear. Tiled surface is detiled into an intermediate buffer,
+	// and it is tiled back by unmapping.
+	bool const linear_storage = !tiled();
+
 	switch(mm)
 	{
 	case map_read:
-		mapped.data = mapped.reallocator(datas_.size());
-		memcpy( mapped.data, datas_.data(), datas_.size() );
+		mapped.data = mapped.reallocator( pitch() * size_[1] );
+		read_texels( 0, 0, size_[0], size_[1], static_cast<byte*>(mapped.data), pitch() );
+		break;
+	case map_write_discard:
+		// Content is undefined after discard, so clears are dropped without filling.
+		std::fill(tiles_cleared_.begin(), tiles_cleared_.end(), 0);
+		clear_pending_ = false;
+		std::fill(uniform_pixels_.begin(), uniform_pixels_.end(), 0);
+		mapped.data = linear_storage ? datas_.data() : mapped.reallocator( pitch() * size_[1] );
 		break;
 	case map_read_write:
 	case map_write_no_overwrite:
-	case map_write_discard:
 	case map_write:
-		mapped.data = datas_.data();
+		materialize();
+		decompress();
+		if(linear_storage)
+		{
+			mapped.data = datas_.data();
+		}
+		else
+		{
+			mapped.data = mapped.reallocator( pitch() * size_[1] );
+			read_texels( 0, 0, size_[0], size_[1], static_cast<byte*>(mapped.data), pitch() );
+		}
 		break;
 	}
 
@@ -128,32 +359,173 @@ result surface::map(internal_mapped_resource& mapped, map_mode mm)
 	mapped.depth_pitch = static_cast<uint32_t>(mapped.row_pitch * size_[1]);
 
 	return result::ok;
-#endif
 }
 
 result surface::unmap(internal_mapped_resource& mapped, map_mode mm)
 {
 	// No intermediate buffer needed in linear mode.
+	if( mm != map_read && tiled() )
+	{
+		write_texels( 0, 0, size_[0], size_[1], static_cast<byte const*>(mapped.data), mapped.row_pitch );
+	}
 	return result::ok;
 }
 
-void surface::resolve(surface& target)
+void surface::transfer(pixel_format srcfmt, const eflib::rect<size_t>& dest_rect, void* pdata)
+{
+	// Source is linear rows of rectangle, and each texel is written to all samples.
+	size_t const src_size = color_infos[srcfmt].size;
+	size_t const sample_count = static_cast<size_t>(sample_count_);
+	byte const* src = static_cast<byte const*>(pdata);
+
+	materialize(dest_rect.x, dest_rect.y, dest_rect.w, dest_rect.h);
+	for(size_t y = 0; y < dest_rect.h; ++y)
+	{
+		for(size_t x = 0; x < dest_rect.w; ++x)
+		{
+			byte const* src_texel = src + (y * dest_rect.w + x) * src_size;
+			for(size_t s = 0; s < sample_count; ++s)
+			{
+				pixel_format_convertor::convert( format_, srcfmt, texel_address(dest_rect.x + x, dest_rect.y + y, s), src_texel );
+			}
+		}
+	}
+}
+
+void surface::transfer(const eflib::rect<size_t>& dest_rect, size_t src_start_x, size_t src_start_y, surface& src_surf)
+{
+	surface const& src = src_surf;
+
+	if( src.format_ == format_ && src.sample_count_ == sample_count_ )
+	{
+		// Rows are copied through a linear buffer, so both surfaces may be tiled.
+		size_t const row_size = dest_rect.w * sample_count_ * elem_size_;
+		std::vector<byte> row(row_size);
+		for(size_t y = 0; y < dest_rect.h; ++y)
+		{
+			src.read_texels(src_start_x, src_start_y + y, dest_rect.w, 1, row.data(), row_size);
+			materialize(dest_rect.x, dest_rect.y + y, dest_rect.w, 1);
+			write_texels(dest_rect.x, dest_rect.y + y, dest_rect.w, 1, row.data(), row_size);
+		}
+		return;
+	}
+
+	size_t const sample_count = static_cast<size_t>(sample_count_);
+	for(size_t y = 0; y < dest_rect.h; ++y)
+	{
+		for(size_t x = 0; x < dest_rect.w; ++x)
+		{
+			for(size_t s = 0; s < sample_count; ++s)
+			{
+				size_t src_sample = std::min<size_t>(s, src.sample_count_ - 1);
+				set_texel( dest_rect.x + x, dest_rect.y + y, s, src.get_texel(src_start_x + x, src_start_y + y, src_sample) );
+			}
+		}
+	}
+}
+
+void surface::resolve(surface& target, bool srgb)
 {
 	EFLIB_ASSERT(1 == target.sample_count(), "Resolve's target can't be a multi-sample surface");
 
+	// All samples of a cleared tile are the clear value, so it is resolved without reading texels.
+	if( clear_pending_ && std::find(tiles_cleared_.begin(), tiles_cleared_.end(), 0) == tiles_cleared_.end() )
+	{
+		target.fill_texels(clear_color_);
+		return;
+	}
+
+	resolve_pixels_fn kernel = nullptr;
+	if( target.format_ == format_ && target.size_[0] == size_[0] && target.size_[1] == size_[1] )
+	{
+		kernel = resolve_kernels::select_resolve_kernel(format_, sample_count_, srgb);
+	}
+
+	// Tiles are resolved in parallel. A target tile is only written by the thread which resolves it.
+	execute_threads(
+		[this, &target, kernel](thread_context const* thread_ctx)
+		{
+			thread_context::package_cursor current_package = thread_ctx->next_package();
+			while ( current_package.valid() )
+			{
+				auto tile_range = current_package.item_range();
+				for (int32_t i = tile_range.first; i < tile_range.second; ++ i)
+				{
+					this->resolve_tile(target, kernel, i % clear_tile_x_count_, i / clear_tile_x_count_);
+				}
+				current_package = thread_ctx->next_package();
+			}
+		},
+		static_cast<int32_t>( tiles_cleared_.size() ), RESOLVE_PACKAGE_SIZE
+		);
+}
+
+void surface::resolve_tile(surface& target, resolve_pixels_fn kernel, size_t tile_x, size_t tile_y) const
+{
+	size_t const left	= tile_x * CLEAR_TILE_SIZE;
+	size_t const top	= tile_y * CLEAR_TILE_SIZE;
+	size_t const right	= std::min<size_t>(left + CLEAR_TILE_SIZE, size_[0]);
+	size_t const bottom	= std::min<size_t>(top + CLEAR_TILE_SIZE, size_[1]);
+
+	if( clear_pending_ && tiles_cleared_[tile_y * clear_tile_x_count_ + tile_x] )
+	{
+		target.fill_texels(left, top, right - left, bottom - top, clear_color_);
+		return;
+	}
+
+	if(kernel != nullptr)
+	{
+		// Target tile is overwritten entirely, so its clear value is not filled.
+		target.tiles_cleared_[tile_y * clear_tile_x_count_ + tile_x] = 0;
+
+		for (size_t y = top; y < bottom; ++ y)
+		{
+			for (size_t x = left; x < right; )
+			{
+				if( pixel_uniform(x, y) )
+				{
+					memcpy( target.datas_.data() + target.texel_offset(x, y, 0), datas_.data() + texel_offset(x, y, 0), elem_size_ );
+					++x;
+					continue;
+				}
+
+				// Run stops at the first uniform pixel, whose other samples are stale.
+				size_t count = target.contiguous_texels( x, contiguous_texels(x, right - x) );
+				for(size_t i = 1; i < count; ++i)
+				{
+					if( pixel_uniform(x + i, y) )
+					{
+						count = i;
+						break;
+					}
+				}
+				kernel( target.datas_.data() + target.texel_offset(x, y, 0), datas_.data() + texel_offset(x, y, 0), count, sample_count_ );
+				x += count;
+			}
+		}
+		return;
+	}
+
+	size_t const sample_count = static_cast<size_t>(sample_count_);
 	color_rgba32f clr;
 	color_rgba32f tmp;
-	for (size_t y = 0; y < size_[1]; ++ y)
+	for (size_t y = top; y < bottom; ++ y)
 	{
-		for (size_t x = 0; x < size_[0]; ++ x)
+		for (size_t x = left; x < right; ++ x)
 		{
+			if( pixel_uniform(x, y) )
+			{
+				target.set_texel( x, y, 0, get_texel(x, y, 0) );
+				continue;
+			}
+
 			clr = color_rgba32f(0, 0, 0, 0);
-			for (size_t s = 0; s < sample_count_; ++ s)
+			for (size_t s = 0; s < sample_count; ++ s)
 			{
-				to_rgba32_func_( &tmp, texel_address(x, y, s) );
+				to_rgba32_func_( &tmp, datas_.data() + texel_offset(x, y, s) );
 				clr.get_vec4() += tmp.get_vec4();
 			}
-			clr.get_vec4() /= static_cast<float>(sample_count_);
+			clr.get_vec4() /= static_cast<float>(sample_count);
 
 			target.set_texel(x, y, 0, clr);
 		}
@@ -197,106 +569,288 @@ void surface::set_texel(size_t x, size_t y, size_t sample, const void* color)
 
 void surface::fill_texels(size_t sx, size_t sy, size_t width, size_t height, const color_rgba32f& color)
 {
+	if( sx == 0 && sy == 0 && width == static_cast<size_t>(size_[0]) && height == static_cast<size_t>(size_[1]) )
+	{
+		clear(color);
+		return;
+	}
+
+	if(width == 0 || height == 0)
+	{
+		return;
+	}
+
+	// Texels out of region have to keep clear value of their tiles.
+	materialize(sx, sy, width, height);
+
 	uint8_t pix_clr[4 * 4 * sizeof(float)];
 	from_rgba32_func_(pix_clr, &color);
 
-#if SALVIA_TILED_SURFACE
-	if (tile_mode_)
-    {
-		if ((0 == sx) && (0 == sy) && (width == size_[0]) && (height == size_[1]))
-        {
-			for (uint32_t x = 0; x < TILE_SIZE; ++ x){
-				for (size_t s = 0; s < sample_count_; ++ s){
-					memcpy(&datas_[this->texel_offset(x, 0, s)], pix_clr, elem_size_);
-				}
-			}
-			for (uint32_t y = 1; y < TILE_SIZE; ++ y){
-				memcpy(&datas_[this->texel_offset(0, y, 0)], &datas_[this->texel_offset(0, 0, 0)], TILE_SIZE * sample_count_ * elem_size_);
-			}
-			for (uint32_t tx = 1; tx < tile_size_[0]; ++ tx){
-				memcpy(&datas_[this->texel_offset(tx << TILE_BITS, 0, 0)], &datas_[this->texel_offset(0, 0, 0)], TILE_SIZE * TILE_SIZE * sample_count_ * elem_size_);
-			}
-			for (uint32_t ty = 1; ty < tile_size_[1]; ++ ty){
-				memcpy(&datas_[this->texel_offset(0, ty << TILE_BITS, 0)], &datas_[this->texel_offset(0, 0, 0)], TILE_SIZE * TILE_SIZE * tile_size_[0] * sample_count_ * elem_size_);
-			}
+	// One row is filled, and it is written to all rows of region.
+	std::vector<byte> row(width * sample_count_ * elem_size_);
+	for(size_t i = 0; i < width * sample_count_; ++i)
+	{
+		memcpy(&row[i * elem_size_], pix_clr, elem_size_);
+	}
+	write_texels(sx, sy, width, height, row.data(), 0);
+}
+
+void surface::fill_texels(color_rgba32f const& color)
+{
+    fill_texels(0, 0, size_[0], size_[1], color);
+}
+
+void surface::clear(color_rgba32f const& color)
+{
+	from_rgba32_func_(clear_texel_, &color);
+	to_rgba32_func_(&clear_color_, clear_texel_);
+	std::fill(tiles_cleared_.begin(), tiles_cleared_.end(), 1);
+	clear_pending_ = true;
+}
+
+bool surface::tile_cleared(size_t x, size_t y) const
+{
+	return clear_pending_ && tiles_cleared_[(y >> CLEAR_TILE_BITS) * clear_tile_x_count_ + (x >> CLEAR_TILE_BITS)];
+}
+
+void surface::materialize()
+{
+	if(!clear_pending_)
+	{
+		return;
+	}
+
+	materialize(0, 0, size_[0], size_[1]);
+	clear_pending_ = false;
+}
+
+void surface::materialize(size_t sx, size_t sy, size_t width, size_t height)
+{
+	if(!clear_pending_ || width == 0 || height == 0)
+	{
+		return;
+	}
+
+	for(size_t tile_y = sy >> CLEAR_TILE_BITS; tile_y <= (sy + height - 1) >> CLEAR_TILE_BITS; ++tile_y)
+	{
+		for(size_t tile_x = sx >> CLEAR_TILE_BITS; tile_x <= (sx + width - 1) >> CLEAR_TILE_BITS; ++tile_x)
+		{
+			materialize_tile(tile_x << CLEAR_TILE_BITS, tile_y << CLEAR_TILE_BITS);
 		}
-		else
-        {
-			size_t begin_tile_x = sx >> TILE_BITS;
-			size_t begin_x_in_tile = sx & TILE_MASK;
-			size_t end_tile_x = (sx + width - 1) >> TILE_BITS;
-			size_t end_x_in_tile = (sx + width - 1) & TILE_MASK;
+	}
+}
 
-			{
-				for (size_t x = begin_x_in_tile; x < TILE_SIZE; ++ x){
-					for (size_t s = 0; s < sample_count_; ++ s){
-						memcpy(&datas_[this->texel_offset((begin_tile_x << TILE_BITS) + x, sy, s)],
-							pix_clr, elem_size_);
-					}
-				}
-				for (size_t y = sy + 1; y < sy + height; ++ y){
-					memcpy(&datas_[this->texel_offset(sx, y, 0)],
-						&datas_[this->texel_offset(sx, sy, 0)], (TILE_SIZE - begin_x_in_tile) * sample_count_ * elem_size_);
-				}
-			}
+void surface::materialize_tile(size_t x, size_t y)
+{
+	size_t const tile_x = x >> CLEAR_TILE_BITS;
+	size_t const tile_y = y >> CLEAR_TILE_BITS;
 
-			for (size_t tx = begin_tile_x + 1; tx < end_tile_x; ++ tx){
-				for (uint32_t x = 0; x < TILE_SIZE; ++ x){
-					for (size_t s = 0; s < sample_count_; ++ s){
-						memcpy(&datas_[this->texel_offset((tx << TILE_BITS) + x, sy, s)],
-							pix_clr, elem_size_);
-					}
-				}
-				for (size_t y = sy + 1; y < sy + height; ++ y){
-					memcpy(&datas_[this->texel_offset(tx << TILE_BITS, y, 0)],
-						&datas_[this->texel_offset(tx << TILE_BITS, sy, 0)], TILE_SIZE * sample_count_ * elem_size_);
-				}
-			}
+	uint8_t& cleared = tiles_cleared_[tile_y * clear_tile_x_count_ + tile_x];
+	if(cleared)
+	{
+		fill_tile(datas_.data(), tile_x, tile_y);
+		cleared = 0;
 
+		if(compression_)
+		{
+			size_t const left	= tile_x << CLEAR_TILE_BITS;
+			size_t const top	= tile_y << CLEAR_TILE_BITS;
+			size_t const right	= std::min<size_t>(left + CLEAR_TILE_SIZE, size_[0]);
+			size_t const bottom	= std::min<size_t>(top + CLEAR_TILE_SIZE, size_[1]);
+			for(size_t y = top; y < bottom; ++y)
 			{
-				for (size_t x = 0; x < end_x_in_tile; ++ x){
-					for (size_t s = 0; s < sample_count_; ++ s){
-						memcpy(&datas_[this->texel_offset((end_tile_x << TILE_BITS) + x, sy, s)],
-							pix_clr, elem_size_);
-					}
-				}
-				for (size_t y = sy + 1; y < sy + height; ++ y){
-					memcpy(&datas_[this->texel_offset(end_tile_x << TILE_BITS, y, 0)],
-						&datas_[this->texel_offset(end_tile_x << TILE_BITS, sy, 0)], end_x_in_tile * sample_count_ * elem_size_);
-				}
+				std::fill(&uniform_pixels_[y * size_[0] + left], &uniform_pixels_[y * size_[0] + right], 1);
 			}
 		}
 	}
+}
+
+void surface::set_compression(bool enabled)
+{
+	enabled = enabled && sample_count_ > 1;
+	if(enabled == compression_)
+	{
+		return;
+	}
+
+	if(enabled)
+	{
+		uniform_pixels_.assign(size_[0] * size_[1], 0);
+	}
 	else
-    {
-		for (size_t x = sx; x < sx + width; ++ x){
-			for (size_t s = 0; s < sample_count_; ++ s){
-				memcpy(&datas_[((size_[0] * sy + x) * sample_count_ + s) * elem_size_], pix_clr, elem_size_);
+	{
+		decompress();
+		std::vector<uint8_t>().swap(uniform_pixels_);
+	}
+	compression_ = enabled;
+}
+
+// Reports flags of storage, which are kept while tile caches are enabled.
+bool surface::pixel_uniform(size_t x, size_t y) const
+{
+	// All samples of a cleared tile are the clear value.
+	return compression_ && ( uniform_pixels_[y * size_[0] + x] || tile_cleared(x, y) );
+}
+
+void* surface::uniform_texel_address(size_t x, size_t y)
+{
+	assert( compressed() );
+
+	if(clear_pending_)
+	{
+		materialize_tile(x, y);
+	}
+	uniform_pixels_[y * size_[0] + x] = 1;
+	return datas_.data() + texel_offset(x, y, 0);
+}
+
+void surface::decompress_pixel(size_t x, size_t y)
+{
+	byte* texel = datas_.data() + texel_offset(x, y, 0);
+	size_t const sample_count = static_cast<size_t>(sample_count_);
+	for(size_t s = 1; s < sample_count; ++s)
+	{
+		memcpy(texel + s * elem_size_, texel, elem_size_);
+	}
+	uniform_pixels_[y * size_[0] + x] = 0;
+}
+
+void surface::decompress()
+{
+	if(!compression_)
+	{
+		return;
+	}
+
+	for(size_t y = 0; y < static_cast<size_t>(size_[1]); ++y)
+	{
+		for(size_t x = 0; x < static_cast<size_t>(size_[0]); ++x)
+		{
+			if(uniform_pixels_[y * size_[0] + x])
+			{
+				decompress_pixel(x, y);
 			}
 		}
-		for (size_t y = sy + 1; y < sy + height; ++ y){
-			memcpy(&datas_[(size_[0] * y + sx) * sample_count_ * elem_size_], &datas_[(size_[0] * sy + sx) * sample_count_ * elem_size_], sample_count_ * elem_size_ * width);
-		}
 	}
-#else
-	for (size_t x = sx; x < sx + width; ++ x)
+}
+
+void surface::reset_uniform_pixels(size_t sx, size_t sy, size_t width, size_t height)
+{
+	if(!compression_)
+	{
+		return;
+	}
+
+	for(size_t y = sy; y < sy + height; ++y)
+	{
+		std::fill(&uniform_pixels_[y * size_[0] + sx], &uniform_pixels_[y * size_[0] + sx] + width, 0);
+	}
+}
+
+size_t surface::tile_cache_size(size_t tile_size) const
+{
+	return tile_size * tile_size * sample_count_ * elem_size_;
+}
+
+void surface::enable_tile_caches(bool enabled)
+{
+	tile_caches_enabled_ = enabled;
+
+	tile_cache no_cache = {nullptr, 0, 0, 0};
+	tile_caches_.assign(enabled ? tiles_cleared_.size() : 0, no_cache);
+}
+
+void surface::attach_tile_cache(size_t left, size_t top, size_t tile_size, byte* buffer)
+{
+	assert(tile_caches_enabled_);
+	assert(left % CLEAR_TILE_SIZE == 0 && top % CLEAR_TILE_SIZE == 0 && tile_size % CLEAR_TILE_SIZE == 0);
+
+	if( left >= static_cast<size_t>(size_[0]) || top >= static_cast<size_t>(size_[1]) )
+	{
+		return;
+	}
+
+	size_t const width	= std::min<size_t>(tile_size, size_[0] - left);
+	size_t const height	= std::min<size_t>(tile_size, size_[1] - top);
+
+	// Cleared tiles are filled from clear value, so they are never materialized in surface.
+	read_texels(left, top, width, height, buffer, width * sample_count_ * elem_size_);
+
+	for(size_t y = top; y < top + height; y += CLEAR_TILE_SIZE)
 	{
-		for (size_t s = 0; s < sample_count_; ++ s)
+		for(size_t x = left; x < left + width; x += CLEAR_TILE_SIZE)
 		{
-			memcpy(&datas_[((size_[0] * sy + x) * sample_count_ + s) * elem_size_], pix_clr, elem_size_);
+			size_t const tile_index = (y >> CLEAR_TILE_BITS) * clear_tile_x_count_ + (x >> CLEAR_TILE_BITS);
+			tiles_cleared_[tile_index] = 0;
+
+			tile_cache& cache = tile_caches_[tile_index];
+			cache.data	= buffer;
+			cache.left	= left;
+			cache.top	= top;
+			cache.width	= width;
 		}
 	}
+}
 
-	for (size_t y = sy + 1; y < sy + height; ++ y)
+void surface::detach_tile_cache(size_t left, size_t top, size_t tile_size)
+{
+	if( left >= static_cast<size_t>(size_[0]) || top >= static_cast<size_t>(size_[1]) )
 	{
-		memcpy(&datas_[(size_[0] * y + sx) * sample_count_ * elem_size_], &datas_[(size_[0] * sy + sx) * sample_count_ * elem_size_], sample_count_ * elem_size_ * width);
+		return;
+	}
+
+	size_t const width	= std::min<size_t>(tile_size, size_[0] - left);
+	size_t const height	= std::min<size_t>(tile_size, size_[1] - top);
+
+	byte const* buffer = tile_caches_[(top >> CLEAR_TILE_BITS) * clear_tile_x_count_ + (left >> CLEAR_TILE_BITS)].data;
+	if(buffer == nullptr)
+	{
+		return;
+	}
+
+	write_texels(left, top, width, height, buffer, width * sample_count_ * elem_size_);
+
+	for(size_t y = top; y < top + height; y += CLEAR_TILE_SIZE)
+	{
+		for(size_t x = left; x < left + width; x += CLEAR_TILE_SIZE)
+		{
+			tile_caches_[(y >> CLEAR_TILE_BITS) * clear_tile_x_count_ + (x >> CLEAR_TILE_BITS)].data = nullptr;
+		}
 	}
-#endif
 }
 
-void surface::fill_texels(color_rgba32f const& color)
+void surface::fill_tile(byte* data, size_t tile_x, size_t tile_y) const
 {
-    fill_texels(0, 0, size_[0], size_[1], color);
+	size_t const left	= tile_x << CLEAR_TILE_BITS;
+	size_t const top	= tile_y << CLEAR_TILE_BITS;
+
+#if SALVIA_TILED_SURFACE
+	// Tile is contiguous in storage, and padding of border tiles is filled too.
+	if (tile_mode_)
+	{
+		byte* tile_data = data + texel_offset(left, top, 0);
+		for(size_t i = 0; i < TILE_SIZE * TILE_SIZE * sample_count_; ++i)
+		{
+			memcpy(tile_data + i * elem_size_, clear_texel_, elem_size_);
+		}
+		return;
+	}
+#endif
+
+	// Rows of a clear tile are contiguous in linear layout, so the first row is filled per texel and copied to others.
+	size_t const width	= std::min<size_t>(CLEAR_TILE_SIZE, size_[0] - left);
+	size_t const height	= std::min<size_t>(CLEAR_TILE_SIZE, size_[1] - top);
+
+	byte* first_row = data + texel_offset(left, top, 0);
+	for(size_t i = 0; i < width * sample_count_; ++i)
+	{
+		memcpy(first_row + i * elem_size_, clear_texel_, elem_size_);
+	}
+
+	for(size_t y = top + 1; y < top + height; ++y)
+	{
+		memcpy(data + texel_offset(left, y, 0), first_row, width * sample_count_ * elem_size_);
+	}
 }
 
 size_t surface::texel_offset(size_t x, size_t y, size_t sample) const
@@ -306,85 +860,137 @@ size_t surface::texel_offset(size_t x, size_t y, size_t sample) const
 	{
 		size_t const tile_x		= x >> TILE_BITS;
 		size_t const tile_y		= y >> TILE_BITS;
-		size_t const x_in_tile	= x & TILE_MASK;
-		size_t const y_in_tile	= y & TILE_MASK;
-		return (((tile_y * tile_size_[0] + tile_x) * TILE_SIZE * TILE_SIZE + (y_in_tile * TILE_SIZE + x_in_tile)) * sample_count_ + sample) * elem_size_;
+		size_t const block_x	= (x & TILE_MASK) >> BLOCK_BITS;
+		size_t const block_y	= (y & TILE_MASK) >> BLOCK_BITS;
+		size_t const texel_index =
+			  ( (tile_y * tile_size_[0] + tile_x) << (TILE_BITS * 2) )
+			+ ( ( (block_y << (TILE_BITS - BLOCK_BITS)) + block_x ) << (BLOCK_BITS * 2) )
+			+ ( ( (y & BLOCK_MASK) << BLOCK_BITS ) + (x & BLOCK_MASK) );
+		return (texel_index * sample_count_ + sample) * elem_size_;
 	}
-	else
+#endif
+	return ((y * size_[0] + x) * sample_count_ + sample) * elem_size_;
+}
+
+size_t surface::contiguous_texels(size_t x, size_t count) const
+{
+#if SALVIA_TILED_SURFACE
+	if (tile_mode_)
 	{
-		return ((y * size_[0] + x) * sample_count_ + sample) * elem_size_;
+		return std::min<size_t>( BLOCK_SIZE - (x & BLOCK_MASK), count );
 	}
 #else
-	return ((y * size_[0] + x) * sample_count_ + sample) * elem_size_;
+	EFLIB_UNREF_DECLARATOR(x);
 #endif
+	return count;
 }
 
+bool surface::tiled() const
+{
 #if SALVIA_TILED_SURFACE
-void surface::tile(internal_mapped_resource const& mapped)
+	return tile_mode_;
+#else
+	return false;
+#endif
+}
+
+// Storage is accessed directly, so attached caches are not visible.
+void surface::read_texels(size_t sx, size_t sy, size_t width, size_t height, byte* linear, size_t linear_pitch) const
 {
-	if (tile_mode_)
+	size_t const sample_count = static_cast<size_t>(sample_count_);
+	size_t const texel_size = sample_count * elem_size_;
+	for(size_t y = sy; y < sy + height; ++y)
 	{
-		for (size_t ty = 0; ty < tile_size_[1]; ++ ty)
+		byte* dst = linear + (y - sy) * linear_pitch;
+		for(size_t x = sx; x < sx + width; )
 		{
-			const size_t by = ty << TILE_BITS;
-			const size_t rest_height = std::min(size_[1] - by, TILE_SIZE);
-			for (size_t tx = 0; tx < tile_size_[0]; ++ tx)
+			// Run does not cross clear tiles, so it is either cleared or stored.
+			size_t const count = contiguous_texels( x, std::min<size_t>( sx + width - x, CLEAR_TILE_SIZE - (x & (CLEAR_TILE_SIZE - 1)) ) );
+			if( tile_cleared(x, y) )
 			{
-				const size_t bx = tx << TILE_BITS;
-				const size_t tile_id = ty * tile_size_[0] + tx;
-				const size_t rest_width = std::min(size_[0] - bx, TILE_SIZE);
-				for (size_t y = 0; y < rest_height; ++ y)
+				for(size_t i = 0; i < count * sample_count; ++i)
 				{
-					memcpy(&datas_[((tile_id * TILE_SIZE + y) * TILE_SIZE) * sample_count_ * elem_size_],
-						&tile_data[((by + y) * size_[0] + bx) * sample_count_ * elem_size_],
-						rest_width * sample_count_ * elem_size_);
+					memcpy(dst + i * elem_size_, clear_texel_, elem_size_);
 				}
 			}
+			else
+			{
+				memcpy( dst, datas_.data() + texel_offset(x, y, 0), count * texel_size );
+				for(size_t i = 0; compression_ && i < count; ++i)
+				{
+					if(uniform_pixels_[y * size_[0] + x + i])
+					{
+						for(size_t s = 1; s < sample_count; ++s)
+						{
+							memcpy(dst + i * texel_size + s * elem_size_, dst + i * texel_size, elem_size_);
+						}
+					}
+				}
+			}
+			dst += count * texel_size;
+			x += count;
 		}
 	}
-	else
-	{
-		datas_ = tile_data;
-	}
 }
 
-void surface::untile(std::vector<byte>& untile_data)
+void surface::write_texels(size_t sx, size_t sy, size_t width, size_t height, byte const* linear, size_t linear_pitch)
 {
-	if (tile_mode_)
+	size_t const texel_size = sample_count_ * elem_size_;
+	for(size_t y = sy; y < sy + height; ++y)
 	{
-		for (size_t ty = 0; ty < tile_size_[1]; ++ ty)
+		byte const* src = linear + (y - sy) * linear_pitch;
+		for(size_t x = sx; x < sx + width; )
 		{
-			const size_t by = ty << TILE_BITS;
-			const size_t rest_height = std::min(size_[1] - by, TILE_SIZE);
-			for (size_t tx = 0; tx < tile_size_[0]; ++ tx)
-			{
-				const size_t bx = tx << TILE_BITS;
-				const size_t tile_id = ty * tile_size_[0] + tx;
-				const size_t rest_width = std::min(size_[0] - bx, TILE_SIZE);
-				for (size_t y = 0; y < rest_height; ++ y)
-				{
-					memcpy(&untile_data[((by + y) * size_[0] + bx) * sample_count_ * elem_size_],
-						&datas_[((tile_id * TILE_SIZE + y) * TILE_SIZE) * sample_count_ * elem_size_],
-						rest_width * sample_count_ * elem_size_);
-				}
-			}
+			size_t const count = contiguous_texels(x, sx + width - x);
+			memcpy( datas_.data() + texel_offset(x, y, 0), src, count * texel_size );
+			src += count * texel_size;
+			x += count;
 		}
 	}
-	else
-	{
-		untile_data = datas_;
-	}
+	reset_uniform_pixels(sx, sy, width, height);
 }
 
-#endif
-
 void* surface::texel_address(size_t x, size_t y, size_t sample)
 {
+	if(tile_caches_enabled_)
+	{
+		tile_cache const& cache = tile_caches_[(y >> CLEAR_TILE_BITS) * clear_tile_x_count_ + (x >> CLEAR_TILE_BITS)];
+		if(cache.data != nullptr)
+		{
+			return cache.data + ( ( (y - cache.top) * cache.width + (x - cache.left) ) * sample_count_ + sample ) * elem_size_;
+		}
+	}
+
+	if(clear_pending_)
+	{
+		materialize_tile(x, y);
+	}
+	if( compression_ && uniform_pixels_[y * size_[0] + x] )
+	{
+		decompress_pixel(x, y);
+	}
     return reinterpret_cast<void*>( datas_.data() + texel_offset(x, y, sample) );
 }
 
 void const* surface::texel_address(size_t x, size_t y, size_t sample) const
 {
+	if(tile_caches_enabled_)
+	{
+		tile_cache const& cache = tile_caches_[(y >> CLEAR_TILE_BITS) * clear_tile_x_count_ + (x >> CLEAR_TILE_BITS)];
+		if(cache.data != nullptr)
+		{
+			return cache.data + ( ( (y - cache.top) * cache.width + (x - cache.left) ) * sample_count_ + sample ) * elem_size_;
+		}
+	}
+
+	if( tile_cleared(x, y) )
+	{
+		return clear_texel_;
+	}
+	if( compression_ && uniform_pixels_[y * size_[0] + x] )
+	{
+		sample = 0;
+	}
     return reinterpret_cast<void const*>( datas_.data() + texel_offset(x, y, sample) );
 }
 END_NS_SALVIAR();
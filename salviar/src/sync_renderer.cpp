@@ -31,7 +31,8 @@ result sync_renderer::commit_state_and_command()
 
 result sync_renderer::flush()
 {
-	return result::ok;
+	state_->cmd = command_id::flush;
+	return commit_state_and_command();
 }
 
 sync_renderer::sync_renderer()
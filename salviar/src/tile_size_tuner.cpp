@@ -0,0 +1,147 @@
+#include <salviar/include/tile_size_tuner.h>
+
+#include <salviar/include/thread_context.h>
+
+#include <eflib/include/platform/boost_begin.h>
+#include <boost/chrono.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/tuple/tuple.hpp>
+#include <boost/tuple/tuple_comparison.hpp>
+#include <eflib/include/platform/boost_end.h>
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <vector>
+
+BEGIN_NS_SALVIAR();
+
+namespace
+{
+	uint32_t const TILE_SIZE_CANDIDATES[] = { 32, 64, 128 };
+
+	// Benchmark buffer is limited, so tuning is cheap even for large targets.
+	uint32_t const MAX_BENCHMARK_SIZE	= 512;
+	// Each tile is read and written several times, like primitives overlapped in tile.
+	uint32_t const OVERDRAW_PASSES		= 4;
+	uint32_t const BENCHMARK_REPEATS	= 2;
+
+	typedef boost::tuple<uint32_t, uint32_t, uint32_t, uint32_t> tuning_key;
+
+	boost::mutex						tuned_sizes_mutex;
+	std::map<tuning_key, uint32_t>		tuned_sizes;
+
+	uint64_t time_stamp()
+	{
+		using namespace boost::chrono;
+		return static_cast<uint64_t>( duration_cast<nanoseconds>( high_resolution_clock::now().time_since_epoch() ).count() );
+	}
+
+	uint64_t benchmark_tile_size(
+		std::vector<uint32_t>& buffer, uint32_t width, uint32_t height, uint32_t words_per_pixel,
+		uint32_t tile_size, uint32_t thread_count)
+	{
+		uint32_t const tile_x_count = (width  + tile_size - 1) / tile_size;
+		uint32_t const tile_y_count = (height + tile_size - 1) / tile_size;
+		uint32_t const pitch = width * words_per_pixel;
+
+		uint64_t start_time = time_stamp();
+
+		execute_threads(
+			[&](thread_context const* thread_ctx)
+			{
+				thread_context::package_cursor current_package = thread_ctx->next_package();
+				while ( current_package.valid() )
+				{
+					auto tile_range = current_package.item_range();
+					for (int32_t i = tile_range.first; i < tile_range.second; ++ i)
+					{
+						uint32_t const tile_y = i / tile_x_count;
+						uint32_t const tile_x = i - tile_y * tile_x_count;
+						uint32_t const left   = tile_x * tile_size;
+						uint32_t const top    = tile_y * tile_size;
+						uint32_t const right  = std::min(left + tile_size, width);
+						uint32_t const bottom = std::min(top  + tile_size, height);
+
+						for (uint32_t pass = 0; pass < OVERDRAW_PASSES; ++ pass)
+						{
+							for (uint32_t y = top; y < bottom; ++ y)
+							{
+								uint32_t* row = &buffer[y * pitch];
+								for (uint32_t w = left * words_per_pixel; w < right * words_per_pixel; ++ w)
+								{
+									row[w] = row[w] * 3 + pass;
+								}
+							}
+						}
+					}
+					current_package = thread_ctx->next_package();
+				}
+			},
+			static_cast<int32_t>(tile_x_count * tile_y_count), 1, static_cast<int32_t>(thread_count)
+			);
+
+		return time_stamp() - start_time;
+	}
+}
+
+bool is_supported_tile_size(uint32_t tile_size)
+{
+	for (uint32_t candidate: TILE_SIZE_CANDIDATES)
+	{
+		if (candidate == tile_size)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+uint32_t tune_tile_size(uint32_t width, uint32_t height, uint32_t bytes_per_pixel, uint32_t thread_count)
+{
+	if (width == 0 || height == 0 || thread_count == 0)
+	{
+		return DEFAULT_TILE_SIZE;
+	}
+
+	tuning_key key(width, height, bytes_per_pixel, thread_count);
+
+	boost::lock_guard<boost::mutex> lock(tuned_sizes_mutex);
+
+	auto it = tuned_sizes.find(key);
+	if (it != tuned_sizes.end())
+	{
+		return it->second;
+	}
+
+	uint32_t const bench_width		= std::min(width,  MAX_BENCHMARK_SIZE);
+	uint32_t const bench_height		= std::min(height, MAX_BENCHMARK_SIZE);
+	uint32_t const words_per_pixel	= std::max<uint32_t>( (bytes_per_pixel + 3) / 4, 1 );
+	std::vector<uint32_t> buffer(bench_width * bench_height * words_per_pixel, 0);
+
+	uint32_t best_size = DEFAULT_TILE_SIZE;
+	uint64_t best_time = std::numeric_limits<uint64_t>::max();
+	for (uint32_t tile_size: TILE_SIZE_CANDIDATES)
+	{
+		uint64_t tile_time = std::numeric_limits<uint64_t>::max();
+		for (uint32_t i = 0; i < BENCHMARK_REPEATS; ++ i)
+		{
+			tile_time = std::min(
+				tile_time,
+				benchmark_tile_size(buffer, bench_width, bench_height, words_per_pixel, tile_size, thread_count)
+				);
+		}
+
+		if (tile_time < best_time)
+		{
+			best_time = tile_time;
+			best_size = tile_size;
+		}
+	}
+
+	tuned_sizes[key] = best_size;
+	return best_size;
+}
+
+END_NS_SALVIAR();
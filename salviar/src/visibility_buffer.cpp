@@ -0,0 +1,80 @@
+#include <salviar/include/visibility_buffer.h>
+
+#include <salviar/include/render_state.h>
+#include <salviar/include/surface.h>
+
+#include <algorithm>
+
+BEGIN_NS_SALVIAR();
+
+uint64_t const visibility_buffer::INVALID_ID;
+
+visibility_buffer::visibility_buffer()
+	: draw_count_(0), width_(0), height_(0), sample_count_(0), ds_target_(nullptr)
+{
+}
+
+bool visibility_buffer::compatible(render_state const* state) const
+{
+	if(empty())
+	{
+		return true;
+	}
+
+	if( state->depth_stencil_target.get() != ds_target_ || state->color_targets.size() != color_targets_.size() )
+	{
+		return false;
+	}
+
+	for(size_t i = 0; i < color_targets_.size(); ++i)
+	{
+		if(state->color_targets[i].get() != color_targets_[i])
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+uint32_t visibility_buffer::add_draw(render_state const* state)
+{
+	if(empty())
+	{
+		width_			= static_cast<size_t>(state->target_vp.w);
+		height_			= static_cast<size_t>(state->target_vp.h);
+		sample_count_	= state->target_sample_count;
+		ds_target_		= state->depth_stencil_target.get();
+
+		color_targets_.clear();
+		for(auto const& color_target: state->color_targets)
+		{
+			color_targets_.push_back( color_target.get() );
+		}
+
+		ids_.assign(width_ * height_ * sample_count_, INVALID_ID);
+	}
+
+	if(draw_count_ == draws_.size())
+	{
+		draws_.resize(draw_count_ + 1);
+	}
+
+	return static_cast<uint32_t>(draw_count_++);
+}
+
+void visibility_buffer::reset()
+{
+	for(size_t i = 0; i < draw_count_; ++i)
+	{
+		deferred_draw& d = draws_[i];
+		d.vx_shader.reset();
+		d.px_shader.reset();
+		d.cpp_bs.reset();
+		d.threaded_psu.clear();
+		d.threaded_bsu.clear();
+	}
+	draw_count_ = 0;
+}
+
+END_NS_SALVIAR();
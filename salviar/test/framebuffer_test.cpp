@@ -0,0 +1,603 @@
+#include <eflib/include/platform/boost_begin.h>
+#include <boost/test/unit_test.hpp>
+#include <eflib/include/platform/boost_end.h>
+
+#include <salviar/test/render_test.h>
+
+#include <salviar/include/framebuffer.h>
+#include <salviar/include/surface.h>
+#include <salviar/include/shader.h>
+#include <salviar/include/shader_regs.h>
+
+#include <cmath>
+#include <type_traits>
+
+using namespace salviar;
+using eflib::vec4;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE( framebuffer )
+
+static vec4 const red	(1.0f, 0.0f, 0.0f, 1.0f);
+static vec4 const green	(0.0f, 1.0f, 0.0f, 1.0f);
+static vec4 const blue	(0.0f, 0.0f, 1.0f, 1.0f);
+static vec4 const yellow(1.0f, 1.0f, 0.0f, 1.0f);
+
+static depth_stencil_state_ptr stencil_state(
+	compare_function depth_func, bool depth_write,
+	compare_function stencil_func, stencil_op depth_fail_op, stencil_op pass_op)
+{
+	depth_stencil_desc desc;
+	desc.depth_func = depth_func;
+	desc.depth_write_mask = depth_write;
+	desc.stencil_enable = true;
+	desc.front_face.stencil_func = stencil_func;
+	desc.front_face.stencil_depth_fail_op = depth_fail_op;
+	desc.front_face.stencil_pass_op = pass_op;
+	desc.back_face = desc.front_face;
+	return depth_stencil_state_ptr( new depth_stencil_state(desc) );
+}
+
+static bool compare(compare_function func, float lhs, float rhs)
+{
+	switch(func)
+	{
+	case compare_function_never:			return false;
+	case compare_function_less:				return lhs <  rhs;
+	case compare_function_equal:			return lhs == rhs;
+	case compare_function_less_equal:		return lhs <= rhs;
+	case compare_function_greater:			return lhs >  rhs;
+	case compare_function_not_equal:		return lhs != rhs;
+	case compare_function_greater_equal:	return lhs >= rhs;
+	default:								return true;
+	}
+}
+
+BOOST_AUTO_TEST_CASE( depth_functions )
+{
+	// Three columns of depth nearer than, equal to and farther than cleared depth.
+	float const cleared_depth = 0.5f;
+	float const column_depths[] = {0.25f, 0.5f, 0.75f};
+
+	for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+	{
+		for(int func = compare_function_never; func <= compare_function_always; ++func)
+		{
+			for(int write_mask = 0; write_mask < 2; ++write_mask)
+			{
+				render_fixture fixture;
+				fixture.create_targets(96, 32, num_samples);
+				fixture.clear( color_rgba32f(0.0f, 0.0f, 0.0f, 0.0f), cleared_depth );
+
+				depth_stencil_desc desc;
+				desc.depth_func = static_cast<compare_function>(func);
+				desc.depth_write_mask = (write_mask != 0);
+				fixture.renderer->set_depth_stencil_state( depth_stencil_state_ptr( new depth_stencil_state(desc) ), 0 );
+
+				vector<test_vertex> verts;
+				for(size_t i = 0; i < 3; ++i)
+				{
+					fixture.add_rect(verts, i * 32.0f, 0.0f, (i + 1) * 32.0f, 32.0f, column_depths[i], red);
+				}
+				fixture.draw(verts);
+				fixture.flush();
+
+				size_t failures = 0;
+				for(size_t y = 0; y < 32; ++y)
+				{
+					for(size_t x = 0; x < 96; ++x)
+					{
+						for(size_t s = 0; s < num_samples; ++s)
+						{
+							float const depth = column_depths[x / 32];
+							bool const passed = compare(desc.depth_func, depth, cleared_depth);
+							float const expected_depth = (passed && desc.depth_write_mask) ? depth : cleared_depth;
+
+							if(    fixture.color(x, y, s).r != (passed ? 1.0f : 0.0f)
+								|| fixture.depth(x, y, s) != expected_depth )
+							{
+								++failures;
+							}
+						}
+					}
+				}
+				BOOST_CHECK_MESSAGE( failures == 0, failures << " samples failed depth function " << func << " with write mask " << write_mask );
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( stencil_masks_draws )
+{
+	pixel_format const ds_formats[] = {pixel_format_color_rg32f, pixel_format_color_d24s8};
+
+	for(size_t i_format = 0; i_format < 2; ++i_format)
+	{
+		for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+		{
+			render_fixture fixture;
+			fixture.create_targets(64, 64, num_samples, pixel_format_color_rgba32f, ds_formats[i_format]);
+			fixture.clear();
+
+			vector<test_vertex> mask, full_near, full_far, full_farther, full_nearest;
+			fixture.add_rect(mask,			16.0f, 16.0f, 48.0f, 48.0f, 0.5f, red);
+			fixture.add_rect(full_near,		0.0f, 0.0f, 64.0f, 64.0f, 0.5f, green);
+			fixture.add_rect(full_far,		0.0f, 0.0f, 64.0f, 64.0f, 0.6f, blue);
+			fixture.add_rect(full_farther,	0.0f, 0.0f, 64.0f, 64.0f, 0.9f, red);
+			fixture.add_rect(full_nearest,	0.0f, 0.0f, 64.0f, 64.0f, 0.1f, yellow);
+
+			// Stencil of mask is 1.
+			fixture.renderer->set_depth_stencil_state(
+				stencil_state(compare_function_always, false, compare_function_always, stencil_op_keep, stencil_op_replace), 1 );
+			fixture.draw(mask);
+
+			// Green inside of mask, blue outside.
+			fixture.renderer->set_depth_stencil_state(
+				stencil_state(compare_function_less, true, compare_function_equal, stencil_op_keep, stencil_op_keep), 1 );
+			fixture.draw(full_near);
+			fixture.renderer->set_depth_stencil_state(
+				stencil_state(compare_function_less, true, compare_function_not_equal, stencil_op_keep, stencil_op_keep), 1 );
+			fixture.draw(full_far);
+
+			// Fails depth everywhere, and increases stencil to 2 inside of mask and 1 outside.
+			fixture.renderer->set_depth_stencil_state(
+				stencil_state(compare_function_less, true, compare_function_always, stencil_op_incr_sat, stencil_op_keep), 0 );
+			fixture.draw(full_farther);
+
+			// Yellow inside of mask only.
+			fixture.renderer->set_depth_stencil_state(
+				stencil_state(compare_function_less, true, compare_function_equal, stencil_op_keep, stencil_op_keep), 2 );
+			fixture.draw(full_nearest);
+			fixture.flush();
+
+			size_t failures = 0;
+			for(size_t y = 0; y < 64; ++y)
+			{
+				for(size_t x = 0; x < 64; ++x)
+				{
+					bool const inside = (16 <= x && x < 48 && 16 <= y && y < 48);
+					vec4 const& expected = inside ? yellow : blue;
+					for(size_t s = 0; s < num_samples; ++s)
+					{
+						color_rgba32f const c = fixture.color(x, y, s);
+						if( c.r != expected.x() || c.g != expected.y() || c.b != expected.z() )
+						{
+							++failures;
+						}
+					}
+				}
+			}
+			BOOST_CHECK_MESSAGE( failures == 0, failures << " samples failed with format " << ds_formats[i_format] << " and " << num_samples << " samples" );
+		}
+	}
+}
+
+// Overlapped rectangles of distinct depths drawn in scrambled order, then crossing triangles.
+// Cleared tiles of targets are filled before drawing if fill_cleared is true.
+static void render_depth_scene(
+	pixel_format ds_format, size_t num_samples, vector<color_rgba32f>& colors, vector<color_rgba32f>& depths,
+	bool fill_cleared = false)
+{
+	render_fixture fixture;
+	fixture.create_targets(128, 128, num_samples, pixel_format_color_rgba32f, ds_format);
+	fixture.clear();
+	if(fill_cleared)
+	{
+		fixture.color_target->materialize();
+		fixture.ds_target->materialize();
+	}
+
+	float const rect_depths[] = {0.5f, 0.25f, 0.75f, 0.125f, 0.625f, 0.375f};
+	vec4 const rect_colors[] = {red, green, blue, yellow, green, red};
+
+	vector<test_vertex> verts;
+	for(size_t i = 0; i < 6; ++i)
+	{
+		float const left = 7.5f + i * 13.0f;
+		float const top = 3.25f + (i * 37 % 6) * 11.0f;
+		fixture.add_rect(verts, left, top, left + 45.0f, top + 50.0f, rect_depths[i], rect_colors[i]);
+	}
+	fixture.draw(verts);
+	overlapped_triangles_scene(fixture);
+	fixture.flush();
+
+	colors = fixture.color_texels();
+	depths = fixture.ds_texels();
+}
+
+BOOST_AUTO_TEST_CASE( packed_depth_formats_match_rg32f )
+{
+	pixel_format const ds_formats[] = {pixel_format_color_d16, pixel_format_color_d24s8, pixel_format_color_d32f};
+	float const depth_tolerances[] = {1.0f / 32768.0f, 1.0f / 8388608.0f, 0.0f};
+
+	for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+	{
+		vector<color_rgba32f> expected_colors, expected_depths;
+		render_depth_scene(pixel_format_color_rg32f, num_samples, expected_colors, expected_depths);
+
+		for(size_t i_format = 0; i_format < 3; ++i_format)
+		{
+			vector<color_rgba32f> colors, depths;
+			render_depth_scene(ds_formats[i_format], num_samples, colors, depths);
+
+			// Only depth of samples is compared, stencil is not stored in all formats.
+			for(size_t i = 0; i < depths.size(); ++i)
+			{
+				depths[i] = color_rgba32f(depths[i].r, 0.0f, 0.0f, 0.0f);
+				expected_depths[i] = color_rgba32f(expected_depths[i].r, 0.0f, 0.0f, 0.0f);
+			}
+
+			size_t const color_failures = count_different_texels(colors, expected_colors);
+			size_t const depth_failures = count_different_texels(depths, expected_depths, depth_tolerances[i_format]);
+			BOOST_CHECK_MESSAGE( color_failures == 0, color_failures << " colors differ with format " << ds_formats[i_format] << " and " << num_samples << " samples" );
+			BOOST_CHECK_MESSAGE( depth_failures == 0, depth_failures << " depths differ with format " << ds_formats[i_format] << " and " << num_samples << " samples" );
+		}
+	}
+}
+
+// Draws the scene twice, and adds the second pass where it passes depth_func against depth of the first one.
+// Depths of rectangles are not representable in D16 or D24S8.
+static vector<color_rgba32f> render_depth_equal_scene(pixel_format ds_format, compare_function depth_func, size_t num_samples)
+{
+	render_fixture fixture;
+	fixture.create_targets(128, 128, num_samples, pixel_format_color_rgba32f, ds_format);
+	fixture.clear();
+
+	float const rect_depths[] = {0.3f, 0.7f, 0.45f, 0.123f, 0.9f, 0.55f};
+	vec4 const rect_colors[] = {red, green, blue, yellow, green, red};
+
+	vector<test_vertex> verts;
+	for(size_t i = 0; i < 6; ++i)
+	{
+		float const left = 7.5f + i * 13.0f;
+		float const top = 3.25f + (i * 37 % 6) * 11.0f;
+		fixture.add_rect(verts, left, top, left + 45.0f, top + 50.0f, rect_depths[i], rect_colors[i]);
+	}
+
+	fixture.draw(verts);
+	overlapped_triangles_scene(fixture);
+
+	depth_stencil_desc desc;
+	desc.depth_func = depth_func;
+	desc.depth_write_mask = false;
+	fixture.renderer->set_depth_stencil_state( depth_stencil_state_ptr( new depth_stencil_state(desc) ), 0 );
+	fixture.renderer->set_blend_state( additive_blend_state() );
+	fixture.draw(verts);
+	overlapped_triangles_scene(fixture);
+	fixture.flush();
+
+	return fixture.color_texels();
+}
+
+BOOST_AUTO_TEST_CASE( packed_depth_formats_pass_equal_depth )
+{
+	pixel_format const ds_formats[] = {pixel_format_color_d16, pixel_format_color_d24s8};
+	compare_function const depth_funcs[] = {compare_function_equal, compare_function_less_equal, compare_function_greater_equal};
+
+	for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+	{
+		for(size_t i_func = 0; i_func < 3; ++i_func)
+		{
+			vector<color_rgba32f> expected = render_depth_equal_scene(pixel_format_color_rg32f, depth_funcs[i_func], num_samples);
+			for(size_t i_format = 0; i_format < 2; ++i_format)
+			{
+				vector<color_rgba32f> colors = render_depth_equal_scene(ds_formats[i_format], depth_funcs[i_func], num_samples);
+				size_t const failures = count_different_texels(colors, expected);
+				BOOST_CHECK_MESSAGE( failures == 0, failures << " colors differ with format " << ds_formats[i_format]
+					<< ", depth function " << depth_funcs[i_func] << " and " << num_samples << " samples" );
+			}
+		}
+	}
+}
+
+// Rectangles on integer pixel edges, so that all samples of a pixel are covered by the same rectangles.
+struct odd_size_rect
+{
+	size_t left, top, right, bottom;
+	float depth;
+	vec4 color;
+
+	bool covers(size_t x, size_t y) const
+	{
+		return left <= x && x < right && top <= y && y < bottom;
+	}
+};
+
+BOOST_AUTO_TEST_CASE( odd_size_targets_keep_neighbor_pixels )
+{
+	// Last column of odd width is the left pixel of partially covered quads, whose right pixel is out of row,
+	// and the bottom row is the top of quads whose lower row is out of surface.
+	size_t const width = 251;
+	size_t const height = 189;
+
+	pixel_format const ds_formats[] = {pixel_format_color_rg32f, pixel_format_color_d16, pixel_format_color_d24s8, pixel_format_color_d32f};
+	bool const has_stencil[] = {true, false, true, false};
+	float const depth_tolerances[] = {0.0f, 1.0f / 32768.0f, 1.0f / 8388608.0f, 0.0f};
+
+	// Rectangles cross tiles of all sizes and touch all sides of target.
+	odd_size_rect const rects[] =
+	{
+		{ 33,  17, 251, 189, 0.5f,  green },
+		{  0,   0, 251, 189, 0.875f, red },
+		{131,   0, 251,  77, 0.75f, yellow },
+		{ 77,  55, 201, 151, 0.125f, blue },
+		{  0, 101, 161, 189, 0.25f, yellow }
+	};
+	size_t const rect_count = sizeof(rects) / sizeof(rects[0]);
+	vec4 const white(1.0f, 1.0f, 1.0f, 1.0f);
+
+	pipeline_options options[4];
+	for(size_t i_options = 1; i_options < 4; ++i_options)
+	{
+		options[i_options].binning = binning_modes::deferred;
+		options[i_options].tile_cache = true;
+		options[i_options].tile_size = 16U << i_options;
+	}
+
+	for(size_t i_format = 0; i_format < 4; ++i_format)
+	{
+		for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+		{
+			for(size_t i_options = 0; i_options < 4; ++i_options)
+			{
+				render_fixture fixture;
+				fixture.create_targets(width, height, num_samples, pixel_format_color_rgba32f, ds_formats[i_format]);
+				fixture.set_options(options[i_options]);
+				fixture.clear();
+
+				// Stencil counts rectangles covering the pixel, whether depth passed or not.
+				if(has_stencil[i_format])
+				{
+					fixture.renderer->set_depth_stencil_state(
+						stencil_state(compare_function_less, true, compare_function_always, stencil_op_incr_sat, stencil_op_incr_sat), 0 );
+				}
+				for(size_t i = 0; i < rect_count; ++i)
+				{
+					vector<test_vertex> verts;
+					fixture.add_rect(verts,
+						static_cast<float>(rects[i].left), static_cast<float>(rects[i].top),
+						static_cast<float>(rects[i].right), static_cast<float>(rects[i].bottom),
+						rects[i].depth, rects[i].color);
+					fixture.draw(verts);
+				}
+
+				// White where two rectangles overlap.
+				if(has_stencil[i_format])
+				{
+					vector<test_vertex> full;
+					fixture.add_rect(full, 0.0f, 0.0f, static_cast<float>(width), static_cast<float>(height), 0.0f, white);
+					fixture.renderer->set_depth_stencil_state(
+						stencil_state(compare_function_always, false, compare_function_equal, stencil_op_keep, stencil_op_keep), 2 );
+					fixture.draw(full);
+				}
+				fixture.flush();
+
+				size_t color_failures = 0;
+				size_t depth_failures = 0;
+				for(size_t y = 0; y < height; ++y)
+				{
+					for(size_t x = 0; x < width; ++x)
+					{
+						size_t covers = 0;
+						odd_size_rect const* nearest = NULL;
+						for(size_t i = 0; i < rect_count; ++i)
+						{
+							if( !rects[i].covers(x, y) ) { continue; }
+							++covers;
+							if(nearest == NULL || rects[i].depth < nearest->depth) { nearest = &rects[i]; }
+						}
+
+						vec4 const& expected = (has_stencil[i_format] && covers == 2) ? white : nearest->color;
+						for(size_t s = 0; s < num_samples; ++s)
+						{
+							color_rgba32f const c = fixture.color(x, y, s);
+							if( c.r != expected.x() || c.g != expected.y() || c.b != expected.z() )
+							{
+								++color_failures;
+							}
+							if( std::abs(fixture.depth(x, y, s) - nearest->depth) > depth_tolerances[i_format] )
+							{
+								++depth_failures;
+							}
+						}
+					}
+				}
+				BOOST_CHECK_MESSAGE( color_failures == 0, color_failures << " colors failed with format " << ds_formats[i_format]
+					<< ", " << num_samples << " samples and options " << i_options );
+				BOOST_CHECK_MESSAGE( depth_failures == 0, depth_failures << " depths failed with format " << ds_formats[i_format]
+					<< ", " << num_samples << " samples and options " << i_options );
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( cleared_targets_match_filled_targets )
+{
+	pixel_format const ds_formats[] = {pixel_format_color_rg32f, pixel_format_color_d24s8};
+
+	for(size_t i_format = 0; i_format < 2; ++i_format)
+	{
+		for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+		{
+			vector<color_rgba32f> expected_colors, expected_depths;
+			render_depth_scene(ds_formats[i_format], num_samples, expected_colors, expected_depths, true);
+
+			vector<color_rgba32f> colors, depths;
+			render_depth_scene(ds_formats[i_format], num_samples, colors, depths);
+			BOOST_CHECK_EQUAL( count_different_texels(colors, expected_colors), 0U );
+			BOOST_CHECK_EQUAL( count_different_texels(depths, expected_depths), 0U );
+		}
+	}
+}
+
+// Scalar blending of render_target_blend_desc in C++ blend shader, as reference of blend_state.
+class reference_blend_shader: public cpp_blend_shader
+{
+	render_target_blend_desc desc_;
+
+	static float factor(blend_factor f, color_rgba32f const& src, color_rgba32f const& dst)
+	{
+		switch(f)
+		{
+		case blend_zero:			return 0.0f;
+		case blend_src_alpha:		return src.a;
+		case blend_inv_src_alpha:	return 1.0f - src.a;
+		case blend_dest_alpha:		return dst.a;
+		case blend_inv_dest_alpha:	return 1.0f - dst.a;
+		default:					return 1.0f;
+		}
+	}
+
+public:
+	reference_blend_shader(render_target_blend_desc const& desc): desc_(desc)
+	{
+	}
+
+	bool shader_prog(size_t sample, pixel_accessor& inout, ps_output const& in)
+	{
+		color_rgba32f const src(in.color[0]);
+		color_rgba32f const dst = inout.color(0, sample);
+		color_rgba32f ret = dst;
+
+		float const src_color_factor = factor(desc_.src_blend, src, dst);
+		float const dst_color_factor = factor(desc_.dest_blend, src, dst);
+		for(int i = 0; i < 3; ++i)
+		{
+			if( desc_.write_mask & (1UL << i) )
+			{
+				(&ret.r)[i] = (&src.r)[i] * src_color_factor + (&dst.r)[i] * dst_color_factor;
+			}
+		}
+		if(desc_.write_mask & color_write_enable_alpha)
+		{
+			ret.a = src.a * factor(desc_.src_blend_alpha, src, dst) + dst.a * factor(desc_.dest_blend_alpha, src, dst);
+		}
+
+		inout.color(0, sample, ret);
+		return true;
+	}
+
+	virtual cpp_shader_ptr clone()
+	{
+		typedef std::remove_pointer<decltype(this)>::type this_type;
+		return cpp_shader_ptr(new this_type(*this));
+	}
+};
+
+// Alpha blending in JIT blending shader.
+char const* alpha_blend_bs_code =
+	"float4 bs_main( float4 src: COLOR, float4 dest: DEST_COLOR ): COLOR \r\n"
+	"{ \r\n"
+	"	return src * src.w + dest * (1.0f - src.w); \r\n"
+	"} \r\n"
+	;
+
+enum blend_paths
+{
+	blend_by_state,
+	blend_by_cpp_shader,
+	blend_by_jit_shader
+};
+
+// Translucent rectangles and a triangle overlapped on a cleared target.
+static vector<color_rgba32f> render_blended_scene(
+	render_target_blend_desc const& desc, blend_paths path, pixel_format color_format, size_t num_samples)
+{
+	render_fixture fixture;
+	fixture.create_targets(64, 64, num_samples, color_format);
+	fixture.clear( color_rgba32f(0.2f, 0.4f, 0.6f, 0.8f) );
+	fixture.renderer->set_depth_stencil_state( depth_disabled_state(), 0 );
+
+	if(path == blend_by_cpp_shader)
+	{
+		fixture.renderer->set_blend_shader( cpp_blend_shader_ptr( new reference_blend_shader(desc) ) );
+	}
+	else if(path == blend_by_jit_shader)
+	{
+		shader_object_ptr bs_code = compile(alpha_blend_bs_code, lang_blending_shader);
+		BOOST_REQUIRE( bs_code );
+		fixture.renderer->set_blend_shader_code(bs_code);
+	}
+	else
+	{
+		blend_desc bdesc;
+		bdesc.render_target[0] = desc;
+		fixture.renderer->set_blend_state( blend_state_ptr( new blend_state(bdesc) ) );
+	}
+
+	vector<test_vertex> verts;
+	fixture.add_rect(verts,  4.5f,  6.0f, 40.0f, 44.5f, 0.5f, vec4(1.0f, 0.5f, 0.0f, 0.25f));
+	fixture.add_rect(verts, 20.0f, 18.5f, 60.5f, 58.0f, 0.5f, vec4(0.0f, 0.75f, 1.0f, 0.5f));
+	verts.push_back( screen_vertex( 2.0f, 62.0f, 0.5f, vec4(0.5f, 0.0f, 1.0f, 0.75f), 64.0f, 64.0f) );
+	verts.push_back( screen_vertex(33.3f,  1.7f, 0.5f, vec4(0.5f, 0.0f, 1.0f, 0.75f), 64.0f, 64.0f) );
+	verts.push_back( screen_vertex(61.9f, 40.1f, 0.5f, vec4(0.5f, 0.0f, 1.0f, 0.75f), 64.0f, 64.0f) );
+	fixture.draw(verts);
+	fixture.flush();
+
+	return fixture.color_texels();
+}
+
+BOOST_AUTO_TEST_CASE( blend_state_matches_blend_shader )
+{
+	render_target_blend_desc descs[3];
+
+	// Alpha blending.
+	descs[0].blend_enable = true;
+	descs[0].src_blend = descs[0].src_blend_alpha = blend_src_alpha;
+	descs[0].dest_blend = descs[0].dest_blend_alpha = blend_inv_src_alpha;
+
+	// Additive blending.
+	descs[1].blend_enable = true;
+	descs[1].src_blend = descs[1].src_blend_alpha = blend_one;
+	descs[1].dest_blend = descs[1].dest_blend_alpha = blend_one;
+
+	// Alpha blending of color only, through generic kernel.
+	descs[2] = descs[0];
+	descs[2].src_blend_alpha = blend_one;
+	descs[2].dest_blend_alpha = blend_zero;
+	descs[2].write_mask = color_write_enable_red | color_write_enable_blue;
+
+	pixel_format const color_formats[] = {pixel_format_color_rgba32f, pixel_format_color_rgba8, pixel_format_color_bgra8};
+	for(size_t i_desc = 0; i_desc < 3; ++i_desc)
+	{
+		for(size_t i_format = 0; i_format < 3; ++i_format)
+		{
+			// 8-bit formats could be rounded differently by SIMD kernels.
+			float const tolerance = (i_format == 0 ? 1.0f / 4096.0f : 1.5f / 255.0f);
+			for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+			{
+				vector<color_rgba32f> expected = render_blended_scene(descs[i_desc], blend_by_cpp_shader, color_formats[i_format], num_samples);
+				vector<color_rgba32f> colors = render_blended_scene(descs[i_desc], blend_by_state, color_formats[i_format], num_samples);
+				BOOST_CHECK_MESSAGE(
+					count_different_texels(colors, expected, tolerance) == 0,
+					"blend " << i_desc << " differs with format " << color_formats[i_format] << " and " << num_samples << " samples"
+					);
+			}
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( jit_blend_shader_matches_blend_state )
+{
+	render_target_blend_desc desc;
+	desc.blend_enable = true;
+	desc.src_blend = desc.src_blend_alpha = blend_src_alpha;
+	desc.dest_blend = desc.dest_blend_alpha = blend_inv_src_alpha;
+
+	pixel_format const color_formats[] = {pixel_format_color_rgba32f, pixel_format_color_rgba8};
+	for(size_t i_format = 0; i_format < 2; ++i_format)
+	{
+		float const tolerance = (i_format == 0 ? 1.0f / 4096.0f : 1.5f / 255.0f);
+		for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+		{
+			vector<color_rgba32f> expected = render_blended_scene(desc, blend_by_state, color_formats[i_format], num_samples);
+			vector<color_rgba32f> colors = render_blended_scene(desc, blend_by_jit_shader, color_formats[i_format], num_samples);
+			BOOST_CHECK_MESSAGE(
+				count_different_texels(colors, expected, tolerance) == 0,
+				"JIT blending differs with format " << color_formats[i_format] << " and " << num_samples << " samples"
+				);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END();
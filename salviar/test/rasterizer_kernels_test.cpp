@@ -0,0 +1,186 @@
+#include <eflib/include/platform/boost_begin.h>
+#include <boost/test/unit_test.hpp>
+#include <eflib/include/platform/boost_end.h>
+
+#include <salviar/include/rasterizer_kernels.h>
+
+#include <eflib/include/platform/cpuinfo.h>
+
+#include <vector>
+#include <string.h>
+
+using namespace salviar;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE( kernels )
+
+// Kernel sets which could run on this CPU. Generic set is the reference of others.
+static vector<rasterizer_kernels const*> available_kernels()
+{
+	vector<rasterizer_kernels const*> ret;
+#if !defined(EFLIB_NO_SIMD)
+	ret.push_back( rasterizer_kernels_sse() );
+	if( eflib::support_feature(eflib::cpu_avx2) )
+	{
+		ret.push_back( rasterizer_kernels_avx2() );
+	}
+	if( eflib::support_feature(eflib::cpu_avx512f) )
+	{
+		ret.push_back( rasterizer_kernels_avx512() );
+	}
+#endif
+	return ret;
+}
+
+// Linear congruential generator, so that failures are reproducible on all platforms.
+class random_ints
+{
+public:
+	random_ints(): seed_(0x5A17A) {}
+
+	int32_t next(int32_t min_value, int32_t max_value)
+	{
+		seed_ = seed_ * 1103515245U + 12345U;
+		return min_value + static_cast<int32_t>( (seed_ >> 8) % static_cast<uint32_t>(max_value - min_value + 1) );
+	}
+
+private:
+	uint32_t seed_;
+};
+
+// Edges are in range which triangle setup produces for a 64x64 tile.
+static void random_edges(tile_edges& edges, random_ints& rnd)
+{
+	for(int e = 0; e < 4; ++e)
+	{
+		edges.value[e]	= rnd.next(-(1 << 20), 1 << 20);
+		edges.dx[e]		= rnd.next(-(1 << 12), 1 << 12);
+		edges.dy[e]		= rnd.next(-(1 << 12), 1 << 12);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( select_supported_kernels )
+{
+	rasterizer_kernels const* selected = select_rasterizer_kernels();
+	BOOST_REQUIRE( selected );
+
+	vector<rasterizer_kernels const*> kernels = available_kernels();
+	if( !kernels.empty() )
+	{
+		BOOST_CHECK_EQUAL( selected, kernels.back() );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( pixel_mask_agrees_with_generic )
+{
+	vector<rasterizer_kernels const*> kernels = available_kernels();
+	rasterizer_kernels const* reference = rasterizer_kernels_generic();
+
+	random_ints rnd;
+	int32_t sample_offsets[32 * 2];
+	for(int i = 0; i < 32 * 2; ++i)
+	{
+		sample_offsets[i] = rnd.next(0, SUBPIXEL_SCALE - 1);
+	}
+
+	uint32_t const sample_counts[] = {1, 2, 4, 8, 16, 32};
+	for(int i_case = 0; i_case < 2000; ++i_case)
+	{
+		tile_edges edges;
+		random_edges(edges, rnd);
+
+		uint32_t const x = static_cast<uint32_t>( rnd.next(0, 15) * 4 );
+		uint32_t const y = static_cast<uint32_t>( rnd.next(0, 15) * 4 );
+		uint32_t const sample_count = sample_counts[i_case % 6];
+
+		uint32_t expected[16];
+		reference->compute_pixel_mask(expected, x, y, &edges, sample_offsets, sample_count);
+
+		for(size_t i_kernels = 0; i_kernels < kernels.size(); ++i_kernels)
+		{
+			uint32_t mask[16];
+			kernels[i_kernels]->compute_pixel_mask(mask, x, y, &edges, sample_offsets, sample_count);
+			BOOST_CHECK_MESSAGE(
+				memcmp(mask, expected, sizeof(mask)) == 0,
+				kernels[i_kernels]->name << " differs from generic at case " << i_case
+				);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( subdivide_region_agrees_with_generic )
+{
+	vector<rasterizer_kernels const*> kernels = available_kernels();
+	rasterizer_kernels const* reference = rasterizer_kernels_generic();
+
+	random_ints rnd;
+	uint32_t const region_sizes[] = {64, 16, 4};
+	for(int i_case = 0; i_case < 2000; ++i_case)
+	{
+		tile_edges edges;
+		random_edges(edges, rnd);
+
+		uint32_t const region_size = region_sizes[i_case % 3];
+		uint32_t const new_size = region_size / 4;
+		uint32_t const region_x = static_cast<uint32_t>( rnd.next(0, 64 / region_size - 1) ) * region_size;
+		uint32_t const region_y = static_cast<uint32_t>( rnd.next(0, 64 / region_size - 1) ) * region_size;
+
+		int32_t bounding_box[4];
+		bounding_box[0] = rnd.next(-16, 64 * SUBPIXEL_SCALE);
+		bounding_box[1] = bounding_box[0] + rnd.next(0, 64 * SUBPIXEL_SCALE);
+		bounding_box[2] = rnd.next(-16, 64 * SUBPIXEL_SCALE);
+		bounding_box[3] = bounding_box[2] + rnd.next(0, 64 * SUBPIXEL_SCALE);
+
+		uint32_t expected[16];
+		uint32_t expected_size = 0;
+		reference->subdivide_region(expected, expected_size, region_x, region_y, new_size, new_size, &edges, bounding_box);
+
+		for(size_t i_kernels = 0; i_kernels < kernels.size(); ++i_kernels)
+		{
+			uint32_t regions[16];
+			uint32_t regions_size = 0;
+			kernels[i_kernels]->subdivide_region(regions, regions_size, region_x, region_y, new_size, new_size, &edges, bounding_box);
+			BOOST_CHECK_MESSAGE(
+				regions_size == expected_size && memcmp(regions, expected, sizeof(uint32_t) * regions_size) == 0,
+				kernels[i_kernels]->name << " differs from generic at case " << i_case
+				);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( setup_triangles_agrees_with_generic )
+{
+	vector<rasterizer_kernels const*> kernels = available_kernels();
+	rasterizer_kernels const* reference = rasterizer_kernels_generic();
+
+	random_ints rnd;
+	for(int i_case = 0; i_case < 200; ++i_case)
+	{
+		triangle_setup_batch input;
+		memset(&input, 0, sizeof(input));
+		for(int i_vert = 0; i_vert < 3; ++i_vert)
+		{
+			for(int i = 0; i < TRIANGLE_SETUP_BATCH_SIZE; ++i)
+			{
+				input.x[i_vert][i] = rnd.next(-4096, 4096) / 16.0f;
+				input.y[i_vert][i] = rnd.next(-4096, 4096) / 16.0f;
+				input.z[i_vert][i] = rnd.next(0, 65536) / 65536.0f;
+			}
+		}
+
+		triangle_setup_batch expected = input;
+		reference->setup_triangles(&expected);
+
+		for(size_t i_kernels = 0; i_kernels < kernels.size(); ++i_kernels)
+		{
+			triangle_setup_batch batch = input;
+			kernels[i_kernels]->setup_triangles(&batch);
+			BOOST_CHECK_MESSAGE(
+				memcmp(&batch, &expected, sizeof(batch)) == 0,
+				kernels[i_kernels]->name << " differs from generic at case " << i_case
+				);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END();
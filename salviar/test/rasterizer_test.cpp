@@ -0,0 +1,755 @@
+#include <eflib/include/platform/boost_begin.h>
+#include <boost/test/unit_test.hpp>
+#include <eflib/include/platform/boost_end.h>
+
+#include <salviar/test/render_test.h>
+
+#include <salviar/include/texture.h>
+#include <salviar/include/surface.h>
+#include <salviar/include/framebuffer.h>
+#include <salviar/include/mapped_resource.h>
+#include <salviar/include/tile_size_tuner.h>
+
+#include <eflib/include/platform/cpuinfo.h>
+
+#include <algorithm>
+#include <type_traits>
+#include <string.h>
+
+using namespace salviar;
+using eflib::vec4;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE( rasterizer )
+
+static vec4 const red	(1.0f, 0.0f, 0.0f, 1.0f);
+static vec4 const green	(0.0f, 1.0f, 0.0f, 1.0f);
+static vec4 const blue	(0.0f, 0.0f, 1.0f, 1.0f);
+
+static bool same_color(color_rgba32f const& lhs, vec4 const& rhs)
+{
+	return lhs.r == rhs.x() && lhs.g == rhs.y() && lhs.b == rhs.z() && lhs.a == rhs.w();
+}
+
+static size_t count_color(render_fixture const& fixture, vec4 const& c)
+{
+	size_t ret = 0;
+	for(size_t y = 0; y < fixture.height; ++y)
+	{
+		for(size_t x = 0; x < fixture.width; ++x)
+		{
+			if( same_color(fixture.color(x, y), c) )
+			{
+				++ret;
+			}
+		}
+	}
+	return ret;
+}
+
+// Appends a mesh of cells_x * cells_y cells which covers the whole target without overlaps.
+// Interior vertices are moved by multiples of jitter pixels, so that edges and vertices lie on pixel centers and between them.
+// Triangles of a cell have different windings.
+static void add_mesh(
+	vector<test_vertex>& verts, render_fixture const& fixture,
+	size_t cells_x, size_t cells_y, float jitter, vec4 const& color)
+{
+	float const w = static_cast<float>(fixture.width);
+	float const h = static_cast<float>(fixture.height);
+
+	vector<test_vertex> grid;
+	for(size_t j = 0; j <= cells_y; ++j)
+	{
+		for(size_t i = 0; i <= cells_x; ++i)
+		{
+			float x = i * w / cells_x;
+			float y = j * h / cells_y;
+			if(0 < i && i < cells_x)
+			{
+				x += (static_cast<int>( (i * 7 + j * 13) % 9 ) - 4) * jitter;
+			}
+			if(0 < j && j < cells_y)
+			{
+				y += (static_cast<int>( (i * 5 + j * 11) % 9 ) - 4) * jitter;
+			}
+			grid.push_back( screen_vertex(x, y, 0.5f, color, w, h) );
+		}
+	}
+
+	for(size_t j = 0; j < cells_y; ++j)
+	{
+		for(size_t i = 0; i < cells_x; ++i)
+		{
+			test_vertex const& lt = grid[ j		* (cells_x + 1) + i ];
+			test_vertex const& rt = grid[ j		* (cells_x + 1) + i + 1 ];
+			test_vertex const& lb = grid[ (j + 1)	* (cells_x + 1) + i ];
+			test_vertex const& rb = grid[ (j + 1)	* (cells_x + 1) + i + 1 ];
+
+			if( (i + j) % 2 == 0 )
+			{
+				verts.push_back(lt); verts.push_back(rt); verts.push_back(lb);
+				verts.push_back(rb); verts.push_back(rt); verts.push_back(lb);
+			}
+			else
+			{
+				verts.push_back(lt); verts.push_back(rt); verts.push_back(rb);
+				verts.push_back(lt); verts.push_back(lb); verts.push_back(rb);
+			}
+		}
+	}
+}
+
+// Draws mesh by additive blending without depth test, so that each sample must have color of exactly one triangle.
+static size_t count_samples_not_drawn_once(size_t num_samples, size_t cells_x, size_t cells_y, float jitter)
+{
+	render_fixture fixture;
+	fixture.create_targets(128, 128, num_samples);
+	fixture.clear();
+	fixture.renderer->set_blend_state( additive_blend_state() );
+	fixture.renderer->set_depth_stencil_state( depth_disabled_state(), 0 );
+
+	vec4 const color(0.25f, 0.0f, 0.0f, 0.25f);
+	vector<test_vertex> verts;
+	add_mesh(verts, fixture, cells_x, cells_y, jitter, color);
+	fixture.draw(verts);
+	fixture.flush();
+
+	vector<color_rgba32f> expected( 128 * 128 * num_samples, color_rgba32f(0.25f, 0.0f, 0.0f, 0.25f) );
+	return count_different_texels( fixture.color_texels(), expected );
+}
+
+BOOST_AUTO_TEST_CASE( shared_edges_are_drawn_once )
+{
+	BOOST_CHECK_EQUAL( count_samples_not_drawn_once(1, 8, 6, 0.25f), 0U );
+	BOOST_CHECK_EQUAL( count_samples_not_drawn_once(4, 8, 6, 0.25f), 0U );
+	BOOST_CHECK_EQUAL( count_samples_not_drawn_once(1, 5, 7, 0.0625f), 0U );
+}
+
+// Draws overlapped rectangles in one draw without depth test, and compares with the last rectangle covering each pixel.
+static size_t count_misordered_pixels(pipeline_options const& options)
+{
+	render_fixture fixture;
+	fixture.create_targets(256, 256);
+	fixture.set_options(options);
+	fixture.clear();
+	fixture.renderer->set_depth_stencil_state( depth_disabled_state(), 0 );
+
+	size_t const rect_count = 300;
+	vector<color_rgba32f> expected( 256 * 256, color_rgba32f(0.0f, 0.0f, 0.0f, 0.0f) );
+	vector<test_vertex> verts;
+	for(size_t i = 0; i < rect_count; ++i)
+	{
+		// Rectangles have integral bounds, so that coverage of pixel centers is not ambiguous.
+		size_t const left	= (i * 37) % 224;
+		size_t const top	= (i * 61) % 224;
+		size_t const right	= left + 8 + (i * 13) % 120;
+		size_t const bottom	= top + 8 + (i * 29) % 120;
+		vec4 const color( (i % 16) / 16.0f, (i / 16) / 32.0f, 1.0f, 1.0f );
+		fixture.add_rect(
+			verts,
+			static_cast<float>(left), static_cast<float>(top), static_cast<float>(right), static_cast<float>(bottom),
+			0.5f, color
+			);
+
+		for(size_t y = top; y < std::min<size_t>(bottom, 256); ++y)
+		{
+			for(size_t x = left; x < std::min<size_t>(right, 256); ++x)
+			{
+				expected[y * 256 + x] = color_rgba32f( color.x(), color.y(), color.z(), color.w() );
+			}
+		}
+	}
+
+	fixture.draw(verts);
+	fixture.flush();
+	return count_different_texels( fixture.color_texels(), expected );
+}
+
+BOOST_AUTO_TEST_CASE( indexed_draw_matches_list )
+{
+	render_fixture list_fixture;
+	list_fixture.create_targets(128, 128);
+	list_fixture.clear();
+
+	render_fixture indexed_fixture;
+	indexed_fixture.create_targets(128, 128);
+	indexed_fixture.clear();
+
+	vector<test_vertex> list_verts;
+	add_mesh(list_verts, list_fixture, 9, 7, 0.25f, vec4(0.25f, 0.5f, 0.75f, 1.0f));
+	for(size_t i = 0; i < list_verts.size(); ++i)
+	{
+		vec4 const& pos = list_verts[i].position;
+		list_verts[i].color = vec4( pos.x() * 0.5f + 0.5f, pos.y() * 0.5f + 0.5f, pos.x() * pos.y(), 1.0f );
+	}
+
+	// Shared vertexes are referenced by indexes, and unreferenced vertexes are interleaved with them.
+	vector<test_vertex> verts;
+	vector<uint32_t> indexes;
+	for(size_t i = 0; i < list_verts.size(); ++i)
+	{
+		size_t i_vert = 0;
+		while( i_vert < verts.size() && memcmp(&verts[i_vert], &list_verts[i], sizeof(test_vertex)) != 0 )
+		{
+			++i_vert;
+		}
+		if( i_vert == verts.size() )
+		{
+			if(i % 5 == 0)
+			{
+				verts.push_back( screen_vertex(-8.0f, -8.0f, 0.5f, vec4(1.0f, 1.0f, 1.0f, 1.0f), 128.0f, 128.0f) );
+				++i_vert;
+			}
+			verts.push_back(list_verts[i]);
+		}
+		indexes.push_back( static_cast<uint32_t>(i_vert) );
+	}
+	BOOST_REQUIRE_LT( verts.size(), list_verts.size() );
+
+	list_fixture.draw(list_verts);
+	list_fixture.flush();
+	indexed_fixture.draw_indexed(verts, indexes);
+	indexed_fixture.flush();
+
+	BOOST_CHECK_EQUAL( count_different_texels( indexed_fixture.color_texels(), list_fixture.color_texels() ), 0U );
+	BOOST_CHECK_EQUAL( count_different_texels( indexed_fixture.ds_texels(), list_fixture.ds_texels() ), 0U );
+}
+
+// Outputs derivatives of attribute 0 along x and y, scaled by DERIVATIVE_SCALE.
+float const DERIVATIVE_SCALE = 64.0f;
+
+class derivative_ps: public cpp_pixel_shader
+{
+public:
+	bool shader_prog(vs_output const& /*in*/, ps_output& out)
+	{
+		vec4 const dx = ddx(0);
+		vec4 const dy = ddy(0);
+		out.color[0] = vec4(dx.x() * DERIVATIVE_SCALE, dy.y() * DERIVATIVE_SCALE, dx.y() * DERIVATIVE_SCALE, dy.x() * DERIVATIVE_SCALE);
+		return true;
+	}
+
+	virtual cpp_shader_ptr clone()
+	{
+		typedef std::remove_pointer<decltype(this)>::type this_type;
+		return cpp_shader_ptr(new this_type(*this));
+	}
+};
+
+BOOST_AUTO_TEST_CASE( attribute_derivatives_are_set_up )
+{
+	// Attribute 0 is (x, y) pixels / DERIVATIVE_SCALE at all vertexes of mesh, so its derivatives are constant
+	// on both large triangles and small triangles, whose quads are mostly partially covered.
+	// Vertexes are on sub-pixel grid, so that snapping does not change the gradient.
+	size_t const cell_counts[] = {8, 64};
+	for(size_t i_cells = 0; i_cells < 2; ++i_cells)
+	{
+		render_fixture fixture;
+		fixture.create_targets(128, 128);
+		fixture.clear();
+		fixture.ps.reset( new derivative_ps() );
+
+		vector<test_vertex> verts;
+		add_mesh(verts, fixture, cell_counts[i_cells], cell_counts[i_cells], 0.125f, vec4(0.0f, 0.0f, 0.0f, 0.0f));
+		for(size_t i = 0; i < verts.size(); ++i)
+		{
+			vec4 const& pos = verts[i].position;
+			verts[i].color = vec4(
+				(pos.x() + 1.0f) * 64.0f / DERIVATIVE_SCALE,
+				(1.0f - pos.y()) * 64.0f / DERIVATIVE_SCALE,
+				0.0f, 1.0f
+				);
+		}
+		fixture.draw(verts);
+		fixture.flush();
+
+		vector<color_rgba32f> expected( 128 * 128, color_rgba32f(1.0f, 1.0f, 0.0f, 0.0f) );
+		BOOST_CHECK_EQUAL( count_different_texels(fixture.color_texels(), expected, 1.0f / 256.0f), 0U );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( small_triangles_are_drawn_once )
+{
+	// Cells of 1.6 pixels, so that most triangles are inside a 4x4 block and are drawn by fast path,
+	// and the others cross blocks and tiles.
+	BOOST_CHECK_EQUAL( count_samples_not_drawn_once(1, 80, 80, 0.1f), 0U );
+	BOOST_CHECK_EQUAL( count_samples_not_drawn_once(4, 80, 80, 0.1f), 0U );
+	BOOST_CHECK_EQUAL( count_samples_not_drawn_once(1, 256, 128, 0.03125f), 0U );
+}
+
+BOOST_AUTO_TEST_CASE( primitives_keep_draw_order )
+{
+	pipeline_options options;
+	for(uint32_t tile_size = 32; tile_size <= 128; tile_size *= 2)
+	{
+		options.tile_size = tile_size;
+		BOOST_CHECK_EQUAL( count_misordered_pixels(options), 0U );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( heaviest_first_schedule_keeps_image )
+{
+	pipeline_options in_order;
+	in_order.tile_schedule = tile_schedule_modes::in_order;
+	pipeline_options heaviest_first;
+	heaviest_first.tile_schedule = tile_schedule_modes::heaviest_first;
+
+	vector<color_rgba32f> expected = render_scene(overlapped_triangles_scene, in_order);
+	vector<color_rgba32f> cleared( expected.size(), color_rgba32f(0.0f, 0.0f, 0.0f, 0.0f) );
+	BOOST_REQUIRE_GT( count_different_texels(expected, cleared), 256U * 64U );
+
+	BOOST_CHECK_EQUAL( count_different_texels(render_scene(overlapped_triangles_scene, heaviest_first), expected), 0U );
+	BOOST_CHECK_EQUAL( count_misordered_pixels(heaviest_first), 0U );
+}
+
+BOOST_AUTO_TEST_CASE( tile_sizes_keep_image )
+{
+	// 0 is tuned by a benchmark of bound targets.
+	uint32_t const tile_sizes[] = {0, 32, 128};
+	size_t const sample_counts[] = {1, 4};
+
+	for(size_t i_samples = 0; i_samples < 2; ++i_samples)
+	{
+		pipeline_options options;
+		options.tile_size = 64;
+		vector<color_rgba32f> expected = render_scene(overlapped_triangles_scene, options, 256, 256, sample_counts[i_samples]);
+
+		for(size_t i_size = 0; i_size < 3; ++i_size)
+		{
+			options.tile_size = tile_sizes[i_size];
+			BOOST_CHECK_EQUAL(
+				count_different_texels(
+					render_scene(overlapped_triangles_scene, options, 256, 256, sample_counts[i_samples]),
+					expected
+					),
+				0U
+				);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( tuned_tile_size_is_supported )
+{
+	// Threads of benchmark are taken from global thread pool as rasterizer does.
+	uint32_t const thread_count = eflib::num_available_threads();
+	uint32_t const tile_size = tune_tile_size(512, 384, 24, thread_count);
+	BOOST_CHECK( is_supported_tile_size(tile_size) );
+	BOOST_CHECK_EQUAL( tune_tile_size(512, 384, 24, thread_count), tile_size );
+
+	BOOST_CHECK( is_supported_tile_size(MIN_TILE_SIZE) );
+	BOOST_CHECK( is_supported_tile_size(DEFAULT_TILE_SIZE) );
+	BOOST_CHECK( is_supported_tile_size(MAX_TILE_SIZE) );
+	BOOST_CHECK( !is_supported_tile_size(0) );
+	BOOST_CHECK( !is_supported_tile_size(48) );
+}
+
+// Triangles crossing viewport sides, and one which exceeds guard band of 8 half extents.
+static void crossing_triangles_scene(render_fixture& fixture)
+{
+	overlapped_triangles_scene(fixture);
+
+	float const w = static_cast<float>(fixture.width);
+	float const h = static_cast<float>(fixture.height);
+
+	vector<test_vertex> verts;
+	verts.push_back( screen_vertex(-12.0f * w,  0.2f * h, 0.05f, vec4(0.2f, 0.4f, 0.6f, 1.0f), w, h) );
+	verts.push_back( screen_vertex(  0.9f * w, -0.5f * h, 0.05f, vec4(0.8f, 0.1f, 0.3f, 1.0f), w, h) );
+	verts.push_back( screen_vertex(  0.7f * w,  0.6f * h, 0.05f, vec4(0.1f, 0.9f, 0.5f, 1.0f), w, h) );
+	fixture.draw(verts);
+}
+
+static internal_statistics render_crossing_triangles(float guard_band, vector<color_rgba32f>& image)
+{
+	render_fixture fixture;
+	fixture.create_targets(256, 256);
+
+	pipeline_options options;
+	options.guard_band = guard_band;
+	fixture.set_options(options);
+	fixture.clear();
+
+	async_object_ptr query = fixture.renderer->create_query(async_object_ids::internal_statistics);
+	fixture.renderer->begin(query);
+	crossing_triangles_scene(fixture);
+	fixture.renderer->end(query);
+	fixture.flush();
+
+	internal_statistics stats;
+	BOOST_REQUIRE( fixture.renderer->get_data(query, &stats, false) == async_status::ready );
+	image = fixture.color_texels();
+	return stats;
+}
+
+BOOST_AUTO_TEST_CASE( guard_band_keeps_image )
+{
+	// Vertexes generated by clipping are snapped to sub-pixels, so a few pixels along edges of clipped triangles
+	// may be covered differently. Other pixels must have same colors within precision of interpolation.
+	size_t const max_edge_pixels = 64;
+	float const tolerance = 1.0f / 256.0f;
+
+	// Guard band of 1 clips all triangles at viewport sides, which is the reference.
+	vector<color_rgba32f> expected;
+	internal_statistics stats = render_crossing_triangles(1.0f, expected);
+	BOOST_CHECK_EQUAL( stats.guard_band_accepted_prims, 0U );
+	BOOST_CHECK_EQUAL( stats.clipped_prims, 2U );
+
+	vector<color_rgba32f> image;
+	stats = render_crossing_triangles(8.0f, image);
+	BOOST_CHECK_EQUAL( stats.guard_band_accepted_prims, 1U );
+	BOOST_CHECK_EQUAL( stats.clipped_prims, 1U );
+	BOOST_CHECK_LE( count_different_texels(image, expected, tolerance), max_edge_pixels );
+
+	// Clipping on x and y is disabled.
+	stats = render_crossing_triangles(0.0f, image);
+	BOOST_CHECK_EQUAL( stats.guard_band_accepted_prims, 2U );
+	BOOST_CHECK_EQUAL( stats.clipped_prims, 0U );
+	BOOST_CHECK_LE( count_different_texels(image, expected, tolerance), max_edge_pixels );
+}
+
+// Draws of one rectangle each, which change blend and depth-stencil states and switch targets between them.
+static void state_changes_scene(render_fixture& fixture)
+{
+	blend_state_ptr replace_blend( new blend_state( blend_desc() ) );
+	depth_stencil_state_ptr depth_less( new depth_stencil_state( depth_stencil_desc() ) );
+
+	surface_ptr other_target = fixture.renderer->create_tex2d(
+		fixture.width, fixture.height, fixture.color_target->sample_count(), pixel_format_color_rgba32f
+		)->subresource(0);
+
+	for(size_t i = 0; i < 24; ++i)
+	{
+		float const left = static_cast<float>( (i * 37) % 160 ) + 0.25f;
+		float const top  = static_cast<float>( (i * 53) % 160 ) + 0.5f;
+		vec4 const color( (i % 4) / 8.0f, (i % 3) / 4.0f, (i % 5) / 8.0f, 0.5f );
+
+		fixture.renderer->set_blend_state( i % 3 == 0 ? additive_blend_state() : replace_blend );
+		fixture.renderer->set_depth_stencil_state( i % 4 == 0 ? depth_disabled_state() : depth_less, 0 );
+		if(i == 8)
+		{
+			fixture.renderer->set_render_targets(1, &other_target, fixture.ds_target);
+		}
+		else if(i == 12)
+		{
+			fixture.renderer->set_render_targets(1, &fixture.color_target, fixture.ds_target);
+		}
+
+		vector<test_vertex> verts;
+		fixture.add_rect(verts, left, top, left + 96.0f, top + 80.0f, 1.0f - i / 32.0f, color);
+		fixture.draw(verts);
+	}
+}
+
+BOOST_AUTO_TEST_CASE( deferred_binning_keeps_image )
+{
+	pipeline_options immediate;
+	immediate.binning = binning_modes::immediate;
+	pipeline_options deferred;
+	deferred.binning = binning_modes::deferred;
+
+	test_scene_fn const scenes[] = { &overlapped_triangles_scene, &state_changes_scene };
+	for(size_t i_scene = 0; i_scene < 2; ++i_scene)
+	{
+		for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+		{
+			BOOST_CHECK_EQUAL(
+				count_different_texels(
+					render_scene(scenes[i_scene], deferred, 256, 256, num_samples),
+					render_scene(scenes[i_scene], immediate, 256, 256, num_samples)
+					),
+				0U
+				);
+		}
+	}
+	BOOST_CHECK_EQUAL( count_misordered_pixels(deferred), 0U );
+}
+
+// Reads all samples of color target back through map(), in the order of render_fixture::color_texels().
+static vector<color_rgba32f> mapped_texels(render_fixture& fixture)
+{
+	size_t const row_texels = fixture.width * fixture.color_target->sample_count();
+	vector<color_rgba32f> ret(row_texels * fixture.height);
+
+	mapped_resource mapped;
+	BOOST_REQUIRE( fixture.renderer->map(mapped, fixture.color_target, map_read) == result::ok );
+	for(size_t y = 0; y < fixture.height; ++y)
+	{
+		memcpy( &ret[y * row_texels], static_cast<uint8_t const*>(mapped.data) + y * mapped.row_pitch, row_texels * sizeof(color_rgba32f) );
+	}
+	BOOST_CHECK( fixture.renderer->unmap() == result::ok );
+	return ret;
+}
+
+// Size of target is odd, so that border tiles of all tile sizes are partial and quads of last column and row
+// are partially out of target.
+static size_t const odd_width	= 251;
+static size_t const odd_height	= 189;
+
+BOOST_AUTO_TEST_CASE( tile_cache_keeps_border_tiles )
+{
+	// Rectangles on integer pixel edges cross tile boundaries of all sizes, and touch right and bottom sides.
+	// They are added up, so that pixels which are lost or written back twice by caches are detected.
+	size_t const rects[][4] =
+	{
+		{ 31,  31,  97,  65},
+		{ 63, 120, 251, 189},
+		{127,   0, 251,  33},
+		{  0, 127, 129, 189},
+		{200,  60, 251, 140},
+		{250, 188, 251, 189}
+	};
+	size_t const rect_count = sizeof(rects) / sizeof(rects[0]);
+	size_t const tile_sizes[] = {32, 64, 128};
+	color_rgba32f const cleared(0.0f, 0.0f, 0.0f, 0.0625f);
+
+	for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+	{
+		for(size_t i_size = 0; i_size < 3; ++i_size)
+		{
+			pipeline_options options;
+			options.binning = binning_modes::deferred;
+			options.tile_cache = true;
+			options.tile_size = static_cast<uint32_t>(tile_sizes[i_size]);
+
+			render_fixture fixture;
+			fixture.create_targets(odd_width, odd_height, num_samples);
+			fixture.set_options(options);
+			fixture.clear(cleared);
+			fixture.renderer->set_blend_state( additive_blend_state() );
+			fixture.renderer->set_depth_stencil_state( depth_disabled_state(), 0 );
+
+			for(size_t i = 0; i < rect_count; ++i)
+			{
+				vec4 const color( (i + 1) / 8.0f, (i % 2) / 4.0f, (i % 3) / 4.0f, 0.125f );
+				vector<test_vertex> verts;
+				fixture.add_rect(verts,
+					static_cast<float>(rects[i][0]), static_cast<float>(rects[i][1]),
+					static_cast<float>(rects[i][2]), static_cast<float>(rects[i][3]),
+					0.5f, color);
+				fixture.draw(verts);
+			}
+
+			vector<color_rgba32f> texels = mapped_texels(fixture);
+
+			size_t failures = 0;
+			for(size_t y = 0; y < odd_height; ++y)
+			{
+				for(size_t x = 0; x < odd_width; ++x)
+				{
+					vec4 expected = cleared.get_vec4();
+					for(size_t i = 0; i < rect_count; ++i)
+					{
+						if(rects[i][0] <= x && x < rects[i][2] && rects[i][1] <= y && y < rects[i][3])
+						{
+							expected += vec4( (i + 1) / 8.0f, (i % 2) / 4.0f, (i % 3) / 4.0f, 0.125f );
+						}
+					}
+
+					for(size_t s = 0; s < num_samples; ++s)
+					{
+						if( !same_color(texels[(y * odd_width + x) * num_samples + s], expected) )
+						{
+							++failures;
+						}
+					}
+				}
+			}
+			BOOST_CHECK_MESSAGE( failures == 0, failures << " samples failed with tile size " << tile_sizes[i_size] << " and " << num_samples << " samples" );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( msaa_compression_keeps_partial_pixels )
+{
+	// Green covers all samples, so that all pixels are compressed. Red covers the bottom-right corner on
+	// half pixel edges, so that pixels along its left and top edges have samples of both colors.
+	size_t const left = 100;
+	size_t const top = 50;
+
+	size_t const sample_counts[] = {4, 8, 16};
+	for(size_t i_count = 0; i_count < 3; ++i_count)
+	{
+		size_t const num_samples = sample_counts[i_count];
+		for(int cached = 0; cached < 2; ++cached)
+		{
+			pipeline_options options;
+			options.binning = binning_modes::deferred;
+			options.msaa_compression = true;
+			options.tile_cache = (cached != 0);
+			options.tile_size = 32;
+
+			render_fixture fixture;
+			fixture.create_targets(odd_width, odd_height, num_samples);
+			fixture.set_options(options);
+			fixture.clear();
+			fixture.renderer->set_depth_stencil_state( depth_disabled_state(), 0 );
+
+			vector<test_vertex> verts;
+			fixture.add_rect(verts, 0.0f, 0.0f, static_cast<float>(odd_width), static_cast<float>(odd_height), 0.5f, green);
+			fixture.add_rect(verts, left + 0.5f, top + 0.5f, static_cast<float>(odd_width), static_cast<float>(odd_height), 0.5f, red);
+			fixture.draw(verts);
+
+			vector<color_rgba32f> texels = mapped_texels(fixture);
+
+			size_t failures = 0;
+			for(size_t y = 0; y < odd_height; ++y)
+			{
+				for(size_t x = 0; x < odd_width; ++x)
+				{
+					size_t reds = 0;
+					size_t greens = 0;
+					for(size_t s = 0; s < num_samples; ++s)
+					{
+						color_rgba32f const& c = texels[(y * odd_width + x) * num_samples + s];
+						reds	+= same_color(c, red) ? 1 : 0;
+						greens	+= same_color(c, green) ? 1 : 0;
+					}
+
+					bool passed = false;
+					if(x < left || y < top)
+					{
+						passed = (greens == num_samples);
+					}
+					else if(x > left && y > top)
+					{
+						passed = (reds == num_samples);
+					}
+					else if(x == left && y == top)
+					{
+						// Corner pixel is covered by a quarter.
+						passed = (reds + greens == num_samples);
+					}
+					else
+					{
+						passed = (reds + greens == num_samples && reds > 0 && greens > 0);
+					}
+					failures += passed ? 0 : 1;
+				}
+			}
+			BOOST_CHECK_MESSAGE( failures == 0, failures << " pixels failed with " << num_samples << " samples and tile cache " << cached );
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE( depth_only_draws_keep_depth )
+{
+	for(size_t num_samples = 1; num_samples <= 4; num_samples *= 4)
+	{
+		render_fixture expected;
+		expected.create_targets(256, 256, num_samples);
+		expected.clear();
+		overlapped_triangles_scene(expected);
+		expected.flush();
+
+		// Z pre-pass writes depth only, even if color target and pixel shader are bound.
+		render_fixture prepass;
+		prepass.create_targets(256, 256, num_samples);
+		pipeline_options options;
+		options.z_prepass = true;
+		prepass.set_options(options);
+		prepass.clear();
+		overlapped_triangles_scene(prepass);
+		prepass.flush();
+
+		BOOST_CHECK_EQUAL( count_different_texels( prepass.ds_texels(), expected.ds_texels() ), 0U );
+		vector<color_rgba32f> cleared( 256 * 256 * num_samples, color_rgba32f(0.0f, 0.0f, 0.0f, 0.0f) );
+		BOOST_CHECK_EQUAL( count_different_texels( prepass.color_texels(), cleared ), 0U );
+
+		// Draws without color target and C++ pixel shader take depth only pipeline by themselves.
+		render_fixture depth_only;
+		depth_only.create_targets(256, 256, num_samples);
+		depth_only.clear();
+		depth_only.ps.reset();
+		depth_only.renderer->set_render_targets(0, nullptr, depth_only.ds_target);
+		overlapped_triangles_scene(depth_only);
+		depth_only.flush();
+
+		BOOST_CHECK_EQUAL( count_different_texels( depth_only.ds_texels(), expected.ds_texels() ), 0U );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( hiz_rejects_occluded_tiles )
+{
+	render_fixture fixture;
+	fixture.create_targets(256, 256);
+	fixture.clear();
+
+	async_object_ptr query = fixture.renderer->create_query(async_object_ids::internal_statistics);
+	fixture.renderer->begin(query);
+
+	vector<test_vertex> near_verts, far_verts;
+	fixture.add_rect(near_verts, 0.0f, 0.0f, 256.0f, 256.0f, 0.2f, red);
+	fixture.add_rect(far_verts,  0.0f, 0.0f, 256.0f, 256.0f, 0.8f, green);
+	fixture.draw(near_verts);
+	fixture.draw(far_verts);
+
+	fixture.renderer->end(query);
+	fixture.flush();
+
+	internal_statistics stats;
+	BOOST_REQUIRE( fixture.renderer->get_data(query, &stats, false) == async_status::ready );
+	BOOST_CHECK_GT( stats.hiz_tile_rejections, 0U );
+
+	BOOST_CHECK_EQUAL( count_color(fixture, red), 256U * 256U );
+}
+
+BOOST_AUTO_TEST_CASE( hiz_follows_depth_target_switch )
+{
+	render_fixture fixture;
+	fixture.create_targets(128, 128);
+	fixture.clear();
+
+	surface_ptr near_ds = fixture.ds_target;
+	surface_ptr other_ds = fixture.renderer->create_tex2d(128, 128, 1, pixel_format_color_rg32f)->subresource(0);
+	fixture.renderer->clear_depth_stencil(other_ds, clear_depth | clear_stencil, 1.0f, 0);
+
+	vector<test_vertex> near_verts, far_verts, farther_verts;
+	fixture.add_rect(near_verts,	0.0f, 0.0f, 128.0f, 128.0f, 0.2f, red);
+	fixture.add_rect(far_verts,		0.0f, 0.0f, 128.0f, 128.0f, 0.8f, green);
+	fixture.add_rect(farther_verts,	0.0f, 0.0f, 128.0f, 128.0f, 0.9f, blue);
+	fixture.draw(near_verts);
+
+	// Bounds of the new target must not be those of the previous one.
+	fixture.renderer->set_render_targets(1, &fixture.color_target, other_ds);
+	fixture.draw(far_verts);
+	fixture.flush();
+	BOOST_CHECK_EQUAL( count_color(fixture, green), 128U * 128U );
+
+	// Bounds of the previous target are read from its depth again.
+	fixture.renderer->set_render_targets(1, &fixture.color_target, near_ds);
+	fixture.draw(farther_verts);
+	fixture.flush();
+	BOOST_CHECK_EQUAL( count_color(fixture, green), 128U * 128U );
+}
+
+BOOST_AUTO_TEST_CASE( hiz_keeps_visible_pixels )
+{
+	// Front to back order is rejected by Hi-Z, but back to front order is not, and both have same image.
+	render_fixture front_to_back;
+	front_to_back.create_targets(256, 256);
+	front_to_back.clear();
+
+	render_fixture back_to_front;
+	back_to_front.create_targets(256, 256);
+	back_to_front.clear();
+
+	vector<vector<test_vertex>> layers(4);
+	for(size_t i = 0; i < layers.size(); ++i)
+	{
+		float const offset = i * 24.0f;
+		vec4 const color( i / 4.0f, 1.0f - i / 4.0f, 0.5f, 1.0f );
+		front_to_back.add_rect(layers[i], offset, offset * 0.5f, 200.0f + offset, 180.0f + offset, 0.1f + i * 0.2f, color);
+	}
+
+	for(size_t i = 0; i < layers.size(); ++i)
+	{
+		front_to_back.draw(layers[i]);
+		back_to_front.draw(layers[layers.size() - 1 - i]);
+	}
+	front_to_back.flush();
+	back_to_front.flush();
+
+	BOOST_CHECK_EQUAL( count_different_texels( front_to_back.color_texels(), back_to_front.color_texels() ), 0U );
+	BOOST_CHECK_EQUAL( count_different_texels( front_to_back.ds_texels(), back_to_front.ds_texels() ), 0U );
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,356 @@
+#include <salviar/test/render_test.h>
+
+#include <salviar/include/input_layout.h>
+#include <salviar/include/buffer.h>
+#include <salviar/include/texture.h>
+#include <salviar/include/surface.h>
+#include <salviar/include/raster_state.h>
+#include <salviar/include/viewport.h>
+#include <salviar/include/framebuffer.h>
+
+#include <algorithm>
+#include <type_traits>
+#include <cmath>
+
+using namespace salviar;
+using eflib::vec4;
+using std::vector;
+
+class pass_through_vs: public cpp_vertex_shader
+{
+public:
+	pass_through_vs()
+	{
+		bind_semantic( "POSITION", 0, 0 );
+		bind_semantic( "COLOR", 0, 1 );
+	}
+
+	void shader_prog(vs_input const& in, vs_output& out)
+	{
+		out.position() = in.attribute(0);
+		out.attribute(0) = in.attribute(1);
+	}
+
+	uint32_t num_output_attributes() const
+	{
+		return 1;
+	}
+
+	uint32_t output_attribute_modifiers(uint32_t /*index*/) const
+	{
+		return vs_output::am_linear;
+	}
+
+	virtual cpp_shader_ptr clone()
+	{
+		typedef std::remove_pointer<decltype(this)>::type this_type;
+		return cpp_shader_ptr(new this_type(*this));
+	}
+};
+
+class color_ps: public cpp_pixel_shader
+{
+public:
+	bool shader_prog(vs_output const& in, ps_output& out)
+	{
+		out.color[0] = in.attribute(0);
+		return true;
+	}
+
+	virtual cpp_shader_ptr clone()
+	{
+		typedef std::remove_pointer<decltype(this)>::type this_type;
+		return cpp_shader_ptr(new this_type(*this));
+	}
+};
+
+char const* pass_through_vs_code =
+	"struct VSIn{ \r\n"
+	"	float4 pos: POSITION; \r\n"
+	"	float4 color: TEXCOORD0; \r\n"
+	"}; \r\n"
+	"struct VSOut{ \r\n"
+	"	float4 pos: sv_position; \r\n"
+	"	float4 color: TEXCOORD0; \r\n"
+	"}; \r\n"
+	"VSOut vs_main(VSIn in){ \r\n"
+	"	VSOut out; \r\n"
+	"	out.pos = in.pos; \r\n"
+	"	out.color = in.color; \r\n"
+	"	return out; \r\n"
+	"} \r\n"
+	;
+
+char const* color_ps_code =
+	"float4 ps_main( float4 color: TEXCOORD0 ): COLOR \r\n"
+	"{ \r\n"
+	"	return color; \r\n"
+	"} \r\n"
+	;
+
+test_vertex screen_vertex(float x, float y, float z, vec4 const& color, float width, float height)
+{
+	test_vertex ret;
+	ret.position = vec4(x / width * 2.0f - 1.0f, 1.0f - y / height * 2.0f, z, 1.0f);
+	ret.color = color;
+	return ret;
+}
+
+render_fixture::render_fixture(renderer_ptr const& rend)
+	: renderer(rend), width(0), height(0)
+{
+	vs.reset( new pass_through_vs() );
+	ps.reset( new color_ps() );
+
+	input_element_desc descs[] =
+	{
+		input_element_desc("POSITION", 0, format_r32g32b32a32_float, 0, 0, input_per_vertex, 0),
+		input_element_desc("COLOR", 0, format_r32g32b32a32_float, 0, sizeof(vec4), input_per_vertex, 0)
+	};
+	layout = renderer->create_input_layout( descs, sizeof(descs) / sizeof(descs[0]), vs );
+
+	raster_desc rs_desc;
+	rs_desc.cm = cull_none;
+	renderer->set_rasterizer_state( raster_state_ptr( new raster_state(rs_desc) ) );
+}
+
+bool render_fixture::use_jit_shaders()
+{
+	vs_code = compile(pass_through_vs_code, lang_vertex_shader);
+	ps_code = compile(color_ps_code, lang_pixel_shader);
+	if(!vs_code || !ps_code)
+	{
+		return false;
+	}
+
+	input_element_desc descs[] =
+	{
+		input_element_desc("POSITION", 0, format_r32g32b32a32_float, 0, 0, input_per_vertex, 0),
+		input_element_desc("TEXCOORD", 0, format_r32g32b32a32_float, 0, sizeof(vec4), input_per_vertex, 0)
+	};
+	layout = renderer->create_input_layout( descs, sizeof(descs) / sizeof(descs[0]), vs_code );
+
+	vs.reset();
+	ps.reset();
+	renderer->set_vertex_shader_code(vs_code);
+	renderer->set_pixel_shader_code(ps_code);
+	return true;
+}
+
+void render_fixture::create_targets(size_t width, size_t height, size_t num_samples, pixel_format color_format, pixel_format ds_format)
+{
+	this->width = width;
+	this->height = height;
+
+	color_target = renderer->create_tex2d(width, height, num_samples, color_format)->subresource(0);
+	ds_target.reset();
+	if(ds_format != pixel_format_invalid)
+	{
+		ds_target = renderer->create_tex2d(width, height, num_samples, ds_format)->subresource(0);
+	}
+	renderer->set_render_targets(1, &color_target, ds_target);
+
+	viewport vp;
+	vp.x = 0;
+	vp.y = 0;
+	vp.w = static_cast<float>(width);
+	vp.h = static_cast<float>(height);
+	vp.minz = 0.0f;
+	vp.maxz = 1.0f;
+	renderer->set_viewport(vp);
+}
+
+void render_fixture::set_options(pipeline_options const& options)
+{
+	renderer->set_pipeline_options(options);
+}
+
+void render_fixture::clear(color_rgba32f const& c, float depth, uint32_t stencil)
+{
+	renderer->clear_color(color_target, c);
+	if(ds_target)
+	{
+		renderer->clear_depth_stencil(ds_target, clear_depth | clear_stencil, depth, stencil);
+	}
+}
+
+void render_fixture::add_rect(vector<test_vertex>& verts, float left, float top, float right, float bottom, float z, vec4 const& color) const
+{
+	float const w = static_cast<float>(width);
+	float const h = static_cast<float>(height);
+
+	test_vertex lt = screen_vertex(left,  top,    z, color, w, h);
+	test_vertex rt = screen_vertex(right, top,    z, color, w, h);
+	test_vertex lb = screen_vertex(left,  bottom, z, color, w, h);
+	test_vertex rb = screen_vertex(right, bottom, z, color, w, h);
+
+	verts.push_back(lt);
+	verts.push_back(rt);
+	verts.push_back(lb);
+	verts.push_back(lb);
+	verts.push_back(rt);
+	verts.push_back(rb);
+}
+
+void render_fixture::bind_vertices(vector<test_vertex> const& verts)
+{
+	buffer_ptr vb = renderer->create_buffer( sizeof(test_vertex) * verts.size() );
+	std::copy(
+		reinterpret_cast<uint8_t const*>( verts.data() ),
+		reinterpret_cast<uint8_t const*>( verts.data() + verts.size() ),
+		vb->raw_data(0)
+		);
+
+	size_t const stride = sizeof(test_vertex);
+	size_t const offset = 0;
+	renderer->set_vertex_buffers(0, 1, &vb, &stride, &offset);
+	renderer->set_input_layout(layout);
+	renderer->set_vertex_shader(vs);
+	renderer->set_pixel_shader(ps);
+	renderer->set_primitive_topology(primitive_triangle_list);
+}
+
+void render_fixture::draw(vector<test_vertex> const& verts)
+{
+	bind_vertices(verts);
+	renderer->draw(0, verts.size() / 3);
+}
+
+void render_fixture::draw_indexed(vector<test_vertex> const& verts, vector<uint32_t> const& indexes)
+{
+	bind_vertices(verts);
+
+	buffer_ptr ib = renderer->create_buffer( sizeof(uint32_t) * indexes.size() );
+	std::copy(
+		reinterpret_cast<uint8_t const*>( indexes.data() ),
+		reinterpret_cast<uint8_t const*>( indexes.data() + indexes.size() ),
+		ib->raw_data(0)
+		);
+	renderer->set_index_buffer(ib, format_r32_uint);
+	renderer->draw_index(0, indexes.size() / 3, 0);
+}
+
+void render_fixture::flush()
+{
+	renderer->flush();
+}
+
+color_rgba32f render_fixture::color(size_t x, size_t y, size_t sample) const
+{
+	return color_target->get_texel(x, y, sample);
+}
+
+float render_fixture::depth(size_t x, size_t y, size_t sample) const
+{
+	return ds_target->get_texel(x, y, sample).r;
+}
+
+static vector<color_rgba32f> all_texels(surface_ptr const& target)
+{
+	vector<color_rgba32f> ret;
+	for(int y = 0; y < target->height(); ++y)
+	{
+		for(int x = 0; x < target->width(); ++x)
+		{
+			for(int s = 0; s < target->sample_count(); ++s)
+			{
+				ret.push_back( target->get_texel(x, y, s) );
+			}
+		}
+	}
+	return ret;
+}
+
+vector<color_rgba32f> render_fixture::color_texels() const
+{
+	return all_texels(color_target);
+}
+
+vector<color_rgba32f> render_fixture::ds_texels() const
+{
+	return all_texels(ds_target);
+}
+
+blend_state_ptr additive_blend_state()
+{
+	blend_desc desc;
+	desc.render_target[0].blend_enable = true;
+	desc.render_target[0].src_blend = blend_one;
+	desc.render_target[0].dest_blend = blend_one;
+	desc.render_target[0].src_blend_alpha = blend_one;
+	desc.render_target[0].dest_blend_alpha = blend_one;
+	return blend_state_ptr( new blend_state(desc) );
+}
+
+depth_stencil_state_ptr depth_disabled_state()
+{
+	depth_stencil_desc desc;
+	desc.depth_enable = false;
+	desc.depth_write_mask = false;
+	return depth_stencil_state_ptr( new depth_stencil_state(desc) );
+}
+
+size_t count_different_texels(vector<color_rgba32f> const& lhs, vector<color_rgba32f> const& rhs, float tolerance)
+{
+	if( lhs.size() != rhs.size() )
+	{
+		return std::max( lhs.size(), rhs.size() );
+	}
+
+	size_t ret = 0;
+	for(size_t i = 0; i < lhs.size(); ++i)
+	{
+		if(    std::abs(lhs[i].r - rhs[i].r) > tolerance
+			|| std::abs(lhs[i].g - rhs[i].g) > tolerance
+			|| std::abs(lhs[i].b - rhs[i].b) > tolerance
+			|| std::abs(lhs[i].a - rhs[i].a) > tolerance )
+		{
+			++ret;
+		}
+	}
+	return ret;
+}
+
+vector<color_rgba32f> render_scene(test_scene_fn scene, pipeline_options const& options, size_t width, size_t height, size_t num_samples)
+{
+	render_fixture fixture;
+	fixture.create_targets(width, height, num_samples);
+	fixture.set_options(options);
+	fixture.clear();
+	scene(fixture);
+	fixture.flush();
+	return fixture.color_texels();
+}
+
+void overlapped_triangles_scene(render_fixture& fixture)
+{
+	float const w = static_cast<float>(fixture.width);
+	float const h = static_cast<float>(fixture.height);
+
+	vector<test_vertex> verts;
+
+	// Large triangles with interpolated colors, crossing each other in depth.
+	verts.push_back( screen_vertex(-0.3f * w, 0.1f * h, 0.2f, vec4(1.0f, 0.0f, 0.0f, 1.0f), w, h) );
+	verts.push_back( screen_vertex( 1.2f * w, 0.3f * h, 0.7f, vec4(0.0f, 1.0f, 0.0f, 1.0f), w, h) );
+	verts.push_back( screen_vertex( 0.4f * w, 1.1f * h, 0.4f, vec4(0.0f, 0.0f, 1.0f, 1.0f), w, h) );
+
+	verts.push_back( screen_vertex( 0.1f * w, 0.9f * h, 0.3f, vec4(1.0f, 1.0f, 0.0f, 1.0f), w, h) );
+	verts.push_back( screen_vertex( 0.9f * w, 0.8f * h, 0.6f, vec4(0.0f, 1.0f, 1.0f, 1.0f), w, h) );
+	verts.push_back( screen_vertex( 0.6f * w, 0.05f * h, 0.1f, vec4(1.0f, 0.0f, 1.0f, 1.0f), w, h) );
+
+	// Small and thin triangles scattered over tiles.
+	for(int i = 0; i < 64; ++i)
+	{
+		float const x = (i % 8) * w / 8.0f + 3.3f;
+		float const y = (i / 8) * h / 8.0f + 2.7f;
+		float const size = 1.5f + (i % 5) * 2.25f;
+		float const z = (i % 7) / 8.0f;
+		vec4 const color( (i % 3) / 2.0f, (i % 4) / 3.0f, (i % 5) / 4.0f, 1.0f );
+
+		verts.push_back( screen_vertex(x, y, z, color, w, h) );
+		verts.push_back( screen_vertex(x + size, y + size * 0.25f, z, color, w, h) );
+		verts.push_back( screen_vertex(x + size * 0.5f, y + size, z, color, w, h) );
+	}
+
+	fixture.draw(verts);
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <salviar/include/renderer.h>
+#include <salviar/include/shader.h>
+#include <salviar/include/shader_regs.h>
+#include <salviar/include/pipeline_options.h>
+#include <salviar/include/async_object.h>
+#include <salviar/include/colors.h>
+#include <salviar/include/colors_convertors.h>
+
+#include <eflib/include/math/vector.h>
+
+#include <vector>
+
+struct test_vertex
+{
+	eflib::vec4 position;	// Clip space position.
+	eflib::vec4 color;
+};
+
+// Builds vertex at (x, y) pixels of target with z in [0, 1].
+test_vertex screen_vertex(float x, float y, float z, eflib::vec4 const& color, float width, float height);
+
+// Renders triangle lists through a pass-through C++ vertex shader and a pixel shader which outputs
+// interpolated color, so that results of different pipeline options could be compared pixel by pixel.
+class render_fixture
+{
+public:
+	render_fixture(salviar::renderer_ptr const& rend = salviar::create_benchmark_renderer());
+
+	// Creates and binds targets. Depth-stencil target is not created if ds_format is invalid.
+	void create_targets(
+		size_t width, size_t height, size_t num_samples = 1,
+		salviar::pixel_format color_format = salviar::pixel_format_color_rgba32f,
+		salviar::pixel_format ds_format = salviar::pixel_format_color_rg32f
+		);
+
+	// Replaces C++ shaders by JIT shaders of same function. Returns false if shaders could not be compiled.
+	bool use_jit_shaders();
+
+	void set_options(salviar::pipeline_options const& options);
+	void clear(salviar::color_rgba32f const& c = salviar::color_rgba32f(0.0f, 0.0f, 0.0f, 0.0f), float depth = 1.0f, uint32_t stencil = 0);
+
+	// Appends a rectangle of two triangles in pixels to verts.
+	void add_rect(
+		std::vector<test_vertex>& verts,
+		float left, float top, float right, float bottom, float z, eflib::vec4 const& color
+		) const;
+
+	void draw(std::vector<test_vertex> const& verts);
+	void draw_indexed(std::vector<test_vertex> const& verts, std::vector<uint32_t> const& indexes);
+	void flush();
+
+	salviar::color_rgba32f	color(size_t x, size_t y, size_t sample = 0) const;
+	float					depth(size_t x, size_t y, size_t sample = 0) const;
+
+	// All samples of all pixels.
+	std::vector<salviar::color_rgba32f> color_texels() const;
+	std::vector<salviar::color_rgba32f> ds_texels() const;
+
+	salviar::renderer_ptr			renderer;
+	salviar::surface_ptr			color_target;
+	salviar::surface_ptr			ds_target;
+	salviar::cpp_vertex_shader_ptr	vs;
+	salviar::cpp_pixel_shader_ptr	ps;
+	salviar::shader_object_ptr		vs_code;
+	salviar::shader_object_ptr		ps_code;
+	salviar::input_layout_ptr		layout;
+
+	size_t							width;
+	size_t							height;
+
+private:
+	void bind_vertices(std::vector<test_vertex> const& verts);
+};
+
+// Blends color as dest + src, so that pixels drawn twice are detectable.
+salviar::blend_state_ptr additive_blend_state();
+
+// Neither tests nor writes depth.
+salviar::depth_stencil_state_ptr depth_disabled_state();
+
+// Number of texels which differ by more than tolerance in any channel.
+size_t count_different_texels(
+	std::vector<salviar::color_rgba32f> const& lhs,
+	std::vector<salviar::color_rgba32f> const& rhs,
+	float tolerance = 0.0f
+	);
+
+// Renders the same draws with options and returns all color samples.
+typedef void (*test_scene_fn)(render_fixture& fixture);
+std::vector<salviar::color_rgba32f> render_scene(
+	test_scene_fn scene, salviar::pipeline_options const& options,
+	size_t width = 256, size_t height = 256, size_t num_samples = 1
+	);
+
+// Scene with overlapped triangles of different depth and sizes, which crosses tiles of all sizes.
+void overlapped_triangles_scene(render_fixture& fixture);
@@ -0,0 +1,242 @@
+#include <eflib/include/platform/boost_begin.h>
+#include <boost/test/unit_test.hpp>
+#include <eflib/include/platform/boost_end.h>
+
+#include <salviar/test/render_test.h>
+
+#include <salviar/include/async_renderer.h>
+
+#include <type_traits>
+
+using namespace salviar;
+using eflib::vec4;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE( shading )
+
+BOOST_AUTO_TEST_CASE( async_flush_does_not_redraw )
+{
+	render_fixture fixture( create_async_renderer() );
+	fixture.create_targets(64, 64);
+	fixture.clear();
+	fixture.renderer->set_blend_state( additive_blend_state() );
+	fixture.renderer->set_depth_stencil_state( depth_disabled_state(), 0 );
+
+	vector<test_vertex> verts;
+	fixture.add_rect(verts, 0.0f, 0.0f, 64.0f, 64.0f, 0.5f, vec4(0.25f, 0.0f, 0.0f, 0.25f));
+
+	// Flush commands must not replay the last draw.
+	fixture.draw(verts);
+	fixture.flush();
+	fixture.flush();
+	vector<color_rgba32f> once( 64 * 64, color_rgba32f(0.25f, 0.0f, 0.0f, 0.25f) );
+	BOOST_CHECK_EQUAL( count_different_texels(fixture.color_texels(), once), 0U );
+
+	fixture.draw(verts);
+	fixture.flush();
+	fixture.flush();
+	vector<color_rgba32f> twice( 64 * 64, color_rgba32f(0.5f, 0.0f, 0.0f, 0.5f) );
+	BOOST_CHECK_EQUAL( count_different_texels(fixture.color_texels(), twice), 0U );
+}
+
+static void render_shaded_scene(
+	renderer_ptr const& rend, bool jit, shading_modes shading, size_t num_samples,
+	vector<color_rgba32f>& colors, vector<color_rgba32f>& depths)
+{
+	render_fixture fixture(rend);
+	if(jit)
+	{
+		BOOST_REQUIRE( fixture.use_jit_shaders() );
+	}
+	fixture.create_targets(256, 256, num_samples);
+
+	pipeline_options options;
+	options.shading = shading;
+	fixture.set_options(options);
+	fixture.clear();
+	overlapped_triangles_scene(fixture);
+	fixture.flush();
+
+	colors = fixture.color_texels();
+	depths = fixture.ds_texels();
+}
+
+BOOST_AUTO_TEST_CASE( visibility_buffer_matches_forward )
+{
+	// Attributes of deferred triangles are stepped from their first vertex, which differs in rounding only.
+	float const tolerance = 1.0f / 1024.0f;
+
+	size_t const sample_counts[] = {1, 4};
+	for(size_t i_samples = 0; i_samples < 2; ++i_samples)
+	{
+		vector<color_rgba32f> expected_colors, expected_depths;
+		render_shaded_scene(create_benchmark_renderer(), true, shading_modes::forward, sample_counts[i_samples], expected_colors, expected_depths);
+
+		vector<color_rgba32f> colors, depths;
+		render_shaded_scene(create_benchmark_renderer(), true, shading_modes::visibility_buffer, sample_counts[i_samples], colors, depths);
+		BOOST_CHECK_EQUAL( count_different_texels(colors, expected_colors, tolerance), 0U );
+		BOOST_CHECK_EQUAL( count_different_texels(depths, expected_depths), 0U );
+
+		// Pending draws are shaded by flush command of async renderer.
+		render_shaded_scene(create_async_renderer(), true, shading_modes::visibility_buffer, sample_counts[i_samples], colors, depths);
+		BOOST_CHECK_EQUAL( count_different_texels(colors, expected_colors, tolerance), 0U );
+		BOOST_CHECK_EQUAL( count_different_texels(depths, expected_depths), 0U );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( jit_pixel_shader_matches_cpp )
+{
+	// Quads of a tile are shaded in batches, and JIT shader still runs one quad per call.
+	float const tolerance = 1.0f / 1024.0f;
+
+	size_t const sample_counts[] = {1, 4};
+	for(size_t i_samples = 0; i_samples < 2; ++i_samples)
+	{
+		vector<color_rgba32f> expected_colors, expected_depths;
+		render_shaded_scene(create_benchmark_renderer(), false, shading_modes::forward, sample_counts[i_samples], expected_colors, expected_depths);
+
+		vector<color_rgba32f> colors, depths;
+		render_shaded_scene(create_benchmark_renderer(), true, shading_modes::forward, sample_counts[i_samples], colors, depths);
+		BOOST_CHECK_EQUAL( count_different_texels(colors, expected_colors, tolerance), 0U );
+		BOOST_CHECK_EQUAL( count_different_texels(depths, expected_depths), 0U );
+	}
+}
+
+// Outputs color as attribute 0 and reversed color as attribute 1, which is interpolated with modifier.
+class two_attributes_vs: public cpp_vertex_shader
+{
+	uint32_t modifier_;
+
+public:
+	two_attributes_vs(uint32_t modifier): modifier_(modifier)
+	{
+		bind_semantic( "POSITION", 0, 0 );
+		bind_semantic( "COLOR", 0, 1 );
+	}
+
+	void shader_prog(vs_input const& in, vs_output& out)
+	{
+		vec4 const& color = in.attribute(1);
+		out.position() = in.attribute(0);
+		out.attribute(0) = color;
+		out.attribute(1) = vec4( color.w(), color.z(), color.y(), color.x() );
+	}
+
+	uint32_t num_output_attributes() const
+	{
+		return 2;
+	}
+
+	uint32_t output_attribute_modifiers(uint32_t index) const
+	{
+		return index == 1 ? modifier_ : vs_output::am_linear;
+	}
+
+	virtual cpp_shader_ptr clone()
+	{
+		typedef std::remove_pointer<decltype(this)>::type this_type;
+		return cpp_shader_ptr(new this_type(*this));
+	}
+};
+
+class mix_ps: public cpp_pixel_shader
+{
+public:
+	bool shader_prog(vs_output const& in, ps_output& out)
+	{
+		out.color[0] = ( in.attribute(0) + in.attribute(1) ) * 0.5f;
+		return true;
+	}
+
+	virtual cpp_shader_ptr clone()
+	{
+		typedef std::remove_pointer<decltype(this)>::type this_type;
+		return cpp_shader_ptr(new this_type(*this));
+	}
+};
+
+// JIT pixel shaders which read different attributes of two_attributes_vs.
+char const* first_attribute_ps_code =
+	"float4 ps_main( float4 first: TEXCOORD0, float4 second: TEXCOORD1 ): COLOR \r\n"
+	"{ \r\n"
+	"	return first; \r\n"
+	"} \r\n"
+	;
+
+char const* second_attribute_ps_code =
+	"float4 ps_main( float4 first: TEXCOORD0, float4 second: TEXCOORD1 ): COLOR \r\n"
+	"{ \r\n"
+	"	return second; \r\n"
+	"} \r\n"
+	;
+
+// Overlapped triangles with perspective are drawn one per draw. Interpolation modifiers of vertex shader
+// are changed between draws if mixed_modifiers is true, and JIT pixel shaders of different live attributes
+// are switched between draws if live_sets is true.
+static vector<color_rgba32f> render_interpolation_scene(binning_modes binning, bool mixed_modifiers, bool live_sets)
+{
+	render_fixture fixture;
+	fixture.create_targets(128, 128);
+	pipeline_options options;
+	options.binning = binning;
+	fixture.set_options(options);
+	fixture.clear();
+
+	shader_object_ptr ps_codes[2];
+	if(live_sets)
+	{
+		ps_codes[0] = compile(first_attribute_ps_code, lang_pixel_shader);
+		ps_codes[1] = compile(second_attribute_ps_code, lang_pixel_shader);
+		BOOST_REQUIRE( ps_codes[0] && ps_codes[1] );
+		fixture.ps.reset();
+	}
+	else
+	{
+		fixture.ps.reset( new mix_ps() );
+	}
+
+	uint32_t const modifiers[] = { vs_output::am_linear, vs_output::am_noperspective, vs_output::am_nointerpolation };
+	for(size_t i = 0; i < 12; ++i)
+	{
+		fixture.vs.reset( new two_attributes_vs( mixed_modifiers ? modifiers[i % 3] : vs_output::am_linear ) );
+		if(live_sets)
+		{
+			fixture.renderer->set_pixel_shader_code( ps_codes[i % 2] );
+		}
+
+		vector<test_vertex> verts;
+		for(size_t i_vert = 0; i_vert < 3; ++i_vert)
+		{
+			size_t const k = i * 3 + i_vert;
+			test_vertex v = screen_vertex(
+				static_cast<float>( (k * 41) % 160 ) - 16.0f, static_cast<float>( (k * 67) % 160 ) - 16.0f,
+				static_cast<float>( (k * 5) % 9 ) / 10.0f,
+				vec4( (k % 3) / 2.0f, (k % 5) / 4.0f, (k % 7) / 6.0f, 1.0f ),
+				128.0f, 128.0f
+				);
+			// Same screen position with different w.
+			v.position *= 1.0f + (k % 4) * 0.75f;
+			verts.push_back(v);
+		}
+		fixture.draw(verts);
+	}
+	fixture.flush();
+
+	return fixture.color_texels();
+}
+
+BOOST_AUTO_TEST_CASE( mixed_interpolation_modifiers_keep_image )
+{
+	vector<color_rgba32f> expected = render_interpolation_scene(binning_modes::immediate, true, false);
+	BOOST_REQUIRE_GT( count_different_texels( render_interpolation_scene(binning_modes::immediate, false, false), expected ), 0U );
+
+	BOOST_CHECK_EQUAL( count_different_texels( render_interpolation_scene(binning_modes::deferred, true, false), expected ), 0U );
+}
+
+BOOST_AUTO_TEST_CASE( live_attribute_sets_keep_image )
+{
+	vector<color_rgba32f> expected = render_interpolation_scene(binning_modes::immediate, true, true);
+	BOOST_CHECK_EQUAL( count_different_texels( render_interpolation_scene(binning_modes::deferred, true, true), expected ), 0U );
+}
+
+BOOST_AUTO_TEST_SUITE_END();
@@ -0,0 +1,448 @@
+#include <eflib/include/platform/boost_begin.h>
+#include <boost/test/unit_test.hpp>
+#include <eflib/include/platform/boost_end.h>
+
+#include <salviar/include/surface.h>
+#include <salviar/include/internal_mapped_resource.h>
+
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <string.h>
+
+using namespace salviar;
+using std::vector;
+
+BOOST_AUTO_TEST_SUITE( surfaces )
+
+// Linear congruential generator, so that failures are reproducible on all platforms.
+class random_ints
+{
+public:
+	random_ints(): seed_(0x5A17A) {}
+
+	uint32_t next()
+	{
+		seed_ = seed_ * 1103515245U + 12345U;
+		return seed_ >> 8;
+	}
+
+private:
+	uint32_t seed_;
+};
+
+static float srgb_to_linear(float v)
+{
+	return v <= 0.04045f ? v / 12.92f : std::pow( (v + 0.055f) / 1.055f, 2.4f );
+}
+
+static float linear_to_srgb(float v)
+{
+	return v <= 0.0031308f ? v * 12.92f : 1.055f * std::pow(v, 1.0f / 2.4f) - 0.055f;
+}
+
+static bool equal_colors(color_rgba32f const& lhs, color_rgba32f const& rhs)
+{
+	return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b && lhs.a == rhs.a;
+}
+
+// Texels of a rgba32f surface, read through map.
+static vector<color_rgba32f> mapped_texels(surface& surf)
+{
+	vector<byte> buffer;
+	internal_mapped_resource mapped( [&buffer](size_t size) -> void* { buffer.resize(size); return buffer.data(); } );
+	surf.map(mapped, map_read);
+
+	vector<color_rgba32f> ret;
+	for(int y = 0; y < surf.height(); ++y)
+	{
+		color_rgba32f const* row = reinterpret_cast<color_rgba32f const*>( static_cast<byte const*>(mapped.data) + y * mapped.row_pitch );
+		ret.insert( ret.end(), row, row + surf.width() * surf.sample_count() );
+	}
+
+	surf.unmap(mapped, map_read);
+	return ret;
+}
+
+static color_rgba32f texel_pattern(size_t x, size_t y, size_t sample)
+{
+	return color_rgba32f( static_cast<float>(x), static_cast<float>(y), static_cast<float>(sample), 1.0f );
+}
+
+BOOST_AUTO_TEST_CASE( cleared_tiles_are_read_without_filling )
+{
+	color_rgba32f const clear_color(1.0f, 2.0f, 3.0f, 4.0f);
+	color_rgba32f const written(5.0f, 6.0f, 7.0f, 8.0f);
+
+	surface surf(70, 50, 2, pixel_format_color_rgba32f);
+	surf.fill_texels( color_rgba32f(9.0f, 9.0f, 9.0f, 9.0f) );
+	surf.clear(clear_color);
+
+	vector<color_rgba32f> texels = mapped_texels(surf);
+	BOOST_REQUIRE_EQUAL( texels.size(), 70U * 50U * 2U );
+	size_t failures = 0;
+	for(size_t i = 0; i < texels.size(); ++i)
+	{
+		failures += equal_colors(texels[i], clear_color) ? 0 : 1;
+	}
+	BOOST_CHECK_EQUAL( failures, 0U );
+
+	surface resolved(70, 50, 1, pixel_format_color_rgba32f);
+	surf.resolve(resolved);
+	BOOST_CHECK( equal_colors( resolved.get_texel(69, 49, 0), clear_color ) );
+
+	// Reads do not fill tiles.
+	for(size_t y = 0; y < 50; y += CLEAR_TILE_SIZE)
+	{
+		for(size_t x = 0; x < 70; x += CLEAR_TILE_SIZE)
+		{
+			BOOST_CHECK( surf.tile_cleared(x, y) );
+		}
+	}
+
+	// Writing fills only the tile of texel.
+	surf.set_texel(33, 40, 1, written);
+	BOOST_CHECK( !surf.tile_cleared(33, 40) );
+	BOOST_CHECK( surf.tile_cleared(0, 0) );
+	BOOST_CHECK( surf.tile_cleared(64, 40) );
+
+	failures = 0;
+	for(size_t y = 0; y < 50; ++y)
+	{
+		for(size_t x = 0; x < 70; ++x)
+		{
+			for(size_t s = 0; s < 2; ++s)
+			{
+				bool const is_written = (x == 33 && y == 40 && s == 1);
+				failures += equal_colors( surf.get_texel(x, y, s), is_written ? written : clear_color ) ? 0 : 1;
+			}
+		}
+	}
+	BOOST_CHECK_EQUAL( failures, 0U );
+
+	// Partial fill keeps clear value of texels out of region.
+	color_rgba32f const filled(0.5f, 0.5f, 0.5f, 0.5f);
+	surf.fill_texels(10, 10, 30, 5, filled);
+	texels = mapped_texels(surf);
+	failures = 0;
+	for(size_t y = 0; y < 50; ++y)
+	{
+		for(size_t x = 0; x < 70; ++x)
+		{
+			for(size_t s = 0; s < 2; ++s)
+			{
+				color_rgba32f expected = clear_color;
+				if(x == 33 && y == 40 && s == 1)					{ expected = written; }
+				if(10 <= x && x < 40 && 10 <= y && y < 15)			{ expected = filled; }
+				failures += equal_colors( texels[(y * 70 + x) * 2 + s], expected ) ? 0 : 1;
+			}
+		}
+	}
+	BOOST_CHECK_EQUAL( failures, 0U );
+}
+
+BOOST_AUTO_TEST_CASE( resolve_averages_samples )
+{
+	size_t const sample_counts[] = {2, 4, 8, 16};
+	for(size_t i_count = 0; i_count < 4; ++i_count)
+	{
+		size_t const num_samples = sample_counts[i_count];
+
+		// Lower part has random samples, and equal samples in every other pixel. Upper part is cleared.
+		surface samples8(100, 70, num_samples, pixel_format_color_rgba8);
+		surface samples32f(100, 70, num_samples, pixel_format_color_rgba32f);
+		samples8.clear( color_rgba32f(0.2f, 0.4f, 0.6f, 1.0f) );
+		samples32f.clear( color_rgba32f(0.2f, 0.4f, 0.6f, 1.0f) );
+
+		random_ints rnd;
+		for(size_t y = 33; y < 70; ++y)
+		{
+			for(size_t x = 0; x < 100; ++x)
+			{
+				uint32_t const pixel_texel = rnd.next();
+				for(size_t s = 0; s < num_samples; ++s)
+				{
+					uint32_t const texel = ( (x & 1) && (y & 1) ) ? pixel_texel : rnd.next();
+					samples8.set_texel(x, y, s, &texel);
+					samples32f.set_texel( x, y, s, samples8.get_texel(x, y, s) );
+				}
+			}
+		}
+
+		surface resolved8(100, 70, 1, pixel_format_color_rgba8);
+		surface resolved_srgb(100, 70, 1, pixel_format_color_rgba8);
+		surface resolved32f(100, 70, 1, pixel_format_color_rgba32f);
+		samples8.resolve(resolved8);
+		samples8.resolve(resolved_srgb, true);
+		samples32f.resolve(resolved32f);
+
+		size_t failures = 0;
+		for(size_t y = 0; y < 70; ++y)
+		{
+			for(size_t x = 0; x < 100; ++x)
+			{
+				uint8_t texel8[4], texel_srgb[4];
+				resolved8.get_texel(texel8, x, y, 0);
+				resolved_srgb.get_texel(texel_srgb, x, y, 0);
+				color_rgba32f const texel32f = resolved32f.get_texel(x, y, 0);
+
+				for(int c = 0; c < 4; ++c)
+				{
+					uint32_t sum = 0;
+					float sum32f = 0.0f;
+					float sum_linear = 0.0f;
+					for(size_t s = 0; s < num_samples; ++s)
+					{
+						uint8_t sample[4];
+						samples8.get_texel(sample, x, y, s);
+						sum += sample[c];
+						sum32f += (&samples32f.get_texel(x, y, s).r)[c];
+						sum_linear += srgb_to_linear(sample[c] / 255.0f);
+					}
+
+					// 8-bit average is rounded to nearest, and sRGB is averaged in linear space except alpha.
+					uint32_t const expected8 = static_cast<uint32_t>( (sum + num_samples / 2) / num_samples );
+					float const expected_srgb = (c == 3) ? expected8 : linear_to_srgb(sum_linear / num_samples) * 255.0f;
+					float const expected32f = sum32f / num_samples;
+
+					if(    texel8[c] != expected8
+						|| std::abs(texel_srgb[c] - expected_srgb) > 1.0f
+						|| std::abs( (&texel32f.r)[c] - expected32f ) > 1.0e-5f )
+					{
+						++failures;
+					}
+				}
+			}
+		}
+		BOOST_CHECK_MESSAGE( failures == 0, failures << " channels differ from average of " << num_samples << " samples" );
+	}
+}
+
+BOOST_AUTO_TEST_CASE( tile_cache_is_written_back_by_detaching )
+{
+	size_t const tile_size = 64;
+	color_rgba32f const clear_color(1.0f, 2.0f, 3.0f, 4.0f);
+	color_rgba32f const written(5.0f, 6.0f, 7.0f, 8.0f);
+
+	surface surf(100, 70, 2, pixel_format_color_rgba32f);
+	surf.clear(clear_color);
+	surf.set_texel(70, 10, 0, written);
+
+	vector<byte> cache_data( surf.tile_cache_size(tile_size) + 64 );
+	byte* cache = reinterpret_cast<byte*>( ( reinterpret_cast<uintptr_t>( cache_data.data() ) + 63 ) & ~uintptr_t(63) );
+
+	surf.enable_tile_caches(true);
+
+	// Cache of border tile is partial and filled from cleared tiles and texels of surface.
+	surf.attach_tile_cache(64, 0, tile_size, cache);
+	BOOST_CHECK( equal_colors( surf.get_texel(70, 10, 0), written ) );
+	BOOST_CHECK( equal_colors( surf.get_texel(99, 63, 1), clear_color ) );
+	surf.set_texel(99, 63, 1, written);
+	surf.set_texel(64, 0, 0, written);
+	surf.detach_tile_cache(64, 0, tile_size);
+
+	// Texels out of any cache are written to surface directly.
+	surf.set_texel(0, 69, 1, written);
+	surf.enable_tile_caches(false);
+
+	vector<color_rgba32f> texels = mapped_texels(surf);
+	size_t failures = 0;
+	for(size_t y = 0; y < 70; ++y)
+	{
+		for(size_t x = 0; x < 100; ++x)
+		{
+			for(size_t s = 0; s < 2; ++s)
+			{
+				bool const is_written =
+					   (x == 70 && y == 10 && s == 0) || (x == 99 && y == 63 && s == 1)
+					|| (x == 64 && y == 0 && s == 0) || (x == 0 && y == 69 && s == 1);
+				failures += equal_colors( texels[(y * 100 + x) * 2 + s], is_written ? written : clear_color ) ? 0 : 1;
+			}
+		}
+	}
+	BOOST_CHECK_EQUAL( failures, 0U );
+}
+
+BOOST_AUTO_TEST_CASE( mapped_and_transferred_texels_keep_positions )
+{
+	// Mapped data is linear in all layouts.
+	surface src(75, 45, 2, pixel_format_color_rgba32f);
+	{
+		vector<byte> buffer;
+		internal_mapped_resource mapped( [&buffer](size_t size) -> void* { buffer.resize(size); return buffer.data(); } );
+		src.map(mapped, map_write_discard);
+		for(size_t y = 0; y < 45; ++y)
+		{
+			color_rgba32f* row = reinterpret_cast<color_rgba32f*>( static_cast<byte*>(mapped.data) + y * mapped.row_pitch );
+			for(size_t x = 0; x < 75; ++x)
+			{
+				row[x * 2 + 0] = texel_pattern(x, y, 0);
+				row[x * 2 + 1] = texel_pattern(x, y, 1);
+			}
+		}
+		src.unmap(mapped, map_write_discard);
+	}
+
+	size_t failures = 0;
+	for(size_t y = 0; y < 45; ++y)
+	{
+		for(size_t x = 0; x < 75; ++x)
+		{
+			for(size_t s = 0; s < 2; ++s)
+			{
+				failures += equal_colors( src.get_texel(x, y, s), texel_pattern(x, y, s) ) ? 0 : 1;
+			}
+		}
+	}
+	BOOST_CHECK_EQUAL( failures, 0U );
+
+	// Region of surface is copied to another surface.
+	color_rgba32f const clear_color(0.5f, 0.5f, 0.5f, 0.5f);
+	surface dest(75, 45, 2, pixel_format_color_rgba32f);
+	dest.clear(clear_color);
+	dest.transfer( eflib::rect<size_t>(5, 7, 60, 30), 3, 2, src );
+
+	failures = 0;
+	for(size_t y = 0; y < 45; ++y)
+	{
+		for(size_t x = 0; x < 75; ++x)
+		{
+			for(size_t s = 0; s < 2; ++s)
+			{
+				bool const copied = (5 <= x && x < 65 && 7 <= y && y < 37);
+				color_rgba32f const expected = copied ? texel_pattern(x - 2, y - 5, s) : clear_color;
+				failures += equal_colors( dest.get_texel(x, y, s), expected ) ? 0 : 1;
+			}
+		}
+	}
+	BOOST_CHECK_EQUAL( failures, 0U );
+
+	// Linear data of other format is converted to texels of region.
+	vector<uint32_t> data(40 * 20);
+	for(size_t i = 0; i < data.size(); ++i)
+	{
+		data[i] = static_cast<uint32_t>(i % 40) | (static_cast<uint32_t>(i / 40) << 8) | 0xFF000000U;
+	}
+	dest.transfer( pixel_format_color_rgba8, eflib::rect<size_t>(33, 17, 40, 20), data.data() );
+
+	failures = 0;
+	for(size_t y = 0; y < 20; ++y)
+	{
+		for(size_t x = 0; x < 40; ++x)
+		{
+			color_rgba32f const expected( x / 255.0f, y / 255.0f, 0.0f, 1.0f );
+			for(size_t s = 0; s < 2; ++s)
+			{
+				color_rgba32f const texel = dest.get_texel(33 + x, 17 + y, s);
+				failures += (std::abs(texel.r - expected.r) < 1.0e-6f && std::abs(texel.g - expected.g) < 1.0e-6f && texel.a == 1.0f) ? 0 : 1;
+			}
+		}
+	}
+	BOOST_CHECK_EQUAL( failures, 0U );
+	BOOST_CHECK( equal_colors( dest.get_texel(32, 17, 0), texel_pattern(30, 12, 0) ) );
+}
+
+BOOST_AUTO_TEST_CASE( compressed_samples_match_uncompressed )
+{
+	size_t const sample_counts[] = {2, 4, 8, 16};
+	for(size_t i_count = 0; i_count < 4; ++i_count)
+	{
+		size_t const num_samples = sample_counts[i_count];
+		size_t const width = 100;
+		size_t const height = 70;
+
+		// Same writes are applied to a compressed surface and to texels of reference.
+		surface surf(width, height, num_samples, pixel_format_color_rgba8);
+		surf.set_compression(true);
+		surf.clear( color_rgba32f(0.0f, 0.0f, 0.0f, 0.0f) );
+		vector<uint32_t> expected(width * height * num_samples, 0);
+
+		random_ints rnd;
+		size_t failures = 0;
+		for(int i_op = 0; i_op < 20000; ++i_op)
+		{
+			size_t const x = rnd.next() % width;
+			size_t const y = rnd.next() % height;
+			size_t const s = rnd.next() % num_samples;
+			uint32_t const texel = rnd.next();
+			uint32_t* expected_pixel = &expected[(y * width + x) * num_samples];
+
+			switch(i_op % 4)
+			{
+			case 0:
+				// All samples are written at once.
+				memcpy( surf.uniform_texel_address(x, y), &texel, sizeof(texel) );
+				std::fill(expected_pixel, expected_pixel + num_samples, texel);
+				break;
+			case 1:
+				surf.set_texel(x, y, s, &texel);
+				expected_pixel[s] = texel;
+				break;
+			case 2:
+				{
+					uint32_t read_texel;
+					surf.get_texel(&read_texel, x, y, s);
+					failures += (read_texel == expected_pixel[s]) ? 0 : 1;
+				}
+				break;
+			default:
+				if(i_op % 500 == 3)
+				{
+					surf.fill_texels( 5, 5, 20, 10, color_rgba32f(1.0f, 0.0f, 0.0f, 1.0f) );
+					for(size_t fill_y = 5; fill_y < 15; ++fill_y)
+					{
+						std::fill(
+							expected.begin() + (fill_y * width + 5) * num_samples,
+							expected.begin() + (fill_y * width + 25) * num_samples,
+							0xFF0000FFU
+							);
+					}
+				}
+				break;
+			}
+		}
+		BOOST_CHECK_EQUAL( failures, 0U );
+
+		// Uniform pixels are resolved to their only color.
+		surface resolved(width, height, 1, pixel_format_color_rgba8);
+		surf.resolve(resolved);
+		failures = 0;
+		for(size_t y = 0; y < height; ++y)
+		{
+			for(size_t x = 0; x < width; ++x)
+			{
+				uint8_t texel[4];
+				resolved.get_texel(texel, x, y, 0);
+				for(int c = 0; c < 4; ++c)
+				{
+					uint32_t sum = 0;
+					for(size_t s = 0; s < num_samples; ++s)
+					{
+						sum += reinterpret_cast<uint8_t const*>( &expected[(y * width + x) * num_samples + s] )[c];
+					}
+					failures += ( texel[c] == (sum + num_samples / 2) / num_samples ) ? 0 : 1;
+				}
+			}
+		}
+		BOOST_CHECK_EQUAL( failures, 0U );
+
+		// Surface is decompressed by disabling compression.
+		surf.set_compression(false);
+		failures = 0;
+		for(size_t y = 0; y < height; ++y)
+		{
+			for(size_t x = 0; x < width; ++x)
+			{
+				for(size_t s = 0; s < num_samples; ++s)
+				{
+					uint32_t texel;
+					surf.get_texel(&texel, x, y, s);
+					failures += (texel == expected[(y * width + x) * num_samples + s]) ? 0 : 1;
+				}
+			}
+		}
+		BOOST_CHECK_EQUAL( failures, 0U );
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END();
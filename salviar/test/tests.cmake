@@ -0,0 +1,28 @@
+set( SALVIAR_TEST_HEADERS "" )
+set( SALVIAR_TEST_SOURCES "" )
+set( SALVIAR_TEST_LIBS "" )
+set( SALVIAR_TILED_TEST_SOURCES "" )
+
+set( SALVIAR_TEST_HEADERS
+	${SALVIA_HOME_DIR}/salviar/test/render_test.h
+)
+set( SALVIAR_TEST_SOURCES
+	${SALVIA_HOME_DIR}/salviar/test/render_test.cpp
+	${SALVIA_HOME_DIR}/salviar/test/rasterizer_test.cpp
+	${SALVIA_HOME_DIR}/salviar/test/rasterizer_kernels_test.cpp
+	${SALVIA_HOME_DIR}/salviar/test/shading_test.cpp
+	${SALVIA_HOME_DIR}/salviar/test/framebuffer_test.cpp
+	${SALVIA_HOME_DIR}/salviar/test/surface_test.cpp
+)
+
+# Surface tests and surface sources, which are compiled with SALVIA_TILED_SURFACE.
+set( SALVIAR_TILED_TEST_SOURCES
+	${SALVIA_HOME_DIR}/salviar/test/surface_test.cpp
+	${SALVIA_HOME_DIR}/salviar/src/surface.cpp
+	${SALVIA_HOME_DIR}/salviar/src/color_convertors.cpp
+	${SALVIA_HOME_DIR}/salviar/src/thread_pool.cpp
+)
+
+if(UNIX)
+	set( SALVIAR_TEST_LIBS pthread )
+endif()
@@ -541,6 +541,12 @@ void sample_app::save_profiling_result()
 	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_stat.ps_invocations		;}, root, "async.pipeline_stat.ps_invocations");
 		
 	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.internal_stat.backend_input_pixels	;}, root, "async.internal_stat.backend_input_pixels");
+	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.internal_stat.hiz_tile_tests		;}, root, "async.internal_stat.hiz_tile_tests");
+	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.internal_stat.hiz_tile_rejections	;}, root, "async.internal_stat.hiz_tile_rejections");
+	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.internal_stat.hiz_subtile_tests	;}, root, "async.internal_stat.hiz_subtile_tests");
+	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.internal_stat.hiz_subtile_rejections	;}, root, "async.internal_stat.hiz_subtile_rejections");
+	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.internal_stat.guard_band_accepted_prims;}, root, "async.internal_stat.guard_band_accepted_prims");
+	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.internal_stat.clipped_prims		;}, root, "async.internal_stat.clipped_prims");
 
 	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_prof.gather_vtx			;}, root, "async.pipeline_prof.gather_vtx");
 	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_prof.vtx_proc				;}, root, "async.pipeline_prof.vtx_proc");
@@ -548,7 +554,11 @@ void sample_app::save_profiling_result()
 	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_prof.compact_clip			;}, root, "async.pipeline_prof.compact_clip");
 	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_prof.vp_trans				;}, root, "async.pipeline_prof.vp_trans");
 	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_prof.tri_dispatch			;}, root, "async.pipeline_prof.tri_dispatch");
+	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_prof.tile_schedule		;}, root, "async.pipeline_prof.tile_schedule");
 	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_prof.ras					;}, root, "async.pipeline_prof.ras");
+	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_prof.ras_idle				;}, root, "async.pipeline_prof.ras_idle");
+	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_prof.ras_tile_cost		;}, root, "async.pipeline_prof.ras_tile_cost");
+	reduce_and_output<uint64_t>(data_->frame_profs.begin(), data_->frame_profs.end(), [](frame_data const& v) { return v.pipeline_prof.ras_max_tile_cost	;}, root, "async.pipeline_prof.ras_max_tile_cost");
 
 	write_json(ss.str(), root);
 }
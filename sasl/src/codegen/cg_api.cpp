@@ -55,7 +55,9 @@ module_vmcode_ptr generate_vmcode(
 		}
 	}
 
-	if( reflection->get_language() == salviar::lang_pixel_shader )
+	// Blending shader is executed on quads as same as pixel shader.
+	if( reflection->get_language() == salviar::lang_pixel_shader
+		|| reflection->get_language() == salviar::lang_blending_shader )
 	{
 		cg_ps cg;
 		if( cg.generate(sem, reflection) )
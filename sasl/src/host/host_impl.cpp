@@ -260,6 +260,9 @@ void salvia_compile_shader_impl(
 	case lang_vertex_shader:
 		lang_name = "--lang=vs";
 		break;
+	case lang_blending_shader:
+		lang_name = "--lang=bs";
+		break;
 	default:
 		lang_name = "--lang=g";
 		break;
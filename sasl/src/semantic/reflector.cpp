@@ -54,6 +54,7 @@ bool verify_semantic_type( builtin_types btc, salviar::semantic_value const& sem
 	case salviar::sv_texcoord:
 	case salviar::sv_normal:
 	case salviar::sv_target:
+	case salviar::sv_dest_target:
 		return 
 			( is_scalar(btc) || is_vector(btc) || is_matrix(btc) )
 			&& ( scalar_of(btc) == builtin_types::_float || scalar_of(btc) == builtin_types::_sint32 );
@@ -112,6 +113,25 @@ sv_usage psoutput_semantic_usage( salviar::semantic_value const& sem ){
 	return su_none;
 }
 
+sv_usage bsinput_semantic_usage( salviar::semantic_value const& sem ){
+	switch( sem.get_system_value() ){
+	case salviar::sv_target:
+	case salviar::sv_dest_target:
+		return su_stream_in;
+	}
+	EFLIB_ASSERT_UNIMPLEMENTED();
+	return su_none;
+}
+
+sv_usage bsoutput_semantic_usage( salviar::semantic_value const& sem ){
+	switch( sem.get_system_value() ){
+	case salviar::sv_target:
+		return su_stream_out;
+	}
+	EFLIB_ASSERT_UNIMPLEMENTED();
+	return su_none;
+}
+
 sv_usage semantic_usage( salviar::languages lang, bool is_output, salviar::semantic_value const& sem ){
 	switch ( lang ){
 	case salviar::lang_vertex_shader:
@@ -126,6 +146,12 @@ sv_usage semantic_usage( salviar::languages lang, bool is_output, salviar::seman
 		} else {
 			return psinput_semantic_usage(sem);
 		}
+	case salviar::lang_blending_shader:
+		if( is_output ){
+			return bsoutput_semantic_usage(sem);
+		} else {
+			return bsinput_semantic_usage(sem);
+		}
 	}
 
 	return su_none;